@@ -0,0 +1,36 @@
+#ifndef BINARY_HPP
+# define BINARY_HPP
+
+# include <string>
+# include <cstddef>		// size_t
+# include <stdint.h>	// uint32_t, uint64_t, int64_t
+
+/**
+Encoding of the binary records shared by `StateLog` and the hot upgrade:
+fixed-size integers in host byte order, strings as `<u32 length><bytes>`.
+Both ends are always the same build on the same machine.
+*/
+void	putU8(std::string& out, unsigned char value);
+void	putU32(std::string& out, uint32_t value);
+void	putU64(std::string& out, uint64_t value);
+void	putI64(std::string& out, int64_t value);
+void	putString(std::string& out, const std::string& value);
+
+// Cursor over an encoded buffer; any read past `end` fails and clears `ok`.
+struct	BinaryReader
+{
+	BinaryReader(const char* first, const char* last);
+
+	bool	take(void* dest, size_t size);
+	bool	takeU8(unsigned char& value);
+	bool	takeU32(uint32_t& value);
+	bool	takeU64(uint64_t& value);
+	bool	takeI64(int64_t& value);
+	bool	takeString(std::string& value);
+
+	const char*	pos;
+	const char*	end;
+	bool		ok;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef BOTPLUGIN_HPP
+# define BOTPLUGIN_HPP
+
+/**
+C ABI for bot plugin modules (see `BotPlugins` and `plugins/`).
+
+A plugin is a shared object exporting a `BotPlugin` data symbol named
+`BOT_PLUGIN_SYMBOL`. Each of its verbs becomes a bot command, usable as
+`<VERB> <args>` or as a private message to the bot.
+
+Verbs run on a bot worker thread: `run()` may only use its arguments (no
+server state), must be thread-safe and must not throw. It writes a
+NUL-terminated reply of at most `outSize` bytes (including the NUL) to `out`.
+*/
+
+# include <stddef.h>	// size_t
+
+# define BOT_PLUGIN_ABI		1					// Bumped on incompatible changes of the structs below
+# define BOT_PLUGIN_SYMBOL	"ircserv_bot_plugin"
+
+extern "C"
+{
+	typedef struct	BotPluginVerb
+	{
+		const char*	name;	// Command name, upper case (e.g. "ROLL")
+		const char*	usage;	// Short usage hint (e.g. "ROLL [<n>d<sides>]")
+		int			(*run)(const char* args, char* out, size_t outSize);	// 0 on success
+	}	BotPluginVerb;
+
+	typedef struct	BotPlugin
+	{
+		int						abi;		// Must be BOT_PLUGIN_ABI
+		const char*				name;		// Plugin name, for the logs
+		const BotPluginVerb*	verbs;
+		size_t					verbCount;
+	}	BotPlugin;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef BOTPLUGINS_HPP
+# define BOTPLUGINS_HPP
+
+# include <string>
+# include <map>
+# include <vector>
+
+# include "BotPlugin.hpp"
+
+class	Server;
+
+/**
+Loads bot plugin modules (`*.so` in `BOT_PLUGIN_DIR`) with `dlopen()` and
+maps their verbs to the bot commands they implement.
+
+`reload()` swaps in freshly loaded modules without touching any connection.
+Every module is opened from a private copy of its file, so a rebuilt plugin
+is really reloaded (`dlopen()` would hand out the already loaded image for
+the same path). On Linux the copy is a memfd, opened as `/proc/self/fd/<fd>`,
+so no copy ever sits in a shared directory; elsewhere it is a `mkstemp()`
+file in `/tmp`, unlinked right after `dlopen()`. The copy stays open while
+the module is loaded, which keeps the paths of loaded modules unique.
+
+Jobs running a verb hold a reference on its module; a replaced module is
+only closed once its last running job has finished.
+*/
+class	BotPlugins
+{
+	public:
+		struct	Module;
+
+		// A verb of a loaded module; stays valid while its module is referenced
+		struct	Binding
+		{
+			Module*					module;
+			const BotPluginVerb*	verb;
+		};
+
+		struct	Module
+		{
+			void*					handle;		// dlopen() handle
+			int						memFd;		// Private copy the module was opened from (memfd on Linux)
+			const BotPlugin*		plugin;
+			std::vector<Binding>	bindings;
+			int						refs;		// Running jobs using this module
+			bool					retired;	// Replaced by a reload; close once refs drops to 0
+		};
+
+		BotPlugins(Server* server);
+		~BotPlugins();
+
+		void				reload();
+		void				unloadAll();
+		const Binding*		find(const std::string& verb) const;
+		void				acquire(const Binding* binding);
+		void				release(const Binding* binding);
+		size_t				getModuleCount() const;
+		size_t				getVerbCount() const;
+
+	private:
+		BotPlugins();
+		BotPlugins(const BotPlugins& other);
+		BotPlugins&	operator=(const BotPlugins& other);
+
+		Server*							_server;
+		std::vector<Module*>			_modules;	// Current modules
+		std::vector<Module*>			_retired;	// Replaced modules still used by running jobs
+		std::map<std::string, Binding*>	_verbs;		// Verb name -> binding in a current module
+
+		bool				loadModule(const std::string& path);
+		void				closeModule(Module* module);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef BOTWORKERS_HPP
+# define BOTWORKERS_HPP
+
+# include <string>
+# include <deque>
+# include <vector>
+# include <pthread.h>
+
+# include "TimerWheel.hpp"
+
+/**
+Small thread pool that runs bot commands off the event loop.
+
+The reactor thread `submit()`s jobs into a mutex/condvar protected queue.
+Workers run the job's function and push the finished job onto a lock-free
+completion stack (multiple producers, single consumer), then wake the reactor
+through a self-pipe whose read end sits in the `select()` read set.
+The reactor collects finished jobs with `takeCompleted()`.
+
+A job's function only sees the job's `input` and `context` and produces `result`;
+it must not touch any server state and must not throw.
+*/
+class	BotWorkers
+{
+	public:
+		typedef std::string	(*JobFunc)(const std::string& input, const void* context);
+
+		struct	Job
+		{
+			Job();
+
+			Job*				next;		// Completion stack link
+			int					fd;			// Requesting user (-1 once the user is gone)
+			std::string			command;	// Bot command the job answers (for the reply and logs)
+			JobFunc				func;		// Runs on a worker thread
+			std::string			input;
+			const void*			context;	// Opaque data for `func` (e.g. a plugin verb), owned by the submitter
+			std::string			result;
+			bool				timedOut;	// Reactor already told the user; result is dropped
+			TimerWheel::Timer	timer;		// Timeout (reactor side only)
+		};
+
+		BotWorkers();
+		~BotWorkers();
+
+		bool			start(int threads);
+		void			stop();
+		bool			isRunning() const;
+		void			submit(Job* job);
+		Job*			takeCompleted();
+		int				getWakeFd() const;
+
+	private:
+		BotWorkers(const BotWorkers& other);
+		BotWorkers&	operator=(const BotWorkers& other);
+
+		pthread_mutex_t			_mutex;		// Protects `_queue` and `_stopping`
+		pthread_cond_t			_cond;		// Signals new jobs / shutdown to idle workers
+		std::deque<Job*>		_queue;
+		bool					_stopping;
+		std::vector<pthread_t>	_threads;
+		Job* volatile			_completed;	// Lock-free completion stack (Treiber stack)
+		int						_wakePipe[2];	// Self-pipe: workers write, reactor select()s on [0]
+
+		static void*	workerMain(void* arg);
+		void			workerLoop();
+		void			complete(Job* job);
+};
+
+#endif
@@ -4,9 +4,18 @@
 # include <set>
 # include <map>
 # include <string>
+# include <vector>
 # include <ctime>	// time_t
 
+# include "ReplyBurst.hpp"
+# include "MaskSet.hpp"
+
 class	User;
+class	ServerLink;
+class	StateLog;
+class	ReplicationStream;
+class	FanoutPool;
+struct	ChannelState;
 
 class	Channel
 {
@@ -20,18 +29,32 @@ class	Channel
 			JOIN_INVITE_ONLY,
 			JOIN_FULL,
 			JOIN_BAD_KEY,
+			JOIN_BANNED,
 			JOIN_MAX_CHANNELS
 		};
 
+		// Lists of `nick!user@host` masks (modes `b`, `e` and `I`)
+		enum	MaskList
+		{
+			BAN_LIST,
+			EXCEPT_LIST,
+			INVEX_LIST,
+			MASK_LISTS
+		};
+
 		const std::string&				get_name() const;
 		const std::string&				get_name_lower() const;
 		const std::map<std::string, User*>&	get_members() const;
-		std::string						get_names_list() const;
-		std::string						get_mode_string(const User* user) const;
+		const std::map<ServerLink*, int>&	get_links() const;
+		const std::vector<User*>&		get_local_recipients();
+		ReplyBurst*						get_names_reply(const std::string& prefix);
+		const std::string&				get_mode_string(const User* user);
 		int								get_connected_user_number() const;
+		unsigned long					get_version() const;
 
 		void	add_user(User *user);
 		void	remove_user(User *user);
+		void	rename_user(User *user, const std::string& old_nick_lower);
 		bool	is_user_member(User *user) const;
 
 		void	make_user_operator(User *user);
@@ -41,9 +64,12 @@ class	Channel
 		bool	can_user_join(User* user, const std::string& provided_key,
 							JoinResult& result) const;
 
-		void	set_topic(const std::string& topic, const std::string& set_by);
+		void	set_topic(const std::string& topic, const std::string& set_by, time_t set_at = 0);
 		const std::string&	get_topic() const;
 		std::string			get_topic_set_info() const;
+		time_t				get_topic_time() const;
+		time_t				get_creation_time() const;
+		void				set_creation_time(time_t created_at);
 		void	set_topic_protection(bool enable = true);
 		bool	has_topic_protection() const;
 
@@ -57,11 +83,23 @@ class	Channel
 		bool	is_invited(const std::string& user_nick) const;
 		void	add_invite(const std::string& user_nick);
 
+		bool	add_mask(MaskList list, const std::string& mask, const std::string& set_by, time_t set_at = 0);
+		bool	remove_mask(MaskList list, const std::string& mask);
+		const std::vector<MaskEntry>&	get_masks(MaskList list) const;
+		bool	is_banned(const User* user);
+
 		bool	has_password() const;
 		void	set_password(const std::string& password);
 		const std::string&	get_password() const;
 		bool	validate_password(const std::string& password) const;
 
+		void	set_state_log(StateLog* state_log);
+		void	set_replication(ReplicationStream* replication);
+		void	set_fanout(FanoutPool* fanout);
+		FanoutPool*	get_fanout() const;
+		void	save_state(ChannelState& state) const;
+		void	restore_state(const ChannelState& state);
+
 	private:
 		Channel();
 		Channel(const Channel& other);
@@ -72,8 +110,10 @@ class	Channel
 		std::string				_channel_topic;
 		std::string				_channel_topic_set_by;
 		time_t					_channel_topic_set_at;
+		time_t					_channel_created_at;
 		std::map<std::string, User*>	_channel_members_by_nickname;
 		std::map<std::string, User*>	_channel_operators_by_nickname;
+		std::map<ServerLink*, int>		_channel_links;	// Links with members behind them -> how many
 		std::set<std::string>	_channel_invitation_list;
 
 		// MODE RELATED VARS
@@ -81,6 +121,36 @@ class	Channel
 		bool					_invite_only;	// set by i
 		bool					_topic_protection;	// set by t
 		std::string				_channel_key;	// password set by k
+		std::vector<MaskEntry>	_mask_lists[MASK_LISTS];	// set by b, e and I, in the order added
+		MaskSet					_mask_sets[MASK_LISTS];		// The same lists, compiled
+
+		// BAN VERDICTS (decided again when `_masks_version` has moved on)
+		struct	BanVerdict
+		{
+			unsigned long	version;	// `_masks_version` it was decided for (0: none)
+			bool			banned;
+		};
+		unsigned long			_masks_version;	// Bumped on every change of the ban or exception list
+		std::vector<BanVerdict>	_ban_verdicts;	// By member fd; dropped when they leave or change nickname
+
+		StateLog*				_state_log;		// Journal of topic, mode and invite changes (NULL: none)
+		ReplicationStream*		_replication;	// Stream of all changes to a hot standby (NULL: none)
+		FanoutPool*				_fanout;		// Helps broadcasting to very large channels (NULL: none)
+
+		// CACHED REPLIES (rebuilt when `_version` has moved on)
+		unsigned long			_version;		// Bumped on every membership, mode or topic change
+		ReplyBurst*				_names_reply;	// 353... + 366, recipient's nickname left as a slot (shared)
+		unsigned long			_names_version;	// `_version` the names reply was rendered for
+		std::string				_mode_strings[2];	// 324 modes for members / for operators (with key)
+		unsigned long			_modes_version;	// `_version` the mode strings were built for
+		std::vector<User*>		_local_recipients;		// Members with a socket here (not the bot, not remote users)
+		unsigned long			_recipients_version;	// `_version` the recipients were collected for
+
+		void	touch();
+		void	journal();
+		void	journal_mask(MaskList list, const MaskEntry& entry, bool added);
+		void	forget_ban_verdict(const User* user);
+		bool	match_ban(const std::string& hostmask) const;
 };
 
 #endif
@@ -7,21 +7,31 @@
 
 class	Server;
 class	User;
+class	PendingUser;
 class	Channel;
+class	ServerLink;
+class	ScanIndex;
 
 class	Command
 {
 	public:
 		static bool		handleCommand(Server* server, User* user, std::vector<std::string>& tokens);
+		static bool		handlePendingCommand(Server* server, PendingUser* pending, std::vector<std::string>& tokens);
 		static void		broadcastToChannel(Channel* channel, const std::string& message,
 							const std::string& excludeNick = "");
 		static std::vector<std::string>	tokenize(const std::string& message);
+		static std::vector<std::string>	tokenize(const std::string& buffer, size_t begin, size_t end,
+											const ScanIndex& index);
 
 		// === CommandMessaging.cpp ===
 
 		static void		handleMessageToUser(Server* server, User* sender, const std::string& targetNick,
 									const std::string& message, const std::string& commandName, const std::string& botCmd = "");
 		
+		// === CommandServer.cpp ===
+
+		static void		handleServerMessage(Server* server, ServerLink* link, const std::string& line);
+
 		// === CommandUtils.cpp ===
 
 		static bool		checkRegistered(User* user, const std::string& command = "a command");
@@ -40,6 +50,7 @@ class	Command
 			NICK,		// Set user nickname
 			USER,		// Set user username, hostname, servername, and realname
 			PASS,		// Try to authenticate with server password
+			CAP,		// IRCv3 capability negotiation
 			QUIT,		// Disconnect from server
 			PRIVMSG,	// Message to a user or channel
 			NOTICE,		// Message to a user or channel, but triggers no auto-reply
@@ -50,8 +61,21 @@ class	Command
 			INVITE,		// Invite a user to a channel
 			MODE,		// Change channel or user mode
 			LIST,		// Lists the server's existing channels
+			NAMES,		// Lists the members of channels
+			PING,		// Connection liveness check, answered with PONG
+			PONG,		// Reply to a PING sent by the server
+			STATS,		// Server statistics (uptime, reaper counters)
+			MOTD,		// Message of the day
+			LUSERS,		// User and channel counts
+			CHATHISTORY,	// Replay of recent channel messages
+			SEARCH,		// Search of recent channel messages
 			JOKE,		// Only works in bot mode. Bot sends a joke.
-			CALC		// Only works in bot mode. Bot gives result to a math expression.
+			CALC,		// Only works in bot mode. Bot gives result to a math expression.
+			SERVER,		// Introduce a server (server links, or unregistered connections becoming one)
+			SQUIT,		// Server links only: a server left the network
+			NJOIN,		// Server links only: members of a channel (burst)
+			KILL,		// Server links only: remove a user from the network
+			ERROR		// Server links only: the peer is closing the link
 		};
 
 		// === CommandRegistration.cpp ===
@@ -59,6 +83,12 @@ class	Command
 		static void		handleNick(Server* server, User* user, const std::vector<std::string>& tokens);
 		static void		handleUser(User* user, const std::vector<std::string>& tokens);
 		static void		handlePass(Server* server, User* user, const std::vector<std::string>& tokens);
+		static void		handleCap(User* user, const std::vector<std::string>& tokens);
+		static void		handlePendingNick(Server* server, PendingUser* pending, const std::vector<std::string>& tokens);
+		static void		handlePendingUser(Server* server, PendingUser* pending, const std::vector<std::string>& tokens);
+		static void		handlePendingPass(Server* server, PendingUser* pending, const std::vector<std::string>& tokens);
+		static void		handlePendingCap(Server* server, PendingUser* pending, const std::vector<std::string>& tokens);
+		static void		handlePendingServer(Server* server, PendingUser* pending, const std::vector<std::string>& tokens);
 
 		// === CommandChannel.cpp ===
 
@@ -69,7 +99,9 @@ class	Command
 		static bool		handleInvite(Server* server, User* user, const std::vector<std::string>& tokens);
 		static bool		handleTopic(Server* server, User* user, const std::vector<std::string>& tokens);
 		static bool		handleKick(Server* server, User* user, const std::vector<std::string>& tokens);
-		static bool		handleList(Server* server, User* user);
+		static bool		handleList(Server* server, User* user, const std::vector<std::string>& tokens);
+		static bool		handleNames(Server* server, User* user, const std::vector<std::string>& tokens);
+		static void		sendNames(Server* server, User* user, Channel* channel);
 
 		// === CommandModes.cpp ===
 		
@@ -90,6 +122,9 @@ class	Command
 										size_t& paramIndex, std::string& modeParams);
 		static bool		applyOperator(Server* server, Channel* channel, User* user, bool adding,
 										const std::vector<std::string>& tokens, size_t& paramIndex, std::string& modeParams);
+		static bool		applyMaskList(Channel* channel, User* user, char mode, bool adding,
+										const std::vector<std::string>& tokens, size_t& paramIndex, std::string& modeParams);
+		static void		sendMaskList(User* user, Channel* channel, char mode);
 
 		// === CommandMessaging.cpp ===
 		
@@ -99,14 +134,49 @@ class	Command
 							 			const std::string& commandName);
 		static void		handleMessageToChannel(Server* server, User* sender, const std::string& channelName,
 									const std::string& message, const std::string& commandName);
+		static bool		handleChatHistory(Server* server, User* user, const std::vector<std::string>& tokens);
+		static bool		handleSearch(Server* server, User* user, const std::vector<std::string>& tokens);
 
 		// === CommandConnection.cpp ===
 
 		static void		handleQuit(Server* server, User* user, const std::vector<std::string>& tokens);
+		static void		handlePing(Server* server, User* user, const std::vector<std::string>& tokens);
+		static void		handlePong(User* user, const std::vector<std::string>& tokens);
+
+		// === CommandInfo.cpp ===
+
+		static bool		handleStats(Server* server, User* user, const std::vector<std::string>& tokens);
+		static bool		handleMotd(Server* server, User* user);
+		static bool		handleLusers(Server* server, User* user);
+
+		// === CommandServer.cpp ===
+
+		static void		handleLinkHandshake(Server* server, ServerLink* link, Cmd cmd, const std::vector<std::string>& tokens);
+		static void		handleRemoteServer(Server* server, ServerLink* link, const std::string& prefix,
+							const std::vector<std::string>& tokens);
+		static void		handleSquit(Server* server, ServerLink* link, const std::vector<std::string>& tokens);
+		static void		handleRemoteNick(Server* server, ServerLink* link, const std::string& prefix,
+							const std::vector<std::string>& tokens);
+		static void		handleRemoteQuit(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens);
+		static void		handleKill(Server* server, ServerLink* link, const std::string& prefix,
+							const std::vector<std::string>& tokens);
+		static void		handleNjoin(Server* server, ServerLink* link, const std::vector<std::string>& tokens);
+		static void		handleRemoteJoin(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens);
+		static void		handleRemotePart(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens);
+		static void		handleRemoteKick(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens);
+		static void		handleRemoteTopic(Server* server, ServerLink* link, const std::string& prefix,
+							const std::vector<std::string>& tokens);
+		static void		handleRemoteMode(Server* server, ServerLink* link, const std::string& prefix,
+							const std::vector<std::string>& tokens);
+		static void		handleRemoteMessage(Server* server, ServerLink* link, User* source,
+							const std::vector<std::string>& tokens, const std::string& commandName);
+		static void		handleRemoteInvite(Server* server, ServerLink* link, User* source,
+							const std::vector<std::string>& tokens);
 
 		// === CommandUtils.cpp ===
 
 		static Cmd		getCmd(const std::vector<std::string>& tokens, Server* server);
+		static bool		checkUtf8(User* user, std::string& text, const std::string& command, bool sendReplies = true);
 		static std::vector<std::string>	splitCommaList(const std::string& list);
 };
 
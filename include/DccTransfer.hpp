@@ -0,0 +1,102 @@
+#ifndef DCCTRANSFER_HPP
+# define DCCTRANSFER_HPP
+
+# include <string>
+# include <vector>
+# include <sys/select.h>	// fd_set
+# include <netinet/in.h>	// sockaddr_in
+
+# include "TimerWheel.hpp"
+
+/**
+One DCC SEND relayed through the server (see `Server::relayDccOffer()`).
+
+The recipient connects to the relay's listening socket (connections from
+any other address are dropped); the relay then
+connects to the sender's DCC port and pipes bytes between both connections:
+file data from sender to recipient, 4-byte acknowledgements the other way.
+
+On Linux the bytes are moved with `splice()` through a pipe, so the payload
+never enters user space; elsewhere a `read()`/`write()` buffer is used.
+File data is paced by a token bucket (`rateLimit` bytes per second).
+All sockets are non-blocking; the server's `select()` loop drives the transfer.
+*/
+class	DccTransfer
+{
+	public:
+		enum	State
+		{
+			DCC_LISTENING,	// Waiting for the recipient to connect
+			DCC_CONNECTING,	// Recipient connected, connecting to the sender
+			DCC_RELAYING,	// Both connected, moving bytes
+			DCC_FINISHED,	// Both sides closed their end
+			DCC_FAILED		// Socket error (see `getError()`)
+		};
+
+		DccTransfer(int listenFd, const sockaddr_in& senderAddr, const in_addr& recipientAddr,
+					unsigned long rateLimit);
+		~DccTransfer();
+
+		int					prepareFds(fd_set& readFds, fd_set& writeFds, unsigned long nowMs);
+		State				handleEvents(fd_set& readFds, fd_set& writeFds, unsigned long nowMs);
+		long				getThrottleMs() const;
+
+		State				getState() const;
+		const std::string&	getError() const;
+		unsigned long		getBytesToRecipient() const;
+		unsigned long		getBytesToSender() const;
+		unsigned long		getLastActivity() const;
+
+		std::string			fileName;		// As offered (for the logs)
+		std::string			senderNick;
+		std::string			recipientNick;
+		TimerWheel::Timer	deadline;		// Setup deadline, then idle timeout
+		TimerWheel::Timer	throttle;		// Wakes the loop when the token bucket has refilled
+
+	private:
+		DccTransfer();
+		DccTransfer(const DccTransfer& other);
+		DccTransfer&	operator=(const DccTransfer& other);
+
+		// One direction of the relay: bytes read from `from` are written to `to`
+		struct	Direction
+		{
+			Direction();
+
+			int					from;
+			int					to;
+			int					pipe[2];	// splice() buffer (Linux)
+			std::vector<char>	buffer;		// read()/write() buffer (other systems)
+			size_t				offset;		// First unsent byte in `buffer`
+			size_t				pending;	// Bytes read but not yet written
+			bool				eof;		// `from` has closed its end
+			bool				done;		// EOF forwarded to `to`
+			unsigned long		bytes;		// Bytes written to `to`
+		};
+
+		State				_state;
+		std::string			_error;
+		int					_listenFd;
+		int					_recipientFd;
+		int					_senderFd;
+		sockaddr_in			_senderAddr;
+		in_addr				_recipientAddr;	// Only the recipient's IRC address may connect
+		Direction			_data;			// Sender -> recipient (file data)
+		Direction			_acks;			// Recipient -> sender (acknowledgements)
+		unsigned long		_rateLimit;		// Bytes per second for file data, 0 = unlimited
+		unsigned long		_tokens;		// Token bucket: bytes that may be relayed right now
+		unsigned long		_refilledAt;	// Last token bucket refill (monotonic ms)
+		unsigned long		_lastActivity;	// Last time bytes moved (monotonic ms)
+
+		bool				acceptRecipient(unsigned long nowMs);
+		bool				finishConnect(unsigned long nowMs);
+		bool				openDirection(Direction& dir, int from, int to);
+		bool				fill(Direction& dir, size_t maxBytes);
+		bool				drain(Direction& dir);
+		void				refill(unsigned long nowMs);
+		unsigned long		getThreshold() const;
+		State				fail(const std::string& what);
+		static void			closeFd(int& fd);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef FANOUTPOOL_HPP
+# define FANOUTPOOL_HPP
+
+# include <string>
+# include <vector>
+# include <pthread.h>
+
+class	User;
+
+/**
+Threads that help the event loop append one line to the output buffers of
+a very large channel (`FANOUT_THRESHOLD` members or more, see
+`Command::broadcastToChannel()`).
+
+`deliver()` is fork-join: the recipients are split into one range per
+participant (the calling thread and each worker), and returns once every
+recipient has the line. Participants take chunks of `FANOUT_CHUNK`
+recipients off their own range first, then steal chunks from the others'
+ranges, so a worker that is slow to wake up (or never gets a core) only
+leaves its range to the others. Chunks are claimed with an atomic add on
+the range's cursor; each recipient is in exactly one chunk, so its buffer is
+only ever touched by one thread and needs no lock.
+*/
+class	FanoutPool
+{
+	public:
+		FanoutPool();
+		~FanoutPool();
+
+		bool	start(int threads);
+		void	stop();
+		bool	isRunning() const;
+		void	deliver(const std::vector<User*>& recipients, const std::string& line, const User* excluded);
+
+	private:
+		// A participant's share of the recipients; `next` sits on a cache line of its own
+		struct	Range
+		{
+			volatile size_t	next;	// First recipient not claimed yet (moves by FANOUT_CHUNK)
+			size_t			end;
+			char			_pad[64 - 2 * sizeof(size_t)];
+		};
+
+		// One broadcast, shared by all participants
+		struct	Job
+		{
+			const std::vector<User*>*	recipients;
+			const std::string*			line;
+			const User*					excluded;
+			std::vector<Range>			ranges;
+		};
+
+		// What a worker needs to find its way back
+		struct	Worker
+		{
+			FanoutPool*	owner;
+			size_t		index;		// Its range in `Job::ranges` (0 is the event loop's)
+			pthread_t	id;
+		};
+
+		FanoutPool(const FanoutPool& other);
+		FanoutPool&	operator=(const FanoutPool& other);
+
+		static void*	workerMain(void* arg);
+		void			workerLoop(size_t index);
+		static void		work(Job& job, size_t index);
+
+		pthread_mutex_t			_mutex;		// Protects everything below but the ranges' cursors
+		pthread_cond_t			_wakeCond;	// Signals a new job / shutdown to idle workers
+		pthread_cond_t			_doneCond;	// Signals the last worker leaving a closed job
+		std::vector<Worker*>	_workers;
+		Job*					_job;		// Open for workers to join (NULL: none, or closed)
+		unsigned long			_generation;	// Bumped for every job, so a worker joins each at most once
+		int						_joined;	// Workers working on the current job
+		bool					_stopping;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HANDOFF_HPP
+# define HANDOFF_HPP
+
+# include <string>
+# include <vector>
+# include <ctime>		// time_t
+# include <stdint.h>	// uint32_t
+
+# include "StateLog.hpp"	// ChannelState
+
+// A registered user, as handed over to the new binary
+struct	UserHandoff
+{
+	int				fd;
+	std::string		nickname;
+	std::string		username;
+	std::string		realname;
+	std::string		host;
+	std::string		inputBuffer;	// Partial line not processed yet
+	std::string		outputBuffer;	// Not sent yet (including what was left of long replies)
+	unsigned long	lastActivity;	// Monotonic ms (the clock is the same in both processes)
+	unsigned long	pingSentAt;
+	unsigned char	caps;			// `CAP_*` bits the client enabled
+};
+
+// A connection that has not completed registration yet
+struct	PendingHandoff
+{
+	int				fd;
+	uint32_t		addr;		// Peer IPv4 address (network byte order)
+	std::string		nickname;	// Empty if NICK was not accepted yet
+	std::string		username;	// Empty if USER was not accepted yet
+	std::string		realname;
+	bool			hasPassed;
+	bool			negotiating;	// Between `CAP LS`/`REQ` and `CAP END`
+	unsigned char	caps;
+	std::string		inputBuffer;
+	std::string		outputBuffer;
+};
+
+// A channel: its persistent state plus what only lives while it has members
+struct	ChannelHandoff
+{
+	ChannelState				state;
+	time_t						createdAt;
+	std::vector<std::string>	members;	// Normalized nicknames
+	std::vector<std::string>	operators;
+};
+
+/**
+Everything a running server hands over to a freshly exec'd binary on a hot
+upgrade (`SIGUSR2`, see `Server::upgrade()`): the listening socket, all
+client connections with their buffers, and all channels.
+
+The state is encoded into one blob (see `Binary.hpp`) and written to a Unix
+socket, followed by the file descriptors, passed with `SCM_RIGHTS` in batches
+(the kernel takes at most 253 per message): the listening socket first, then
+the users', then the unregistered connections', in the order of the records.
+The receiver gets new descriptors for the same sockets, so clients notice
+nothing.
+*/
+class	Handoff
+{
+	public:
+		Handoff();
+		~Handoff();
+
+		bool		send(int sock, std::string& error) const;
+		bool		receive(int sock, std::string& error);
+		size_t		getFdCount() const;
+
+		int								listenFd;
+		time_t							startTime;	// Uptime goes on
+		unsigned long					peakUsers;
+		std::vector<UserHandoff>		users;
+		std::vector<PendingHandoff>		pending;
+		std::vector<ChannelHandoff>		channels;
+
+	private:
+		Handoff(const Handoff& other);
+		Handoff&	operator=(const Handoff& other);
+
+		void		encode(std::string& out) const;
+		bool		decode(const std::string& blob);
+		void		collectFds(std::vector<int>& fds) const;
+		void		assignFds(const std::vector<int>& fds);
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef IOWORKERS_HPP
+# define IOWORKERS_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <pthread.h>
+
+# include "ScanIndex.hpp"
+
+/**
+I/O threads for registered users' connections (`IO_THREADS`).
+
+Each thread owns a share of the sockets and runs its own `select()` loop over
+them: it reads, cuts the input into lines, tokenizes them, and writes what the
+server queued. The server's thread keeps everything else (users, channels,
+every command): it never touches these sockets, it only sees their input as
+ready-made commands and hands their output over in one piece per event loop
+iteration.
+
+Both directions go through lock-free stacks (multiple producers, single
+consumer), each paired with a self-pipe that is only written when the stack
+was empty, as in `BotWorkers`:
+ - Orders (server -> thread): take a connection, send output, let one go.
+ - Events (threads -> server): input lines, output drained, connection lost.
+
+Every connection handed over gets a serial, so that an event about a socket
+the server already let go cannot reach the next user on the same fd.
+*/
+class	IoWorkers
+{
+	public:
+		// A line received from a user, cut and tokenized on an I/O thread
+		struct	Line
+		{
+			std::vector<std::string>	tokens;	// Empty for a line too long to be processed
+			std::string					raw;	// The line itself (LOG_RAW_CMDS only)
+			size_t						length;
+		};
+
+		struct	Event
+		{
+			enum	Type
+			{
+				IO_INPUT,	// `lines` were received
+				IO_DRAINED,	// Everything handed over was sent (asked for with `send()`)
+				IO_CLOSED	// Connection lost: `error` is the errno of a failed read/write (0: closed by the peer)
+			};
+
+			Event*				next;
+			Type				type;
+			int					fd;
+			unsigned long		serial;
+			std::vector<Line>	lines;
+			int					error;
+			bool				writing;	// `error` is from a write
+		};
+
+		// What a stopped thread still had for a connection
+		struct	Leftover
+		{
+			int				fd;
+			unsigned long	serial;
+			std::string		input;	// Partial line
+			std::string		output;	// Not sent yet
+		};
+
+		IoWorkers();
+		~IoWorkers();
+
+		bool			start(int threads);
+		void			stop(std::vector<Leftover>& leftovers);
+		bool			isRunning() const;
+		int				getWakeFd() const;
+
+		unsigned long	attach(int fd, std::string& input);
+		void			send(unsigned long serial, int fd, std::string& output, bool notifyDrained);
+		void			detach(unsigned long serial, int fd, std::string& output);
+		void			wake();
+		Event*			takeEvents();
+
+	private:
+		// Something the server asks a thread to do
+		struct	Order
+		{
+			enum	Type
+			{
+				IO_ATTACH,	// Take the socket (`data`: input received before)
+				IO_OUTPUT,	// Send `data`
+				IO_DETACH	// Send `data` (best effort), then close the socket
+			};
+
+			Order*			next;
+			Type			type;
+			int				fd;
+			unsigned long	serial;
+			std::string		data;
+			bool			notify;		// IO_OUTPUT: post IO_DRAINED once sent
+		};
+
+		// A socket, as its thread sees it
+		struct	Connection
+		{
+			unsigned long	serial;
+			std::string		input;
+			std::string		output;
+			size_t			outputOffset;	// First unsent byte of `output`
+			bool			lost;			// IO_CLOSED was posted: nothing more is read or written
+			bool			notify;
+			bool			discarding;		// Dropping the rest of a line refused as too long
+		};
+
+		struct	Thread
+		{
+			IoWorkers*						owner;
+			pthread_t						id;
+			int								wakePipe[2];	// Orders are waiting ([0] is in the thread's `select()`)
+			Order* volatile					orders;		// Lock-free stack (Treiber stack)
+			volatile bool					stopping;
+			bool							woken;		// Server side: orders pushed since the last `wake()`
+			std::map<int, Connection>		connections;
+			ScanIndex						scan;		// Index of the input being framed (storage kept between reads)
+		};
+
+		IoWorkers(const IoWorkers& other);
+		IoWorkers&	operator=(const IoWorkers& other);
+
+		static void*	threadMain(void* arg);
+		void			threadLoop(Thread& thread);
+		void			applyOrders(Thread& thread, Order* orders);
+		void			readConnection(Thread& thread, int fd, Connection& connection, Event*& events);
+		void			writeConnection(Thread& thread, int fd, Connection& connection, Event*& events);
+		void			push(Thread& thread, Order* order);
+		void			post(Event* events);
+		Event*			newEvent(Event::Type type, int fd, const Connection& connection);
+
+		std::vector<Thread*>	_threads;
+		Event* volatile			_events;		// Lock-free stack of events for the server
+		int						_wakePipe[2];	// Events are waiting ([0] is in the server's `select()` read set)
+		unsigned long			_nextSerial;
+};
+
+#endif
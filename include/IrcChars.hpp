@@ -0,0 +1,35 @@
+#ifndef IRCCHARS_HPP
+# define IRCCHARS_HPP
+
+# include <string>
+
+/**
+Character tables of IRC names: the casemapping (`CASEMAPPING`, advertised in
+ISUPPORT) and the characters nicknames and channel names may contain.
+
+Every mapping only lowers one run of bytes by 32, from `A` up to `Z`
+(`ascii`), `]` (`strict-rfc1459`: `[]\` lower to `{}|`) or `^`
+(`rfc1459`: also `^` to `~`). So a name is folded 16 bytes at a time with
+two compares and an add (SSE2, every x86-64 CPU has it), or through a
+256-byte table for what is left; both work in place, and folding twice
+changes nothing.
+*/
+class	IrcChars
+{
+	public:
+		static bool			selectCaseMapping(const std::string& name);
+		static const char*	getCaseMapping();
+
+		static void			fold(char* data, size_t size);
+		static bool			equal(const std::string& a, const std::string& b);
+		static bool			isNickChars(const char* data, size_t size);
+		static bool			isChannelChars(const char* data, size_t size);
+
+	private:
+		// Pure utility class, no need for instantiation
+		IrcChars();
+		IrcChars(const IrcChars& other);
+		IrcChars&	operator=(const IrcChars& other);
+};
+
+#endif
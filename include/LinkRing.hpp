@@ -0,0 +1,72 @@
+#ifndef LINKRING_HPP
+# define LINKRING_HPP
+
+# include <string>
+# include <stdint.h>	// uint32_t
+# include <sys/types.h>	// ssize_t
+
+/**
+The transport of a link between two servers on the same host: a pair of
+single-producer/single-consumer byte rings in shared memory (`memfd`), one per
+direction, instead of a loopback TCP connection.
+
+The server that connects creates the memory and both `eventfd`s and passes
+them over a Unix socket (`SCM_RIGHTS`, see `Server::connectLocalLink()`);
+the socket stays open only so that each side notices when the other is gone.
+
+Each side owns one `eventfd` and sleeps on it in `select()`; the other side
+signals it when it puts data into an empty ring, or frees space in a ring
+the owner found full. Indices only grow (they wrap at 2^32), so a ring never
+needs a lock: the producer alone moves `head`, the consumer alone moves `tail`.
+A line crossing the link costs one copy into the ring and, at most once per
+event loop iteration, one `eventfd` write.
+
+Memfds and eventfds are Linux-only: elsewhere `create()` and `attach()`
+always fail, and links between local servers use TCP.
+*/
+class	LinkRing
+{
+	public:
+		static LinkRing*	create(std::string& error);
+		static LinkRing*	attach(const int fds[3], std::string& error);
+		~LinkRing();
+
+		ssize_t				write(const char* data, size_t size);
+		ssize_t				read(std::string& out);
+
+		void				getPeerFds(int fds[3]) const;
+		int					getWakeFd() const;
+		size_t				getSize() const;
+
+	private:
+		// One direction; `head`, `tail` and `wantSpace` sit on cache lines of their own
+		struct	Ring
+		{
+			volatile uint32_t	head;		// Bytes ever written (producer)
+			char				_pad1[60];
+			volatile uint32_t	tail;		// Bytes ever read (consumer)
+			char				_pad2[60];
+			volatile uint32_t	wantSpace;	// The producer found the ring full and waits to be signalled
+			char				_pad3[60];
+		};
+
+		LinkRing();
+		LinkRing(const LinkRing& other);
+		LinkRing&	operator=(const LinkRing& other);
+
+		bool				map(bool creator, std::string& error);
+		void				wake(int fd);
+
+		int					_memFd;
+		void*				_memory;
+		size_t				_mappedSize;
+		uint32_t			_size;			// Bytes of each ring's data (a power of 2)
+		Ring*				_tx;			// This side writes...
+		char*				_txData;
+		Ring*				_rx;			// ...and reads
+		char*				_rxData;
+		int					_wakeFd;		// Signalled by the peer (this side's `select()` waits on it)
+		int					_peerWakeFd;	// Signals the peer
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef LISTSTREAM_HPP
+# define LISTSTREAM_HPP
+
+# include <string>
+# include <vector>
+# include <ctime>	// time_t
+
+# include "ReplyStream.hpp"
+
+class	Server;
+class	Channel;
+
+/**
+The `LIST` reply (`322` lines, then `323`), generated as the client's socket
+drains (see `ReplyStream`).
+
+The stream is a cursor over the server's channel index: it remembers the
+name of the next channel to look at, so channels created or deleted while
+the list is being sent never invalidate it. Channels are filtered in place
+(ELIST, see `parse()`), without copying the index or the channels.
+*/
+class	ListStream : public ReplyStream
+{
+	public:
+		ListStream(Server* server, const std::string& nick);
+
+		void	parse(const std::string& params);
+		bool	pump(std::string& out, size_t maxBytes);
+
+	private:
+		ListStream(const ListStream& other);
+		ListStream&	operator=(const ListStream& other);
+
+		// A numeric ELIST condition, e.g. `>5` (more than 5 users) or `T<60`
+		struct	Condition
+		{
+			char	field;	// 'U' users, 'C' creation time, 'T' topic time (minutes ago)
+			bool	above;	// '>' (true) or '<' (false)
+			long	value;
+		};
+
+		Server*						_server;
+		std::string					_nick;			// Target of the replies
+		std::vector<std::string>	_masks;			// Normalized name masks (any must match)
+		std::vector<std::string>	_notMasks;		// Normalized `!` masks (none may match)
+		std::vector<Condition>		_conditions;	// All must hold
+		bool						_literal;		// Only exact names: looked up, not scanned
+		size_t						_nextMask;		// Literal mode: next name to look up
+		std::string					_nextKey;		// Scan mode: next channel (normalized name)
+		bool						_started;
+		time_t						_now;
+
+		bool	matches(const std::string& key, const Channel& channel) const;
+		void	writeChannel(std::string& out, const Channel& channel) const;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef MASKSET_HPP
+# define MASKSET_HPP
+
+# include <string>
+# include <vector>
+# include <ctime>		// time_t
+# include <stdint.h>	// uint64_t
+
+// One entry of a channel's ban, exception or invite-exception list
+struct	MaskEntry
+{
+	std::string	mask;	// `nick!user@host`, with `*` and `?` (see `MaskSet::complete()`)
+	std::string	setBy;	// Hostmask or server that added it
+	time_t		setAt;
+};
+
+/**
+A list of `nick!user@host` masks compiled into one automaton, so a hostmask
+is checked against all of them in a single pass instead of mask by mask.
+
+Each mask becomes a chain of states, one per character it consumes (a
+literal or `?`); a `*` is a loop on the state before it. The chains of all
+masks sit side by side in one bit vector (shift-and): for every byte of the
+hostmask, the active states move one bit up where the byte is accepted, and
+stay where they loop. That is one shift, one AND and one OR per 64 states,
+whatever the number of masks, and it stops as soon as no state is left.
+
+Names compare under the casemapping (`IrcChars`): the masks are folded when
+compiled, the hostmask when checked. The bytes the masks name get one row
+of the transition table each; all others share one row (`?` only).
+*/
+class	MaskSet
+{
+	public:
+		MaskSet();
+		~MaskSet();
+
+		void				compile(const std::vector<MaskEntry>& entries);
+		bool				matches(const std::string& hostmask) const;
+		bool				empty() const;
+
+		static std::string	complete(const std::string& mask);
+
+	private:
+		MaskSet(const MaskSet& other);
+		MaskSet&	operator=(const MaskSet& other);
+
+		size_t					_words;			// 64-bit words per state vector (0: no masks)
+		unsigned char			_rowOf[256];	// Folded byte -> its row of `_table`
+		std::vector<uint64_t>	_table;			// Row `r`, word `w` at [r * _words + w]: states entered on that byte
+		std::vector<uint64_t>	_loops;			// States followed by a `*`
+		std::vector<uint64_t>	_start;			// First state of every mask
+		std::vector<uint64_t>	_accept;		// Last state of every mask
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef MESSAGEHISTORY_HPP
+# define MESSAGEHISTORY_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <list>
+# include <map>
+# include <cstddef>	// size_t
+
+# include "ReplyStream.hpp"
+
+/**
+Recent `PRIVMSG` / `NOTICE` lines of every channel, replayed by `CHATHISTORY`.
+
+Each channel has a ring of lines, capped at `channelMaxBytes`; all rings
+together are capped at `maxBytes`. When the server-wide budget is exceeded,
+the oldest lines of the least recently used channel (written to or replayed)
+are evicted first, so busy channels cannot push quiet ones out entirely
+unless memory runs short.
+
+A line is serialized once, with its `time` and `msgid` tags, when it is
+recorded. Replays share it (`retain()` / `release()`), so an evicted line
+stays valid while a `HistoryStream` still has to send it.
+
+Optionally, each ring also keeps an inverted index of the words of its
+messages (for `SEARCH`): per word, the `msgid`s of the lines containing it,
+oldest first. Lines always enter a ring at the back and leave it at the
+front, so the index is updated in place as lines are recorded and evicted.
+*/
+class	MessageHistory
+{
+	public:
+		// A recorded message, shared by its ring and the replays sending it
+		struct	Line
+		{
+			std::string		text;	// "@time=...;msgid=<id> :<hostmask> PRIVMSG <channel> :<text>\r\n"
+			unsigned long	id;		// `msgid`, increasing server-wide
+			unsigned long	time;	// Milliseconds since the epoch, never decreasing
+			int				refs;
+		};
+
+		// Where a query starts: `*`, `msgid=<id>` or `timestamp=<YYYY-MM-DDThh:mm:ss.sssZ>`
+		struct	Ref
+		{
+			enum	Type { REF_NONE, REF_MSGID, REF_TIME }	type;
+			unsigned long									value;
+		};
+
+		enum	Query
+		{
+			QUERY_LATEST,	// The newest lines (after the reference, if any)
+			QUERY_BEFORE,	// The lines right before the reference
+			QUERY_AFTER		// The lines right after the reference
+		};
+
+		// What the history holds and has dropped so far (STATS h)
+		struct	Stats
+		{
+			size_t			bytes;		// Held by all rings
+			size_t			lines;
+			size_t			channels;	// Channels with a non-empty ring
+			unsigned long	recorded;	// Lines recorded since startup
+			unsigned long	trimmed;	// Dropped by a full channel ring
+			unsigned long	evicted;	// Dropped by the server-wide budget
+			size_t			indexTerms;		// Distinct words, summed over all channels
+			size_t			indexPostings;	// (word, message) pairs
+			size_t			indexBytes;		// Estimated memory of the index
+		};
+
+		MessageHistory(size_t maxBytes, size_t channelMaxBytes, bool indexed);
+		~MessageHistory();
+
+		void			record(const std::string& channelKey, const std::string& line);
+		void			find(const std::string& channelKey, Query query, const Ref& ref, size_t limit,
+							std::vector<Line*>& lines);
+		void			search(const std::string& channelKey, const std::vector<std::string>& terms, size_t limit,
+							std::vector<Line*>& lines);
+		void			drop(const std::string& channelKey);
+
+		const Stats&	getStats() const;
+		size_t			getChannelBytes(const std::string& channelKey) const;
+		size_t			getChannelLines(const std::string& channelKey) const;
+		size_t			getChannelIndexBytes(const std::string& channelKey) const;
+		bool			isIndexed() const;
+		size_t			getMaxBytes() const;
+		size_t			getChannelMaxBytes() const;
+
+		static bool		parseRef(const std::string& param, Ref& ref);
+		static void		tokenize(const std::string& text, std::vector<std::string>& terms);
+		static Line*	retain(Line* line);
+		static void		release(Line* line);
+
+	private:
+		MessageHistory(const MessageHistory& other);
+		MessageHistory&	operator=(const MessageHistory& other);
+
+		// The lines containing a word: `ids[head]`... (oldest first; the front is dropped lazily)
+		struct	Postings
+		{
+			std::vector<unsigned long>	ids;
+			size_t						head;
+		};
+
+		typedef std::map<std::string, Postings>	Index;
+
+		struct	Ring
+		{
+			std::string					key;	// Normalized channel name
+			std::deque<Line*>			lines;	// Oldest first
+			size_t						bytes;
+			Index						index;		// Word -> lines (if indexed)
+			size_t						indexBytes;	// Estimated memory of `index`
+			std::list<Ring*>::iterator	lru;	// Position in `_lru`
+		};
+
+		const size_t					_maxBytes;			// Budget of all rings together
+		const size_t					_channelMaxBytes;	// Budget of a single ring
+		const bool						_indexed;			// Rings keep a word index (SEARCH)
+		std::map<std::string, Ring*>	_rings;				// By normalized channel name (owned)
+		std::list<Ring*>				_lru;				// Most recently used first
+		unsigned long					_nextId;
+		unsigned long					_lastTime;
+		Stats							_stats;
+
+		void	popOldest(Ring* ring);
+		void	indexLine(Ring* ring, const Line* line, bool add);
+		static bool	hasFewerPostings(const Postings* a, const Postings* b);
+		void	use(Ring* ring);
+		size_t	lowerBound(const Ring* ring, const Ref& ref, bool inclusive) const;
+};
+
+/**
+A `CHATHISTORY` or `SEARCH` reply: the selected lines, written as the
+client's socket drains (see `ReplyStream`), in the format the client asked
+for with `CAP` (see `User.hpp`). With every capability, the lines are wrapped
+in a batch and written as recorded, only with the `batch` tag put in front;
+without `batch`, `server-time` and `message-tags`, they are plain messages.
+*/
+class	HistoryStream : public ReplyStream
+{
+	public:
+		HistoryStream(const std::string& prefix, const std::string& batchType, const std::string& target,
+			const std::string& batchId, std::vector<MessageHistory::Line*>& lines, unsigned char caps);
+		~HistoryStream();
+
+		bool	pump(std::string& out, size_t maxBytes);
+
+	private:
+		HistoryStream(const HistoryStream& other);
+		HistoryStream&	operator=(const HistoryStream& other);
+
+		void	writeLine(std::string& out, const std::string& text) const;
+
+		const std::string					_prefix;	// ":<server name> "
+		const std::string					_batchType;	// "chathistory" or "search"
+		const std::string					_target;	// The channel
+		const std::string					_batchId;
+		const unsigned char					_caps;		// The client's `CAP_*` bits
+		std::vector<MessageHistory::Line*>	_lines;		// Retained until the stream is done
+		size_t								_next;		// Next line to write
+		bool								_started;	// `BATCH +` was written
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef NUMERICS_HPP
+# define NUMERICS_HPP
+
+# include <string>
+# include <cstddef>	// size_t, NULL
+
+/**
+Catalog of all numeric replies the server sends.
+
+Each entry is `X(name, code, arity, format)`: the format is everything after
+`<code> <target> `, with one `%s` per parameter. The reply writer adds the
+server prefix, the code and the target (the client's nickname, `*` before
+registration), so handlers only pass the parameters:
+
+	reply<ERR_NOSUCHCHANNEL>(user, channelName);
+
+The number of parameters is checked at compile time against `arity`;
+`checkNumericCatalog()` verifies once at startup that every format has
+exactly `arity` placeholders.
+
+Source: https://dd.ircdocs.horse/refs/numerics/
+*/
+# define IRC_NUMERICS(X) \
+	X(RPL_WELCOME,				1,		4,	":Welcome to the %s Network, %s!%s@%s") \
+	X(RPL_YOURHOST,				2,		2,	":Your host is %s, running version %s") \
+	X(RPL_CREATED,				3,		1,	":This server was created %s") \
+	X(RPL_MYINFO,				4,		4,	"%s %s %s %s") \
+	X(RPL_ISUPPORT,				5,		1,	"%s :are supported by this server") \
+	X(RPL_ENDOFSTATS,			219,	1,	"%s :End of /STATS report") \
+	X(RPL_STATSUPTIME,			242,	4,	":Server Up %s days %s:%s:%s") \
+	X(RPL_STATSDEBUG,			249,	1,	":%s") \
+	X(RPL_LUSERCLIENT,			251,	2,	":There are %s users and 0 invisible on %s servers") \
+	X(RPL_LUSERUNKNOWN,			253,	1,	"%s :unknown connection(s)") \
+	X(RPL_LUSERCHANNELS,		254,	1,	"%s :channels formed") \
+	X(RPL_LUSERME,				255,	2,	":I have %s clients and %s servers") \
+	X(RPL_LOCALUSERS,			265,	4,	"%s %s :Current local users %s, max %s") \
+	X(RPL_GLOBALUSERS,			266,	4,	"%s %s :Current global users %s, max %s") \
+	X(RPL_LISTSTART,			321,	0,	"Channel :Users Name") \
+	X(RPL_LIST,					322,	3,	"%s %s :%s") \
+	X(RPL_LISTEND,				323,	0,	":End of /LIST") \
+	X(RPL_CHANNELMODEIS,		324,	3,	"%s %s%s") \
+	X(RPL_NOTOPIC,				331,	1,	"%s :No topic is set") \
+	X(RPL_TOPIC,				332,	2,	"%s :%s") \
+	X(RPL_TOPICWHOTIME,			333,	2,	"%s %s") \
+	X(RPL_INVITING,				341,	2,	"%s %s") \
+	X(RPL_INVITELIST,			346,	4,	"%s %s %s %s") \
+	X(RPL_ENDOFINVITELIST,		347,	1,	"%s :End of channel invite exception list") \
+	X(RPL_EXCEPTLIST,			348,	4,	"%s %s %s %s") \
+	X(RPL_ENDOFEXCEPTLIST,		349,	1,	"%s :End of channel exception list") \
+	X(RPL_NAMREPLY,				353,	2,	"= %s :%s") \
+	X(RPL_ENDOFNAMES,			366,	1,	"%s :End of /NAMES list") \
+	X(RPL_BANLIST,				367,	4,	"%s %s %s %s") \
+	X(RPL_ENDOFBANLIST,			368,	1,	"%s :End of channel ban list") \
+	X(RPL_MOTD,					372,	1,	":- %s") \
+	X(RPL_MOTDSTART,			375,	1,	":- %s Message of the day - ") \
+	X(RPL_ENDOFMOTD,			376,	0,	":End of /MOTD command.") \
+	X(ERR_NOSUCHNICK,			401,	1,	"%s :No such nick/channel") \
+	X(ERR_NOSUCHCHANNEL,		403,	1,	"%s :No such channel") \
+	X(ERR_NOCHANNELGIVEN,		403,	0,	":No channel specified") \
+	X(ERR_CANNOTSENDTOCHAN,		404,	1,	"%s :Cannot send to channel") \
+	X(ERR_TOOMANYCHANNELS,		405,	1,	"%s :You have joined too many channels") \
+	X(ERR_NOORIGIN,				409,	0,	":No origin specified") \
+	X(ERR_INVALIDCAPCMD,		410,	1,	"%s :Invalid CAP command") \
+	X(ERR_NORECIPIENT,			411,	1,	":No recipient given (%s)") \
+	X(ERR_NOTEXTTOSEND,			412,	0,	":No text to send") \
+	X(ERR_INPUTTOOLONG,			417,	0,	":Input line was too long") \
+	X(ERR_UNKNOWNCOMMAND,		421,	1,	"%s :Unknown command") \
+	X(ERR_NOMOTD,				422,	0,	":MOTD File is missing") \
+	X(ERR_NONICKNAMEGIVEN,		431,	0,	":No nickname given") \
+	X(ERR_ERRONEUSNICKNAME,		432,	1,	"%s :Erroneous nickname") \
+	X(ERR_NICKNAMEINUSE,		433,	1,	"%s :Nickname is already in use") \
+	X(ERR_USERNOTINCHANNEL,		441,	2,	"%s %s :They aren't on that channel") \
+	X(ERR_NOTONCHANNEL,			442,	1,	"%s :You're not on that channel") \
+	X(ERR_USERONCHANNEL,		443,	2,	"%s %s :is already on channel") \
+	X(ERR_NOTREGISTERED,		451,	0,	":You have not registered") \
+	X(ERR_NEEDMOREPARAMS,		461,	1,	"%s :Not enough parameters") \
+	X(ERR_ALREADYREGISTERED,	462,	0,	":You may not reregister") \
+	X(ERR_PASSWDMISMATCH,		464,	0,	":Password incorrect") \
+	X(ERR_CHANNELISFULL,		471,	1,	"%s :Cannot join channel (+l)") \
+	X(ERR_UNKNOWNMODE,			472,	1,	"%s :is unknown mode char to me") \
+	X(ERR_INVITEONLYCHAN,		473,	1,	"%s :Cannot join channel (+i)") \
+	X(ERR_BANNEDFROMCHAN,		474,	1,	"%s :Cannot join channel (+b)") \
+	X(ERR_BADCHANNELKEY,		475,	1,	"%s :Cannot join channel (+k)") \
+	X(ERR_BANLISTFULL,			478,	2,	"%s %s :Channel list is full") \
+	X(ERR_CHANOPRIVSNEEDED,		482,	1,	"%s :You're not channel operator") \
+	X(ERR_CANNOTKICKOP,			482,	1,	"%s :Cannot kick another channel operator") \
+	X(ERR_CANNOTDEOP,			482,	1,	"%s :You cannot de-op another channel operator.") \
+	X(ERR_CHANNELCREATE,		500,	1,	":Internal server error while creating channel %s") \
+	X(ERR_UMODEUNKNOWNFLAG,		501,	0,	":Mode string must start with + or -") \
+	X(ERR_USERSDONTMATCH,		502,	0,	":Cant change mode for other users") \
+	X(ERR_INVALIDMODEPARAM,		696,	4,	"%s %s %s :%s")
+
+// Numeric reply identifiers (index into the catalog, not the numeric code)
+enum	NumericId
+{
+# define NUMERIC_ID(name, code, arity, format)	name,
+	IRC_NUMERICS(NUMERIC_ID)
+# undef NUMERIC_ID
+	NUMERIC_COUNT
+};
+
+// Compile-time view of a catalog entry
+template <int Id>
+struct	Numeric;
+
+# define NUMERIC_TRAITS(name, numericCode, numericArity, numericFormat) \
+	template <> \
+	struct	Numeric<name> \
+	{ \
+		enum	{ code = numericCode, arity = numericArity }; \
+		static const char*	format() { return numericFormat; } \
+	};
+IRC_NUMERICS(NUMERIC_TRAITS)
+# undef NUMERIC_TRAITS
+
+// Only `NumericArityMatches<true>` is complete: `sizeof()` of the other one fails to compile
+template <bool>
+struct	NumericArityMatches;
+template <>
+struct	NumericArityMatches<true> {};
+
+# define CHECK_NUMERIC_ARITY(Id, count) \
+	(void)sizeof(NumericArityMatches<static_cast<int>(Numeric<Id>::arity) == (count)>)
+
+/**
+A reply parameter: a view of a string, or a number formatted in place.
+Never allocates; it must not outlive the string it was created from.
+*/
+class	ReplyArg
+{
+	public:
+		ReplyArg(const std::string& str);
+		ReplyArg(const char* str);
+		ReplyArg(long number);
+		ReplyArg(unsigned long number);
+		ReplyArg(int number);
+		ReplyArg(const ReplyArg& other);
+
+		const char*	data() const;
+		size_t		size() const;
+
+	private:
+		ReplyArg&	operator=(const ReplyArg& other);
+
+		const char*	_data;
+		size_t		_size;
+		char		_digits[24];	// Formatted number (20 digits + sign at most)
+
+		void		formatNumber(unsigned long number, bool negative);
+};
+
+void	appendReply(std::string& out, const std::string& prefix, int code, const ReplyArg& target,
+			const char* format, const ReplyArg* const* args, int count);
+bool	checkNumericCatalog(std::string& error);
+
+/**
+Client stand-in for `reply<>()` that writes into any buffer, e.g. a
+`ReplyStream` filling a user's output buffer:
+
+	ReplyWriter	writer(out, server->getReplyPrefix(), nickname);
+	reply<RPL_LISTEND>(&writer);
+*/
+class	ReplyWriter
+{
+	public:
+		ReplyWriter(std::string& out, const std::string& prefix, const std::string& target);
+
+		void	writeReply(int code, const char* format, const ReplyArg* const* args, int count);
+
+	private:
+		std::string&		_out;
+		const std::string&	_prefix;
+		const std::string&	_target;
+};
+
+/**
+Reply writer: appends numeric `Id` for `client` (a `User` or `PendingUser`)
+to its output buffer. The parameters are checked against the catalog's arity
+at compile time.
+*/
+template <int Id, class Client>
+void	reply(Client* client)
+{
+	CHECK_NUMERIC_ARITY(Id, 0);
+	client->writeReply(Numeric<Id>::code, Numeric<Id>::format(), NULL, 0);
+}
+
+template <int Id, class Client>
+void	reply(Client* client, const ReplyArg& a)
+{
+	CHECK_NUMERIC_ARITY(Id, 1);
+	const ReplyArg*	args[] = { &a };
+	client->writeReply(Numeric<Id>::code, Numeric<Id>::format(), args, 1);
+}
+
+template <int Id, class Client>
+void	reply(Client* client, const ReplyArg& a, const ReplyArg& b)
+{
+	CHECK_NUMERIC_ARITY(Id, 2);
+	const ReplyArg*	args[] = { &a, &b };
+	client->writeReply(Numeric<Id>::code, Numeric<Id>::format(), args, 2);
+}
+
+template <int Id, class Client>
+void	reply(Client* client, const ReplyArg& a, const ReplyArg& b, const ReplyArg& c)
+{
+	CHECK_NUMERIC_ARITY(Id, 3);
+	const ReplyArg*	args[] = { &a, &b, &c };
+	client->writeReply(Numeric<Id>::code, Numeric<Id>::format(), args, 3);
+}
+
+template <int Id, class Client>
+void	reply(Client* client, const ReplyArg& a, const ReplyArg& b, const ReplyArg& c, const ReplyArg& d)
+{
+	CHECK_NUMERIC_ARITY(Id, 4);
+	const ReplyArg*	args[] = { &a, &b, &c, &d };
+	client->writeReply(Numeric<Id>::code, Numeric<Id>::format(), args, 4);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PENDINGUSER_HPP
+# define PENDINGUSER_HPP
+
+# include <string>
+# include <stdint.h>	// uint32_t
+
+# include "TimerWheel.hpp"
+# include "defines.hpp"	// MAX_NICK_LENGTH
+
+class	Server;
+class	ReplyArg;
+
+/**
+Minimal record for a connection that has not completed registration yet.
+
+Holds only what the PASS/NICK/USER (and CAP) handshake needs: the socket, I/O buffers,
+registration flags and the identity sent so far. Once registration completes,
+the record is promoted to a full `User` (see `Server::promotePendingUser()`)
+and recycled through the server's pool, so accepting and dropping
+unregistered connections does not hit the allocator in steady state.
+*/
+class	PendingUser
+{
+	public:
+		PendingUser();
+		~PendingUser();
+
+		void				reset(Server* server, int fd, uint32_t addr);
+		void				clear();
+
+		void				logAction(const std::string& message) const;
+		void				sendServerMsg(const std::string& message);
+		void				writeReply(int code, const char* format, const ReplyArg* const* args, int count);
+
+		void				setNickname(const std::string& nick);
+		void				setUser(const std::string& username, const std::string& realname);
+		void				setHasPassed(bool b);
+		void				setNegotiating(bool b);
+		void				setCaps(unsigned char caps);
+		void				setConnectedAt(unsigned long nowMs);
+		void				setPartialSince(unsigned long nowMs);
+
+		int					getFd() const;
+		uint32_t			getAddr() const;
+		std::string			getHost() const;
+		const char*			getNickname() const;
+		const std::string&	getUsername() const;
+		const std::string&	getRealname() const;
+		std::string&		getInputBuffer();
+		std::string&		getOutputBuffer();
+		TimerWheel::Timer&	getDeadlineTimer();
+		unsigned long		getConnectedAt() const;
+		unsigned long		getPartialSince() const;
+		bool				hasNick() const;
+		bool				hasUser() const;
+		bool				hasPassed() const;
+		bool				isNegotiating() const;
+		unsigned char		getCaps() const;
+		bool				isComplete() const;
+
+	private:
+		PendingUser(const PendingUser& other);
+		PendingUser&	operator=(const PendingUser& other);
+
+		// Registration flags
+		enum
+		{
+			HAS_NICK = 1,	// NICK was accepted
+			HAS_USER = 2,	// USER was accepted
+			HAS_PASSED = 4,	// PASS was accepted (or no server password)
+			NEGOTIATING = 8	// CAP LS/REQ was sent, registration waits for CAP END
+		};
+
+		int					_fd;
+		uint32_t			_addr;		// Peer IPv4 address (network byte order); host string built on demand
+		unsigned char		_flags;		// HAS_* bits
+		unsigned char		_caps;		// `CAP_*` bits requested so far (see `User.hpp`)
+		char				_nickname[MAX_NICK_LENGTH + 1];	// "*" until NICK is accepted
+		Server*				_server;
+		std::string			_inputBuffer;
+		std::string			_outputBuffer;
+		std::string			_username;
+		std::string			_realname;
+		TimerWheel::Timer	_deadlineTimer;	// Registration / partial-line deadline
+		unsigned long		_connectedAt;	// Monotonic ms when the connection was accepted
+		unsigned long		_partialSince;	// Monotonic ms since an unterminated line is buffered (0 if none)
+};
+
+#endif
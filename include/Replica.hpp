@@ -0,0 +1,100 @@
+#ifndef REPLICA_HPP
+# define REPLICA_HPP
+
+# include <string>
+# include <map>
+# include <set>
+# include <deque>
+# include <ctime>	// time_t
+
+# include "StateLog.hpp"	// ChannelState
+# include "Handoff.hpp"		// UserHandoff
+
+struct	BinaryReader;
+
+/**
+The standby's side of the replication (see `ReplicationStream`): connects to
+the primary's `REPLICATION_SOCKET`, applies the records it streams to an
+in-memory copy of its users and channels, and holds on to the sockets passed
+along (the listening socket and every registered user's connection) without
+ever reading from them.
+
+When the primary is gone, the copy is turned into a `Handoff` and taken
+over exactly like a hot upgrade (`Server::promoteStandby()`): since the
+standby kept the sockets open, clients keep their connections.
+*/
+class	Replica
+{
+	public:
+		// What `receive()` ran into
+		enum	Result
+		{
+			REPLICA_OK,			// Records applied (or nothing to read yet)
+			REPLICA_CLOSED,		// The stream ended without a word: the primary may have died
+			REPLICA_BYE,		// The primary shut down on purpose
+			REPLICA_HANDOVER,	// The primary handed over to a new binary (hot upgrade)
+			REPLICA_ERROR		// Damaged stream or lost descriptors
+		};
+
+		// How far behind the primary the copy is (logged by the standby)
+		struct	Stats
+		{
+			unsigned long	records;	// Records applied
+			unsigned long	bytes;		// Bytes received
+			unsigned long	ticks;		// Batches closed by a `REPL_TICK`
+			unsigned long	lagTotalUs;	// Sum of the lags measured at each tick
+			unsigned long	lagMaxUs;	// Worst lag measured
+		};
+
+		Replica(const std::string& path);
+		~Replica();
+
+		bool			connect(std::string& error);
+		Result			receive(std::string& error);
+		void			reset();
+		void			takeHandoff(Handoff& handoff);
+
+		static bool		probe(const std::string& path, int timeoutMs);
+
+		bool			isConnected() const;
+		bool			isSynced() const;
+		int				getFd() const;
+		size_t			getUserCount() const;
+		size_t			getChannelCount() const;
+		const Stats&	getStats() const;
+
+	private:
+		Replica(const Replica& other);
+		Replica&	operator=(const Replica& other);
+
+		struct	ReplicaUser
+		{
+			UserHandoff				record;
+			std::set<std::string>	channels;	// Channel keys
+		};
+
+		struct	ReplicaChannel
+		{
+			ChannelState			state;
+			time_t					createdAt;
+			std::set<std::string>	members;	// Normalized nicknames (the bot's included)
+			std::set<std::string>	operators;
+		};
+
+		const std::string						_path;
+		int										_fd;		// Stream from the primary (-1: not connected)
+		std::string								_in;		// Received bytes not applied yet (partial record)
+		std::deque<int>							_fds;		// Descriptors received, not claimed by their record yet
+		int										_listenFd;
+		time_t									_startTime;
+		unsigned long							_peakUsers;
+		std::map<std::string, ReplicaUser>		_users;		// By normalized nickname
+		std::map<std::string, ReplicaChannel>	_channels;	// By normalized channel name
+		Stats									_stats;
+
+		Result	apply(unsigned char type, BinaryReader& in);
+		bool	takeFd(int& fd);
+		void	removeUser(const std::string& nickLower);
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef REPLICATIONSTREAM_HPP
+# define REPLICATIONSTREAM_HPP
+
+# include <string>
+# include <deque>
+# include <ctime>	// time_t
+
+class	User;
+class	Channel;
+
+/**
+Records of the replication stream, each `<u32 size><u8 type><payload>`
+(`size` counts type and payload; see `Binary.hpp` for the encoding). Records
+marked (fd) carry a socket, passed with `SCM_RIGHTS` along with their first
+byte.
+*/
+enum	ReplicationRecord
+{
+	REPL_LISTEN = 1,	// (fd) The listening socket
+	REPL_SERVER,		// Start time, peak users
+	REPL_USER,			// (fd) A registered user: nickname, username, realname, host
+	REPL_NICK,			// A user changed nickname: old normalized nickname, new nickname
+	REPL_QUIT,			// A user is gone: normalized nickname
+	REPL_CHANNEL,		// A channel was created or its state changed: `ChannelState`, creation time
+	REPL_JOIN,			// Channel key, normalized nickname
+	REPL_PART,			// Channel key, normalized nickname (operator status goes with it)
+	REPL_OP,			// Channel key, normalized nickname, granted (u8)
+	REPL_DROP,			// Channel key: channel deleted
+	REPL_TICK,			// End of a batch: monotonic us its first record was queued at (replication lag)
+	REPL_BYE			// The primary shuts down (0) or hands over to a new binary (1)
+};
+
+/**
+The primary's side of the replication to a hot standby (see `Replica`):
+every change of users, channels, memberships, modes and topics is encoded
+as a record and streamed to the standby over a Unix socket
+(`REPLICATION_SOCKET`).
+
+The sockets themselves go along: the listening socket and every registered
+user's connection are passed to the standby, which keeps them open without
+touching them. If this process dies, the connections survive in the standby,
+which takes over without clients noticing more than a short pause.
+
+Records are queued and written without blocking (`flush()`), once per event
+loop iteration; each batch ends with a `REPL_TICK`, which lets the standby
+measure how far behind it is. A standby that falls more than
+`REPLICATION_MAX_BACKLOG` bytes behind is dropped (it reconnects and syncs
+again). Only one standby is served at a time.
+*/
+class	ReplicationStream
+{
+	public:
+		// What the stream has cost so far (STATS p)
+		struct	Stats
+		{
+			unsigned long	standbys;	// Standbys attached since startup
+			unsigned long	dropped;	// Standbys dropped for falling behind or errors
+			unsigned long	records;	// Records queued
+			unsigned long	bytes;		// Bytes written to standbys
+			unsigned long	flushUs;	// Time spent writing them
+			size_t			maxBacklog;	// Most bytes ever queued at once
+		};
+
+		ReplicationStream(const std::string& path);
+		~ReplicationStream();
+
+		bool			listen(std::string& error);
+		void			close(bool upgrading);
+		int				accept(std::string& error);
+		void			detach();
+
+		bool			isListening() const;
+		bool			isAttached() const;
+		bool			wantsWrite() const;
+		int				getListenFd() const;
+		int				getStandbyFd() const;
+		size_t			getBacklog() const;
+		const Stats&	getStats() const;
+
+		void			saveListener(int fd);
+		void			saveServer(time_t startTime, unsigned long peakUsers);
+		void			saveUser(const User& user);
+		void			renameUser(const std::string& oldNickLower, const User& user);
+		bool			removeUser(const User& user);
+		void			saveChannel(const Channel& channel);
+		void			join(const Channel& channel, const std::string& nickLower);
+		void			part(const Channel& channel, const std::string& nickLower);
+		void			setOperator(const Channel& channel, const std::string& nickLower, bool granted);
+		void			dropChannel(const std::string& channelKey);
+
+		bool			flush(std::string& error);
+
+	private:
+		ReplicationStream(const ReplicationStream& other);
+		ReplicationStream&	operator=(const ReplicationStream& other);
+
+		// A socket to pass along with the byte at `offset` of `_out`
+		struct	Attachment
+		{
+			size_t	offset;
+			int		fd;
+			bool	owned;	// A dup() made when the original was closed before being sent
+		};
+
+		const std::string		_path;
+		int						_listenFd;		// -1 while not listening
+		int						_standbyFd;		// -1 while no standby is attached
+		std::string				_out;			// Queued records; `_out[_head]` is the next byte to write
+		size_t					_head;
+		std::deque<Attachment>	_fds;			// Sockets queued with the records, in stream order
+		unsigned long			_batchStartUs;	// When the first record since the last `REPL_TICK` was queued (0: none)
+		Stats					_stats;
+
+		size_t	beginRecord(ReplicationRecord type, int fd = -1);
+		void	endRecord(size_t start);
+		bool	writeQueued(std::string& error);
+		void	clearQueue();
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef REPLYBURST_HPP
+# define REPLYBURST_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>	// size_t
+
+/**
+A run of reply lines serialized once, with the per-client parts left as slots
+(e.g. the welcome burst `001`–`005`, or the MOTD).
+
+Lines are rendered with the slot markers (`ReplyBurst::nick` etc.) in place of
+the client's values, e.g. with `appendReply()`. `add()` cuts each line at its
+markers into segments, so writing the burst for a client is one `reserve()`
+and one copy per segment:
+
+	burst.write(user->getOutputBuffer(), nick, username, host);
+
+Long bursts can also be written a few lines at a time (see `BurstStream`);
+such shared bursts are heap-allocated and reference-counted (`retain()`,
+`release()`), so a rebuilt burst never pulls lines from under a stream.
+
+Slot values must be short enough that no line exceeds `MAX_LINE_LENGTH`
+(nicknames and usernames are capped at `MAX_NICK_LENGTH` / `MAX_USER_LENGTH`).
+*/
+class	ReplyBurst
+{
+	public:
+		enum	Slot
+		{
+			SLOT_NICK,	// The client's nickname
+			SLOT_USER,	// The client's username
+			SLOT_HOST,	// The client's host
+			SLOT_COUNT,
+			SLOT_NONE = SLOT_COUNT	// Last segment: nothing follows
+		};
+
+		// Markers standing in for the slots while a line is rendered ('\0' never occurs in IRC lines)
+		static const std::string	nick;
+		static const std::string	user;
+		static const std::string	host;
+
+		ReplyBurst();
+
+		void		clear();
+		void		add(const std::string& line);
+		void		write(std::string& out, const std::string& nickValue, const std::string& userValue,
+						const std::string& hostValue) const;
+		void		write(std::string& out, const std::string& nickValue) const;
+		size_t		write(std::string& out, size_t firstLine, size_t maxBytes, const std::string& nickValue) const;
+		size_t		getLineCount() const;
+		size_t		getSize(size_t nickLength) const;
+
+		ReplyBurst*	retain();
+		static void	release(ReplyBurst* burst);
+		bool		isShared() const;
+
+	private:
+		struct	Segment
+		{
+			std::string	text;	// Fixed bytes
+			Slot		slot;	// Value written after `text`
+		};
+
+		std::vector<Segment>	_segments;
+		std::vector<size_t>		_lineStarts;			// First segment of each line
+		size_t					_textSize;				// Fixed bytes of all segments
+		size_t					_slotCount[SLOT_COUNT];	// How often each slot occurs
+		int						_refs;					// Owners of a shared (heap-allocated) burst
+
+		ReplyBurst(const ReplyBurst& other);
+		ReplyBurst&	operator=(const ReplyBurst& other);
+};
+
+class	ReplyArg;
+
+/**
+Client stand-in for `reply<>()`: renders each reply with the nickname slot as
+its target and adds it to a `ReplyBurst`, so cached replies go through the
+same catalog (and compile-time checks) as all others.
+
+	BurstRenderer	renderer(burst, server->getReplyPrefix());
+	reply<RPL_ENDOFNAMES>(&renderer, channelName);
+*/
+class	BurstRenderer
+{
+	public:
+		BurstRenderer(ReplyBurst& burst, const std::string& prefix);
+
+		void	writeReply(int code, const char* format, const ReplyArg* const* args, int count);
+
+	private:
+		ReplyBurst&			_burst;
+		const std::string&	_prefix;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef REPLYSTREAM_HPP
+# define REPLYSTREAM_HPP
+
+# include <string>
+# include <cstddef>	// size_t
+
+class	ReplyBurst;
+
+/**
+A long reply that is generated as the client's socket drains, instead of all
+at once (e.g. `NAMES` of a huge channel).
+
+A user's streams are pumped in order whenever their output buffer is below
+`SENDQ_WATERMARK` (see `User::pumpReplyStreams()`), so the buffer never has
+to hold the whole reply. Streams always write whole lines; other replies sent
+meanwhile may end up between two of its lines.
+*/
+class	ReplyStream
+{
+	public:
+		virtual ~ReplyStream();
+
+		/**
+		Appends the next lines to `out`, about `maxBytes` (whole lines only).
+
+		 @return	`false` once the reply is complete (the stream is then deleted).
+		*/
+		virtual bool	pump(std::string& out, size_t maxBytes) = 0;
+};
+
+// Streams the lines of a shared `ReplyBurst` (nickname slots only).
+class	BurstStream : public ReplyStream
+{
+	public:
+		BurstStream(ReplyBurst* burst, const std::string& nick);
+		~BurstStream();
+
+		bool	pump(std::string& out, size_t maxBytes);
+
+	private:
+		BurstStream(const BurstStream& other);
+		BurstStream&	operator=(const BurstStream& other);
+
+		ReplyBurst*	_burst;	// Retained until the stream is done
+		std::string	_nick;	// Written into the nickname slots
+		size_t		_line;	// Next line to write
+};
+
+#endif
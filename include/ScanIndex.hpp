@@ -0,0 +1,52 @@
+#ifndef SCANINDEX_HPP
+# define SCANINDEX_HPP
+
+# include <string>
+# include <vector>
+# include <stdint.h>	// uint64_t
+
+/**
+Bitmask index of the line feeds and spaces in a buffer, built in one pass
+by a vector kernel (AVX2 or SSE2, whichever the CPU has, chosen once at
+startup; a scalar loop elsewhere). Each 64-byte block of the buffer gets one
+64-bit mask per class, bit `i` standing for byte `i` of the block.
+
+Framing and tokenizing then jump from one set bit to the next (count
+trailing zeros) instead of testing every byte. The other delimiters only
+matter at single, known positions (`\r` before a line feed, `:` where a
+token starts), so they are checked there and not indexed.
+*/
+class	ScanIndex
+{
+	public:
+		ScanIndex();
+		~ScanIndex();
+
+		void				build(const char* data, size_t size);
+		void				build(const std::string& data);
+		size_t				nextNewline(size_t from, size_t to) const;
+		size_t				nextSpace(size_t from, size_t to) const;
+
+		static const char*	getKernelName();
+		static bool			useKernel(const std::string& name);
+
+	private:
+		enum	Class
+		{
+			SCAN_NEWLINE,
+			SCAN_SPACE,
+			SCAN_CLASSES
+		};
+
+		ScanIndex(const ScanIndex& other);
+		ScanIndex&	operator=(const ScanIndex& other);
+
+		size_t				next(int type, size_t from, size_t to) const;
+
+		uint64_t				_inline[SCAN_CLASSES * 8];	// Masks of buffers up to 512 bytes (a whole IRC line)
+		std::vector<uint64_t>	_heap;		// Masks of longer buffers (capacity kept for the next build)
+		uint64_t*				_masks;		// `_inline` or `_heap`: block `b`, class `c` at [b * SCAN_CLASSES + c]
+		size_t					_size;		// Bytes indexed
+};
+
+#endif
@@ -3,26 +3,65 @@
 
 # include <string>
 # include <map>
+# include <set>
 # include <vector>
 # include <sys/select.h>	// for fd_set
 # include <fstream>			// for std::ofstream
+# include <ctime>			// for time_t
+# include <stdint.h>		// for uint32_t
+
+# include "TimerWheel.hpp"
+# include "BotWorkers.hpp"
+# include "IoWorkers.hpp"
+# include "FanoutPool.hpp"
+# include "BotPlugins.hpp"
+# include "DccTransfer.hpp"
+# include "ReplyBurst.hpp"
+# include "MessageHistory.hpp"
+# include "StateLog.hpp"
+# include "Handoff.hpp"
+# include "ReplicationStream.hpp"
+# include "Replica.hpp"
+# include "ServerLink.hpp"
 
 class	User;	// no include needed as only pointer is used
+class	PendingUser;
 class	Channel;
 
 class Server
 {
 	public:
+		// Counters of connections closed by the registration reaper (see `STATS r`)
+		struct	ReapStats
+		{
+			unsigned long	registrationTimeouts;	// Did not finish PASS/NICK/USER in time
+			unsigned long	partialLineTimeouts;	// Sat on an unterminated line for too long
+			unsigned long	rejectedPerHost;		// Refused: too many unregistered from same IP
+			unsigned long	rejectedTotal;			// Refused: too many unregistered server-wide
+		};
+
+		// Counters of the DCC relay (STATS d)
+		struct	DccStats
+		{
+			unsigned long	relayed;	// Offers rewritten to point at the relay
+			unsigned long	completed;	// Relays both sides closed normally
+			unsigned long	failed;		// Relays closed on errors or timeouts
+			unsigned long	refused;	// Offers forwarded unchanged (DCC_MAX_TRANSFERS reached)
+			unsigned long	bytes;		// Bytes relayed, both directions
+		};
+
 		// === Server.cpp ===
 
-		Server(int port, const std::string& password);
+		Server(int port, const std::string& password, bool standby, const std::string& name);
 		~Server();
 
 		void				run();
 		void				logServerMessage(const std::string& message);
 		void				openLogFile();
+		void				reload(void);
 
 		const std::string&	getServerName() const;
+		const std::string&	getReplyPrefix() const;
 		const std::string&	getVersion() const;
 		const std::string&	getNetwork() const;
 		const std::string&	getCreationTime() const;
@@ -34,6 +73,8 @@ class Server
 		bool				getBotMode() const;	// Bot
 		User*				getBotUser() const;	// Bot
 		std::ofstream&		getLogFile();		// Log file stream
+		MessageHistory&		getHistory();		// Channel history (CHATHISTORY)
+		const StateLog&		getStateLog() const;	// Saved channel states (STATS c)
 
 		std::map<std::string, User*>&	getNickMap();
 		void				removeNickMapping(const std::string& nickname);
@@ -44,6 +85,7 @@ class Server
 		User*				getUser(const std::string& nickname) const;
 		void				disconnectUser(int fd, const std::string& reason);
 		void				deleteUser(int fd, std::string logMsg);
+		void				quitChannels(User* user, const std::string& reason);
 
 		// === ServerChannel.cpp ===
 
@@ -52,12 +94,81 @@ class Server
 																bool* wasCreated = NULL);
 		void								deleteChannel(const std::string& channelName, std::string reason);
 		std::map<std::string, Channel*>&	getAllChannels();
+		bool								restoreChannelState(Channel* channel, User* user);
+
+		// === ServerUpgrade.cpp ===
+
+		void								setBinaryPath(const std::string& path);
+
+		// === ServerReplication.cpp ===
+
+		ReplicationStream&					getReplication();
+
+		// === ServerLinks.cpp ===
+
+		void				addLinkTarget(const std::string& address);
+		void				acceptServerLink(PendingUser* pending, const std::string& name, const std::string& info);
+		bool				registerServerLink(ServerLink* link, const std::string& name, const std::string& info);
+		void				sendHandshake(ServerLink* link);
+		void				closeLink(ServerLink* link, const std::string& reason);
+		void				propagate(const std::string& line, ServerLink* except = NULL);
+		void				propagateToChannel(Channel* channel, const std::string& line, ServerLink* except = NULL);
+		void				propagateChannel(Channel* channel);
+		std::string			buildNickIntro(const User* user) const;
+		User*				addRemoteUser(ServerLink* link, const std::string& serverName, const std::string& nickname,
+								const std::string& username, const std::string& host, const std::string& realname);
+		void				removeRemoteUser(User* user, const std::string& reason);
+		void				killUser(User* user, const std::string& reason);
+		void				addRemoteServer(ServerLink* link, const std::string& name, const std::string& uplink,
+								int hops, const std::string& info);
+		void				removeRemoteServer(const std::string& name, const std::string& reason);
+		const RemoteServer*	getRemoteServer(const std::string& name) const;
+		bool				isServerNameInUse(const std::string& name) const;
+		const std::map<int, ServerLink*>&	getLinks() const;
+		size_t				getServerCount() const;
+		size_t				getRemoteUserCount() const;
 
 		// === ServerBot.cpp ===
 
 		static void			handleJoke(Server *server, User *user);
 		static void			handleCalc(Server *server, User *user, const std::vector<std::string>& tokens);
+		void				botOnChannelJoin(User* user, const std::string& channelName);
+		void				botOnDirectMessage(User* sender, const std::string& message,
+								const std::string& commandName);
+		void				submitBotJob(User* user, const std::string& command,
+								BotWorkers::JobFunc func, const std::string& input,
+								const BotPlugins::Binding* plugin = NULL);
+		bool				runBotVerb(User* user, const std::vector<std::string>& tokens);
+
+		// === ServerTimers.cpp ===
 
+		unsigned long		getNowMs() const;
+		time_t				getStartTime() const;
+
+		// === ServerPending.cpp ===
+
+		bool				isNickInUse(const std::string& normNick) const;
+		void				reservePendingNick(PendingUser* pending, const std::string& normNick);
+		User*				promotePendingUser(PendingUser* pending);
+		void				closePendingUser(int fd, const std::string& logMsg);
+
+		// === ServerReaper.cpp ===
+
+		void				finishRegistration(User* user);
+		const ReapStats&	getReapStats() const;
+		size_t				getUnregisteredCount() const;
+
+		// === ServerDcc.cpp ===
+
+		std::string			relayDccOffer(User* sender, User* recipient, const std::string& message);
+		const DccStats&		getDccStats() const;
+		size_t				getDccTransferCount() const;
+
+		// === ServerWelcome.cpp ===
+
+		void				sendWelcomeBurst(User* user);
+		void				sendLusers(User* user);
+		void				sendMotd(User* user);
 
 	private:
 		// Disable default constructor and copying (makes no sense for a server)
@@ -72,10 +183,24 @@ class Server
 			INPUT_ERROR
 		};
 
+		// What an expired `TimerWheel::Timer` stands for
+		enum	TimerType
+		{
+			TIMER_KEEPALIVE,	// Idle user: send PING, or disconnect if the last one went unanswered
+			TIMER_REGISTRATION,	// Unregistered user: registration or partial-line deadline reached
+			TIMER_BOT_JOB,		// Bot command still running: answer the user with a timeout
+			TIMER_DCC_DEADLINE,	// DCC relay not accepted / not connected / idle for too long
+			TIMER_DCC_THROTTLE,	// DCC relay's token bucket has refilled
+			TIMER_STATE_SNAPSHOT,	// Channel states are due for a new snapshot
+			TIMER_LINK_RETRY,		// A `--link` target is due for another connection attempt
+			TIMER_LINK_KEEPALIVE	// Server link: handshake deadline, or PING when idle
+		};
+
 		const std::string	_name;		// Server name, used in replies
 		const std::string	_version;	// Server version, used in replies
 		const std::string	_network;	// Network name, used in replies
 		const std::string	_creationTime;	// Server creation time, used in replies
+		const std::string	_replyPrefix;	// ":<server name> ", precomputed for every reply
 		const int			_port;		// Server port
 		const std::string	_password;	// Server password for client authentication
 
@@ -89,11 +214,58 @@ class Server
 		const int			_maxChannels;	// Max channels per user
 
 		bool				_botMode;	// Is bot mode enabled
-		int					_botFd;		// Stores the bot socket
-		User*				_botUser;	// Stores the bot user
+		User*				_botUser;	// Stores the bot user (virtual, no socket)
+		BotWorkers			_botWorkers;	// Runs bot commands off the event loop
+		std::set<BotWorkers::Job*>	_botJobs;		// Submitted, not yet completed bot jobs (owned)
+		std::map<int, int>	_botJobsPerFd;	// Uncompleted bot jobs per user fd (BOT_MAX_JOBS)
+		BotPlugins			_botPlugins;	// Bot commands loaded from BOT_PLUGIN_DIR
+
+		IoWorkers			_ioWorkers;		// Serve registered users' sockets off the event loop (IO_THREADS)
+		FanoutPool			_fanout;		// Help broadcasting to very large channels (FANOUT_THREADS)
 
 		std::ofstream		_logFile;		// Log file stream
 		std::string			_logFilePath;	// Path to the log file
+
+		TimerWheel			_timers;	// All per-connection timers
+		unsigned long		_nowMs;		// Monotonic time of the current loop iteration
+		time_t				_startTime;	// Wall clock time the server was started (for uptime)
+
+		std::vector<PendingUser*>	_pendingFd;		// Unregistered connections, indexed by fd (FD_SETSIZE slots)
+		size_t						_pendingCount;	// Non-NULL entries in `_pendingFd`
+		std::vector<PendingUser*>	_pendingPool;	// Recycled records, reused by the next accept()
+		std::map<std::string, int>	_pendingNicks;	// Nicknames held by unregistered connections -> fd
+
+		std::map<uint32_t, int>	_unregPerHost;	// Unregistered connections per source IP
+		size_t				_unregCount;	// Unregistered connections server-wide
+		ReapStats			_reapStats;		// What the registration reaper has closed so far
+
+		std::set<DccTransfer*>	_dccTransfers;	// Running DCC relays (owned)
+		DccStats			_dccStats;		// What the DCC relay has done so far
+
+		ReplyBurst			_welcomeBurst;	// 001-005, serialized once (nickname, username, host filled in per user)
+		ReplyBurst			_motdBurst;		// 375, 372..., 376 from MOTD_FILE
+		bool				_hasMotd;		// MOTD_FILE could be read (otherwise 422)
+		size_t				_peakUsers;		// Most users registered at once (LUSERS)
+
+		MessageHistory		_history;		// Recent channel messages (CHATHISTORY)
+		StateLog			_stateLog;		// Channel topics, modes and invite lists saved across restarts
+		TimerWheel::Timer	_snapshotTimer;	// Next snapshot of `_stateLog` (STATE_SNAPSHOT_INTERVAL)
+
+		std::string			_binaryPath;	// Executed on a hot upgrade (SIGUSR2)
+		int					_upgradeFd;		// Socket the previous binary hands over on (-1: fresh start)
+		bool				_handedOff;		// Everything was handed over to a new binary: exit quietly
+
+		ReplicationStream	_replication;	// Changes streamed to a hot standby (REPLICATION_SOCKET)
+		Replica				_replica;		// Standby mode: the copy of the primary's state
+		bool				_standby;		// Following a primary instead of serving (until promoted)
+
+		std::map<int, ServerLink*>			_links;			// Connections to neighbouring servers, by fd (owned)
+		std::map<std::string, RemoteServer>	_remoteServers;	// Every other server of the network, by normalized name
+		std::vector<LinkTarget*>			_linkTargets;	// Servers to connect to (`--link`, owned)
+		int									_localLinkFd;	// Listening for local servers' rings (LINK_LOCAL_SOCKET), -1 if not
+		std::map<int, unsigned long>		_localLinkPending;	// Accepted local link sockets waiting for their rings -> accepted at (ms)
+		size_t								_remoteUserCount;	// Users of `_usersNick` that are on other servers
+		size_t								_peakGlobalUsers;	// Most users on the network at once, as seen from here (LUSERS)
 	
 		// === ServerSocket.cpp ===
 
@@ -110,14 +282,112 @@ class Server
 		bool				acceptNewUser();
 		void				handleReadReadyUsers(fd_set& readFds);
 		void				handleWriteReadyUsers(fd_set& writeFds);
+		UserInputResult		receiveInput(int fd, std::string& inputBuffer);
 		UserInputResult		handleUserInput(int fd);
-		std::vector<std::string>	extractMessagesFromBuffer(User* user);
+		void				processUserInput(User* user);
+		void				dispatchUserCommand(User* user, std::vector<std::string>& tokens);
+		void				capPartialLine(User* user);
+		void				rejectOverlongLine(User* user, size_t length);
+		bool				sendOutputBuffer(int fd, std::string& outputBuffer);
+
+		// === ServerIo.cpp ===
+
+		void				startIo();
+		void				stopIo();
+		bool				isIoAttached(const User* user) const;
+		void				handleIoEvents();
+		void				handleIoEvent(User* user, IoWorkers::Event& event);
+
+		// === ServerPending.cpp ===
+
+		bool				acceptPendingUser(int fd, uint32_t addr);
+		PendingUser*		getPendingUser(int fd) const;
+		void				releasePendingUser(PendingUser* pending);
+		void				handleReadReadyPending(fd_set& readFds);
+		void				handleWriteReadyPending(fd_set& writeFds);
+		UserInputResult		handlePendingInput(int fd);
+		void				processPendingInput(PendingUser* pending);
 
 		// === ServerBot.cpp ===
 
 		void				initBot(void);
-		void				initBotSocket(void);
-		void				initBotCredentials(void);
+		void				deleteBot(void);
+		void				handleBotCompletions(void);
+		void				handleBotJobTimeout(BotWorkers::Job* job);
+		void				deliverBotJob(BotWorkers::Job* job);
+		void				releaseBotJobSlot(int fd);
+		void				cancelBotJobs(int fd);
+
+		// === ServerTimers.cpp ===
+
+		struct timeval*		prepareTimeout(struct timeval& tv);
+		void				updateNow();
+		void				handleTimers();
+		void				handleKeepalive(int fd);
+		void				armKeepalive(User* user);
+
+		// === ServerChannel.cpp ===
+
+		void				openStateLog();
+		void				writeStateSnapshot();
+		void				startFanout();
+
+		// === ServerReaper.cpp ===
+
+		bool				admitUnregistered(int fd, uint32_t addr);
+		void				trackUnregistered(PendingUser* pending);
+		void				untrackUnregistered(PendingUser* pending);
+		void				updatePartialLine(PendingUser* pending);
+		void				handleRegistrationTimer(int fd);
+		void				reapUser(int fd, const char* reason);
+
+		// === ServerDcc.cpp ===
+
+		int					prepareDccSets(fd_set& readFds, fd_set& writeFds);
+		void				handleDccTransfers(fd_set& readFds, fd_set& writeFds);
+		void				handleDccTimer(DccTransfer* transfer, int type);
+		void				closeDccTransfer(DccTransfer* transfer, const std::string& reason);
+
+		// === ServerUpgrade.cpp ===
+
+		static int			takeUpgradeFd();
+		bool				upgrade();
+		void				collectHandoff(Handoff& handoff);
+		void				resumeUpgrade();
+		void				adoptHandoff(Handoff& handoff);
+
+		// === ServerReplication.cpp ===
+
+		void				openReplication();
+		int					prepareReplicationSets(fd_set& readFds, fd_set& writeFds);
+		void				handleReplication(fd_set& readFds, fd_set& writeFds);
+		void				syncStandby();
+		void				flushReplication();
+		bool				runStandby();
+		void				promoteStandby();
+
+		// === ServerLinks.cpp ===
+
+		ServerLink*			getLink(int fd) const;
+		void				openLinks();
+		void				connectLink(LinkTarget* target);
+		bool				connectLocalLink(LinkTarget* target);
+		void				listenLocalLinks();
+		void				acceptLocalLink();
+		void				receiveLocalLink(int fd);
+		int					prepareLinkSets(fd_set& readFds, fd_set& writeFds);
+		void				handleLinks(fd_set& readFds, fd_set& writeFds);
+		void				processLinkInput(ServerLink* link);
+		void				sendBurst(ServerLink* link);
+		void				buildChannelBurst(Channel* channel, std::vector<std::string>& lines) const;
+		void				dropServers(const std::set<std::string>& lost, ServerLink* link,
+								const std::string& quitReason);
+		void				handleLinkKeepalive(ServerLink* link);
+		void				closeAllLinks(const std::string& reason);
+
+		// === ServerWelcome.cpp ===
+
+		void				buildReplyBursts(void);
 };
 
 #endif
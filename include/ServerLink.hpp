@@ -0,0 +1,118 @@
+#ifndef SERVERLINK_HPP
+# define SERVERLINK_HPP
+
+# include <string>
+# include <netinet/in.h>	// sockaddr_in
+
+# include "TimerWheel.hpp"
+# include "LinkRing.hpp"
+
+class	ServerLink;
+
+// A `--link` target: a server this one connects to (and reconnects to when the link drops).
+struct	LinkTarget
+{
+	std::string			address;	// "<host>:<port>", as given
+	sockaddr_in			addr;		// Resolved once at startup
+	ServerLink*			link;		// Current connection (NULL: none, retry pending)
+	TimerWheel::Timer	retry;		// Next connection attempt (LINK_RETRY)
+};
+
+// Another server of the network, directly linked or behind one.
+struct	RemoteServer
+{
+	std::string			name;
+	std::string			uplink;		// Server it is attached to (this one's name for direct links)
+	std::string			info;		// Description sent in `SERVER`
+	int					hops;		// 1 for direct links
+	ServerLink*			link;		// Link it is reached through
+};
+
+/**
+A connection to a neighbouring server (RFC 2813): accepted on the client
+port (the peer sent `SERVER` instead of `NICK`/`USER`), or opened to one of
+the `--link` targets. A link to a server on the same host goes through shared
+memory instead of TCP (see `LinkRing`); nothing else differs.
+
+Servers form a spanning tree: every change of the network's users and
+channels crosses each link once, and so does every channel message with
+members behind the link (see `Server::propagateToChannel()`). The link
+itself only moves lines; what they mean is up to `Command::handleServerMessage()`.
+
+All sockets are non-blocking; the server's `select()` loop drives the link.
+*/
+class	ServerLink
+{
+	public:
+		enum	State
+		{
+			LINK_CONNECTING,	// Outgoing, connect() in progress
+			LINK_HANDSHAKE,		// Waiting for the peer's `PASS` and `SERVER`
+			LINK_ACTIVE			// Registered: burst sent, traffic flowing
+		};
+
+		// What went over the link (STATS l)
+		struct	Stats
+		{
+			unsigned long	linesIn;
+			unsigned long	linesOut;
+			unsigned long	bytesIn;
+			unsigned long	bytesOut;
+		};
+
+		ServerLink(int fd, const std::string& address, LinkTarget* target, LinkRing* ring);
+		~ServerLink();
+
+		bool				finishConnect(std::string& error);
+		bool				receive(std::string& error);
+		bool				popLine(std::string& line);
+		bool				flush(std::string& error);
+		void				send(const std::string& line);
+		void				appendInput(const std::string& input);
+
+		void				setState(State state);
+		void				setPeer(const std::string& name, const std::string& info);
+		void				setHasPassed(bool hasPassed);
+		void				setLastActivity(unsigned long nowMs);
+		void				setPingSentAt(unsigned long nowMs);
+
+		int					getFd() const;
+		State				getState() const;
+		const std::string&	getName() const;
+		const std::string&	getInfo() const;
+		const std::string&	getAddress() const;
+		LinkTarget*			getTarget() const;
+		bool				isLocal() const;
+		int					getWakeFd() const;
+		bool				hasPassed() const;
+		size_t				getRecvQ() const;
+		size_t				getSendQ() const;
+		unsigned long		getLastActivity() const;
+		unsigned long		getPingSentAt() const;
+		const Stats&		getStats() const;
+
+		TimerWheel::Timer	keepalive;		// PING when idle, drop when the PING goes unanswered
+
+	private:
+		ServerLink();
+		ServerLink(const ServerLink& other);
+		ServerLink&	operator=(const ServerLink& other);
+
+		int					_fd;
+		State				_state;
+		std::string			_name;			// The peer's server name ("*" until its `SERVER`)
+		std::string			_info;
+		std::string			_address;		// "<host>:<port>" of the peer (for the logs)
+		LinkTarget*			_target;		// Outgoing link: the target it was opened for (NULL: accepted)
+		LinkRing*			_ring;			// Local link: the rings lines go through (`_fd` only tells when the peer is gone)
+		bool				_hasPassed;		// The peer sent the right `PASS` (outgoing links; accepted ones checked it as pending)
+		std::string			_inputBuffer;
+		size_t				_inputOffset;	// First byte of `_inputBuffer` not taken by `popLine()`
+		std::string			_outputBuffer;
+		size_t				_outputOffset;	// First unsent byte of `_outputBuffer`
+		unsigned long		_lastActivity;	// Monotonic ms of the last data received
+		unsigned long		_pingSentAt;	// Monotonic ms of the unanswered PING (0 if none)
+		Stats				_stats;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef STATELOG_HPP
+# define STATELOG_HPP
+
+# include <string>
+# include <set>
+# include <map>
+# include <vector>
+# include <ctime>	// time_t
+
+# include "MaskSet.hpp"	// MaskEntry
+
+class	Channel;
+struct	BinaryReader;
+
+// The persistent part of a channel: topic, modes, invite list and mask lists
+struct	ChannelState
+{
+	std::string				name;			// As created (case preserved)
+	std::string				topic;
+	std::string				topicSetBy;
+	time_t					topicSetAt;
+	bool					inviteOnly;		// +i
+	bool					topicProtection;	// +t
+	int						userLimit;		// +l, 0 if not set
+	std::string				key;			// +k, empty if not set
+	std::set<std::string>	invites;		// Normalized nicknames
+	std::vector<MaskEntry>	bans;			// +b
+	std::vector<MaskEntry>	exceptions;		// +e
+	std::vector<MaskEntry>	inviteExceptions;	// +I
+	bool					claimed;		// A live channel owns it (otherwise restored, waiting for its channel)
+};
+
+/**
+Channel state that survives a restart: a compact snapshot plus an
+append-only journal of the changes made since.
+
+Every change of a channel's topic, modes, invite or mask lists is appended
+to the journal as it happens (`save()`, `saveInvite()`, `saveMask()`,
+`drop()`): one binary record, one `write()`. Every `STATE_SNAPSHOT_INTERVAL` seconds, and on
+shutdown, the state of all channels is written to a new snapshot (written
+aside, then renamed over the old one) and the journal is emptied.
+
+On startup, the snapshot is memory-mapped and decoded in place, then the
+journal is replayed over it. A record cut short by a crash ends the replay
+(and is cut off the journal). Restored states wait for their channel: when
+it is created again (first `JOIN`), it gets its topic, modes and invite list
+back (`restore()`). States not claimed within `STATE_RESTORE_WINDOW` seconds
+are left out of the next snapshot.
+
+Both files use the host's byte order; they are meant for restarting on the
+same machine, not for exchanging.
+*/
+class	StateLog
+{
+	public:
+		// What startup loaded (logged, and reported by `STATS c`)
+		struct	Stats
+		{
+			size_t			snapshotRecords;	// Channels read from the snapshot
+			size_t			journalRecords;		// Changes replayed from the journal
+			unsigned long	loadUs;				// Time spent loading both
+			unsigned long	journalWrites;		// Records appended since startup
+			unsigned long	snapshots;			// Snapshots written since startup
+		};
+
+		StateLog(const std::string& snapshotPath, const std::string& journalPath);
+		~StateLog();
+
+		bool			open(std::string& error);
+		void			close();
+		bool			writeSnapshot(bool dropUnclaimed, std::string& error);
+
+		void			save(const Channel& channel);
+		void			saveInvite(const Channel& channel, const std::string& nickLower);
+		void			saveMask(const Channel& channel, int list, const MaskEntry& entry, bool added);
+		void			drop(const std::string& channelKey);
+		bool			restore(Channel* channel);
+		void			claim(const Channel& channel);
+
+		bool			isOpen() const;
+		bool			hasChanges() const;
+		size_t			getChannelCount() const;
+		size_t			getUnclaimedCount() const;
+		const Stats&	getStats() const;
+
+		static void		encodeState(std::string& out, const ChannelState& state);
+		static bool		decodeState(BinaryReader& in, ChannelState& state);
+
+	private:
+		StateLog(const StateLog& other);
+		StateLog&	operator=(const StateLog& other);
+
+		enum	RecordType
+		{
+			RECORD_STATE = 1,	// Full state of a channel
+			RECORD_INVITE,		// One nickname added to an invite list
+			RECORD_DROP,		// Channel deleted
+			RECORD_MASK_ADD,	// One mask added to a ban, exception or invite-exception list
+			RECORD_MASK_REMOVE	// One mask removed from such a list
+		};
+
+		const std::string					_snapshotPath;
+		const std::string					_journalPath;
+		int									_journalFd;		// -1 while closed
+		size_t								_journalSize;	// Bytes of valid records in the journal
+		std::map<std::string, ChannelState>	_states;		// By normalized channel name
+		size_t								_unclaimed;		// Entries of `_states` no channel has claimed yet
+		Stats								_stats;
+
+		bool	loadFile(const std::string& path, bool isSnapshot, std::string& error);
+		void	append(const std::string& record);
+};
+
+#endif
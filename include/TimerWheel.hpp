@@ -0,0 +1,67 @@
+#ifndef TIMERWHEEL_HPP
+# define TIMERWHEEL_HPP
+
+# include <cstddef>	// size_t
+
+/**
+Hierarchical timer wheel (4 levels x 64 slots) with O(1) schedule and cancel.
+
+Timers are intrusive: the owner (e.g. a `User`) embeds a `Timer` node, so arming
+and disarming never allocates. Level 0 covers the next 64 ticks; timers further
+away sit in coarser levels and are cascaded down as the wheel turns.
+
+Expired timers are moved to an internal list and handed out one by one via
+`popExpired()`, so an expiry handler may safely cancel any other timer
+(including ones that already expired in the same tick).
+*/
+class	TimerWheel
+{
+	public:
+		struct	Timer
+		{
+			Timer();
+
+			bool			isArmed() const;
+
+			Timer*			prev;		// Intrusive list links (NULL if not armed)
+			Timer*			next;
+			unsigned long	expires;	// Absolute tick at which the timer fires
+			int				type;		// What to do on expiry, interpreted by the owner
+			int				fd;			// Connection the timer belongs to
+			void*			data;		// Owner object, for timers not tied to a connection
+		};
+
+		TimerWheel();
+		~TimerWheel();
+
+		void			schedule(Timer* timer, unsigned long delayMs);
+		void			cancel(Timer* timer);
+		void			advance(unsigned long nowMs);
+		Timer*			popExpired();
+		long			getTimeoutMs(unsigned long nowMs) const;
+		size_t			size() const;
+
+	private:
+		TimerWheel(const TimerWheel& other);
+		TimerWheel&	operator=(const TimerWheel& other);
+
+		static const int	LEVELS = 4;
+		static const int	SLOT_BITS = 6;
+		static const int	SLOTS = 1 << SLOT_BITS;
+		static const int	SLOT_MASK = SLOTS - 1;
+
+		Timer			_slots[LEVELS][SLOTS];	// Sentinel heads of the slot lists
+		Timer			_expired;				// Sentinel head of the expired list
+		unsigned long	_currentTick;			// Next tick to be processed
+		size_t			_count;					// Armed timers (incl. expired, not yet popped)
+
+		void			insert(Timer* timer);
+		void			cascade(int level);
+		void			processTick();
+		static void		initList(Timer* head);
+		static void		linkBefore(Timer* head, Timer* timer);
+		static void		unlink(Timer* timer);
+		static unsigned long	msToTick(unsigned long ms);
+};
+
+#endif
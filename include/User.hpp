@@ -2,19 +2,41 @@
 # define USER_HPP
 
 #include <set>
+#include <deque>
 #include <string>
 #include <vector>
 
+#include "TimerWheel.hpp"
+
 class	Server;
+class	ServerLink;
+class	PendingUser;
+class	ReplyArg;
+class	ReplyStream;
+struct	UserHandoff;
+
+// IRCv3 capabilities a client can enable with `CAP REQ` (bits of `User::getCaps()`)
+enum	Capability
+{
+	CAP_BATCH = 1,			// `BATCH` around history replays
+	CAP_SERVER_TIME = 2,	// `time` tag on replayed messages
+	CAP_MESSAGE_TAGS = 4	// Message tags in general (`msgid`)
+};
 
 class	User
 {
 	public:
 		User(int fd, Server* server);
+		User(int fd, Server* server, PendingUser& pending);
+		User(int fd, Server* server, UserHandoff& handoff);
+		User(Server* server, ServerLink* link, const std::string& serverName, const std::string& nickname,
+			const std::string& username, const std::string& host, const std::string& realname);
 		~User();
 
 		std::string			buildHostmask() const;
 		void				logUserAction(const std::string& message, bool botMode = false);
+		static void			writeLog(Server* server, const std::string& nick, int fd,
+								const std::string& message, bool botMode = false);
 
 		void				setNickname(const std::string& displayNick, const std::string& canonicalNick);
 		void				setUsername(const std::string& username);
@@ -23,10 +45,14 @@ class	User
 		void				setHost(const std::string& host);
 		void				markDisconnected();
 		void				setIsBotToTrue(void); // Bot
+		void				setCaps(unsigned char caps);
+		void				saveHandoff(UserHandoff& handoff);
 
 		int					getFd() const;
 		std::string&		getInputBuffer();
 		std::string&		getOutputBuffer();
+		bool				isDiscardingLine() const;
+		void				setDiscardingLine(bool discarding);
 		const std::string&	getNickname() const;
 		const std::string&  getNicknameLower() const;
 		const std::string&	getUsername() const;
@@ -34,6 +60,21 @@ class	User
 		const std::string&	getHost() const;
 		const Server*		getServer() const;
 		bool				getIsBot() const; // Bot
+		unsigned char		getCaps() const;		// `CAP_*` bits the client enabled
+		ServerLink*			getLink() const;		// Remote user: link they are reached through (NULL: local)
+		const std::string&	getServerName() const;	// Server the user is connected to
+
+		// Keepalive (PING/PONG)
+		TimerWheel::Timer&	getKeepaliveTimer();
+		void				setLastActivity(unsigned long nowMs);
+		unsigned long		getLastActivity() const;
+		void				setPingSentAt(unsigned long nowMs);
+		unsigned long		getPingSentAt() const;
+
+		// I/O threads (IO_THREADS)
+		void				setIoSerial(unsigned long serial);
+		unsigned long		getIoSerial() const;
+		bool				hasReplyStreams() const;
 
 		const std::set<std::string>&	getChannels() const;
 		void				addChannel(const std::string& channel);
@@ -42,9 +83,11 @@ class	User
 		// === UserMessaging.cpp ===
 
 		void				sendWelcome();
-		void				sendError(int code, const std::string& param, const std::string& message);
+		void				writeReply(int code, const char* format, const ReplyArg* const* args, int count);
 		void				sendServerMsg(const std::string& message);
 		void				sendMsgFromUser(const User* sender, const std::string& message);
+		void				queueReplyStream(ReplyStream* stream);
+		void				pumpReplyStreams();
 
 		// === UserRegistration.cpp ===
 
@@ -68,8 +111,12 @@ class	User
 		std::string					_host;			// rather obsolete, most clients use '*' -> use IP address obtained from socket
 
 		Server*						_server;		// Pointer to the server user is connected to (to use 'Server' methods)
+		ServerLink*					_link;			// Remote user: the link towards their server (NULL: local user)
+		std::string					_serverName;	// Remote user: the server they are connected to
 		std::string					_inputBuffer;	// buffer for incoming messages (client->server), accumulated until a full message is formed
 		std::string					_outputBuffer;	// buffer for outgoing messages (server->client), to be sent when socket is ready
+		bool						_discardingLine;	// dropping the rest of a line refused as too long (up to its newline)
+		std::deque<ReplyStream*>	_replyStreams;	// long replies still being generated into `_outputBuffer` (owned)
 		std::vector<std::string>	_opChannels;	// channels where this user has operator privileges
 		std::set<std::string>		_channels;		// channels where this user is in
 		bool						_hasNick;		// true if user has sent NICK command (got nickname)
@@ -78,6 +125,12 @@ class	User
 		bool						_isRegistered;	// true if user has sent NICK, USER commands to server
 
 		bool						_isBot; // true if user is IRCbot
+		unsigned char				_caps;	// `CAP_*` bits enabled with `CAP REQ`
+
+		TimerWheel::Timer			_keepaliveTimer;	// Fires when the user has been idle for too long
+		unsigned long				_lastActivity;		// Monotonic ms of the last data received from the user
+		unsigned long				_pingSentAt;		// Monotonic ms of the unanswered PING (0 if none)
+		unsigned long				_ioSerial;			// Socket served by an I/O thread under this serial (0 if not)
 };
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef UTF8_HPP
+# define UTF8_HPP
+
+# include <string>
+
+/**
+UTF-8 validation of message text (`UTF8_ONLY`, IRCv3 `UTF8ONLY`).
+
+`isValid()` checks 32 bytes at a time with AVX2 where the CPU has it (the
+lookup algorithm of Keiser and Lemire: three table lookups on the nibbles of
+each byte and the one before it find every invalid pair of bytes, and two
+saturating subtractions find missing continuation bytes), or with a scalar
+loop that skips ASCII 8 bytes at a time. ASCII blocks take one test either
+way. `repair()` replaces what is invalid with U+FFFD.
+*/
+class	Utf8
+{
+	public:
+		static bool			isValid(const std::string& text);
+		static size_t		repair(std::string& text);
+
+		static const char*	getKernelName();
+		static bool			useKernel(const std::string& name);
+
+	private:
+		// Pure utility class, no need for instantiation
+		Utf8();
+		Utf8(const Utf8& other);
+		Utf8&	operator=(const Utf8& other);
+};
+
+#endif
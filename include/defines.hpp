@@ -7,18 +7,81 @@
 
 # define LOG_RAW_CMDS		0	// '1': Commands as sent by users are logged; '0': not logged --> Good for Debugging!
 
+# define MOTD_FILE			"./ircserv.motd"	// Message of the day, (re)loaded on startup and SIGHUP
+
 # define BOT_NAME			"IRCbot"
 # define BOT_COLOR			"\033[38;5;214m"	// Orange color for bot messages
 # define BOT_SILENT_NOTE	1	// '1': No logging of bot NOTICE messages; '0': log them; helps to avoid cluttering the log
+# define BOT_WORKERS		2	// Worker threads running bot commands off the event loop
+# define BOT_MAX_JOBS		2	// Bot commands a single user may have running at once
+# define BOT_JOB_TIMEOUT	5	// Seconds until a running bot command is answered with a timeout
+# define BOT_PLUGIN_DIR		"./plugins"	// Bot plugin modules (*.so), (re)loaded on startup and SIGHUP
 
 # define MAX_CHANNELS		10		// Max channels per user; recommended in RFC 1459, 1.3
-# define C_MODES			"itkol"	// Supported channel modes, as per subject
+# define C_MODES			"itkolbeI"	// Supported channel modes: the subject's, plus ban, exception and invite-exception lists
+# define MAX_CHANNEL_LIST	200		// Max masks per ban, exception or invite-exception list of a channel (ISUPPORT MAXLIST)
 # define U_MODES			"-"		// No user modes implemented
+# define CASEMAPPING		"rfc1459"	// How names compare: "rfc1459" ([]\^ = {}|~), "strict-rfc1459" ([]\ = {}|) or "ascii"
+
+# define TIMER_TICK_MS		100		// Resolution of the server's timer wheel
+# define PING_INTERVAL		120		// Seconds of silence before the server sends a PING
+# define PING_TIMEOUT		60		// Seconds a user has to answer a PING before being disconnected
+
+# define REGISTRATION_TIMEOUT	30	// Seconds a connection may take to complete PASS/NICK/USER
+# define PARTIAL_LINE_TIMEOUT	10	// Seconds an unregistered connection may sit on an unterminated line
+# define MAX_UNREG_PER_HOST	8		// Max unregistered connections per source IP
+# define MAX_UNREG_TOTAL	512		// Max unregistered connections server-wide
+
+# define IO_THREADS			0	// Threads owning registered users' sockets (recv, framing, parsing, send); '0': all in the event loop
+# define IO_READ_SIZE		4096	// Max bytes an I/O thread reads from a user at once
+
+# define FANOUT_THREADS		2	// Threads helping the event loop broadcast to very large channels; '0': none
+# define FANOUT_THRESHOLD	4096	// Members a channel needs before its broadcasts are split among the fanout threads
+# define FANOUT_CHUNK		256	// Members a fanout thread takes at once (from its own range, or stolen)
+
+# define UTF8_ONLY			1	// '1': PRIVMSG, NOTICE and TOPIC text must be valid UTF-8 (ISUPPORT UTF8ONLY); '0': any bytes
+# define UTF8_REPLACE		0	// '1': invalid UTF-8 is replaced with U+FFFD; '0': the command is refused (FAIL ... INVALID_UTF8)
+
+# define SENDQ_WATERMARK	16384	// Long replies (NAMES of big channels) are generated while a user's output buffer is below this
+
+# define HISTORY_MAX_BYTES		4194304	// Memory for channel history (CHATHISTORY), all channels together
+# define HISTORY_CHANNEL_BYTES	262144	// Memory for the history of a single channel, 0 = no history
+# define HISTORY_MAX_REPLAY		100		// Max messages a single CHATHISTORY or SEARCH request returns
+# define HISTORY_INDEX			1		// '1': Channel history is indexed by word for SEARCH; '0': no index, SEARCH is disabled
+
+# define STATE_PERSIST			1					// '1': Channel topics, modes and invite lists survive a restart; '0': not saved
+# define STATE_SNAPSHOT_FILE	"./ircserv.state"	// Snapshot of all channel states
+# define STATE_JOURNAL_FILE		"./ircserv.journal"	// Channel state changes since the snapshot
+# define STATE_SNAPSHOT_INTERVAL	300				// Seconds between snapshots (the journal is emptied by each)
+# define STATE_RESTORE_WINDOW	3600				// Seconds after startup a saved channel state waits to be claimed by a JOIN
+
+# define UPGRADE_TIMEOUT		10		// Seconds the new binary has to take over on a hot upgrade (SIGUSR2) before it is killed
+
+# define REPLICATION				1						// '1': A hot standby (`--standby`) can follow this server; '0': no replication
+# define REPLICATION_SOCKET			"./ircserv.replica"		// Unix socket the standby connects to
+# define REPLICATION_MAX_BACKLOG	(16 * 1024 * 1024)		// Bytes queued for a standby that falls behind before it is dropped
+
+# define LINK_RETRY			10					// Seconds between attempts to connect a `--link` target
+# define LINK_SENDQ			(16 * 1024 * 1024)	// Bytes queued for a linked server that falls behind before the link is dropped
+# define LINK_READ_SIZE		65536				// Max bytes read from a server link at once
+# define LINK_LOCAL			1					// '1': Links to servers on this host (loopback) use shared memory rings; '0': TCP only
+# define LINK_LOCAL_SOCKET	"ircserv-link-"		// Abstract Unix socket (+ client port) where a server takes rings from local peers
+# define LINK_RING_SIZE		(1024 * 1024)		// Bytes of shared memory per direction of a local link (a power of 2)
+
+# define DCC_RELAY			0		// '1': DCC SEND offers are relayed through the server (for clients behind NAT); '0': direct
+# define DCC_MAX_TRANSFERS	8		// Max DCC relays running at once; further offers are forwarded for a direct transfer
+# define DCC_RATE_LIMIT		1048576	// Bytes per second per relayed transfer, 0 = unlimited
+# define DCC_ACCEPT_TIMEOUT	60		// Seconds the recipient has to connect to the relay
+# define DCC_IDLE_TIMEOUT	60		// Seconds a relay may go without moving a byte
+# define DCC_CHUNK_SIZE		65536	// Max bytes moved per read/write (the size of a pipe on Linux)
 
 // Below is all according to RFC 1459:
 
+# define MAX_LINE_LENGTH	512		// Max length of a line the server sends, incl. "\r\n" (RFC 1459, 2.3)
+# define ISUPPORT_PER_LINE	13		// Max tokens per RPL_ISUPPORT (005) line (not in RFC 1459, but in use since)
 # define MAX_BUFFER_SIZE	512		// You can send longer messages, 'recv' just reads in 512-byte chunks.
 # define MAX_NICK_LENGTH	9		// according to RFC 1459, 1.2
+# define MAX_USER_LENGTH	10		// Longer usernames are cut (USERLEN, as on most networks)
 # define MAX_CHANNEL_LENGTH	24		// according to RFC 1459, 1.3 that's max. 200; but we can use less
 
 # define RED				"\033[31m"			// used for errors / invalid input
@@ -0,0 +1,25 @@
+#ifndef PLATFORM_HPP
+# define PLATFORM_HPP
+
+# include <sys/socket.h>	// MSG_NOSIGNAL, SO_NOSIGPIPE, setsockopt()
+
+/*
+What differs between the systems the server builds on (Linux and macOS).
+*/
+
+# ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL	0	// macOS: no such flag, the socket gets SO_NOSIGPIPE instead (see `noSigPipe()`)
+# endif
+
+// Keeps writes to `fd` from raising SIGPIPE once the peer is gone, where `MSG_NOSIGNAL` does not exist.
+inline void	noSigPipe(int fd)
+{
+# ifdef SO_NOSIGPIPE
+	int	on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+# else
+	(void)fd;
+# endif
+}
+
+#endif
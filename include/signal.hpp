@@ -1,10 +1,14 @@
 #ifndef SIGNALS_HPP
 # define SIGNALS_HPP
 
-# include <csignal>	// for sig_atomic_t, SIGINT, SIG_ERR
+# include <csignal>	// for sig_atomic_t, SIGINT, SIGHUP, SIGUSR2, SIGPIPE, SIG_ERR
 
 // Global variable to control server running state (used in signal handler)
 extern volatile sig_atomic_t	g_running;
+// Set by SIGHUP, cleared by the main loop once it has reloaded
+extern volatile sig_atomic_t	g_reload;
+// Set by SIGUSR2, cleared by the main loop once it has tried a hot upgrade
+extern volatile sig_atomic_t	g_upgrade;
 
 void	setupSignalHandler();
 
@@ -3,14 +3,21 @@
 
 # include <sstream>	// std::ostringstream
 # include <string>	// std::string
+# include <vector>	// std::vector
 
 int			parsePort(const char* arg);
 std::string	getFormattedTime();
 std::string	getTimestamp();
+unsigned long	getMonotonicMs();
+unsigned long	getMonotonicUs();
 bool		isValidNick(const std::string& nick);
 bool		isValidChannelName(const std::string& channelName);
+bool		isValidServerName(const std::string& serverName);
 std::string	normalize(const std::string& name);
+bool		matchMask(const std::string& mask, const std::string& str);
 std::string	removeColorCodes(const std::string& str);
+bool		sendFds(int sock, const int* fds, size_t count);
+bool		receiveFds(int sock, std::vector<int>& fds, size_t count);
 
 // Converts any type to a `std::string` using stringstream
 template <typename T>
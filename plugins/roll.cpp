@@ -0,0 +1,76 @@
+#include <cstdio>		// snprintf()
+#include <cstdlib>		// strtol()
+#include <ctime>		// clock_gettime()
+
+#include "../include/BotPlugin.hpp"
+
+/**
+Sample bot plugin: `ROLL [<n>d<sides>]` rolls dice (default `1d6`).
+
+Build with `make plugins`, then send `ROLL 2d20` (or `PRIVMSG IRCbot :roll 2d20`).
+Edit, rebuild and `kill -HUP` the server to reload it without disconnecting anyone.
+*/
+
+# define MAX_DICE	20
+# define MAX_SIDES	1000
+
+// Small xorshift generator with per-call state, so concurrent workers never share it
+static unsigned int	nextRandom(unsigned int& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static int	roll(const char* args, char* out, size_t outSize)
+{
+	long	dice = 1;
+	long	sides = 6;
+	char*	end;
+
+	while (*args == ' ')
+		++args;
+	if (*args)
+	{
+		dice = strtol(args, &end, 10);
+		if (end == args || (*end != 'd' && *end != 'D'))
+			return 1;
+		args = end + 1;
+		sides = strtol(args, &end, 10);
+		if (end == args || *end != '\0')
+			return 1;
+	}
+	if (dice < 1 || dice > MAX_DICE || sides < 2 || sides > MAX_SIDES)
+	{
+		snprintf(out, outSize, "I only roll 1-%d dice with 2-%d sides.", MAX_DICE, MAX_SIDES);
+		return 1;
+	}
+
+	struct timespec	ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	unsigned int	state = static_cast<unsigned int>(ts.tv_nsec ^ ts.tv_sec) | 1;
+	long			total = 0;
+	int				len = snprintf(out, outSize, "You rolled %ldd%ld:", dice, sides);
+
+	for (long i = 0; i < dice; ++i)
+	{
+		long	value = nextRandom(state) % sides + 1;
+		total += value;
+		if (len > 0 && static_cast<size_t>(len) < outSize)
+			len += snprintf(out + len, outSize - len, " %ld", value);
+	}
+	if (len > 0 && static_cast<size_t>(len) < outSize)
+		snprintf(out + len, outSize - len, " (total %ld)", total);
+	return 0;
+}
+
+static const BotPluginVerb	verbs[] =
+{
+	{ "ROLL", "ROLL [<n>d<sides>] (e.g. 'roll 2d20')", roll }
+};
+
+extern "C" const BotPlugin	ircserv_bot_plugin =
+{
+	BOT_PLUGIN_ABI, "dice", verbs, sizeof(verbs) / sizeof(verbs[0])
+};
@@ -0,0 +1,75 @@
+#include <string>
+#include <cstring>	// memcpy()
+
+#include "../include/Binary.hpp"
+
+void	putU8(std::string& out, unsigned char value)
+{
+	out += static_cast<char>(value);
+}
+
+void	putU32(std::string& out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void	putU64(std::string& out, uint64_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void	putI64(std::string& out, int64_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void	putString(std::string& out, const std::string& value)
+{
+	putU32(out, static_cast<uint32_t>(value.size()));
+	out.append(value);
+}
+
+BinaryReader::BinaryReader(const char* first, const char* last)
+	:	pos(first), end(last), ok(true)
+{}
+
+// Copies the next `size` bytes to `dest`.
+bool	BinaryReader::take(void* dest, size_t size)
+{
+	if (!ok || static_cast<size_t>(end - pos) < size)
+		return ok = false;
+	memcpy(dest, pos, size);
+	pos += size;
+	return true;
+}
+
+bool	BinaryReader::takeU8(unsigned char& value)
+{
+	return take(&value, sizeof(value));
+}
+
+bool	BinaryReader::takeU32(uint32_t& value)
+{
+	return take(&value, sizeof(value));
+}
+
+bool	BinaryReader::takeU64(uint64_t& value)
+{
+	return take(&value, sizeof(value));
+}
+
+bool	BinaryReader::takeI64(int64_t& value)
+{
+	return take(&value, sizeof(value));
+}
+
+bool	BinaryReader::takeString(std::string& value)
+{
+	uint32_t	size;
+
+	if (!takeU32(size) || static_cast<size_t>(end - pos) < size)
+		return ok = false;
+	value.assign(pos, size);
+	pos += size;
+	return true;
+}
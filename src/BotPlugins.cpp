@@ -0,0 +1,260 @@
+#include <string>
+#include <cstring>		// strerror(), strlen()
+#include <cerrno>		// errno
+#include <cstdio>		// snprintf()
+
+#include <dirent.h>		// opendir(), readdir(), closedir()
+#include <dlfcn.h>		// dlopen(), dlsym(), dlclose(), dlerror()
+#include <fcntl.h>		// open(), fcntl()
+#include <unistd.h>		// read(), write(), close(), unlink()
+#include <cstdlib>		// mkstemp()
+#ifdef LINUX_OS
+# include <sys/mman.h>	// memfd_create()
+#endif
+
+#include "../include/BotPlugins.hpp"
+#include "../include/Server.hpp"
+#include "../include/defines.hpp"	// BOT_PLUGIN_DIR, color formatting
+#include "../include/utils.hpp"		// toString(), getMonotonicUs()
+
+BotPlugins::BotPlugins(Server* server) : _server(server) {}
+
+BotPlugins::~BotPlugins()
+{
+	unloadAll();
+}
+
+/**
+Copies a file into a private one (used to give every loaded module its own
+path, see `BotPlugins`): a memfd on Linux, elsewhere a temporary file that
+`loadModule()` unlinks once it is opened.
+
+ @param path	Set to the path of the copy, for `dlopen()`.
+ @return		The copy, or -1 if the copy failed (`errno` is set).
+*/
+static int	copyPlugin(const std::string& from, std::string& path)
+{
+	char	buffer[16384];
+	ssize_t	bytesRead;
+	int		in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+	int		out;
+
+	if (in == -1)
+		return -1;
+#ifdef LINUX_OS
+	out = memfd_create(from.substr(from.rfind('/') + 1).c_str(), MFD_CLOEXEC);
+	if (out != -1)
+		path = "/proc/self/fd/" + toString(out);
+#else
+	char	tempPath[] = "/tmp/ircserv-plugin-XXXXXX";
+	out = mkstemp(tempPath);
+	if (out != -1)
+	{
+		fcntl(out, F_SETFD, FD_CLOEXEC);
+		path = tempPath;
+	}
+#endif
+	if (out == -1)
+	{
+		close(in);
+		return -1;
+	}
+	while ((bytesRead = read(in, buffer, sizeof(buffer))) > 0)
+	{
+		if (write(out, buffer, bytesRead) != bytesRead)
+		{
+			bytesRead = -1;
+			break;
+		}
+	}
+	int	savedErrno = errno;
+	close(in);
+	if (bytesRead != 0)
+	{
+		close(out);
+#ifndef LINUX_OS
+		unlink(path.c_str());
+#endif
+		errno = savedErrno;
+		return -1;
+	}
+	return out;
+}
+
+/**
+(Re)loads all plugins from `BOT_PLUGIN_DIR`.
+
+Current modules are retired (closed right away unless jobs still run their
+code), then every `*.so` in the directory is loaded. Users stay connected;
+commands sent during the reload are simply handled by the new modules.
+The time the reload took is logged.
+*/
+void	BotPlugins::reload()
+{
+	unsigned long	startUs = getMonotonicUs();
+
+	for (size_t i = 0; i < _modules.size(); ++i)
+	{
+		_modules[i]->retired = true;
+		if (_modules[i]->refs == 0)
+			closeModule(_modules[i]);
+		else
+			_retired.push_back(_modules[i]);
+	}
+	_modules.clear();
+	_verbs.clear();
+
+	DIR*	dir = opendir(BOT_PLUGIN_DIR);
+	if (dir)
+	{
+		struct dirent*	entry;
+		while ((entry = readdir(dir)) != NULL)
+		{
+			std::string	name = entry->d_name;
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, ".so") == 0)
+				loadModule(toString(BOT_PLUGIN_DIR) + "/" + name);
+		}
+		closedir(dir);
+	}
+
+	unsigned long	elapsedUs = getMonotonicUs() - startUs;
+	char			elapsed[32];
+	snprintf(elapsed, sizeof(elapsed), "%lu.%03lu ms", elapsedUs / 1000, elapsedUs % 1000);
+	_server->logServerMessage(toString("Bot plugins loaded: ") + YELLOW + toString(_modules.size())
+		+ RESET + " modules, " + YELLOW + toString(_verbs.size()) + RESET + " verbs in " + YELLOW
+		+ elapsed + RESET + (_retired.empty() ? "" : " (" + toString(_retired.size()) + " old modules still busy)"));
+}
+
+/**
+Loads one plugin module and registers its verbs.
+Verbs that are already taken (by an earlier module) are skipped.
+*/
+bool	BotPlugins::loadModule(const std::string& path)
+{
+	std::string	copyPath;
+	int			memFd = copyPlugin(path, copyPath);
+
+	if (memFd == -1)
+	{
+		_server->logServerMessage(RED + toString("ERROR: Cannot copy bot plugin ") + path + ": "
+			+ strerror(errno) + RESET);
+		return false;
+	}
+
+	void*	handle = dlopen(copyPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+#ifndef LINUX_OS
+	unlink(copyPath.c_str()); // The mapping and the open copy keep it alive
+#endif
+	if (!handle)
+	{
+		_server->logServerMessage(RED + toString("ERROR: Cannot load bot plugin ") + path + ": "
+			+ dlerror() + RESET);
+		close(memFd);
+		return false;
+	}
+
+	const BotPlugin*	plugin = static_cast<const BotPlugin*>(dlsym(handle, BOT_PLUGIN_SYMBOL));
+	if (!plugin || plugin->abi != BOT_PLUGIN_ABI)
+	{
+		_server->logServerMessage(RED + toString("ERROR: ") + path + " is not a bot plugin (ABI "
+			+ toString(BOT_PLUGIN_ABI) + ")" + RESET);
+		dlclose(handle);
+		close(memFd);
+		return false;
+	}
+
+	Module*	module = new Module();
+	module->handle = handle;
+	module->memFd = memFd;
+	module->plugin = plugin;
+	module->refs = 0;
+	module->retired = false;
+	for (size_t i = 0; i < plugin->verbCount; ++i)
+	{
+		const BotPluginVerb&	verb = plugin->verbs[i];
+		if (!verb.name || !verb.run || _verbs.count(verb.name))
+		{
+			_server->logServerMessage(YELLOW + toString("WARNING: Bot plugin ") + plugin->name
+				+ ": skipping verb " + (verb.name ? verb.name : "(unnamed)") + RESET);
+			continue;
+		}
+		Binding	binding = { module, &verb };
+		module->bindings.push_back(binding);
+	}
+	for (size_t i = 0; i < module->bindings.size(); ++i)
+		_verbs[module->bindings[i].verb->name] = &module->bindings[i];
+
+	_modules.push_back(module);
+	_server->logServerMessage(toString("Bot plugin ") + BOT_COLOR + plugin->name + RESET + " loaded ("
+		+ toString(module->bindings.size()) + " verbs)");
+	return true;
+}
+
+// Closes a module's shared object and frees it.
+void	BotPlugins::closeModule(Module* module)
+{
+	dlclose(module->handle);
+	close(module->memFd);
+	delete module;
+}
+
+// Closes all modules, busy or not (server shutdown, after the bot workers were stopped).
+void	BotPlugins::unloadAll()
+{
+	for (size_t i = 0; i < _modules.size(); ++i)
+		closeModule(_modules[i]);
+	for (size_t i = 0; i < _retired.size(); ++i)
+		closeModule(_retired[i]);
+	_modules.clear();
+	_retired.clear();
+	_verbs.clear();
+}
+
+/**
+Looks up a verb of the current modules.
+
+ @param verb	The command name, upper case.
+ @return		The verb's binding, or `NULL` if no plugin provides it.
+*/
+const BotPlugins::Binding*	BotPlugins::find(const std::string& verb) const
+{
+	std::map<std::string, Binding*>::const_iterator	it = _verbs.find(verb);
+	if (it == _verbs.end())
+		return NULL;
+	return it->second;
+}
+
+// Marks the binding's module as used by a job (reactor thread only).
+void	BotPlugins::acquire(const Binding* binding)
+{
+	++binding->module->refs;
+}
+
+// A job using the binding's module has finished; closes retired modules that became idle.
+void	BotPlugins::release(const Binding* binding)
+{
+	Module*	module = binding->module;
+
+	if (--module->refs > 0 || !module->retired)
+		return;
+
+	for (size_t i = 0; i < _retired.size(); ++i)
+	{
+		if (_retired[i] == module)
+		{
+			_retired.erase(_retired.begin() + i);
+			break;
+		}
+	}
+	closeModule(module);
+}
+
+size_t	BotPlugins::getModuleCount() const
+{
+	return _modules.size();
+}
+
+size_t	BotPlugins::getVerbCount() const
+{
+	return _verbs.size();
+}
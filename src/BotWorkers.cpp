@@ -0,0 +1,206 @@
+#include <string>
+#include <csignal>		// sigset_t, sigfillset()
+
+#include <unistd.h>		// pipe(), read(), write(), close()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK
+#include <pthread.h>
+
+#include "../include/BotWorkers.hpp"
+
+/////////
+// Job //
+/////////
+
+BotWorkers::Job::Job()
+	:	next(NULL), fd(-1), func(NULL), context(NULL), timedOut(false)
+{}
+
+////////////////
+// BotWorkers //
+////////////////
+
+BotWorkers::BotWorkers() : _stopping(false), _completed(NULL)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_cond, NULL);
+	_wakePipe[0] = -1;
+	_wakePipe[1] = -1;
+}
+
+BotWorkers::~BotWorkers()
+{
+	stop();
+	pthread_cond_destroy(&_cond);
+	pthread_mutex_destroy(&_mutex);
+}
+
+/**
+Creates the self-pipe and starts the worker threads.
+
+Workers are started with all signals blocked, so `SIGINT` keeps
+interrupting the reactor's `select()` in the main thread.
+
+ @param threads	Number of worker threads.
+ @return		`false` if the pipe or any thread could not be created
+				(the pool is stopped again in that case).
+*/
+bool	BotWorkers::start(int threads)
+{
+	sigset_t	all;
+	sigset_t	old;
+
+	_stopping = false;
+	if (pipe(_wakePipe) == -1)
+		return false;
+	fcntl(_wakePipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(_wakePipe[1], F_SETFL, O_NONBLOCK);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (int i = 0; i < threads; ++i)
+	{
+		pthread_t	thread;
+		if (pthread_create(&thread, NULL, workerMain, this) != 0)
+			break;
+		_threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (static_cast<int>(_threads.size()) != threads)
+	{
+		stop();
+		return false;
+	}
+	return true;
+}
+
+/**
+Stops and joins all workers. Jobs still queued are not run; all jobs
+(queued or completed) remain owned by whoever submitted them.
+*/
+void	BotWorkers::stop()
+{
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	_queue.clear();
+	pthread_cond_broadcast(&_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	for (size_t i = 0; i < _threads.size(); ++i)
+		pthread_join(_threads[i], NULL);
+	_threads.clear();
+
+	for (int i = 0; i < 2; ++i)
+	{
+		if (_wakePipe[i] != -1)
+			close(_wakePipe[i]);
+		_wakePipe[i] = -1;
+	}
+}
+
+// True while worker threads are running.
+bool	BotWorkers::isRunning() const
+{
+	return !_threads.empty();
+}
+
+// Queues a job for the next idle worker (reactor thread only).
+void	BotWorkers::submit(Job* job)
+{
+	pthread_mutex_lock(&_mutex);
+	_queue.push_back(job);
+	pthread_cond_signal(&_cond);
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+Detaches all finished jobs from the completion stack (reactor thread only).
+
+The wake-up pipe is drained first: a job pushed after that point either
+is part of the detached list or finds the stack empty and writes a new
+wake-up byte, so no completion is ever missed.
+
+ @return	Finished jobs in completion order, linked through `next`
+			(`NULL` if there are none).
+*/
+BotWorkers::Job*	BotWorkers::takeCompleted()
+{
+	char	drain[64];
+	Job*	head;
+	Job*	ordered = NULL;
+
+	while (read(_wakePipe[0], drain, sizeof(drain)) > 0)
+		; // Just emptying the pipe
+
+	do
+		head = _completed;
+	while (!__sync_bool_compare_and_swap(&_completed, head, static_cast<Job*>(NULL)));
+
+	// The stack is LIFO; reverse it so replies go out in completion order
+	while (head)
+	{
+		Job*	next = head->next;
+		head->next = ordered;
+		ordered = head;
+		head = next;
+	}
+	return ordered;
+}
+
+// Returns the read end of the self-pipe (readable when jobs have completed).
+int	BotWorkers::getWakeFd() const
+{
+	return _wakePipe[0];
+}
+
+// Thread entry point.
+void*	BotWorkers::workerMain(void* arg)
+{
+	static_cast<BotWorkers*>(arg)->workerLoop();
+	return NULL;
+}
+
+// Takes jobs off the queue and runs them until the pool is stopped.
+void	BotWorkers::workerLoop()
+{
+	for (;;)
+	{
+		pthread_mutex_lock(&_mutex);
+		while (_queue.empty() && !_stopping)
+			pthread_cond_wait(&_cond, &_mutex);
+		if (_stopping)
+		{
+			pthread_mutex_unlock(&_mutex);
+			return;
+		}
+		Job*	job = _queue.front();
+		_queue.pop_front();
+		pthread_mutex_unlock(&_mutex);
+
+		job->result = job->func(job->input, job->context);
+		complete(job);
+	}
+}
+
+/**
+Pushes a finished job onto the completion stack (any worker thread) and
+wakes the reactor if the stack was empty; otherwise a wake-up is already pending.
+*/
+void	BotWorkers::complete(Job* job)
+{
+	Job*	head;
+
+	do
+	{
+		head = _completed;
+		job->next = head;
+	}
+	while (!__sync_bool_compare_and_swap(&_completed, head, job));
+
+	if (head == NULL)
+	{
+		char	byte = 1;
+		if (write(_wakePipe[1], &byte, 1) == -1)
+			return; // Pipe full: the reactor has a wake-up pending anyway
+	}
+}
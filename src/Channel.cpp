@@ -1,5 +1,9 @@
 #include "../include/Channel.hpp"
 #include "../include/User.hpp"		// for User* in get_mode_string()
+#include "../include/StateLog.hpp"	// journal of topic, mode and invite changes
+#include "../include/ReplicationStream.hpp"	// changes streamed to a hot standby
+#include "../include/IrcChars.hpp"	// IrcChars::equal()
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/utils.hpp"		// toString
 #include "../include/defines.hpp"	// MAX_CHANNELS
 
@@ -9,12 +13,17 @@
 // Constructor: Initializes the channel with a name and default values.
 Channel::Channel(std::string name)
 	:	_channel_name(name), _channel_name_lower(normalize(name)),
-		_channel_topic_set_at(0), _user_limit(0), _invite_only(false),
-		_topic_protection(false)
+		_channel_topic_set_at(0), _channel_created_at(time(NULL)), _user_limit(0), _invite_only(false),
+		_topic_protection(false), _masks_version(1), _state_log(NULL), _replication(NULL), _fanout(NULL), _version(1), _names_reply(new ReplyBurst()),
+		_names_version(0), _modes_version(0), _recipients_version(0)
 {}
 
-// Default destructor
-Channel::~Channel() {}
+// Destructor: drops the channel's reference on the cached names reply
+// (streams still sending it keep their own).
+Channel::~Channel()
+{
+	ReplyBurst::release(_names_reply);
+}
 
 // Adds a user to the channel.
 void	Channel::add_user(User *user)
@@ -23,7 +32,13 @@ void	Channel::add_user(User *user)
 		return;
 
 	const std::string	nick_lower = user->getNicknameLower();
-	_channel_members_by_nickname.insert(std::make_pair(nick_lower, user));
+	if (!_channel_members_by_nickname.insert(std::make_pair(nick_lower, user)).second)
+		return;
+	touch();
+	if (user->getLink())
+		++_channel_links[user->getLink()];
+	else if (_replication)
+		_replication->join(*this, nick_lower);
 }
 
 // Removes a user from the channel.
@@ -33,8 +48,42 @@ void	Channel::remove_user(User* user)
 		return;
 
 	const std::string	nick_lower = user->getNicknameLower();
-	_channel_members_by_nickname.erase(nick_lower);
+	if (_channel_members_by_nickname.erase(nick_lower))
+	{
+		touch();
+		std::map<ServerLink*, int>::iterator	it = _channel_links.find(user->getLink());
+		if (it != _channel_links.end() && --it->second == 0)
+			_channel_links.erase(it);
+		else if (!user->getLink() && _replication)
+			_replication->part(*this, nick_lower);
+	}
 	_channel_operators_by_nickname.erase(nick_lower);
+	forget_ban_verdict(user);
+}
+
+/**
+Moves a member that changed their nickname to the new key
+(members and operators are keyed by the lowercase nickname).
+
+ @param user			The member, already carrying the new nickname.
+ @param old_nick_lower	The member's previous lowercase nickname.
+*/
+void	Channel::rename_user(User* user, const std::string& old_nick_lower)
+{
+	if (!user || _channel_members_by_nickname.erase(old_nick_lower) == 0)
+		return;
+
+	const std::string	nick_lower = user->getNicknameLower();
+	_channel_members_by_nickname[nick_lower] = user;
+	if (_channel_operators_by_nickname.erase(old_nick_lower))
+		_channel_operators_by_nickname[nick_lower] = user;
+	bool	invited = _channel_invitation_list.erase(old_nick_lower);
+	if (invited)
+		_channel_invitation_list.insert(nick_lower);
+	forget_ban_verdict(user); // Bans may name the nickname
+	touch();
+	if (invited)
+		journal();
 }
 
 // Grants operator status to the given user.
@@ -44,7 +93,11 @@ void	Channel::make_user_operator(User* user)
 		return;
 
 	const std::string	nick_lower = user->getNicknameLower();
-	_channel_operators_by_nickname.insert(std::make_pair(nick_lower, user));
+	if (!_channel_operators_by_nickname.insert(std::make_pair(nick_lower, user)).second)
+		return;
+	touch();
+	if (_replication && !user->getLink())
+		_replication->setOperator(*this, nick_lower, true);
 }
 
 // Revokes operator status from the given user.
@@ -54,7 +107,11 @@ void	Channel::remove_user_operator_status(User* user)
 		return;
 
 	std::string	nick_lower = user->getNicknameLower();
-	_channel_operators_by_nickname.erase(nick_lower);
+	if (!_channel_operators_by_nickname.erase(nick_lower))
+		return;
+	touch();
+	if (_replication && !user->getLink())
+		_replication->setOperator(*this, nick_lower, false);
 }
 
 // Checks whether the given user is a channel member.
@@ -86,7 +143,13 @@ bool	Channel::can_user_join(User* user, const std::string &provided_key,
 		return false;
 
 	std::string	nick_lower = user->getNicknameLower();
+	std::string	hostmask = user->buildHostmask();
 
+	if (match_ban(hostmask))
+	{
+		result = JOIN_BANNED;
+		return false;
+	}
 	if (has_user_limit() && is_at_user_limit())
 	{
 		result = JOIN_FULL;
@@ -97,7 +160,7 @@ bool	Channel::can_user_join(User* user, const std::string &provided_key,
 		result = JOIN_BAD_KEY;
 		return false;
 	}
-	if (is_invite_only() && !is_invited(nick_lower))
+	if (is_invite_only() && !is_invited(nick_lower) && !_mask_sets[INVEX_LIST].matches(hostmask))
 	{
 		result = JOIN_INVITE_ONLY;
 		return false;
@@ -114,6 +177,8 @@ bool	Channel::can_user_join(User* user, const std::string &provided_key,
 void	Channel::set_topic_protection(bool enable)
 {
 	_topic_protection = enable;
+	touch();
+	journal();
 }
 
 // Returns true if topic protection is enabled.
@@ -122,12 +187,14 @@ bool	Channel::has_topic_protection() const
 	return _topic_protection;
 }
 
-// Sets the topic of the channel.
-void	Channel::set_topic(const std::string &topic, const std::string& set_by)
+// Sets the topic of the channel (`set_at`: when, if not now; topics learned from linked servers keep their time).
+void	Channel::set_topic(const std::string &topic, const std::string& set_by, time_t set_at)
 {
 	_channel_topic = topic;
 	_channel_topic_set_by = set_by;
-	_channel_topic_set_at = time(NULL);
+	_channel_topic_set_at = set_at ? set_at : time(NULL);
+	touch();
+	journal();
 }
 
 // Retrieves the current channel topic.
@@ -143,6 +210,25 @@ std::string	Channel::get_topic_set_info() const
 	return _channel_topic_set_by + " " + toString(_channel_topic_set_at);
 }
 
+// Returns when the topic was last set (0 if never).
+time_t	Channel::get_topic_time() const
+{
+	return _channel_topic_set_at;
+}
+
+// Returns when the channel was created.
+time_t	Channel::get_creation_time() const
+{
+	return _channel_created_at;
+}
+
+// Sets the channel creation time (a channel taken over by a hot upgrade keeps its own).
+void	Channel::set_creation_time(time_t created_at)
+{
+	_channel_created_at = created_at;
+	touch();
+}
+
 // Returns true if a user limit is set.
 bool	Channel::has_user_limit() const
 {
@@ -159,6 +245,8 @@ bool	Channel::is_at_user_limit() const
 void	Channel::set_user_limit(const int new_limit)
 {
 	_user_limit = new_limit;
+	touch();
+	journal();
 }
 
 // Gets the current user limit.
@@ -171,6 +259,8 @@ int	Channel::get_user_limit() const
 void	Channel::set_invite_only(bool enable)
 {
 	_invite_only = enable;
+	touch();
+	journal();
 }
 
 // Returns true if the channel is invite-only.
@@ -190,7 +280,109 @@ bool	Channel::is_invited(const std::string& user_nick) const
 void	Channel::add_invite(const std::string& user_nick)
 {
 	std::string	nick_lower = normalize(user_nick);
-	_channel_invitation_list.insert(nick_lower);
+	if (!_channel_invitation_list.insert(nick_lower).second)
+		return;
+	if (_state_log)
+		_state_log->saveInvite(*this, nick_lower);
+	if (_replication)
+		_replication->saveChannel(*this);
+}
+
+/**
+Adds a mask to the ban, exception or invite-exception list.
+
+ @param mask	A complete `nick!user@host` mask (see `MaskSet::complete()`).
+ @param set_by	Who set it (shown in the list replies).
+ @param set_at	When, if not now.
+ @return		`false` if the list already has it (as folded).
+*/
+bool	Channel::add_mask(MaskList list, const std::string& mask, const std::string& set_by, time_t set_at)
+{
+	std::vector<MaskEntry>&	entries = _mask_lists[list];
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (IrcChars::equal(entries[i].mask, mask))
+			return false;
+	}
+
+	MaskEntry	entry;
+	entry.mask = mask;
+	entry.setBy = set_by;
+	entry.setAt = set_at ? set_at : time(NULL);
+	entries.push_back(entry);
+	_mask_sets[list].compile(entries);
+	if (list != INVEX_LIST)
+		++_masks_version;
+	journal_mask(list, entry, true);
+	return true;
+}
+
+// Removes a mask from a list; `false` if it was not on it.
+bool	Channel::remove_mask(MaskList list, const std::string& mask)
+{
+	std::vector<MaskEntry>&	entries = _mask_lists[list];
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (!IrcChars::equal(entries[i].mask, mask))
+			continue;
+		MaskEntry	removed = entries[i];
+		entries.erase(entries.begin() + i);
+		_mask_sets[list].compile(entries);
+		if (list != INVEX_LIST)
+			++_masks_version;
+		journal_mask(list, removed, false);
+		return true;
+	}
+	return false;
+}
+
+const std::vector<MaskEntry>&	Channel::get_masks(MaskList list) const
+{
+	return _mask_lists[list];
+}
+
+/**
+Returns true if a member matches a ban and no exception. The verdict is
+kept per member, in a table indexed by their fd, until the ban or exception
+list changes or the member changes nickname, so a ban-heavy channel costs
+one array access per message, not a pass over its masks. Users without a
+socket here (remote users, the bot) are matched every time.
+*/
+bool	Channel::is_banned(const User* user)
+{
+	if (!user || _mask_sets[BAN_LIST].empty())
+		return false;
+
+	int	fd = user->getFd();
+	if (fd < 0)
+		return match_ban(user->buildHostmask());
+	if (static_cast<size_t>(fd) >= _ban_verdicts.size())
+		_ban_verdicts.resize(fd + 1, BanVerdict());
+
+	BanVerdict&	verdict = _ban_verdicts[fd];
+	if (verdict.version != _masks_version)
+	{
+		verdict.version = _masks_version;
+		verdict.banned = match_ban(user->buildHostmask());
+	}
+	return verdict.banned;
+}
+
+// Drops the ban verdict kept for a member (they left, or changed nickname).
+void	Channel::forget_ban_verdict(const User* user)
+{
+	int	fd = user->getFd();
+
+	if (fd >= 0 && static_cast<size_t>(fd) < _ban_verdicts.size())
+		_ban_verdicts[fd].version = 0;
+}
+
+// True if `hostmask` is on the ban list and not on the exception list.
+bool	Channel::match_ban(const std::string& hostmask) const
+{
+	return _mask_sets[BAN_LIST].matches(hostmask) && !_mask_sets[EXCEPT_LIST].matches(hostmask);
 }
 
 // Returns true if a channel password is set.
@@ -203,6 +395,8 @@ bool	Channel::has_password() const
 void	Channel::set_password(const std::string &password)
 {
 	_channel_key = password;
+	touch();
+	journal();
 }
 
 // Gets the channel password.
@@ -236,80 +430,242 @@ const std::map<std::string, User*>&	Channel::get_members() const
 	return _channel_members_by_nickname;
 }
 
+// Returns the links to other servers with members of this channel behind them (and how many each).
+const std::map<ServerLink*, int>&	Channel::get_links() const
+{
+	return _channel_links;
+}
+
 // Returns the amount of the channel's connected users.
 int	Channel::get_connected_user_number() const
 {
 	return _channel_members_by_nickname.size();
 }
 
+// Returns the channel's version, which moves on with every membership, mode or topic change.
+unsigned long	Channel::get_version() const
+{
+	return _version;
+}
+
 /**
-Generates a space-separated string of nicknames for an `RPL_NAMREPLY` reply.
+Makes the channel write its topic, mode and invite list changes to `state_log`
+(see `StateLog`); `NULL` stops it.
+*/
+void	Channel::set_state_log(StateLog* state_log)
+{
+	_state_log = state_log;
+}
 
-This function iterates through all channel members, prefixing channel operators
-with an '@' symbol as required by the IRC protocol. The resulting string is
-formatted for direct use in a 353 numeric reply (`RPL_NAMREPLY`).
+/**
+Makes the channel report every change (members, operators, topic, modes,
+invite list) to `replication` (see `ReplicationStream`); `NULL` stops it.
+*/
+void	Channel::set_replication(ReplicationStream* replication)
+{
+	_replication = replication;
+}
 
- @return	A `std::string` containing the formatted list of member nicknames.
+/**
+Makes the channel's broadcasts use `fanout` once it has `FANOUT_THRESHOLD`
+members or more (see `Command::broadcastToChannel()`); `NULL` stops it.
 */
-std::string	Channel::get_names_list() const
+void	Channel::set_fanout(FanoutPool* fanout)
+{
+	_fanout = fanout;
+}
+
+FanoutPool*	Channel::get_fanout() const
+{
+	return _fanout;
+}
+
+// Copies the persistent state (topic, modes, invite and mask lists) into `state`.
+void	Channel::save_state(ChannelState& state) const
 {
-	std::string	namesList;
+	state.name = _channel_name;
+	state.topic = _channel_topic;
+	state.topicSetBy = _channel_topic_set_by;
+	state.topicSetAt = _channel_topic_set_at;
+	state.inviteOnly = _invite_only;
+	state.topicProtection = _topic_protection;
+	state.userLimit = _user_limit;
+	state.key = _channel_key;
+	state.invites = _channel_invitation_list;
+	state.bans = _mask_lists[BAN_LIST];
+	state.exceptions = _mask_lists[EXCEPT_LIST];
+	state.inviteExceptions = _mask_lists[INVEX_LIST];
+}
+
+// Takes over a state saved before a restart (without journaling it again).
+void	Channel::restore_state(const ChannelState& state)
+{
+	_channel_topic = state.topic;
+	_channel_topic_set_by = state.topicSetBy;
+	_channel_topic_set_at = state.topicSetAt;
+	_invite_only = state.inviteOnly;
+	_topic_protection = state.topicProtection;
+	_user_limit = state.userLimit;
+	_channel_key = state.key;
+	_channel_invitation_list = state.invites;
+	_mask_lists[BAN_LIST] = state.bans;
+	_mask_lists[EXCEPT_LIST] = state.exceptions;
+	_mask_lists[INVEX_LIST] = state.inviteExceptions;
+	for (int list = 0; list < MASK_LISTS; ++list)
+		_mask_sets[list].compile(_mask_lists[list]);
+	++_masks_version;
+	touch();
+}
 
-	for (std::map<std::string, User*>::const_iterator it = get_members().begin();
-			it != get_members().end(); ++it)
+// Appends the channel's new state to the journal and to the standby's stream, if any.
+void	Channel::journal()
+{
+	if (_state_log)
+		_state_log->save(*this);
+	if (_replication)
+		_replication->saveChannel(*this);
+}
+
+/**
+Appends one added or removed mask to the journal (not the whole state with
+all lists), and the channel's new state to the standby's stream, if any.
+*/
+void	Channel::journal_mask(MaskList list, const MaskEntry& entry, bool added)
+{
+	if (_state_log)
+		_state_log->saveMask(*this, list, entry, added);
+	if (_replication)
+		_replication->saveChannel(*this);
+}
+
+// Invalidates the cached replies (membership, mode or topic changed).
+void	Channel::touch()
+{
+	++_version;
+}
+
+/**
+Returns the channel's `RPL_NAMREPLY` (`353`) and `RPL_ENDOFNAMES` (`366`)
+lines, serialized with the recipient's nickname left as a slot. Nicknames
+are split over as many `353` lines as needed, each within `MAX_LINE_LENGTH`.
+
+The lines are rendered at most once per channel version, so a join wave or
+repeated `NAMES` queries reuse them until the membership changes. Members
+and operators are both ordered by lowercase nickname, so operators (`@`) are
+found by walking both maps side by side instead of a lookup per member.
+
+The reply is shared: a caller that keeps it past the current command (a
+`BurstStream`) must `retain()` it. A reply that is still being streamed is
+left alone and replaced by a new one when the channel changes.
+
+ @param prefix	The server's reply prefix (`:<server name> `).
+*/
+ReplyBurst*	Channel::get_names_reply(const std::string& prefix)
+{
+	if (_names_version == _version)
+		return _names_reply;
+
+	if (_names_reply->isShared())
 	{
-		// Prefix operators with '@'
-		if (is_user_operator(it->second))
-			namesList += "@" + it->second->getNickname() + " ";
-		else
-			namesList += it->second->getNickname() + " ";
+		ReplyBurst::release(_names_reply);
+		_names_reply = new ReplyBurst();
+	}
+	else
+		_names_reply->clear();
+
+	// ":<server> 353 <nick> = <channel> :<names>\r\n", for the longest possible nickname
+	size_t			maxNames = MAX_LINE_LENGTH - prefix.size() - 4 - MAX_NICK_LENGTH - 3
+						- _channel_name.size() - 2 - 2;
+	BurstRenderer	renderer(*_names_reply, prefix);
+	std::string		namesList;
+	std::map<std::string, User*>::const_iterator	op = _channel_operators_by_nickname.begin();
+
+	for (std::map<std::string, User*>::const_iterator it = _channel_members_by_nickname.begin();
+			it != _channel_members_by_nickname.end(); ++it)
+	{
+		while (op != _channel_operators_by_nickname.end() && op->first < it->first)
+			++op;
+		bool				isOperator = op != _channel_operators_by_nickname.end() && op->first == it->first;
+		const std::string&	nick = it->second->getNickname();
+
+		if (!namesList.empty() && namesList.size() + 1 + isOperator + nick.size() > maxNames)
+		{
+			reply<RPL_NAMREPLY>(&renderer, _channel_name, namesList);
+			namesList.clear();
+		}
+		if (!namesList.empty())
+			namesList += ' ';
+		if (isOperator)
+			namesList += '@'; // Prefix operators with '@'
+		namesList += nick;
 	}
-
 	if (!namesList.empty())
-		 namesList.erase(namesList.length() - 1); // Remove trailing space
+		reply<RPL_NAMREPLY>(&renderer, _channel_name, namesList);
+	reply<RPL_ENDOFNAMES>(&renderer, _channel_name);
+	_names_version = _version;
+	return _names_reply;
+}
+
+/**
+Returns the members a broadcast is written for: those connected to this
+server, without the bot (users of other servers get it from their server).
+Collected at most once per channel version, so a busy channel is walked
+as a flat array instead of a map, and can be split into ranges.
+*/
+const std::vector<User*>&	Channel::get_local_recipients()
+{
+	if (_recipients_version == _version)
+		return _local_recipients;
 
-	return namesList;
+	_local_recipients.clear();
+	for (std::map<std::string, User*>::const_iterator it = _channel_members_by_nickname.begin();
+			it != _channel_members_by_nickname.end(); ++it)
+	{
+		if (it->second && !it->second->getIsBot() && !it->second->getLink())
+			_local_recipients.push_back(it->second);
+	}
+	_recipients_version = _version;
+	return _local_recipients;
 }
 
 /**
-Constructs the mode string and its parameters for RPL_CHANNELMODEIS (`324`).
+Returns the mode string and its parameters for RPL_CHANNELMODEIS (`324`).
 
-This function assembles a string representing the channel's current modes.
 For example, for an invite-only channel with a user limit of 10, it
-would return "+il 10". The channel key (+k) is only included if the
-requesting user is a channel operator.
+returns "+il 10"; "+" if no modes are set. The channel key (+k) is only
+included if the requesting user is a channel operator. Both variants are
+built at most once per channel version.
 
  @param user	The user who is requesting the modes. Used to check for operator
 				privileges before revealing the channel key.
- @return		A std::string containing the formatted modes and parameters.
+ @return		The formatted modes and parameters.
 */
-std::string	Channel::get_mode_string(const User* user) const
+const std::string&	Channel::get_mode_string(const User* user)
 {
-	std::string	modeChars;
-	std::string	modeParams;
+	if (_modes_version != _version)
+	{
+		std::string	modeChars = "+";
+		std::string	modeParams;
 
-	if (this->is_invite_only())
-		modeChars += "i";
+		if (this->is_invite_only())
+			modeChars += "i";
 
-	if (this->has_topic_protection())
-		modeChars += "t";
+		if (this->has_topic_protection())
+			modeChars += "t";
 
-	if (this->has_user_limit())
-	{
-		modeChars += "l";
-		modeParams += " " + toString(get_user_limit());
-	}
+		if (this->has_user_limit())
+		{
+			modeChars += "l";
+			modeParams += " " + toString(get_user_limit());
+		}
 
-	if (this->has_password())
-	{
-		modeChars += "k";
+		if (this->has_password())
+			modeChars += "k";
+
+		_mode_strings[0] = modeChars + modeParams;
 		// Only show the actual key to channel operators for security.
-		if (this->is_user_operator(user))
-			modeParams += " " + this->get_password();
+		_mode_strings[1] = _mode_strings[0] + (this->has_password() ? " " + this->get_password() : "");
+		_modes_version = _version;
 	}
-
-	if (modeChars.empty())
-		return ""; // No modes are set
-
-	return "+" + modeChars + modeParams;
+	return _mode_strings[this->is_user_operator(user) ? 1 : 0];
 }
@@ -6,6 +6,10 @@
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
+#include "../include/FanoutPool.hpp"
+#include "../include/ScanIndex.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/defines.hpp"	// FANOUT_THRESHOLD
 
 /**
 Handles a single IRC command received from a client.
@@ -32,6 +36,7 @@ bool	Command::handleCommand(Server* server, User* user, std::vector<std::string>
 		case NICK:		handleNick(server, user, tokens); break;
 		case USER:		handleUser(user, tokens); break;
 		case PASS:		handlePass(server, user, tokens); break;
+		case CAP:		handleCap(user, tokens); break;
 		case JOIN:		handleJoin(server, user, tokens); break;
 		case QUIT:		handleQuit(server, user, tokens); break;
 		case PART:		handlePart(server, user, tokens); break;
@@ -41,11 +46,20 @@ bool	Command::handleCommand(Server* server, User* user, std::vector<std::string>
 		case KICK:		handleKick(server, user, tokens); break;
 		case INVITE:	handleInvite(server, user, tokens); break;
 		case MODE:		handleMode(server, user, tokens); break;
-		case LIST:		handleList(server, user); break;
+		case LIST:		handleList(server, user, tokens); break;
+		case NAMES:		handleNames(server, user, tokens); break;
+		case PING:		handlePing(server, user, tokens); break;
+		case PONG:		handlePong(user, tokens); break;
+		case STATS:		handleStats(server, user, tokens); break;
+		case MOTD:		handleMotd(server, user); break;
+		case LUSERS:	handleLusers(server, user); break;
+		case CHATHISTORY:	handleChatHistory(server, user, tokens); break;
+		case SEARCH:	handleSearch(server, user, tokens); break;
 		case JOKE:		Server::handleJoke(server, user); break;
 		case CALC:		Server::handleCalc(server, user, tokens); break;
+		case SERVER:	reply<ERR_ALREADYREGISTERED>(user); break;
 		default:
-			return false;	// unknown command
+			return server->runBotVerb(user, tokens);	// Bot plugin verb, or unknown command
 	}
 	return true;
 }
@@ -53,24 +67,39 @@ bool	Command::handleCommand(Server* server, User* user, std::vector<std::string>
 /**
 Sends a message to all members of a given channel, optionally excluding one user.
 
+Channels with `FANOUT_THRESHOLD` members or more are written by the channel's
+`FanoutPool` (the event loop and its workers, each taking a range of the
+members); smaller ones are written right here.
+
  @param channel		Pointer to the channel whose members will receive the message.
  @param message		The message to broadcast (without trailing "\r\n")
  @param excludeNick	Optional nickname of a user to exclude from receiving the message.
 */
 void	Command::broadcastToChannel(Channel* channel, const std::string& message,const std::string& excludeNick)
 {
-	const std::map<std::string, User*>&	members = channel->get_members();
-	std::string							formattedMessage = message + "\r\n";
+	// The bot is virtual, it has no output buffer to fill; users of other servers get it from their server
+	const std::vector<User*>&	recipients = channel->get_local_recipients();
+	std::string					formattedMessage = message + "\r\n";
+	const User*					excluded = NULL;
 
-	for (std::map<std::string, User*>::const_iterator it = members.begin(); it != members.end(); ++it)
+	// Skip excluded user if specified
+	if (!excludeNick.empty())
 	{
-		// Skip excluded user if specified
-		if (!excludeNick.empty() && it->first == excludeNick)
-			continue;
+		std::map<std::string, User*>::const_iterator	it = channel->get_members().find(excludeNick);
+		if (it != channel->get_members().end())
+			excluded = it->second;
+	}
 
-		User*	member = it->second;
-		if (member)
-			member->getOutputBuffer() += formattedMessage;
+	FanoutPool*	fanout = channel->get_fanout();
+	if (fanout && fanout->isRunning() && recipients.size() >= FANOUT_THRESHOLD)
+	{
+		fanout->deliver(recipients, formattedMessage, excluded);
+		return;
+	}
+	for (size_t i = 0; i < recipients.size(); ++i)
+	{
+		if (recipients[i] != excluded)
+			recipients[i]->getOutputBuffer() += formattedMessage;
 	}
 }
 
@@ -90,35 +119,48 @@ as a single argument (the trailing parameter), as per IRC protocol.
  @return		A vector of tokens: command + arguments (with trailing combined).
 */
 std::vector<std::string>	Command::tokenize(const std::string& message)
+{
+	ScanIndex	index; // Masks of a line fit inline: no allocation
+
+	index.build(message);
+	return tokenize(message, 0, message.size(), index);
+}
+
+/**
+Tokenizes the line [`begin`, `end`) of `buffer` (same rules as above),
+jumping from one space to the next with `index`, built over `buffer`.
+*/
+std::vector<std::string>	Command::tokenize(const std::string& buffer, size_t begin, size_t end,
+	const ScanIndex& index)
 {
 	std::vector<std::string>	tokens;
-	std::string::size_type		pos = 0;	// size_type is for string positions
-	std::string::size_type		end;
+	size_t						pos = begin;
+	size_t						space;
 
-	while (pos < message.size())
+	while (pos < end)
 	{
 		// Skip leading spaces
-		while (pos < message.size() && message[pos] == ' ')
+		while (pos < end && buffer[pos] == ' ')
 			++pos;
 
-		if (pos >= message.size())
+		if (pos >= end)
 			break; // No more tokens
 
 		// If token starts with ':', rest is trailing param
-		if (message[pos] == ':')
+		if (buffer[pos] == ':')
 		{
-			if (pos + 1 < message.size()) // Only push trailing param if there is something after ':'
-				tokens.push_back(message.substr(pos + 1)); // Add the rest of the line as one token
+			if (pos + 1 < end) // Only push trailing param if there is something after ':'
+				tokens.push_back(buffer.substr(pos + 1, end - pos - 1));
 			break; // No more tokens
 		}
 
-		// Find next space (after token) to extract the token
-		end = message.find(' ', pos);
-		if (end == std::string::npos)
-			end = message.size(); // No more spaces, take the rest of the line
+		// Next space (after token) from the index
+		space = index.nextSpace(pos, end);
+		if (space == std::string::npos)
+			space = end; // No more spaces, take the rest of the line
 
-		tokens.push_back(message.substr(pos, end - pos));
-		pos = end + 1; // Move past the space
+		tokens.push_back(buffer.substr(pos, space - pos));
+		pos = space + 1; // Move past the space
 	}
 	return tokens;
 }
@@ -4,14 +4,17 @@
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/ReplyStream.hpp"	// BurstStream
+#include "../include/ListStream.hpp"
 #include "../include/utils.hpp"		// isValidChannelName
-#include "../include/defines.hpp"	// color formatting
+#include "../include/defines.hpp"	// color formatting, SENDQ_WATERMARK
 
 /**
 Handles a single `JOIN` command for a single channel/key pair.
 
 Validates channel name, checks if user is already a member, and verifies
-channel restrictions (invite-only, user limit, password).
+channel restrictions (bans, invite-only, user limit, password).
 On success, adds the user to the channel and broadcasts the join message.
 
  @param server		Pointer to the server instance.
@@ -28,7 +31,7 @@ bool	Command::handleSingleJoin(Server* server, User* user, const std::string& ch
 	if (!isValidChannelName(channelName))
 	{
 		user->logUserAction(toString("sent JOIN with invalid channel name: ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -39,7 +42,7 @@ bool	Command::handleSingleJoin(Server* server, User* user, const std::string& ch
 
 		user->logUserAction(toString("tried to join already joined ")
 			+ BLUE + existingChannel->get_name() + RESET);
-		user->sendError(443, existingChannel->get_name(), "is already on channel");
+		reply<ERR_USERONCHANNEL>(user, user->getNickname(), existingChannel->get_name());
 		return false;
 	}
 
@@ -58,23 +61,28 @@ bool	Command::handleSingleJoin(Server* server, User* user, const std::string& ch
 			case Channel::JOIN_INVITE_ONLY:
 				user->logUserAction(toString("tried to join invite-only channel ")
 					+ BLUE + channelNameOrig + RESET + " without being invited");
-				user->sendError(473, channelNameOrig, "Cannot join channel (+i)");
+				reply<ERR_INVITEONLYCHAN>(user, channelNameOrig);
 				break;
 
 			case Channel::JOIN_FULL:
 				user->logUserAction(toString("tried to join full ") + BLUE + channelNameOrig + RESET);
-				user->sendError(471, channelNameOrig, "Cannot join channel (+l)");
+				reply<ERR_CHANNELISFULL>(user, channelNameOrig);
 				break;
 
 			case Channel::JOIN_BAD_KEY:
 				user->logUserAction(toString("tried to join channel ") + BLUE + channelNameOrig + RESET
 					+ " with bad key");
-				user->sendError(475, channelNameOrig, "Cannot join channel (+k)");
+				reply<ERR_BADCHANNELKEY>(user, channelNameOrig);
+				break;
+			case Channel::JOIN_BANNED:
+				user->logUserAction(toString("tried to join ") + BLUE + channelNameOrig + RESET
+					+ " but is banned");
+				reply<ERR_BANNEDFROMCHAN>(user, channelNameOrig);
 				break;
 			case Channel::JOIN_MAX_CHANNELS:
 				user->logUserAction(toString("tried to join ") + BLUE + channelNameOrig + RESET
 					+ " but is in too many channels");
-				user->sendError(405, channelNameOrig, "You have joined too many channels");
+				reply<ERR_TOOMANYCHANNELS>(user, channelNameOrig);
 				if (!server->getChannel(channelNameOrig)->get_connected_user_number())
 					server->deleteChannel(channelNameOrig, "no connected users");
 				break;
@@ -92,6 +100,9 @@ bool	Command::handleSingleJoin(Server* server, User* user, const std::string& ch
 		channel->make_user_operator(user);
 		user->logUserAction(toString("became operator of ") + BLUE + channelName + RESET);
 
+		// Take over the topic and modes the channel had before a restart (the creator passes them)
+		server->restoreChannelState(channel, user);
+
 		// Make channel password protected if key was provided
 		if (!key.empty())
 		{
@@ -112,21 +123,24 @@ bool	Command::handleSingleJoin(Server* server, User* user, const std::string& ch
 	std::string	joinMessage =	":" + user->buildHostmask() + " JOIN :" + channelNameOrig;
 	broadcastToChannel(channel, joinMessage);
 
+	// Tell the other servers: a new channel as in a burst (creator as operator, restored modes), or the join
+	if (wasCreated)
+		server->propagateChannel(channel);
+	else
+		server->propagate(":" + user->getNickname() + " JOIN " + channelNameOrig);
+
 	// Send channel topic to the joining user
 	if (channel->get_topic().empty())
-		user->sendServerMsg(toString("331 ") + user->getNickname() + " " + channelNameOrig + " :No topic is set");
-
+		reply<RPL_NOTOPIC>(user, channelNameOrig);
 	else
-		user->sendServerMsg(toString("332 ") + user->getNickname() + " " + channelNameOrig + " :" + channel->get_topic());
-
-	// Send channel mode to the joining user
-	std::string	modeString = channel->get_mode_string(user);
-	user->sendServerMsg(toString("324 ") + user->getNickname() + " " + channelNameOrig + " " + modeString);
+	{
+		reply<RPL_TOPIC>(user, channelNameOrig, channel->get_topic());
+		reply<RPL_TOPICWHOTIME>(user, channelNameOrig, channel->get_topic_set_info());
+	}
 
-	// Send names list to the joining user
-	std::string	namesList = channel->get_names_list();
-	user->sendServerMsg(toString("353 ") + user->getNickname() + " = " + channelNameOrig + " :" + namesList);
-	user->sendServerMsg(toString("366 ") + user->getNickname() + " " + channelNameOrig + " :End of /NAMES list");
+	// Send channel mode and names list to the joining user (cached until the channel changes)
+	reply<RPL_CHANNELMODEIS>(user, channelNameOrig, channel->get_mode_string(user), "");
+	sendNames(server, user, channel);
 
 	user->logUserAction(toString("joined ") + BLUE + channelNameOrig + RESET);
 
@@ -160,7 +174,7 @@ bool	Command::handleJoin(Server* server, User* user, const std::vector<std::stri
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent JOIN without a channel name");
-		user->sendError(461, "JOIN", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "JOIN");
 		return false;
 	}
 
@@ -184,14 +198,7 @@ bool	Command::handleJoin(Server* server, User* user, const std::vector<std::stri
 		bool usrJoined = handleSingleJoin(server, user, channelName, key);
 
 		if (server->getBotMode() && usrJoined)
-		{
-			handleMessageToUser(server, server->getBotUser(), user->getNicknameLower(),
-				"Welcome to " + channelName + ", dear " + user->getNickname() + "!", "NOTICE");
-			handleMessageToUser(server, server->getBotUser(), user->getNicknameLower(),
-				"I am a friendly IRCbot and I'm pleased to meet you!", "NOTICE");
-			handleMessageToUser(server, server->getBotUser(), user->getNicknameLower(),
-				"Use command 'joke' or 'calc <expression>' (e.g. 'calc 40 + 2', int only) and see what happens!", "NOTICE");
-		}
+			server->botOnChannelJoin(user, channelName);
 	}
 	return true;
 }
@@ -218,7 +225,7 @@ bool	Command::handleSinglePart(Server* server, User* user, const std::string& ch
 	if (!isValidChannelName(channelName))
 	{
 		user->logUserAction(toString("sent PART with invalid channel name: ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -227,7 +234,7 @@ bool	Command::handleSinglePart(Server* server, User* user, const std::string& ch
 	if (!channel)
 	{
 		user->logUserAction(toString("tried to leave non-existing ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -238,7 +245,7 @@ bool	Command::handleSinglePart(Server* server, User* user, const std::string& ch
 	{
 		user->logUserAction(toString("tried to leave ") + BLUE + channelNameOrig + RESET
 			+ " but is not a member");
-		user->sendError(442, channelNameOrig, "You're not on that channel");
+		reply<ERR_NOTONCHANNEL>(user, channelNameOrig);
 		return false;
 	}
 
@@ -248,6 +255,8 @@ bool	Command::handleSinglePart(Server* server, User* user, const std::string& ch
 		partLine += " :" + partMessage;
 
 	broadcastToChannel(channel, partLine); // No exclusion - everyone gets the message
+	server->propagate(":" + user->getNickname() + " PART " + channelNameOrig
+		+ (partMessage.empty() ? "" : " :" + partMessage));
 
 	// Remove user from the channel
 	channel->remove_user(user);
@@ -280,7 +289,7 @@ bool Command::handlePart(Server* server, User* user, const std::vector<std::stri
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent PART without a channel name");
-		user->sendError(461, "PART", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "PART");
 		return false;
 	}
 
@@ -304,15 +313,20 @@ bool Command::handlePart(Server* server, User* user, const std::vector<std::stri
 	{
 		handleSinglePart(server, user, channels[i], partMessage);
 
+		Channel*	channel = server->getChannel(channels[i]);
+		if (!channel)
+			continue;
+
 		// BOT MODE: If channel has no active users except bot - it removes the channel.
-		if (server->getBotMode() && server->getChannel(channels[i])->get_connected_user_number() == 1)
+		if (server->getBotMode() && channel->get_connected_user_number() == 1
+			&& channel->is_user_member(server->getBotUser()))
 		{
 			server->getBotUser()->removeChannel(channels[i]);
 			server->deleteChannel(channels[i], "no connected users");
 		}
 
 		// If channel has no active users - it removes the channel. 
-		else if (!server->getChannel(channels[i])->get_connected_user_number())
+		else if (!channel->get_connected_user_number())
 			server->deleteChannel(channels[i], "no connected users");
 	}
 
@@ -345,7 +359,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	if (tokens.size() < 3)
 	{
 		user->logUserAction("sent KICK without enough parameters");
-		user->sendError(461, "KICK", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "KICK");
 		return false;
 	}
 
@@ -356,7 +370,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	if (channelName.empty() || channelName[0] != '#')
 	{
 		user->logUserAction(toString("sent KICK with invalid channel name: ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -365,7 +379,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	if (!channel)
 	{
 		user->logUserAction(toString("tried to KICK from non-existing ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -376,7 +390,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	{
 		user->logUserAction(toString("tried to KICK from channel ") + BLUE + channelNameOrig + RESET
 			+ " but is not a member");
-		user->sendError(442, channelNameOrig, "You're not on that channel");
+		reply<ERR_NOTONCHANNEL>(user, channelNameOrig);
 		return false;
 	}
 
@@ -385,7 +399,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	{
 		user->logUserAction(toString("tried to KICK from channel ") + BLUE + channelNameOrig + RESET
 			+ " but is not an operator");
-		user->sendError(482, channelNameOrig, "You're not channel operator");
+		reply<ERR_CHANOPRIVSNEEDED>(user, channelNameOrig);
 		return false;
 	}
 
@@ -394,7 +408,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	if (!targetUser)
 	{
 		user->logUserAction(toString("tried to KICK non-existing ") + RED + targetNickOrig + RESET);
-		user->sendError(401, targetNickOrig, "No such nick/channel");
+		reply<ERR_NOSUCHNICK>(user, targetNickOrig);
 		return false;
 	}
 
@@ -403,7 +417,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	{
 		user->logUserAction(toString("tried to KICK user ") + GREEN + targetUser->getNickname() + RESET
 			+ " who is not in " + BLUE + channelNameOrig + RESET);
-		user->sendError(441, targetUser->getNickname() + " " + channelNameOrig, "They aren't on that channel");
+		reply<ERR_USERNOTINCHANNEL>(user, targetUser->getNickname(), channelNameOrig);
 		return false;
 	}
 
@@ -412,7 +426,7 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 	{
 		user->logUserAction(toString("tried to KICK operator ") + GREEN + targetUser->getNickname() + RESET
 			+ " from " + BLUE + channelNameOrig + RESET);
-		user->sendError(482, channelNameOrig, "Cannot kick another channel operator");
+		reply<ERR_CANNOTKICKOP>(user, channelNameOrig);
 		return false;
 	}
 
@@ -435,6 +449,8 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 		kickLine += " :" + kickReason;
 
 	broadcastToChannel(channel, kickLine); // Everyone sees the kick
+	server->propagate(":" + user->getNickname() + " KICK " + channelNameOrig + " " + targetUser->getNickname()
+		+ (kickReason.empty() ? "" : " :" + kickReason));
 
 	// Remove target user from the channel
 	channel->remove_user(targetUser);
@@ -444,7 +460,8 @@ bool	Command::handleKick(Server* server, User* user, const std::vector<std::stri
 		+ BLUE + channelNameOrig + RESET + (kickReason.empty() ? "" : toString(": ") + YELLOW + kickReason + RESET));
 
 	// BOT MODE: If channel has no active users except bot - it removes the channel.
-	if (server->getBotMode() && channel->get_connected_user_number() == 1)
+	if (server->getBotMode() && channel->get_connected_user_number() == 1
+		&& channel->is_user_member(server->getBotUser()))
 	{
 		server->getBotUser()->removeChannel(channelNameOrig);
 		server->deleteChannel(channelNameOrig, "no connected users");
@@ -484,7 +501,7 @@ bool	Command::handleTopic(Server *server, User *user, const std::vector<std::str
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent TOPIC without a channel name");
-		user->sendError(403, "", "No channel specified");
+		reply<ERR_NOCHANNELGIVEN>(user);
 		return false;
 	}
 
@@ -495,7 +512,7 @@ bool	Command::handleTopic(Server *server, User *user, const std::vector<std::str
 	if (!channel)
 	{
 		user->logUserAction(toString("tried to check/set topic for non-existing ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -506,7 +523,7 @@ bool	Command::handleTopic(Server *server, User *user, const std::vector<std::str
 	{
 		user->logUserAction(toString("tried to check/set topic for ") + BLUE + channelNameOrig + RESET
 			+ " but is not a member");
-		user->sendError(442, channelNameOrig, "You're not on that channel");
+		reply<ERR_NOTONCHANNEL>(user, channelNameOrig);
 		return false;
 	}
 
@@ -518,14 +535,17 @@ bool	Command::handleTopic(Server *server, User *user, const std::vector<std::str
 		{
 			user->logUserAction(toString("tried to set topic for ") + BLUE + channelNameOrig + RESET
 				+ " but is not an operator");
-			user->sendError(482, channelNameOrig, "You're not channel operator");
+			reply<ERR_CHANOPRIVSNEEDED>(user, channelNameOrig);
 			return false;
 		}
+		if (!checkUtf8(user, newTopic, "TOPIC"))
+			return false;
 		channel->set_topic(newTopic, user->buildHostmask());
 
 		// Broadcast topic change to all channel members
 		std::string	topicLine = ":" + user->buildHostmask() + " TOPIC " + channelNameOrig + " :" + newTopic;
 		broadcastToChannel(channel, topicLine); // Everyone gets the topic change
+		server->propagate(":" + user->getNickname() + " TOPIC " + channelNameOrig + " :" + newTopic);
 
 		// Log the topic change
 		user->logUserAction(toString("set topic for ") + BLUE + channelNameOrig + RESET
@@ -538,14 +558,13 @@ bool	Command::handleTopic(Server *server, User *user, const std::vector<std::str
 		std::string	currentTopic = channel->get_topic();
 		if (currentTopic.empty())
 		{
-			user->sendServerMsg("331 " + user->getNickname() + " " + channelNameOrig + " :No topic is set");
+			reply<RPL_NOTOPIC>(user, channelNameOrig);
 		}
 		else
 		{
 			// Send topic reply to user
-			user->sendServerMsg("332 " + user->getNickname() + " " + channelNameOrig + " :" + currentTopic);
-			user->sendServerMsg("333 " + user->getNickname() + " " + channelNameOrig + " "
-				+ channel->get_topic_set_info());
+			reply<RPL_TOPIC>(user, channelNameOrig, currentTopic);
+			reply<RPL_TOPICWHOTIME>(user, channelNameOrig, channel->get_topic_set_info());
 		}
 
 		// Log the topic request
@@ -581,7 +600,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	if (tokens.size() < 3)
 	{
 		user->logUserAction("sent INVITE without enough arguments");
-		user->sendError(461, "", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "INVITE");
 		return false;
 	}
 
@@ -593,7 +612,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	if (!channel)
 	{
 		user->logUserAction(toString("tried to invite to non-existing ") + RED + channelName + RESET);
-		user->sendError(403, channelName, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, channelName);
 		return false;
 	}
 
@@ -604,7 +623,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	{
 		user->logUserAction(toString("tried to invite to ") + BLUE + channelNameOrig + RESET
 			+ " but is not a member");
-		user->sendError(442, channelNameOrig, "You're not on that channel");
+		reply<ERR_NOTONCHANNEL>(user, channelNameOrig);
 		return false;
 	}
 
@@ -613,7 +632,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	{
 		user->logUserAction(toString("tried to invite to invite-only ") + BLUE + channelNameOrig + RESET
 			+ " but is not an operator");
-		user->sendError(482, channelNameOrig, "You're not channel operator");
+		reply<ERR_CHANOPRIVSNEEDED>(user, channelNameOrig);
 		return false;
 	}
 
@@ -622,7 +641,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	if (!targetUser)
 	{
 		user->logUserAction(toString("tried to invite non-existing ") + RED + targetNickOrig + RESET);
-		user->sendError(401, targetNickOrig, "No such nick/channel");
+		reply<ERR_NOSUCHNICK>(user, targetNickOrig);
 		return false;
 	}
 
@@ -631,7 +650,7 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 	{
 		user->logUserAction(toString("tried to invite already member ") + GREEN + targetUser->getNickname() + RESET
 			+ " to " + BLUE + channelNameOrig + RESET);
-		user->sendError(443, targetUser->getNickname() + " " + channelNameOrig, "is already on channel");
+		reply<ERR_USERONCHANNEL>(user, targetUser->getNickname(), channelNameOrig);
 		return false;
 	}
 
@@ -640,10 +659,14 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 		channel->add_invite(targetNickOrig); // Normalized inside add_invite
 
 	// send confirmation to inviter
-	user->sendServerMsg("341 " + user->getNickname() + " " + targetUser->getNickname() + " " + channelNameOrig);
+	reply<RPL_INVITING>(user, targetUser->getNickname(), channelNameOrig);
 
-	// send invitation to target user
-	targetUser->sendMsgFromUser(user, "INVITE " + targetUser->getNickname() + " :" + channelNameOrig);
+	// send invitation to target user (through their server if they are on another one)
+	if (targetUser->getLink())
+		targetUser->getLink()->send(":" + user->getNickname() + " INVITE " + targetUser->getNickname()
+			+ " " + channelNameOrig);
+	else
+		targetUser->sendMsgFromUser(user, "INVITE " + targetUser->getNickname() + " :" + channelNameOrig);
 
 	// log the invite action
 	user->logUserAction(toString("invited ") + GREEN + targetUser->getNickname() + RESET
@@ -653,44 +676,98 @@ bool	Command::handleInvite(Server* server, User* user, const std::vector<std::st
 }
 
 /**
-Handles the IRC `LIST` command, displaying a list of the server's channels.
+Handles the IRC `LIST` command, displaying a list of the server's channels:
+the amount of connected users in each channel and the topic (if any).
 
-As opposed to the regular `LIST` command which behaves differently depending
-on if it's parameterized or not - this function will behave the same way
-regardless of if arguments are provided or not.
-It displays the different channels, the amount of connected users in each channel,
-and the topic of the channel (if any).
+The list is a `ListStream`: `322` lines are generated only while the user's
+output buffer is below `SENDQ_WATERMARK`, so listing a huge number of
+channels never queues the whole list at once (`SAFELIST`). The channels can
+be filtered with ELIST conditions (advertised as `ELIST=CMNTU`).
 
 Syntax:
 	LIST
+	LIST #chan1,#chan2
+	LIST #42*,!#42-old*,>10,T<60
 
  @param server	Pointer to the server instance handling the command.
  @param user	The user issuing the `LIST` command.
- @param tokens	Parsed IRC command tokens "LIST".
+ @param tokens	Parsed IRC command tokens (e.g., {"LIST", ">5"}).
 
  @return		True if the command was successfully processed,
 				false if an error occurred.
 */
-bool	Command::handleList(Server* server, User* user)
+bool	Command::handleList(Server* server, User* user, const std::vector<std::string>& tokens)
 {
 	if (!checkRegistered(user, "LIST"))
 		return false;
 
+	ListStream*	list = new ListStream(server, user->getNickname());
+	if (tokens.size() > 1)
+		list->parse(tokens[1]);
+
 	user->logUserAction("sent valid LIST command");
-	user->sendServerMsg("321 " + user->getNickname() + " Channel :Users Name"); // Start of list
+	reply<RPL_LISTSTART>(user); // Start of list
+	user->queueReplyStream(list); // 322 lines and the end of list (323)
 
-	std::map<std::string, Channel*> channels = server->getAllChannels();
+	return true;
+}
+
+/**
+Sends a channel's member list (`353` lines, then `366`) to a user.
 
-	std::map<std::string, Channel*>::const_iterator	it;
-	std::map<std::string, Channel*>::const_iterator	ite = channels.end();
+The lines come from the channel's cached names reply. If it is larger than
+`SENDQ_WATERMARK`, it is streamed: more lines are generated only as the
+user's socket drains, so their output buffer never holds the whole list.
+*/
+void	Command::sendNames(Server* server, User* user, Channel* channel)
+{
+	ReplyBurst*	names = channel->get_names_reply(server->getReplyPrefix());
 
-	for (it = channels.begin(); it != ite; it++) // Iterates through each channel and sends to user.
+	if (names->getSize(user->getNickname().size()) <= SENDQ_WATERMARK)
+		names->write(user->getOutputBuffer(), user->getNickname());
+	else
+		user->queueReplyStream(new BurstStream(names, user->getNickname()));
+}
+
+/**
+Handles the IRC `NAMES` command, listing the members of one or more channels
+(operators prefixed with `@`). Every channel is visible, so members of
+channels the user is not in are listed as well.
+
+Without a channel, only `366` is sent: listing every user on the server
+would be one huge reply for a single command.
+
+Syntax:
+	NAMES [<channel>{,<channel>}]
+
+ @param server	Pointer to the server instance handling the command.
+ @param user	The user issuing the `NAMES` command.
+ @param tokens	Parsed IRC command tokens (e.g., {"NAMES", "#chan1,#chan2"}).
+
+ @return		True if the command was successfully processed,
+				false if an error occurred.
+*/
+bool	Command::handleNames(Server* server, User* user, const std::vector<std::string>& tokens)
+{
+	if (!checkRegistered(user, "NAMES"))
+		return false;
+
+	if (tokens.size() < 2 || tokens[1].empty())
 	{
-		user->sendServerMsg("322 " + user->getNickname() + " " + it->second->get_name() + " " 
-			+ toString(it->second->get_connected_user_number()) + " :" + it->second->get_topic());
+		reply<RPL_ENDOFNAMES>(user, "*");
+		user->logUserAction("sent NAMES without a channel");
+		return true;
 	}
 
-	user->sendServerMsg("323 " + toString(user->getNickname()) + " :End of /LIST"); // End of list.
-
+	std::vector<std::string>	channelNames = splitCommaList(tokens[1]);
+	for (size_t i = 0; i < channelNames.size(); ++i)
+	{
+		Channel*	channel = server->getChannel(channelNames[i]);
+		if (channel)
+			sendNames(server, user, channel);
+		else
+			reply<RPL_ENDOFNAMES>(user, channelNames[i]);
+	}
+	user->logUserAction(toString("requested NAMES of ") + BLUE + tokens[1] + RESET);
 	return true;
 }
@@ -6,6 +6,7 @@
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/defines.hpp"	// color formatting
 
 // Helper function to get the quit reason from the tokens
@@ -34,3 +35,47 @@ void	Command::handleQuit(Server* server, User* user, const std::vector<std::stri
 
 	server->disconnectUser(user->getFd(), reason);
 }
+
+/**
+Handles the `PING` command from a user by replying with a `PONG`.
+Clients use it to measure lag or to check that the server is still alive.
+Also accepted before registration.
+
+Syntax:
+	PING <token>
+
+ @param server	Pointer to the Server object (for the server name in the reply).
+ @param user	Pointer to the User who sent the PING.
+ @param tokens	Vector of parsed command tokens. `tokens[1]` is echoed back.
+*/
+void	Command::handlePing(Server* server, User* user, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+	{
+		reply<ERR_NOORIGIN>(user);
+		return;
+	}
+
+	user->sendServerMsg("PONG " + server->getServerName() + " :" + tokens[1]);
+}
+
+/**
+Handles the `PONG` command, the answer to a keepalive `PING` sent by the server.
+Clears the pending PING so the keepalive timer does not disconnect the user.
+
+Syntax:
+	PONG <token>
+
+ @param user	Pointer to the User who sent the PONG.
+ @param tokens	Vector of parsed command tokens.
+*/
+void	Command::handlePong(User* user, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+	{
+		reply<ERR_NOORIGIN>(user);
+		return;
+	}
+
+	user->setPingSentAt(0);
+}
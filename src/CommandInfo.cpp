@@ -0,0 +1,223 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>	// time()
+#include <cstdio>	// snprintf()
+
+#include "../include/Command.hpp"
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/Channel.hpp"
+#include "../include/MessageHistory.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/utils.hpp"		// toString()
+#include "../include/defines.hpp"	// color formatting, DCC_*, REPLICATION
+
+// Formats `value` with at least two digits, as the minutes and seconds of `RPL_STATSUPTIME`.
+static std::string	twoDigits(long value)
+{
+	char	buffer[24];
+
+	snprintf(buffer, sizeof(buffer), "%02ld", value);
+	return buffer;
+}
+
+/**
+Handles the IRC `STATS` command, reporting server statistics.
+
+Supported queries:
+ - `u`: Server uptime (`242`), as `<days> days <hours>:<mm>:<ss>`.
+ - `r`: Registration reaper counters, i.e. connections closed for not finishing
+		registration in time, for trickling partial lines, or refused because
+		their host / the server already had too many unregistered connections (`249`).
+ - `d`: DCC relay counters: running relays, finished / failed / refused ones
+		and the bytes relayed (`249`).
+ - `h`: Channel history memory: all channels against `HISTORY_MAX_BYTES`,
+		lines dropped so far, the size of the word index (`SEARCH`), and each
+		channel against `HISTORY_CHANNEL_BYTES` (`249`).
+ - `c`: Saved channel states (see `StateLog`): channels saved, those still
+		waiting for a JOIN, what startup loaded and how long it took, and the
+		journal records and snapshots written since (`249`).
+ - `p`: Replication to a hot standby (see `ReplicationStream`): whether one
+		is attached, the records and bytes streamed, the time spent writing
+		them, and the backlog (`249`).
+ - `l`: Server links (see `ServerLink`): servers and users of the network,
+		then per link its peer, state, lines and bytes each way, and the
+		send queue (`249`).
+
+Unknown queries only produce the terminating `219`.
+
+Syntax:
+	STATS <query>
+
+ @param server	Pointer to the server instance handling the command.
+ @param user	The user issuing the `STATS` command.
+ @param tokens	Parsed IRC command tokens (e.g., {"STATS", "r"}).
+
+ @return		True if the command was processed successfully,
+				false if an error occurred.
+*/
+bool	Command::handleStats(Server* server, User* user, const std::vector<std::string>& tokens)
+{
+	if (!checkRegistered(user, "STATS"))
+		return false;
+
+	if (tokens.size() < 2 || tokens[1].empty())
+	{
+		user->logUserAction("sent STATS without a query");
+		reply<ERR_NEEDMOREPARAMS>(user, "STATS");
+		return false;
+	}
+
+	char				query = tokens[1][0];
+	const char			queryString[2] = { query, '\0' };
+
+	switch (query)
+	{
+		case 'u':
+		{
+			long	uptime = static_cast<long>(time(NULL) - server->getStartTime());
+			reply<RPL_STATSUPTIME>(user, uptime / 86400, (uptime % 86400) / 3600, twoDigits((uptime % 3600) / 60),
+				twoDigits(uptime % 60));
+			break;
+		}
+		case 'r':
+		{
+			const Server::ReapStats&	stats = server->getReapStats();
+			reply<RPL_STATSDEBUG>(user, toString("Unregistered connections: ")
+				+ toString(server->getUnregisteredCount()));
+			reply<RPL_STATSDEBUG>(user, toString("Reaped (registration timeout): ")
+				+ toString(stats.registrationTimeouts));
+			reply<RPL_STATSDEBUG>(user, toString("Reaped (partial line timeout): ")
+				+ toString(stats.partialLineTimeouts));
+			reply<RPL_STATSDEBUG>(user, toString("Refused (per-host limit): ")
+				+ toString(stats.rejectedPerHost));
+			reply<RPL_STATSDEBUG>(user, toString("Refused (server-wide limit): ")
+				+ toString(stats.rejectedTotal));
+			break;
+		}
+		case 'd':
+		{
+			const Server::DccStats&	stats = server->getDccStats();
+			reply<RPL_STATSDEBUG>(user, toString("DCC relay: ") + (DCC_RELAY ? "on" : "off") + ", "
+				+ toString(server->getDccTransferCount()) + "/" + toString(DCC_MAX_TRANSFERS) + " running, "
+				+ (DCC_RATE_LIMIT ? toString(DCC_RATE_LIMIT) + " bytes/s each" : toString("no rate limit")));
+			reply<RPL_STATSDEBUG>(user, toString("Relayed offers: ") + toString(stats.relayed)
+				+ " (" + toString(stats.completed) + " completed, " + toString(stats.failed) + " failed)");
+			reply<RPL_STATSDEBUG>(user, toString("Refused (relay busy): ") + toString(stats.refused));
+			reply<RPL_STATSDEBUG>(user, toString("Bytes relayed: ") + toString(stats.bytes));
+			break;
+		}
+		case 'h':
+		{
+			const MessageHistory&			history = server->getHistory();
+			const MessageHistory::Stats&	stats = history.getStats();
+			reply<RPL_STATSDEBUG>(user, toString("History: ") + toString(stats.bytes) + "/"
+				+ toString(history.getMaxBytes()) + " bytes, " + toString(stats.lines) + " messages in "
+				+ toString(stats.channels) + " channels");
+			reply<RPL_STATSDEBUG>(user, toString("Recorded: ") + toString(stats.recorded) + " (trimmed per channel: "
+				+ toString(stats.trimmed) + ", evicted: " + toString(stats.evicted) + ")");
+			if (history.isIndexed())
+				reply<RPL_STATSDEBUG>(user, toString("Search index: ") + toString(stats.indexBytes) + " bytes, "
+					+ toString(stats.indexTerms) + " words, " + toString(stats.indexPostings) + " postings");
+
+			const std::map<std::string, Channel*>&	channels = server->getAllChannels();
+			for (std::map<std::string, Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it)
+			{
+				size_t	bytes = history.getChannelBytes(it->first);
+				if (bytes > 0)
+					reply<RPL_STATSDEBUG>(user, it->second->get_name() + ": " + toString(bytes) + "/"
+						+ toString(history.getChannelMaxBytes()) + " bytes, "
+						+ toString(history.getChannelLines(it->first)) + " messages, index "
+						+ toString(history.getChannelIndexBytes(it->first)) + " bytes");
+			}
+			break;
+		}
+		case 'c':
+		{
+			const StateLog&			stateLog = server->getStateLog();
+			const StateLog::Stats&	stats = stateLog.getStats();
+			reply<RPL_STATSDEBUG>(user, toString("Channel state: ") + (stateLog.isOpen() ? "saved" : "not saved")
+				+ ", " + toString(stateLog.getChannelCount()) + " channels (" + toString(stateLog.getUnclaimedCount())
+				+ " waiting to be restored)");
+			reply<RPL_STATSDEBUG>(user, toString("Loaded: ") + toString(stats.snapshotRecords) + " snapshot records, "
+				+ toString(stats.journalRecords) + " journal records in " + toString(stats.loadUs) + " us");
+			reply<RPL_STATSDEBUG>(user, toString("Written: ") + toString(stats.journalWrites) + " journal records, "
+				+ toString(stats.snapshots) + " snapshots");
+			break;
+		}
+		case 'p':
+		{
+			const ReplicationStream&		replication = server->getReplication();
+			const ReplicationStream::Stats&	stats = replication.getStats();
+			reply<RPL_STATSDEBUG>(user, toString("Replication: ") + (!REPLICATION ? "off"
+				: replication.isAttached() ? "standby attached" : "no standby") + ", "
+				+ toString(stats.standbys) + " attached since startup, " + toString(stats.dropped) + " dropped");
+			reply<RPL_STATSDEBUG>(user, toString("Streamed: ") + toString(stats.records) + " records, "
+				+ toString(stats.bytes) + " bytes, " + toString(stats.flushUs) + " us spent writing");
+			reply<RPL_STATSDEBUG>(user, toString("Backlog: ") + toString(replication.getBacklog()) + " bytes (at most "
+				+ toString(stats.maxBacklog) + ")");
+			break;
+		}
+		case 'l':
+		{
+			const std::map<int, ServerLink*>&	links = server->getLinks();
+			reply<RPL_STATSDEBUG>(user, toString("Network: ") + toString(server->getServerCount()) + " servers, "
+				+ toString(server->getNickMap().size()) + " users (" + toString(server->getRemoteUserCount())
+				+ " on other servers), " + toString(links.size()) + " links");
+			for (std::map<int, ServerLink*>::const_iterator it = links.begin(); it != links.end(); ++it)
+			{
+				const ServerLink*			link = it->second;
+				const ServerLink::Stats&	stats = link->getStats();
+				reply<RPL_STATSDEBUG>(user, link->getName() + " (" + link->getAddress()
+					+ (link->isLocal() ? ", shared memory" : "") + "): "
+					+ (link->getState() == ServerLink::LINK_ACTIVE ? "active" : "connecting") + ", in "
+					+ toString(stats.linesIn) + " lines/" + toString(stats.bytesIn) + " bytes, out "
+					+ toString(stats.linesOut) + " lines/" + toString(stats.bytesOut) + " bytes, sendq "
+					+ toString(link->getSendQ()));
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	reply<RPL_ENDOFSTATS>(user, queryString);
+	user->logUserAction(toString("queried STATS ") + YELLOW + query + RESET);
+	return true;
+}
+
+/**
+Handles the IRC `MOTD` command: sends the message of the day
+(`375`, `372`, `376`), or `422` if `MOTD_FILE` could not be read.
+The target server parameter is ignored (there is only this one).
+
+Syntax:
+	MOTD [<target>]
+*/
+bool	Command::handleMotd(Server* server, User* user)
+{
+	if (!checkRegistered(user, "MOTD"))
+		return false;
+
+	server->sendMotd(user);
+	user->logUserAction("requested the MOTD");
+	return true;
+}
+
+/**
+Handles the IRC `LUSERS` command: sends the user and channel counts
+(`251`, `253`–`255`, `265`, `266`).
+
+Syntax:
+	LUSERS
+*/
+bool	Command::handleLusers(Server* server, User* user)
+{
+	if (!checkRegistered(user, "LUSERS"))
+		return false;
+
+	server->sendLusers(user);
+	user->logUserAction("requested LUSERS");
+	return true;
+}
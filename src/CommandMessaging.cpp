@@ -1,14 +1,19 @@
 #include <string>
 #include <vector>
+#include <cctype>	// toupper()
+#include <cstdlib>	// strtoul()
 
 #include "../include/Command.hpp"
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
-#include "../include/utils.hpp"		// isValidChannelName()
-#include "../include/defines.hpp"	// color formatting
+#include "../include/MessageHistory.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/utils.hpp"		// isValidChannelName(), getMonotonicUs()
+#include "../include/defines.hpp"	// color formatting, HISTORY_MAX_REPLAY
 
 static bool isDccSend(const std::string& message);
+static std::string	nextBatchId();
 
 /**
 Handles sending a message (`PRIVMSG` or `NOTICE`) to users and channels.
@@ -32,19 +37,21 @@ void	Command::handleMessage(Server* server, User* user, const std::vector<std::s
 	{
 		user->logUserAction("sent invalid " + commandName + " (no recipient)");
 		if (sendReplies)
-			user->sendError(411, "", "No recipient given (" + commandName + ")");
+			reply<ERR_NORECIPIENT>(user, commandName);
 		return;
 	}
 	if (tokens.size() < 3)
 	{
 		user->logUserAction("sent invalid " + commandName + " (no text)");
 		if (sendReplies)
-			user->sendError(412, "", "No text to send");
+			reply<ERR_NOTEXTTOSEND>(user);
 		return;
 	}
 
 	// Get message
 	std::string	message = tokens[2];
+	if (!checkUtf8(user, message, commandName, sendReplies))
+		return;
 
 	// Send message to each target
 	std::vector<std::string>	targets = splitCommaList(tokens[1]);
@@ -88,6 +95,145 @@ void Command::handleNotice(Server *server, User *user, const std::vector<std::st
 	handleMessage(server, user, tokens, "NOTICE");
 }
 
+/**
+Handles the IRCv3 `CHATHISTORY` command: replays recent messages of a channel
+the user is in, as a `chathistory` batch (tagged with `time` and `msgid`).
+The batch and the tags are only sent if the client enabled them with `CAP REQ`
+(`batch`, `server-time`, `message-tags`); otherwise the replay is plain messages.
+
+Syntax:
+	CHATHISTORY LATEST <channel> <* | msgid=<id> | timestamp=<time>> <limit>
+	CHATHISTORY BEFORE <channel> <msgid=<id> | timestamp=<time>> <limit>
+	CHATHISTORY AFTER <channel> <msgid=<id> | timestamp=<time>> <limit>
+
+`limit` is capped at `HISTORY_MAX_REPLAY`. Errors are `FAIL` standard replies.
+
+ @param server	Pointer to the server instance.
+ @param user	Pointer to the user requesting the history.
+ @param tokens	Tokenized input of the CHATHISTORY command.
+*/
+bool	Command::handleChatHistory(Server* server, User* user, const std::vector<std::string>& tokens)
+{
+	if (!checkRegistered(user, "CHATHISTORY"))
+		return false;
+
+	if (tokens.size() < 5)
+	{
+		user->logUserAction("sent CHATHISTORY with missing parameters");
+		user->sendServerMsg("FAIL CHATHISTORY NEED_MORE_PARAMS CHATHISTORY :Missing parameters");
+		return false;
+	}
+
+	std::string				subcommand = tokens[1];
+	MessageHistory::Query	query;
+	for (size_t i = 0; i < subcommand.size(); ++i)
+		subcommand[i] = static_cast<char>(toupper(static_cast<unsigned char>(subcommand[i])));
+	if (subcommand == "LATEST")
+		query = MessageHistory::QUERY_LATEST;
+	else if (subcommand == "BEFORE")
+		query = MessageHistory::QUERY_BEFORE;
+	else if (subcommand == "AFTER")
+		query = MessageHistory::QUERY_AFTER;
+	else
+	{
+		user->sendServerMsg("FAIL CHATHISTORY INVALID_PARAMS " + tokens[1] + " :Unknown subcommand");
+		return false;
+	}
+
+	MessageHistory::Ref	ref;
+	if (!MessageHistory::parseRef(tokens[3], ref)
+		|| (ref.type == MessageHistory::Ref::REF_NONE && query != MessageHistory::QUERY_LATEST))
+	{
+		user->sendServerMsg("FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + tokens[3]
+			+ " :Invalid message reference");
+		return false;
+	}
+
+	unsigned long	limit = strtoul(tokens[4].c_str(), NULL, 10);
+	if (tokens[4].find_first_not_of("0123456789") != std::string::npos || limit == 0)
+	{
+		user->sendServerMsg("FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + tokens[4] + " :Invalid limit");
+		return false;
+	}
+	if (limit > HISTORY_MAX_REPLAY)
+		limit = HISTORY_MAX_REPLAY;
+
+	Channel*	channel = isValidChannelName(tokens[2]) ? server->getChannel(tokens[2]) : NULL;
+	if (!channel || !channel->is_user_member(user))
+	{
+		user->logUserAction(toString("requested CHATHISTORY of ") + RED + tokens[2] + RESET + " but is not a member");
+		user->sendServerMsg("FAIL CHATHISTORY INVALID_TARGET " + subcommand + " " + tokens[2]
+			+ " :Messages could not be retrieved");
+		return false;
+	}
+
+	std::vector<MessageHistory::Line*>	lines;
+	server->getHistory().find(channel->get_name_lower(), query, ref, limit, lines);
+	user->logUserAction(toString("requested CHATHISTORY ") + subcommand + " of " + BLUE + channel->get_name()
+		+ RESET + " (" + YELLOW + toString(lines.size()) + RESET + " messages)");
+	user->queueReplyStream(new HistoryStream(server->getReplyPrefix(), "chathistory", channel->get_name(),
+		nextBatchId(), lines, user->getCaps()));
+	return true;
+}
+
+/**
+Handles the `SEARCH` command: finds the newest messages of a channel the user
+is in that contain all given words (whole words, case-insensitive), using the
+word index of the channel history. Up to `HISTORY_MAX_REPLAY` results are sent
+oldest first, as a `search` batch tagged like `CHATHISTORY` replies.
+
+Syntax:
+	SEARCH <channel> :<words>
+
+ @param server	Pointer to the server instance.
+ @param user	Pointer to the user searching.
+ @param tokens	Tokenized input of the SEARCH command.
+*/
+bool	Command::handleSearch(Server* server, User* user, const std::vector<std::string>& tokens)
+{
+	if (!checkRegistered(user, "SEARCH"))
+		return false;
+
+	MessageHistory&	history = server->getHistory();
+	if (!history.isIndexed())
+	{
+		user->sendServerMsg("FAIL SEARCH UNAVAILABLE :Message search is disabled on this server");
+		return false;
+	}
+	if (tokens.size() < 3)
+	{
+		user->logUserAction("sent SEARCH with missing parameters");
+		user->sendServerMsg("FAIL SEARCH NEED_MORE_PARAMS SEARCH :Missing parameters");
+		return false;
+	}
+
+	std::vector<std::string>	terms;
+	MessageHistory::tokenize(tokens[2], terms);
+	if (terms.empty())
+	{
+		user->sendServerMsg("FAIL SEARCH INVALID_PARAMS " + tokens[1] + " :No word of at least 2 letters or digits");
+		return false;
+	}
+
+	Channel*	channel = isValidChannelName(tokens[1]) ? server->getChannel(tokens[1]) : NULL;
+	if (!channel || !channel->is_user_member(user))
+	{
+		user->logUserAction(toString("searched ") + RED + tokens[1] + RESET + " but is not a member");
+		user->sendServerMsg("FAIL SEARCH INVALID_TARGET " + tokens[1] + " :Messages could not be retrieved");
+		return false;
+	}
+
+	std::vector<MessageHistory::Line*>	lines;
+	unsigned long						startUs = getMonotonicUs();
+	history.search(channel->get_name_lower(), terms, HISTORY_MAX_REPLAY, lines);
+	user->logUserAction(toString("searched ") + BLUE + channel->get_name() + RESET + " for " + YELLOW
+		+ toString(terms.size()) + RESET + " words (" + YELLOW + toString(lines.size()) + RESET + " results in "
+		+ toString(getMonotonicUs() - startUs) + " us)");
+	user->queueReplyStream(new HistoryStream(server->getReplyPrefix(), "search", channel->get_name(),
+		nextBatchId(), lines, user->getCaps()));
+	return true;
+}
+
 ////////////
 // HELPER //
 ////////////
@@ -126,6 +272,14 @@ static bool isDccSend(const std::string& message)
 	return true;
 }
 
+// Returns a new batch reference tag (for `CHATHISTORY` and `SEARCH` replies).
+static std::string	nextBatchId()
+{
+	static unsigned long	batchCount = 0;
+
+	return "history" + toString(++batchCount);
+}
+
 /**
 Sends a message (`PRIVMSG` or `NOTICE`) from a user to a channel.
 
@@ -143,7 +297,7 @@ void	Command::handleMessageToChannel(Server* server, User* sender, const std::st
 			+ " to non-existing " + RED + channelName + RESET);
 		
 		if (sendReplies)
-			sender->sendError(403, channelName, "No such channel");
+			reply<ERR_NOSUCHCHANNEL>(sender, channelName);
 		return;
 	}
 
@@ -154,13 +308,25 @@ void	Command::handleMessageToChannel(Server* server, User* sender, const std::st
 			+ " to " + BLUE + channelNameOrig + RESET + " but is not a member");
 		// Only send error for PRIVMSG, NOTICE does not trigger replies
 		if (sendReplies)
-			sender->sendError(404, channelNameOrig, "Cannot send to channel");
+			reply<ERR_CANNOTSENDTOCHAN>(sender, channelNameOrig);
+		return;
+	}
+	if (!channel->is_user_operator(sender) && channel->is_banned(sender))
+	{
+		sender->logUserAction("tried to send " + commandName
+			+ " to " + BLUE + channelNameOrig + RESET + " but is banned");
+		if (sendReplies)
+			reply<ERR_CANNOTSENDTOCHAN>(sender, channelNameOrig);
 		return;
 	}
 
-	// Construct the IRC line and broadcast it
+	// Construct the IRC line, broadcast it and keep it for CHATHISTORY
 	std::string	line = ":" + sender->buildHostmask() + " " + commandName + " " + channelNameOrig + " :" + message;
 	Command::broadcastToChannel(channel, line, sender->getNicknameLower()); // exclude sender
+	server->getHistory().record(channel->get_name_lower(), line);
+	if (!sender->getIsBot()) // The bot stays local, other servers do not know it
+		server->propagateToChannel(channel, ":" + sender->getNickname() + " " + commandName + " "
+			+ channelNameOrig + " :" + message);
 	sender->logUserAction("sent " + commandName + " to " + BLUE + channelNameOrig + RESET);
 }
 
@@ -195,7 +361,7 @@ void Command::handleMessageToUser(Server* server, User* sender, const std::strin
 			sender->logUserAction("tried to send " + logCmd
 				+ " to non-existing " + RED + targetNick + RESET);
 		if (sendReplies)
-			sender->sendError(401, targetNick, "No such nick/channel");
+			reply<ERR_NOSUCHNICK>(sender, targetNick);
 		return;
 	}
 
@@ -206,12 +372,39 @@ void Command::handleMessageToUser(Server* server, User* sender, const std::strin
 			sender->logUserAction("tried to send " + logCmd
 				+ " to not registered " + RED + targetNick + RESET);
 		if (sendReplies)
-			sender->sendError(401, targetNick, "No such nick/channel");
+			reply<ERR_NOSUCHNICK>(sender, targetNick);
+		return;
+	}
+
+	// The bot has no socket: hand the message over in-process
+	if (targetUser->getIsBot())
+	{
+		if (logAction)
+			sender->logUserAction("sent " + logCmd + " to bot "
+				+ BOT_COLOR + targetUser->getNickname() + RESET, sender->getIsBot());
+		server->botOnDirectMessage(sender, message, commandName);
+		return;
+	}
+
+	// A user of another server: the message goes to their server as is (the bot stays local)
+	if (targetUser->getLink())
+	{
+		if (!sender->getIsBot())
+			targetUser->getLink()->send(":" + sender->getNickname() + " " + commandName + " "
+				+ targetUser->getNickname() + " :" + message);
+		if (logAction)
+			sender->logUserAction("sent " + logCmd + " to user " + GREEN + targetUser->getNickname() + RESET
+				+ " on " + targetUser->getServerName(), sender->getIsBot());
 		return;
 	}
 
+	// A file offer may be rewritten to go through the server's DCC relay
+	std::string	forwarded = message;
+	if (commandName == "PRIVMSG" && isDccSend(message))
+		forwarded = server->relayDccOffer(sender, targetUser, message);
+
 	// Construct the IRC line and add to the target user's output buffer
-	std::string	line =	commandName + " " + targetUser->getNickname() + " :" + message;
+	std::string	line =	commandName + " " + targetUser->getNickname() + " :" + forwarded;
 	targetUser->sendMsgFromUser(sender, line);
 
 	// Logging successful message sending
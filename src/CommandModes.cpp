@@ -4,8 +4,10 @@
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/utils.hpp"		// isValidChannelName()
-#include "../include/defines.hpp"	// color formatting
+#include "../include/MaskSet.hpp"	// MaskSet::complete()
+#include "../include/defines.hpp"	// color formatting, MAX_CHANNEL_LIST
 
 /**
 Handles the IRC `MODE` command.
@@ -15,6 +17,8 @@ This function processes both MODE queries and MODE changes:
 			and relevant parameters (e.g., user limit, key for operators) to the user.
  - Change:	If mode flags and parameters are provided, changes are applied
  			via `handleModeChanges`.
+ - List:	A single list mode without a mask (`b`, `e` or `I`) lists its
+			entries; any member may ask.
 
 The function validates that the user is registered, the target is a valid
 channel, and that the user is a member of the channel. Sends appropriate
@@ -35,7 +39,7 @@ bool	Command::handleMode(Server* server, User* user, const std::vector<std::stri
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent MODE without parameters");
-		user->sendError(461, "MODE", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "MODE");
 		return false;
 	}
 
@@ -56,12 +60,21 @@ bool	Command::handleMode(Server* server, User* user, const std::vector<std::stri
 		return true;
 	}
 
+	// MODE list query: "b", "+b" (also "e" and "I") without a mask
+	const std::string&	modeString = tokens[2];
+	std::string			listMode = modeString.substr(!modeString.empty() && modeString[0] == '+' ? 1 : 0);
+	if (tokens.size() == 3 && (listMode == "b" || listMode == "e" || listMode == "I"))
+	{
+		sendMaskList(user, channel, listMode[0]);
+		return true;
+	}
+
 	// MODE change: requires operator privileges
 	if (!channel->is_user_operator(user))
 	{
 		user->logUserAction(toString("tried to change modes for ") + BLUE + target + RESET
 			+ " but is not an operator");
-		user->sendError(482, target, "You're not channel operator");
+		reply<ERR_CHANOPRIVSNEEDED>(user, target);
 		return false;
 	}
 
@@ -83,15 +96,15 @@ bool	Command::handleModeChanges(Server* server, User* user, Channel* channel, co
 	size_t				paramIndex = 3;
 	bool				adding = true;
 
-	std::string			addedModes;
-	std::string			removedModes;
+	std::string			appliedModes;	// In the order applied, so the parameters line up with their modes
+	char				appliedSign = 0;
 	std::string			modeParams;
 
 	// first determine initial direction (+ or -)
 	if (modeString.empty() || (modeString[0] != '+' && modeString[0] != '-'))
 	{
 		user->logUserAction(toString("sent MODE with invalid mode string: ") + RED + modeString + RESET);
-		user->sendError(501, "", "Mode string must start with + or -");
+		reply<ERR_UMODEUNKNOWNFLAG>(user);
 		return false;
 	}
 
@@ -107,34 +120,30 @@ bool	Command::handleModeChanges(Server* server, User* user, Channel* channel, co
 											modeParams, modeCandidateFound);
 		if (success)
 		{
-			if (adding)
-				addedModes += mode;
-			else
-				removedModes += mode;
+			if (appliedSign != (adding ? '+' : '-'))
+			{
+				appliedSign = adding ? '+' : '-';
+				appliedModes += appliedSign;
+			}
+			appliedModes += mode;
 		}
 	}
 
-	if (addedModes.empty() && removedModes.empty() && !modeCandidateFound) // just + or - with no potential modes
+	if (appliedModes.empty() && !modeCandidateFound) // just + or - with no potential modes
 	{
 		user->logUserAction("sent MODE without parameters");
-		user->sendError(461, "MODE", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "MODE");
 		return false;
 	}
 
 	// Broadcast mode changes if any were applied
-	std::string	appliedModes;
-	if (!addedModes.empty())
-		appliedModes += "+" + addedModes;
-
-	if (!removedModes.empty())
-		appliedModes += "-" + removedModes;
-
 	if (appliedModes.empty())
 		return true; // No valid modes were changed
 
 	std::string	modeMsg =	":" + user->buildHostmask() + " MODE " + channel->get_name()
 							+ " " + appliedModes + modeParams;
 	broadcastToChannel(channel, modeMsg);
+	server->propagate(":" + user->getNickname() + " MODE " + channel->get_name() + " " + appliedModes + modeParams);
 
 	return true;
 }
@@ -164,12 +173,12 @@ Channel*	Command::validateChannelAndUser(Server* server, User* user, const std::
 		if (server->getUser(target)) // user exists
 		{
 			user->logUserAction(toString("sent MODE for a user target (unsupported): ") + RED + target + RESET);
-			user->sendError(502, "", "Cant change mode for other users");
+			reply<ERR_USERSDONTMATCH>(user);
 		}
 		else // user does not exist
 		{
 			user->logUserAction(toString("sent MODE for non-existing user: ") + RED + target + RESET);
-			user->sendError(401, target, "No such nick/channel");
+			reply<ERR_NOSUCHNICK>(user, target);
 		}
 		return NULL;
 	}
@@ -179,7 +188,7 @@ Channel*	Command::validateChannelAndUser(Server* server, User* user, const std::
 	if (!channel)
 	{
 		user->logUserAction(toString("tried to change modes for non-existing ") + RED + target + RESET);
-		user->sendError(403, target, "No such channel");
+		reply<ERR_NOSUCHCHANNEL>(user, target);
 		return NULL;
 	}
 
@@ -189,7 +198,7 @@ Channel*	Command::validateChannelAndUser(Server* server, User* user, const std::
 	if (!channel->is_user_member(user))
 	{
 		user->logUserAction(toString("sent MODE but is not a member of ") + BLUE + channelNameOrig + RESET);
-		user->sendError(442, channelNameOrig, "You're not on that channel");
+		reply<ERR_NOTONCHANNEL>(user, channelNameOrig);
 		return NULL;
 	}
 
@@ -257,8 +266,7 @@ void	Command::sendModeReply(User* user, const std::string& target, const std::st
 		return; // Should not happen as already validated before
 	std::string	channelNameOrig = channel->get_name();
 
-	user->sendServerMsg("324 " + user->getNickname() + " " + channelNameOrig
-		+ (modes.empty() ? "" : " " + modes) + params);
+	reply<RPL_CHANNELMODEIS>(user, channelNameOrig, modes.empty() ? "+" : modes.c_str(), params);
 
 	user->logUserAction(toString("queried modes for ") + BLUE + channelNameOrig + RESET
 		+ (modes.empty() ? " (no modes set)" : toString(" (") + YELLOW + modes + RESET + paramsLogging + ")"));
@@ -286,9 +294,14 @@ bool	Command::applyChannelMode(Server* server, User* user, Channel* channel, cha
 		case 'o':
 			return applyOperator(server, channel, user, adding, tokens, paramIndex, modeParams);
 
+		case 'b':
+		case 'e':
+		case 'I':
+			return applyMaskList(channel, user, mode, adding, tokens, paramIndex, modeParams);
+
 		default:
 			user->logUserAction(toString("tried to set unknown mode: ") + RED + mode + RESET);
-			user->sendError(472, std::string(1, mode), "is unknown mode char to me");
+			reply<ERR_UNKNOWNMODE>(user, std::string(1, mode));
 			return false;
 	}
 }
@@ -323,7 +336,7 @@ bool	Command::applyUserLimit(Channel* channel, User* user, bool adding, const st
 		if (paramIndex >= tokens.size())
 		{
 			user->logUserAction("sent MODE l without enough parameters");
-			user->sendError(461, "MODE", "Not enough parameters");
+			reply<ERR_NEEDMOREPARAMS>(user, "MODE");
 			return false; // Failed: Missing parameter for user limit
 		}
 
@@ -341,7 +354,7 @@ bool	Command::applyUserLimit(Channel* channel, User* user, bool adding, const st
 		// limit is zero or negative
 		user->logUserAction(toString("sent invalid user limit: ") + RED
 			+ tokens[paramIndex] + RESET);
-		user->sendError(696, channel->get_name() + " l " + tokens[paramIndex],
+		reply<ERR_INVALIDMODEPARAM>(user, channel->get_name(), "l", tokens[paramIndex],
 			"Invalid user limit: Must be a positive number");
 		++paramIndex;
 		return false;
@@ -364,7 +377,7 @@ bool	Command::applyChannelKey(Channel* channel, User* user, bool adding, const s
 		if (paramIndex >= tokens.size())
 		{
 			user->logUserAction("sent MODE k without enough parameters");
-			user->sendError(461, "MODE", "Not enough parameters");
+			reply<ERR_NEEDMOREPARAMS>(user, "MODE");
 			return false; // Failed: Missing parameter for channel key
 		}
 
@@ -397,7 +410,7 @@ bool	Command::applyOperator(Server* server, Channel* channel, User* user, bool a
 	if (paramIndex >= tokens.size())
 	{
 		user->logUserAction("sent MODE o without enough parameters");
-		user->sendError(461, "MODE", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "MODE");
 		return false; // Failed: Missing parameter.
 	}
 
@@ -408,7 +421,7 @@ bool	Command::applyOperator(Server* server, Channel* channel, User* user, bool a
 	{
 		user->logUserAction(toString("tried to set operator status for non-existing user: ")
 			+ RED + targetNickOrig + RESET);
-		user->sendError(401, targetNickOrig, "No such nick/channel");
+		reply<ERR_NOSUCHNICK>(user, targetNickOrig);
 		++paramIndex;
 		return false;
 	}
@@ -417,7 +430,7 @@ bool	Command::applyOperator(Server* server, Channel* channel, User* user, bool a
 	{
 		user->logUserAction(toString("tried to set operator status for user not in ")
 			+ BLUE + channel->get_name() + RESET + ": " + RED + targetUser->getNickname() + RESET);
-		user->sendError(441, targetUser->getNickname() + " " + channel->get_name(), "They aren't on that channel");
+		reply<ERR_USERNOTINCHANNEL>(user, targetUser->getNickname(), channel->get_name());
 		++paramIndex;
 		return false;
 	}
@@ -430,7 +443,7 @@ bool	Command::applyOperator(Server* server, Channel* channel, User* user, bool a
 		{
 			user->logUserAction(toString("tried to remove operator status from operator ")
 				+ GREEN + targetUser->getNickname() + RESET + " in " + BLUE + channel->get_name() + RESET);
-			user->sendError(482, channel->get_name(), "You cannot de-op another channel operator.");
+			reply<ERR_CANNOTDEOP>(user, channel->get_name());
 			++paramIndex;
 			return false;
 		}
@@ -448,3 +461,79 @@ bool	Command::applyOperator(Server* server, Channel* channel, User* user, bool a
 	++paramIndex;
 	return true;
 }
+
+// The list a list mode (`b`, `e` or `I`) stands for.
+static Channel::MaskList	getMaskList(char mode)
+{
+	if (mode == 'e')
+		return Channel::EXCEPT_LIST;
+	if (mode == 'I')
+		return Channel::INVEX_LIST;
+	return Channel::BAN_LIST;
+}
+
+/**
+Handles the `b` (ban), `e` (ban exception) and `I` (invite exception) modes.
+
+The mask is completed to `nick!user@host` (`bob` -> `bob!*@*`) before it is
+added or removed, and the completed form is echoed. Without a mask, the list
+is sent instead. A list holds at most `MAX_CHANNEL_LIST` masks.
+*/
+bool	Command::applyMaskList(Channel* channel, User* user, char mode, bool adding,
+								const std::vector<std::string>& tokens, size_t& paramIndex, std::string& modeParams)
+{
+	if (paramIndex >= tokens.size())
+	{
+		sendMaskList(user, channel, mode);
+		return false;
+	}
+
+	Channel::MaskList	list = getMaskList(mode);
+	std::string			mask = MaskSet::complete(tokens[paramIndex++]);
+
+	if (adding)
+	{
+		if (channel->get_masks(list).size() >= MAX_CHANNEL_LIST)
+		{
+			user->logUserAction(toString("tried to add ") + RED + mask + RESET + " to the full +" + mode
+				+ " list of " + BLUE + channel->get_name() + RESET);
+			reply<ERR_BANLISTFULL>(user, channel->get_name(), std::string(1, mode));
+			return false;
+		}
+		if (!channel->add_mask(list, mask, user->buildHostmask()))
+			return false; // Already listed
+	}
+	else if (!channel->remove_mask(list, mask))
+		return false; // Not listed
+
+	modeParams += " " + mask;
+	user->logUserAction((adding ? "added " : "removed ") + toString(YELLOW) + mask + RESET
+		+ (adding ? " to" : " from") + " the +" + mode + " list of " + BLUE + channel->get_name() + RESET);
+	return true;
+}
+
+// Sends one list's entries and its end reply.
+template <int Entry, int End>
+static void	sendMaskEntries(User* user, Channel* channel, Channel::MaskList list)
+{
+	const std::vector<MaskEntry>&	entries = channel->get_masks(list);
+
+	for (size_t i = 0; i < entries.size(); ++i)
+		reply<Entry>(user, channel->get_name(), entries[i].mask, entries[i].setBy, toString(entries[i].setAt));
+	reply<End>(user, channel->get_name());
+}
+
+/**
+Sends a channel's ban (`367`/`368`), exception (`348`/`349`) or invite
+exception (`346`/`347`) list.
+*/
+void	Command::sendMaskList(User* user, Channel* channel, char mode)
+{
+	if (mode == 'e')
+		sendMaskEntries<RPL_EXCEPTLIST, RPL_ENDOFEXCEPTLIST>(user, channel, Channel::EXCEPT_LIST);
+	else if (mode == 'I')
+		sendMaskEntries<RPL_INVITELIST, RPL_ENDOFINVITELIST>(user, channel, Channel::INVEX_LIST);
+	else
+		sendMaskEntries<RPL_BANLIST, RPL_ENDOFBANLIST>(user, channel, Channel::BAN_LIST);
+	user->logUserAction(toString("listed the +") + mode + " list of " + BLUE + channel->get_name() + RESET);
+}
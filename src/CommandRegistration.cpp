@@ -1,10 +1,14 @@
 #include "../include/Command.hpp"
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
+#include "../include/Channel.hpp"
+#include "../include/PendingUser.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/utils.hpp"		// isValidNick, normalize
 #include "../include/defines.hpp"	// color formatting
 
 #include <algorithm>	// For std::transform
+#include <sstream>		// std::istringstream
 
 // Handles the `NICK` command for a user. Also part of the initial client registration.
 // Command: `NICK <nickname>`
@@ -13,7 +17,7 @@ void	Command::handleNick(Server* server, User* user, const std::vector<std::stri
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent NICK without a nickname");
-		user->sendError(431, "", "No nickname given");
+		reply<ERR_NONICKNAMEGIVEN>(user);
 		return;
 	}
 
@@ -24,7 +28,7 @@ void	Command::handleNick(Server* server, User* user, const std::vector<std::stri
 	{
 		user->logUserAction(toString("tried to set an invalid nickname: ")
 			+ RED + displayNick + RESET);
-		user->sendError(432, displayNick, "Erroneous nickname");
+		reply<ERR_ERRONEUSNICKNAME>(user, displayNick);
 		return;
 	}
 
@@ -32,11 +36,11 @@ void	Command::handleNick(Server* server, User* user, const std::vector<std::stri
 	std::string	normNick = normalize(displayNick);
 
 	// Nickname is already in use?
-	if (server->getNickMap().count(normNick) > 0)
+	if (server->isNickInUse(normNick))
 	{
 		user->logUserAction(toString("tried to set a nickname already in use: ")
 			+ YELLOW + displayNick + RESET);
-		user->sendError(433, displayNick, "Nickname is already in use");
+		reply<ERR_NICKNAMEINUSE>(user, displayNick);
 		return;
 	}
 
@@ -46,23 +50,28 @@ void	Command::handleNick(Server* server, User* user, const std::vector<std::stri
 	if (user->getUsername().empty())
 		user->setUsernameTemp("~" + displayNick);
 
-	// Notify user of their own nick change
+	// Notify user of their own nick change (from the old hostmask)
+	std::string	notice = ":" + user->buildHostmask() + " NICK :" + displayNick;
+	std::string	oldNickLower = user->getNicknameLower();
+	std::string	oldNick = user->getNickname();
+	bool		wasRegistered = user->isRegistered();
 	user->sendMsgFromUser(user, "NICK :" + displayNick);
 	user->setNickname(displayNick, normNick);
 	user->tryRegister();
 
-	// Notify other users of the nick change
-	if (user->getChannels().size() > 0)
+	// Re-key the user in their channels, then notify the other members of the nick change
+	for (std::set<std::string>::const_iterator it = user->getChannels().begin();
+			it != user->getChannels().end(); ++it)
 	{
-		std::string	notice = ":" + user->buildHostmask() + " NICK :" + displayNick;
-		for (std::set<std::string>::const_iterator it = user->getChannels().begin();
-				it != user->getChannels().end(); ++it)
+		Channel*	channel = server->getChannel(*it);
+		if (channel)
 		{
-			Channel*	channel = server->getChannel(*it);
-			if (channel)
-				broadcastToChannel(channel, notice, normNick); // Exclude the user changing nick
+			channel->rename_user(user, oldNickLower);
+			broadcastToChannel(channel, notice, normNick); // Exclude the user changing nick
 		}
 	}
+	if (wasRegistered && !user->getIsBot())
+		server->propagate(":" + oldNick + " NICK " + displayNick);
 }
 
 // Handles the `USER` command for a user. Also part of the initial client registration.
@@ -72,7 +81,7 @@ void	Command::handleUser(User* user, const std::vector<std::string>& tokens)
 	if (user->isRegistered())
 	{
 		user->logUserAction("tried to resend USER after registration");
-		user->sendError(462, "", "You may not reregister");
+		reply<ERR_ALREADYREGISTERED>(user);
 		return;
 	}
 
@@ -80,7 +89,7 @@ void	Command::handleUser(User* user, const std::vector<std::string>& tokens)
 	if (tokens.size() < 5)
 	{
 		user->logUserAction("sent invalid USER command (too few arguments)");
-		user->sendError(461, "USER", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "USER");
 		return;
 	}
 
@@ -102,14 +111,14 @@ void	Command::handlePass(Server* server, User* user, const std::vector<std::stri
 	if (user->isRegistered())
 	{
 		user->logUserAction("tried to resend PASS after registration");
-		user->sendError(462, "", "You may not reregister");
+		reply<ERR_ALREADYREGISTERED>(user);
 		return;
 	}
 
 	if (tokens.size() < 2)
 	{
 		user->logUserAction("sent invalid PASS command (missing password)");
-		user->sendError(461, "PASS", "Not enough parameters");
+		reply<ERR_NEEDMOREPARAMS>(user, "PASS");
 		return;
 	}
 
@@ -120,7 +129,7 @@ void	Command::handlePass(Server* server, User* user, const std::vector<std::stri
 	if (requiresPassword && password != server->getPassword())
 	{
 		user->logUserAction("provided incorrect password");
-		user->sendError(464, "", "Password incorrect");
+		reply<ERR_PASSWDMISMATCH>(user);
 		return;
 	}
 
@@ -128,3 +137,333 @@ void	Command::handlePass(Server* server, User* user, const std::vector<std::stri
 	user->setHasPassed(true);
 	user->tryRegister();
 }
+
+////////////////////////////
+// Capability Negotiation //
+////////////////////////////
+
+// Capabilities offered by `CAP LS`, with their `CAP_*` bit
+static const struct
+{
+	const char*		name;
+	unsigned char	bit;
+}	CAPABILITIES[] =
+{
+	{ "batch", CAP_BATCH },
+	{ "message-tags", CAP_MESSAGE_TAGS },
+	{ "server-time", CAP_SERVER_TIME }
+};
+static const size_t	CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+// Returns the names of the capabilities in `caps`, separated by spaces.
+static std::string	capNames(unsigned char caps)
+{
+	std::string	names;
+
+	for (size_t i = 0; i < CAPABILITY_COUNT; ++i)
+	{
+		if (!(caps & CAPABILITIES[i].bit))
+			continue;
+		if (!names.empty())
+			names += ' ';
+		names += CAPABILITIES[i].name;
+	}
+	return names;
+}
+
+// Applies a `CAP REQ` list (`-name` disables) to `caps`.
+// All or nothing: `false` (and `caps` unchanged) if a name is unknown or the list is empty.
+static bool	applyCapRequest(const std::string& request, unsigned char& caps)
+{
+	std::istringstream	names(request);
+	std::string			name;
+	unsigned char		result = caps;
+	bool				any = false;
+
+	while (names >> name)
+	{
+		bool	disable = name[0] == '-';
+		size_t	i = 0;
+		if (disable)
+			name.erase(0, 1);
+		while (i < CAPABILITY_COUNT && name != CAPABILITIES[i].name)
+			++i;
+		if (i == CAPABILITY_COUNT)
+			return false;
+		if (disable)
+			result &= ~CAPABILITIES[i].bit;
+		else
+			result |= CAPABILITIES[i].bit;
+		any = true;
+	}
+	if (any)
+		caps = result;
+	return any;
+}
+
+/**
+Answers `CAP LS`, `CAP LIST` and `CAP REQ` (IRCv3 capability negotiation),
+the same way for registered and unregistered clients.
+
+ @param nick	The client's nickname (`*` before `NICK`).
+ @param tokens	`CAP <subcommand> [<param>]`, at least two tokens.
+ @param caps	The client's `CAP_*` bits, updated by `CAP REQ`.
+ @param answer	Set to the reply (without prefix); left empty for `CAP END`.
+
+ @return		`false` if the subcommand is unknown.
+*/
+static bool	answerCap(const std::string& nick, const std::vector<std::string>& tokens, unsigned char& caps,
+				std::string& answer)
+{
+	const std::string&	subcommand = tokens[1];
+
+	if (subcommand == "LS")
+		answer = "CAP " + nick + " LS :" + capNames(0xFF);
+	else if (subcommand == "LIST")
+		answer = "CAP " + nick + " LIST :" + capNames(caps);
+	else if (subcommand == "REQ")
+	{
+		std::string	request = tokens.size() > 2 ? tokens[2] : "";
+		answer = "CAP " + nick + (applyCapRequest(request, caps) ? " ACK :" : " NAK :") + request;
+	}
+	else if (subcommand != "END")
+		return false;
+	return true;
+}
+
+/**
+`CAP` from a registered client: capabilities can still be listed and changed,
+`CAP END` has nothing to end.
+The capabilities only change the format of `CHATHISTORY` and `SEARCH` replies.
+
+Syntax:
+	CAP LS [<version>] | CAP LIST | CAP REQ :<capabilities> | CAP END
+*/
+void	Command::handleCap(User* user, const std::vector<std::string>& tokens)
+{
+	unsigned char	caps = user->getCaps();
+	std::string		answer;
+
+	if (tokens.size() < 2)
+	{
+		reply<ERR_NEEDMOREPARAMS>(user, "CAP");
+		return;
+	}
+	if (!answerCap(user->getNickname(), tokens, caps, answer))
+	{
+		reply<ERR_INVALIDCAPCMD>(user, tokens[1]);
+		return;
+	}
+	if (caps != user->getCaps())
+		user->logUserAction(toString("enabled capabilities: ") + GREEN + capNames(caps) + RESET);
+	user->setCaps(caps);
+	if (!answer.empty())
+		user->sendServerMsg(answer);
+}
+
+//////////////////////////////
+// Unregistered Connections //
+//////////////////////////////
+
+// Promotes the connection to a full user once PASS, NICK and USER are complete.
+static void	tryPromote(Server* server, PendingUser* pending)
+{
+	if (pending->isComplete())
+		server->promotePendingUser(pending);
+}
+
+/**
+Handles a command from a connection that has not completed registration yet.
+
+Only the registration handshake (`PASS`, `NICK`, `USER`, `CAP`) and `QUIT`, `PING`, `PONG`
+are accepted; every other known command is answered with `451`.
+
+ @param server	Pointer to the IRC server instance.
+ @param pending	The unregistered connection.
+ @param tokens	Parsed IRC command tokens.
+
+ @return		`true` if the command was recognized,
+				`false` if the command is unknown.
+*/
+bool	Command::handlePendingCommand(Server* server, PendingUser* pending, std::vector<std::string>& tokens)
+{
+	switch (getCmd(tokens, server))
+	{
+		case NICK:	handlePendingNick(server, pending, tokens); break;
+		case USER:	handlePendingUser(server, pending, tokens); break;
+		case PASS:	handlePendingPass(server, pending, tokens); break;
+		case CAP:	handlePendingCap(server, pending, tokens); break;
+		case SERVER:	handlePendingServer(server, pending, tokens); break;
+		case QUIT:
+			server->closePendingUser(pending->getFd(), toString("disconnected: ") + YELLOW
+				+ (tokens.size() < 2 || tokens[1].empty() ? "Client Quit" : tokens[1]) + RESET);
+			break;
+		case PING:
+			if (tokens.size() < 2)
+				reply<ERR_NOORIGIN>(pending);
+			else
+				pending->sendServerMsg("PONG " + server->getServerName() + " :" + tokens[1]);
+			break;
+		case PONG:
+			if (tokens.size() < 2)
+				reply<ERR_NOORIGIN>(pending);
+			break;
+		case UNKNOWN:
+			return false;
+		default:
+			pending->logAction(toString("tried to execute ")
+				+ YELLOW + tokens[0] + RESET +" before registration");
+			reply<ERR_NOTREGISTERED>(pending);
+			break;
+	}
+	return true;
+}
+
+// `NICK` before registration, see `handleNick()`.
+// The nickname is reserved right away, so two registering clients cannot claim the same one.
+void	Command::handlePendingNick(Server* server, PendingUser* pending, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+	{
+		pending->logAction("sent NICK without a nickname");
+		reply<ERR_NONICKNAMEGIVEN>(pending);
+		return;
+	}
+
+	const std::string&	displayNick = tokens[1];
+
+	if (!isValidNick(displayNick))
+	{
+		pending->logAction(toString("tried to set an invalid nickname: ")
+			+ RED + displayNick + RESET);
+		reply<ERR_ERRONEUSNICKNAME>(pending, displayNick);
+		return;
+	}
+
+	std::string	normNick = normalize(displayNick);
+
+	if (server->isNickInUse(normNick))
+	{
+		pending->logAction(toString("tried to set a nickname already in use: ")
+			+ YELLOW + displayNick + RESET);
+		reply<ERR_NICKNAMEINUSE>(pending, displayNick);
+		return;
+	}
+
+	// Notify the client of its own nick change (temp username until USER is sent)
+	std::string	username = pending->getUsername().empty() ? "~" + displayNick : pending->getUsername();
+	pending->getOutputBuffer() += ":" + toString(pending->getNickname()) + "!" + username + "@"
+		+ pending->getHost() + " NICK :" + displayNick + "\r\n";
+
+	pending->logAction(toString("set nickname to ") + GREEN + displayNick + RESET);
+	server->reservePendingNick(pending, normNick);
+	pending->setNickname(displayNick);
+	tryPromote(server, pending);
+}
+
+// `USER` before registration, see `handleUser()`.
+void	Command::handlePendingUser(Server* server, PendingUser* pending, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 5)
+	{
+		pending->logAction("sent invalid USER command (too few arguments)");
+		reply<ERR_NEEDMOREPARAMS>(pending, "USER");
+		return;
+	}
+
+	pending->logAction("sent valid USER command");
+
+	// Set username and realname / ignore hostname and servername
+	pending->setUser(tokens[1], tokens[4]);
+	tryPromote(server, pending);
+}
+
+// `PASS` before registration, see `handlePass()`.
+void	Command::handlePendingPass(Server* server, PendingUser* pending, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+	{
+		pending->logAction("sent invalid PASS command (missing password)");
+		reply<ERR_NEEDMOREPARAMS>(pending, "PASS");
+		return;
+	}
+
+	// If server password is empty, any password is accepted
+	const std::string&	password = tokens[1];
+	if (!server->getPassword().empty() && password != server->getPassword())
+	{
+		pending->logAction("provided incorrect password");
+		reply<ERR_PASSWDMISMATCH>(pending);
+		return;
+	}
+
+	pending->logAction("sent valid PASS command");
+	pending->setHasPassed(true);
+	tryPromote(server, pending);
+}
+
+/**
+`CAP` before registration, see `handleCap()`.
+`CAP LS` and `CAP REQ` hold registration back until `CAP END`, so the client
+knows what it got before the welcome burst.
+*/
+void	Command::handlePendingCap(Server* server, PendingUser* pending, const std::vector<std::string>& tokens)
+{
+	unsigned char	caps = pending->getCaps();
+	std::string		answer;
+
+	if (tokens.size() < 2)
+	{
+		reply<ERR_NEEDMOREPARAMS>(pending, "CAP");
+		return;
+	}
+	if (!answerCap(pending->getNickname(), tokens, caps, answer))
+	{
+		reply<ERR_INVALIDCAPCMD>(pending, tokens[1]);
+		return;
+	}
+	if (caps != pending->getCaps())
+		pending->logAction(toString("enabled capabilities: ") + GREEN + capNames(caps) + RESET);
+	pending->setCaps(caps);
+	if (!answer.empty())
+		pending->sendServerMsg(answer);
+	if (tokens[1] == "LS" || tokens[1] == "REQ")
+		pending->setNegotiating(true);
+	else if (tokens[1] == "END")
+	{
+		pending->setNegotiating(false);
+		tryPromote(server, pending);
+	}
+}
+
+/**
+`SERVER` before registration: another server linking to this one (RFC 2813, 4.1.2).
+Like a client, it must give the server password first; a connection that has
+started to register as a client (`NICK`/`USER`) cannot turn into a server.
+From here on, the connection is a `ServerLink` (see `Server::acceptServerLink()`).
+
+Syntax:
+	SERVER <servername> <hopcount> :<info>
+*/
+void	Command::handlePendingServer(Server* server, PendingUser* pending, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3)
+	{
+		pending->logAction("sent invalid SERVER command (too few arguments)");
+		reply<ERR_NEEDMOREPARAMS>(pending, "SERVER");
+		return;
+	}
+	if (pending->hasNick() || !pending->getUsername().empty())
+	{
+		reply<ERR_ALREADYREGISTERED>(pending);
+		return;
+	}
+	if (!server->getPassword().empty() && !pending->hasPassed())
+	{
+		pending->logAction("tried to link as a server without the password");
+		reply<ERR_PASSWDMISMATCH>(pending);
+		return;
+	}
+
+	server->acceptServerLink(pending, tokens[1], tokens.size() > 3 ? tokens[3] : "");
+}
@@ -0,0 +1,657 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdlib>		// strtol()
+
+#include "../include/Command.hpp"
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/Channel.hpp"
+#include "../include/ServerLink.hpp"
+#include "../include/utils.hpp"		// normalize(), isValidNick(), isValidChannelName(), toString()
+#include "../include/defines.hpp"	// color formatting
+
+/**
+Splits a line from a server link into its prefix (the origin, without the
+leading ':' and any "!user@host" part; empty if there is none) and its tokens.
+*/
+static void	splitPrefix(const std::string& line, std::string& prefix, std::vector<std::string>& tokens)
+{
+	size_t	start = 0;
+
+	prefix.clear();
+	if (!line.empty() && line[0] == ':')
+	{
+		size_t	space = line.find(' ');
+		prefix = line.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+		prefix = prefix.substr(0, prefix.find('!'));
+		if (space == std::string::npos)
+		{
+			tokens.clear();
+			return;
+		}
+		start = space + 1;
+	}
+	tokens = Command::tokenize(line.substr(start));
+}
+
+/**
+Returns the user a line from `link` comes from: the user named in the prefix,
+if they are on the far side of that link. Anything else is a desync or a
+forged origin, and the line is ignored.
+*/
+static User*	getRemoteSource(Server* server, ServerLink* link, const std::string& prefix)
+{
+	if (prefix.empty())
+		return NULL;
+
+	User*	user = server->getUser(normalize(prefix));
+	return user && user->getLink() == link ? user : NULL;
+}
+
+// Deletes a channel nobody is left in (apart from the bot), as after a local PART or KICK.
+static void	deleteIfEmpty(Server* server, Channel* channel)
+{
+	std::string	channelName = channel->get_name();
+
+	if (server->getBotMode() && channel->get_connected_user_number() == 1
+		&& channel->is_user_member(server->getBotUser()))
+	{
+		server->getBotUser()->removeChannel(channelName);
+		server->deleteChannel(channelName, "no connected users");
+	}
+	else if (!channel->get_connected_user_number())
+		server->deleteChannel(channelName, "no connected users");
+}
+
+/**
+Handles a line received from a neighbouring server (see `ServerLink`).
+
+Before the link is active, only the handshake is accepted (`PASS`, `SERVER`,
+`ERROR`). Afterwards, every change is applied here, shown to the local users
+it concerns, and passed on to the other links (never back to the one it came
+from), so it crosses the spanning tree once. Lines from an origin that is not
+behind the link they came on are ignored.
+
+ @param server	Pointer to the IRC server instance.
+ @param link	The link the line was received on.
+ @param line	The raw line, without "\r\n".
+*/
+void	Command::handleServerMessage(Server* server, ServerLink* link, const std::string& line)
+{
+	std::string					prefix;
+	std::vector<std::string>	tokens;
+
+	splitPrefix(line, prefix, tokens);
+	if (tokens.empty())
+		return;
+
+	Cmd	cmd = getCmd(tokens, server);
+	if (link->getState() != ServerLink::LINK_ACTIVE)
+	{
+		handleLinkHandshake(server, link, cmd, tokens);
+		return;
+	}
+
+	User*	source = getRemoteSource(server, link, prefix);
+	switch (cmd)
+	{
+		case SERVER:	handleRemoteServer(server, link, prefix, tokens); break;
+		case SQUIT:		handleSquit(server, link, tokens); break;
+		case NICK:		handleRemoteNick(server, link, prefix, tokens); break;
+		case KILL:		handleKill(server, link, prefix, tokens); break;
+		case NJOIN:		handleNjoin(server, link, tokens); break;
+		case TOPIC:		handleRemoteTopic(server, link, prefix, tokens); break;
+		case MODE:		handleRemoteMode(server, link, prefix, tokens); break;
+		case PING:
+			link->send(":" + server->getServerName() + " PONG " + server->getServerName()
+				+ (tokens.size() > 1 ? " :" + tokens[1] : ""));
+			break;
+		case PONG:		break; // Any traffic counts as an answer (see `Server::handleLinkKeepalive()`)
+		case ERROR:
+			server->closeLink(link, "ERROR from " + link->getName() + ": "
+				+ (tokens.size() > 1 ? tokens[1] : "(no reason)"));
+			break;
+		default:
+			if (!source) // Commands below come from a user
+				break;
+			switch (cmd)
+			{
+				case QUIT:		handleRemoteQuit(server, link, source, tokens); break;
+				case JOIN:		handleRemoteJoin(server, link, source, tokens); break;
+				case PART:		handleRemotePart(server, link, source, tokens); break;
+				case KICK:		handleRemoteKick(server, link, source, tokens); break;
+				case INVITE:	handleRemoteInvite(server, link, source, tokens); break;
+				case PRIVMSG:	handleRemoteMessage(server, link, source, tokens, "PRIVMSG"); break;
+				case NOTICE:	handleRemoteMessage(server, link, source, tokens, "NOTICE"); break;
+				default:		break; // Not relayed between servers
+			}
+	}
+}
+
+/**
+Handshake of a link (RFC 2813, 4.1): the peer gives the server password
+(`PASS`), then introduces itself (`SERVER`). For a link accepted over TCP,
+both were checked while it was an unregistered connection; this is the
+outgoing side, and the accepting side of a local link.
+*/
+void	Command::handleLinkHandshake(Server* server, ServerLink* link, Cmd cmd, const std::vector<std::string>& tokens)
+{
+	switch (cmd)
+	{
+		case PASS:
+			if (tokens.size() > 1 && (server->getPassword().empty() || tokens[1] == server->getPassword()))
+				link->setHasPassed(true);
+			else
+				server->closeLink(link, "Password incorrect");
+			break;
+		case SERVER:
+			if (!server->getPassword().empty() && !link->hasPassed())
+				server->closeLink(link, "Password required");
+			else if (tokens.size() < 3)
+				server->closeLink(link, "Invalid SERVER");
+			else
+			{
+				if (!link->getTarget()) // Accepted local link: answers only once the peer checked out
+					server->sendHandshake(link);
+				server->registerServerLink(link, tokens[1], tokens.size() > 3 ? tokens[3] : "");
+			}
+			break;
+		case ERROR:
+			server->closeLink(link, "ERROR from peer: " + (tokens.size() > 1 ? tokens[1] : "(no reason)"));
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+A server joined the network behind `link`:
+	:<uplink> SERVER <name> <hopcount> :<info>
+A name that is already known means the network just got a loop: the link
+that closes it is dropped (RFC 2813, 5.4).
+*/
+void	Command::handleRemoteServer(Server* server, ServerLink* link, const std::string& prefix,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3)
+		return;
+
+	const std::string&	name = tokens[1];
+	if (!isValidServerName(name) || server->isServerNameInUse(name))
+	{
+		server->closeLink(link, "Server " + name + " already exists");
+		return;
+	}
+
+	std::string	uplink = prefix.empty() ? link->getName() : prefix;
+	std::string	info = tokens.size() > 3 ? tokens[3] : "";
+	int			hops = std::atoi(tokens[2].c_str());
+
+	server->addRemoteServer(link, name, uplink, hops, info);
+	server->propagate(":" + uplink + " SERVER " + name + " " + toString(hops + 1) + " :" + info, link);
+	server->logServerMessage(toString("Link: ") + BOT_COLOR + name + RESET + " joined the network behind "
+		+ link->getName() + " (" + toString(hops) + " hops)");
+}
+
+/**
+A server left the network:
+	SQUIT <server> :<comment>
+Its users (and those of the servers behind it) quit with the netsplit reason.
+*/
+void	Command::handleSquit(Server* server, ServerLink* link, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	std::string			reason = tokens.size() > 2 ? tokens[2] : tokens[1];
+	const RemoteServer*	remote = server->getRemoteServer(tokens[1]);
+	if (!remote || remote->link != link)
+		return;
+	if (remote->hops == 1) // The peer itself is leaving
+	{
+		server->closeLink(link, reason);
+		return;
+	}
+	server->propagate("SQUIT " + remote->name + " :" + reason, link);
+	server->removeRemoteServer(tokens[1], reason);
+}
+
+/**
+A user joined the network, or one changed their nickname:
+	NICK <nickname> <hopcount> <username> <host> <server> <umode> :<realname>
+	:<old nickname> NICK <new nickname>
+
+If the nickname is taken here, the same name was picked on both sides of the
+link at once: both users are removed (RFC 2813, 5.2). The one behind the link
+gets a `KILL` sent back, ours one sent to the rest of the network.
+*/
+void	Command::handleRemoteNick(Server* server, ServerLink* link, const std::string& prefix,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	const std::string&	nick = tokens[1];
+	const std::string	normNick = normalize(nick);
+	const std::string	killPrefix = ":" + server->getServerName() + " KILL ";
+	User*				source = getRemoteSource(server, link, prefix);
+
+	if (!source) // Introduction of a new user
+	{
+		if (tokens.size() < 7)
+			return;
+		const RemoteServer*	home = server->getRemoteServer(tokens[5]);
+		if (!isValidNick(nick) || !home || home->link != link)
+			return;
+		if (server->isNickInUse(normNick))
+		{
+			server->logServerMessage(YELLOW + toString("Link: nick collision on ") + nick + " with "
+				+ link->getName() + RESET);
+			link->send(killPrefix + nick + " :Nick collision");
+			User*	ours = server->getUser(normNick);
+			if (ours && !ours->getIsBot()) // Otherwise an unregistered connection holds it: it can try again
+			{
+				server->propagate(killPrefix + ours->getNickname() + " :Nick collision", link);
+				server->killUser(ours, "Nick collision");
+			}
+			return;
+		}
+		server->addRemoteUser(link, home->name, nick, tokens[3], tokens[4], tokens.size() > 7 ? tokens[7] : "");
+		server->propagate("NICK " + nick + " " + toString(home->hops + 1) + " " + tokens[3] + " " + tokens[4]
+			+ " " + home->name + " + :" + (tokens.size() > 7 ? tokens[7] : ""), link);
+		return;
+	}
+
+	// Nickname change
+	std::string	oldNick = source->getNickname();
+	if (!isValidNick(nick))
+		return;
+	if (normNick != source->getNicknameLower() && server->isNickInUse(normNick))
+	{
+		server->logServerMessage(YELLOW + toString("Link: nick collision on ") + nick + " with "
+			+ link->getName() + RESET);
+		link->send(killPrefix + nick + " :Nick collision"); // Their side knows the user by the new name
+		server->propagate(killPrefix + oldNick + " :Nick collision", link);
+		server->removeRemoteUser(source, "Nick collision");
+		User*	ours = server->getUser(normNick);
+		if (ours && !ours->getIsBot())
+		{
+			server->propagate(killPrefix + ours->getNickname() + " :Nick collision", link);
+			server->killUser(ours, "Nick collision");
+		}
+		return;
+	}
+
+	// Re-key the user in their channels, then show the change to the local members (as in `handleNick()`)
+	std::string	notice = ":" + source->buildHostmask() + " NICK :" + nick;
+	std::string	oldNickLower = source->getNicknameLower();
+	source->setNickname(nick, normNick);
+	for (std::set<std::string>::const_iterator it = source->getChannels().begin();
+			it != source->getChannels().end(); ++it)
+	{
+		Channel*	channel = server->getChannel(*it);
+		if (channel)
+		{
+			channel->rename_user(source, oldNickLower);
+			broadcastToChannel(channel, notice);
+		}
+	}
+	server->propagate(":" + oldNick + " NICK " + nick, link);
+}
+
+/**
+A user left the network:
+	:<nickname> QUIT :<reason>
+*/
+void	Command::handleRemoteQuit(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens)
+{
+	std::string	reason = tokens.size() > 1 ? tokens[1] : "Client Quit";
+
+	server->propagate(":" + source->getNickname() + " QUIT :" + reason, link);
+	server->removeRemoteUser(source, reason);
+}
+
+/**
+A user is removed from the network (nickname collision, or an operator elsewhere):
+	:<origin> KILL <nickname> :<reason>
+Passed on in every direction but the one it came from, so it reaches the
+user's server wherever that is.
+*/
+void	Command::handleKill(Server* server, ServerLink* link, const std::string& prefix,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	User*	victim = server->getUser(normalize(tokens[1]));
+	if (!victim || victim->getIsBot())
+		return;
+
+	std::string	origin = prefix.empty() ? link->getName() : prefix;
+	std::string	reason = tokens.size() > 2 ? tokens[2] : "Killed";
+	server->propagate(":" + origin + " KILL " + victim->getNickname() + " :" + reason, link);
+	server->logServerMessage(YELLOW + toString("Link: ") + victim->getNickname() + " killed by " + origin
+		+ " (" + reason + ")" + RESET);
+	server->killUser(victim, "Killed (" + origin + " (" + reason + "))");
+}
+
+/**
+Members of a channel (burst, or a channel just created elsewhere):
+	NJOIN <channel> :[@]<nickname>{,[@]<nickname>}
+Each member is shown joining (and getting +o) to the local members; the
+channel is created if needed.
+*/
+void	Command::handleNjoin(Server* server, ServerLink* link, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3 || !isValidChannelName(tokens[1]))
+		return;
+
+	std::vector<std::string>	entries = splitCommaList(tokens[2]);
+	std::string					accepted;
+	Channel*					channel = NULL;
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		std::string	entry = entries[i];
+		bool		op = !entry.empty() && entry[0] == '@';
+		while (!entry.empty() && (entry[0] == '@' || entry[0] == '+'))
+			entry.erase(0, 1);
+
+		User*	member = getRemoteSource(server, link, entry);
+		if (!member)
+			continue;
+		if (!channel)
+			channel = server->getOrCreateChannel(tokens[1], member);
+		if (!channel)
+			return;
+
+		const std::string&	channelName = channel->get_name();
+		if (!channel->is_user_member(member))
+		{
+			channel->add_user(member);
+			member->addChannel(channelName);
+			broadcastToChannel(channel, ":" + member->buildHostmask() + " JOIN :" + channelName);
+		}
+		if (op && !channel->is_user_operator(member))
+		{
+			channel->make_user_operator(member);
+			broadcastToChannel(channel, ":" + member->getServerName() + " MODE " + channelName + " +o "
+				+ member->getNickname());
+		}
+		accepted += (accepted.empty() ? "" : ",") + std::string(op ? "@" : "") + member->getNickname();
+	}
+	if (channel)
+		server->propagate("NJOIN " + channel->get_name() + " :" + accepted, link);
+}
+
+/**
+A user joined channels (without becoming an operator, see `handleNjoin()`):
+	:<nickname> JOIN <channel>{,<channel>}
+*/
+void	Command::handleRemoteJoin(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	std::vector<std::string>	channelNames = splitCommaList(tokens[1]);
+	for (size_t i = 0; i < channelNames.size(); ++i)
+	{
+		if (!isValidChannelName(channelNames[i]))
+			continue;
+		Channel*	channel = server->getOrCreateChannel(channelNames[i], source);
+		if (!channel || channel->is_user_member(source))
+			continue;
+
+		const std::string&	channelName = channel->get_name();
+		channel->add_user(source);
+		source->addChannel(channelName);
+		broadcastToChannel(channel, ":" + source->buildHostmask() + " JOIN :" + channelName);
+		server->propagate(":" + source->getNickname() + " JOIN " + channelName, link);
+	}
+}
+
+/**
+A user left channels:
+	:<nickname> PART <channel>{,<channel>} [:<message>]
+*/
+void	Command::handleRemotePart(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	std::string					message = tokens.size() > 2 ? " :" + tokens[2] : "";
+	std::vector<std::string>	channelNames = splitCommaList(tokens[1]);
+	for (size_t i = 0; i < channelNames.size(); ++i)
+	{
+		Channel*	channel = server->getChannel(channelNames[i]);
+		if (!channel || !channel->is_user_member(source))
+			continue;
+
+		std::string	channelName = channel->get_name();
+		broadcastToChannel(channel, ":" + source->buildHostmask() + " PART " + channelName + message);
+		server->propagate(":" + source->getNickname() + " PART " + channelName + message, link);
+		channel->remove_user(source);
+		source->removeChannel(channelName);
+		deleteIfEmpty(server, channel);
+	}
+}
+
+/**
+A user was kicked (the kicker is behind the link, the victim anywhere):
+	:<nickname> KICK <channel> <victim> [:<reason>]
+*/
+void	Command::handleRemoteKick(Server* server, ServerLink* link, User* source, const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3)
+		return;
+
+	Channel*	channel = server->getChannel(tokens[1]);
+	User*		victim = server->getUser(normalize(tokens[2]));
+	if (!channel || !victim || !channel->is_user_member(victim))
+		return;
+
+	std::string	channelName = channel->get_name();
+	std::string	reason = tokens.size() > 3 ? tokens[3] : source->getNickname();
+	std::string	kick = " KICK " + channelName + " " + victim->getNickname() + " :" + reason;
+	broadcastToChannel(channel, ":" + source->buildHostmask() + kick);
+	server->propagate(":" + source->getNickname() + kick, link);
+	channel->remove_user(victim);
+	victim->removeChannel(channelName);
+	if (!victim->getLink() && !victim->getIsBot())
+		victim->logUserAction("was kicked from " + toString(BLUE) + channelName + RESET + " by "
+			+ source->getNickname() + "@" + source->getServerName());
+	deleteIfEmpty(server, channel);
+}
+
+/**
+A channel's topic changed:
+	:<nickname> TOPIC <channel> [:<topic>]
+	:<server> TOPIC <channel> <set at> <set by> :<topic>	(burst)
+A burst topic only replaces ours if we have none or it is more recent.
+*/
+void	Command::handleRemoteTopic(Server* server, ServerLink* link, const std::string& prefix,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return;
+
+	Channel*	channel = server->getChannel(tokens[1]);
+	if (!channel)
+		return;
+
+	const std::string&	channelName = channel->get_name();
+	User*				source = getRemoteSource(server, link, prefix);
+	if (source)
+	{
+		std::string	topic = tokens.size() > 2 ? tokens[2] : "";
+		channel->set_topic(topic, source->buildHostmask());
+		broadcastToChannel(channel, ":" + source->buildHostmask() + " TOPIC " + channelName + " :" + topic);
+		server->propagate(":" + source->getNickname() + " TOPIC " + channelName + " :" + topic, link);
+		return;
+	}
+
+	const RemoteServer*	origin = server->getRemoteServer(prefix);
+	if (!origin || origin->link != link || tokens.size() < 5)
+		return;
+	time_t	setAt = static_cast<time_t>(std::strtol(tokens[2].c_str(), NULL, 10));
+	if (!channel->get_topic().empty() && setAt <= channel->get_topic_time())
+		return;
+	channel->set_topic(tokens[4], tokens[3], setAt);
+	broadcastToChannel(channel, ":" + origin->name + " TOPIC " + channelName + " :" + tokens[4]);
+	server->propagate(":" + origin->name + " TOPIC " + channelName + " " + tokens[2] + " " + tokens[3]
+		+ " :" + tokens[4], link);
+}
+
+/**
+Channel modes changed (by a user behind the link, or by a server in a burst):
+	:<origin> MODE <channel> <modes> [<parameters>]
+The origin's server checked the change: it is applied as is (a full mask
+list too). Modes `l` and `k` take a parameter when set; `o`, `b`, `e` and `I`
+always.
+*/
+void	Command::handleRemoteMode(Server* server, ServerLink* link, const std::string& prefix,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3)
+		return;
+
+	User*				source = getRemoteSource(server, link, prefix);
+	const RemoteServer*	origin = source ? NULL : server->getRemoteServer(prefix);
+	Channel*			channel = server->getChannel(tokens[1]);
+	if (!channel || (!source && (!origin || origin->link != link)))
+		return;
+
+	const std::string&	modes = tokens[2];
+	size_t				paramIndex = 3;
+	bool				adding = true;
+	for (size_t i = 0; i < modes.size(); ++i)
+	{
+		char	mode = modes[i];
+		bool	hasParam = paramIndex < tokens.size();
+		switch (mode)
+		{
+			case '+':	adding = true; break;
+			case '-':	adding = false; break;
+			case 'i':	channel->set_invite_only(adding); break;
+			case 't':	channel->set_topic_protection(adding); break;
+			case 'l':
+				if (!adding)
+					channel->set_user_limit(0);
+				else if (hasParam)
+					channel->set_user_limit(std::atoi(tokens[paramIndex++].c_str()));
+				break;
+			case 'k':
+				if (!adding)
+					channel->set_password("");
+				else if (hasParam)
+					channel->set_password(tokens[paramIndex++]);
+				break;
+			case 'o':
+				if (hasParam)
+				{
+					User*	target = server->getUser(normalize(tokens[paramIndex++]));
+					if (target && channel->is_user_member(target))
+					{
+						if (adding)
+							channel->make_user_operator(target);
+						else
+							channel->remove_user_operator_status(target);
+					}
+				}
+				break;
+			case 'b':
+			case 'e':
+			case 'I':
+				if (hasParam)
+				{
+					Channel::MaskList	list = mode == 'b' ? Channel::BAN_LIST
+						: mode == 'e' ? Channel::EXCEPT_LIST : Channel::INVEX_LIST;
+					const std::string&	mask = tokens[paramIndex++];
+					if (adding)
+						channel->add_mask(list, mask, source ? source->buildHostmask() : origin->name);
+					else
+						channel->remove_mask(list, mask);
+				}
+				break;
+			default:	break;
+		}
+	}
+
+	std::string	change = " MODE " + channel->get_name();
+	for (size_t i = 2; i < tokens.size(); ++i)
+		change += " " + tokens[i];
+	broadcastToChannel(channel, ":" + (source ? source->buildHostmask() : origin->name) + change);
+	server->propagate(":" + (source ? source->getNickname() : origin->name) + change, link);
+}
+
+/**
+A message from a user behind the link, to a channel or to a user:
+	:<nickname> PRIVMSG|NOTICE <target> :<text>
+A channel message goes to the local members and to the other links with
+members behind them; a private message goes to its target, or one link
+further towards them.
+*/
+void	Command::handleRemoteMessage(Server* server, ServerLink* link, User* source,
+	const std::vector<std::string>& tokens, const std::string& commandName)
+{
+	if (tokens.size() < 3)
+		return;
+
+	const std::string&	target = tokens[1];
+	const std::string&	text = tokens[2];
+	if (isValidChannelName(target))
+	{
+		Channel*	channel = server->getChannel(target);
+		if (!channel)
+			return;
+
+		std::string	line = ":" + source->buildHostmask() + " " + commandName + " " + channel->get_name() + " :" + text;
+		broadcastToChannel(channel, line);
+		server->getHistory().record(channel->get_name_lower(), line);
+		server->propagateToChannel(channel, ":" + source->getNickname() + " " + commandName + " "
+			+ channel->get_name() + " :" + text, link);
+		return;
+	}
+
+	User*	targetUser = server->getUser(normalize(target));
+	if (!targetUser || targetUser->getIsBot())
+		return;
+	if (targetUser->getLink())
+	{
+		if (targetUser->getLink() != link)
+			targetUser->getLink()->send(":" + source->getNickname() + " " + commandName + " "
+				+ targetUser->getNickname() + " :" + text);
+		return;
+	}
+	targetUser->sendMsgFromUser(source, commandName + " " + targetUser->getNickname() + " :" + text);
+}
+
+/**
+An invitation from a user behind the link:
+	:<nickname> INVITE <nickname> <channel>
+The inviter's server checked the inviter may invite; ours records the invite.
+*/
+void	Command::handleRemoteInvite(Server* server, ServerLink* link, User* source,
+	const std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 3)
+		return;
+
+	User*	targetUser = server->getUser(normalize(tokens[1]));
+	if (!targetUser || targetUser->getIsBot())
+		return;
+	if (targetUser->getLink())
+	{
+		if (targetUser->getLink() != link)
+			targetUser->getLink()->send(":" + source->getNickname() + " INVITE " + targetUser->getNickname()
+				+ " " + tokens[2]);
+		return;
+	}
+
+	Channel*	channel = server->getChannel(tokens[2]);
+	if (channel)
+		channel->add_invite(targetUser->getNicknameLower());
+	targetUser->sendMsgFromUser(source, "INVITE " + targetUser->getNickname() + " :" + tokens[2]);
+}
@@ -5,7 +5,9 @@
 #include "../include/Server.hpp"
 #include "../include/Command.hpp"
 #include "../include/User.hpp"
-#include "../include/defines.hpp"	// colors
+#include "../include/Utf8.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/defines.hpp"	// colors, UTF8_ONLY, UTF8_REPLACE
 #include "../include/utils.hpp"		// toString
 
 static int	toUpperChar(int c);
@@ -25,6 +27,7 @@ Command::Cmd	Command::getCmd(const std::vector<std::string>& tokens, Server* ser
 	if (cmd == "NICK")		return NICK;
 	if (cmd == "USER")		return USER;
 	if (cmd == "PASS")		return PASS;
+	if (cmd == "CAP")		return CAP;
 	if (cmd == "JOIN")		return JOIN;
 	if (cmd == "QUIT")		return QUIT;
 	if (cmd == "PART")		return PART;
@@ -35,8 +38,21 @@ Command::Cmd	Command::getCmd(const std::vector<std::string>& tokens, Server* ser
 	if (cmd == "INVITE")	return INVITE;
 	if (cmd == "MODE")		return MODE;
 	if (cmd == "LIST")		return LIST;
+	if (cmd == "NAMES")		return NAMES;
+	if (cmd == "PING")		return PING;
+	if (cmd == "PONG")		return PONG;
+	if (cmd == "STATS")		return STATS;
+	if (cmd == "MOTD")		return MOTD;
+	if (cmd == "LUSERS")	return LUSERS;
+	if (cmd == "CHATHISTORY")	return CHATHISTORY;
+	if (cmd == "SEARCH")	return SEARCH;
 	if (cmd == "JOKE" && server->getBotMode())	return JOKE;
 	if (cmd == "CALC" && server->getBotMode())	return CALC;
+	if (cmd == "SERVER")	return SERVER;
+	if (cmd == "SQUIT")		return SQUIT;
+	if (cmd == "NJOIN")		return NJOIN;
+	if (cmd == "KILL")		return KILL;
+	if (cmd == "ERROR")		return ERROR;
 
 	return UNKNOWN;
 }
@@ -49,12 +65,45 @@ bool	Command::checkRegistered(User* user, const std::string& command)
 	{
 		user->logUserAction(toString("tried to execute ")
 			+ YELLOW + command + RESET +" before registration");
-		user->sendError(451, "", "You have not registered");
+		reply<ERR_NOTREGISTERED>(user);
 		return false;
 	}
 	return true;
 }
 
+/**
+Enforces `UTF8_ONLY` on the text of a message or topic, once per command
+(before it is sent to any target): invalid UTF-8 is either replaced with
+U+FFFD (`UTF8_REPLACE`) or refused with the IRCv3 standard reply
+`FAIL <command> INVALID_UTF8`.
+
+ @param text		The text, repaired in place if so configured.
+ @param sendReplies	`false` for `NOTICE` (no automatic replies).
+ @return			`false` if the command must not go on.
+*/
+bool	Command::checkUtf8(User* user, std::string& text, const std::string& command, bool sendReplies)
+{
+	if (!UTF8_ONLY)
+		return true;
+
+	if (UTF8_REPLACE)
+	{
+		size_t	replaced = Utf8::repair(text);
+		if (replaced > 0)
+			user->logUserAction(toString("sent invalid UTF-8 in ") + YELLOW + command + RESET + " ("
+				+ toString(replaced) + " sequences replaced)");
+		return true;
+	}
+	if (Utf8::isValid(text))
+		return true;
+
+	user->logUserAction(toString("sent invalid UTF-8 in ") + YELLOW + command + RESET + " (refused)");
+	if (sendReplies)
+		user->sendServerMsg("FAIL " + command
+			+ " INVALID_UTF8 :Message rejected, your IRC software MUST use UTF-8 encoding on this network");
+	return false;
+}
+
 /**
 Splits a comma-separated string into a vector of strings.
 
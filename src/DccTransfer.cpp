@@ -0,0 +1,412 @@
+#include <string>
+#include <cerrno>		// errno
+#include <cstring>		// strerror()
+
+#include <unistd.h>		// close(), read(), write(), pipe()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK, splice()
+#include <sys/socket.h>	// accept(), connect(), shutdown(), getsockopt()
+
+#include "../include/DccTransfer.hpp"
+#include "../include/defines.hpp"	// DCC_CHUNK_SIZE
+
+///////////////
+// Direction //
+///////////////
+
+DccTransfer::Direction::Direction()
+	:	from(-1), to(-1), offset(0), pending(0), eof(false), done(false), bytes(0)
+{
+	pipe[0] = -1;
+	pipe[1] = -1;
+}
+
+/////////////////
+// DccTransfer //
+/////////////////
+
+/**
+ @param listenFd		Non-blocking socket listening on the relay port (owned from now on).
+ @param senderAddr		Where the sender listens for the DCC connection.
+ @param recipientAddr	Address of the recipient's IRC connection; only it may connect.
+ @param rateLimit		Bytes per second of file data, 0 for no limit.
+*/
+DccTransfer::DccTransfer(int listenFd, const sockaddr_in& senderAddr, const in_addr& recipientAddr,
+							unsigned long rateLimit)
+	:	_state(DCC_LISTENING), _listenFd(listenFd), _recipientFd(-1), _senderFd(-1),
+		_senderAddr(senderAddr), _recipientAddr(recipientAddr), _rateLimit(rateLimit),
+		_tokens(0), _refilledAt(0), _lastActivity(0)
+{}
+
+DccTransfer::~DccTransfer()
+{
+	closeFd(_listenFd);
+	closeFd(_recipientFd);
+	closeFd(_senderFd);
+	for (int i = 0; i < 2; ++i)
+	{
+		closeFd(_data.pipe[i]);
+		closeFd(_acks.pipe[i]);
+	}
+}
+
+/**
+Adds the transfer's sockets to the `select()` sets, depending on its state.
+A socket is only watched for reading while its direction has room for more
+bytes, and (file data only) while the token bucket allows sending.
+
+ @return	The highest fd added, or -1 if none.
+*/
+int	DccTransfer::prepareFds(fd_set& readFds, fd_set& writeFds, unsigned long nowMs)
+{
+	int	maxFd = -1;
+
+	switch (_state)
+	{
+		case DCC_LISTENING:
+			FD_SET(_listenFd, &readFds);
+			return _listenFd;
+		case DCC_CONNECTING:
+			FD_SET(_senderFd, &writeFds);
+			return _senderFd;
+		case DCC_RELAYING:
+			break;
+		default:
+			return -1;
+	}
+
+	refill(nowMs);
+	Direction*	dirs[2] = { &_data, &_acks };
+	for (int i = 0; i < 2; ++i)
+	{
+		Direction&	dir = *dirs[i];
+		if (dir.done)
+			continue;
+		if (dir.pending > 0)
+		{
+			FD_SET(dir.to, &writeFds);
+			if (dir.to > maxFd)
+				maxFd = dir.to;
+		}
+		bool	throttled = (&dir == &_data && _rateLimit > 0 && _tokens < getThreshold());
+#ifdef LINUX_OS
+		bool	hasRoom = dir.pending < DCC_CHUNK_SIZE;	// The pipe takes more while it is drained
+#else
+		bool	hasRoom = dir.pending == 0;				// The buffer is only refilled once written out
+#endif
+		if (!dir.eof && hasRoom && !throttled)
+		{
+			FD_SET(dir.from, &readFds);
+			if (dir.from > maxFd)
+				maxFd = dir.from;
+		}
+	}
+	return maxFd;
+}
+
+/**
+Handles the sockets `select()` reported as ready and advances the transfer.
+
+ @return	The new state; `DCC_FINISHED` and `DCC_FAILED` mean the transfer
+			is over and can be deleted.
+*/
+DccTransfer::State	DccTransfer::handleEvents(fd_set& readFds, fd_set& writeFds, unsigned long nowMs)
+{
+	if (_state == DCC_LISTENING && FD_ISSET(_listenFd, &readFds))
+	{
+		if (!acceptRecipient(nowMs))
+			return _state;
+	}
+	if (_state == DCC_CONNECTING && FD_ISSET(_senderFd, &writeFds))
+	{
+		if (!finishConnect(nowMs))
+			return _state;
+	}
+	if (_state != DCC_RELAYING)
+		return _state;
+
+	Direction*	dirs[2] = { &_data, &_acks };
+	for (int i = 0; i < 2; ++i)
+	{
+		Direction&		dir = *dirs[i];
+		unsigned long	before = dir.bytes;
+
+		if (dir.done)
+			continue;
+		if (dir.pending > 0 && FD_ISSET(dir.to, &writeFds) && !drain(dir))
+			return _state;
+		if (FD_ISSET(dir.from, &readFds))
+		{
+			size_t	maxBytes = DCC_CHUNK_SIZE - dir.pending;
+			if (&dir == &_data && _rateLimit > 0 && _tokens < maxBytes)
+				maxBytes = _tokens;
+			size_t	pendingBefore = dir.pending;
+			if (maxBytes > 0 && !fill(dir, maxBytes))
+				return _state;
+			if (&dir == &_data && _rateLimit > 0)
+				_tokens -= dir.pending - pendingBefore;
+		}
+		if (dir.bytes != before || dir.pending != 0)
+			_lastActivity = nowMs;
+		if (dir.eof && dir.pending == 0)
+		{
+			shutdown(dir.to, SHUT_WR); // Pass the EOF on
+			dir.done = true;
+		}
+	}
+
+	if (_data.done && _acks.done)
+		_state = DCC_FINISHED;
+	return _state;
+}
+
+/**
+Returns how long the file data direction has to wait for the token bucket.
+
+ @return	Milliseconds until enough tokens are available, or -1 if the
+			transfer is not throttled right now.
+*/
+long	DccTransfer::getThrottleMs() const
+{
+	if (_state != DCC_RELAYING || _rateLimit == 0 || _data.eof || _data.done)
+		return -1;
+
+	unsigned long	threshold = getThreshold();
+	if (_tokens >= threshold)
+		return -1;
+	return static_cast<long>((threshold - _tokens) * 1000 / _rateLimit + 1);
+}
+
+/**
+Accepts the recipient and starts the non-blocking connect() to the sender.
+A connection from another address than the recipient's IRC connection is
+closed and the relay keeps listening, so a port scan cannot take the file.
+*/
+bool	DccTransfer::acceptRecipient(unsigned long nowMs)
+{
+	sockaddr_in	peerAddr;
+	socklen_t	len = sizeof(peerAddr);
+
+	_recipientFd = accept(_listenFd, reinterpret_cast<sockaddr*>(&peerAddr), &len);
+	if (_recipientFd == -1)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+			return false; // Spurious wake-up, keep listening
+		fail("accept()");
+		return false;
+	}
+	if (peerAddr.sin_family != AF_INET || peerAddr.sin_addr.s_addr != _recipientAddr.s_addr)
+	{
+		closeFd(_recipientFd); // Not the recipient, keep listening
+		return false;
+	}
+	closeFd(_listenFd); // One recipient per offer
+	if (_recipientFd >= FD_SETSIZE)
+	{
+		fail("accept() (fd out of select() range)");
+		return false;
+	}
+	fcntl(_recipientFd, F_SETFL, O_NONBLOCK);
+	_lastActivity = nowMs;
+
+	_senderFd = socket(AF_INET, SOCK_STREAM, 0);
+	if (_senderFd == -1 || _senderFd >= FD_SETSIZE)
+	{
+		fail("socket()");
+		return false;
+	}
+	fcntl(_senderFd, F_SETFL, O_NONBLOCK);
+	if (connect(_senderFd, reinterpret_cast<sockaddr*>(&_senderAddr), sizeof(_senderAddr)) == 0)
+		return finishConnect(nowMs);
+	if (errno != EINPROGRESS)
+	{
+		fail("connect()");
+		return false;
+	}
+	_state = DCC_CONNECTING;
+	return true;
+}
+
+// The connect() to the sender has completed: checks its result and starts relaying.
+bool	DccTransfer::finishConnect(unsigned long nowMs)
+{
+	int			error = 0;
+	socklen_t	len = sizeof(error);
+
+	if (getsockopt(_senderFd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+		error = errno;
+	if (error != 0)
+	{
+		errno = error;
+		fail("connect()");
+		return false;
+	}
+
+	if (!openDirection(_data, _senderFd, _recipientFd) || !openDirection(_acks, _recipientFd, _senderFd))
+		return false;
+	_state = DCC_RELAYING;
+	_lastActivity = nowMs;
+	_refilledAt = nowMs;
+	_tokens = getThreshold(); // Enough to start reading right away
+	return true;
+}
+
+// Sets up the buffer of one direction (a pipe for splice(), or a plain buffer).
+bool	DccTransfer::openDirection(Direction& dir, int from, int to)
+{
+	dir.from = from;
+	dir.to = to;
+#ifdef LINUX_OS
+	if (::pipe(dir.pipe) == -1)
+	{
+		fail("pipe()");
+		return false;
+	}
+	fcntl(dir.pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(dir.pipe[1], F_SETFL, O_NONBLOCK);
+#else
+	dir.buffer.resize(DCC_CHUNK_SIZE);
+#endif
+	return true;
+}
+
+/**
+Reads up to `maxBytes` from the direction's source into its buffer.
+On Linux the bytes go from the socket straight into the pipe (`splice()`).
+
+ @return	`false` if the transfer ended because of an error.
+*/
+bool	DccTransfer::fill(Direction& dir, size_t maxBytes)
+{
+	ssize_t	n;
+
+#ifdef LINUX_OS
+	n = splice(dir.from, NULL, dir.pipe[1], NULL, maxBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	if (dir.pending > 0)
+		return true; // Buffer is written out first
+	if (maxBytes > dir.buffer.size())
+		maxBytes = dir.buffer.size();
+	n = read(dir.from, &dir.buffer[0], maxBytes);
+	dir.offset = 0;
+#endif
+	if (n > 0)
+		dir.pending += n;
+	else if (n == 0)
+		dir.eof = true;
+	else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+		// A peer resetting its end after all file data went through is a normal close
+		if (&dir == &_acks && _data.done)
+		{
+			dir.eof = true;
+			return true;
+		}
+		fail(&dir == &_data ? "receiving from sender" : "receiving from recipient");
+		return false;
+	}
+	return true;
+}
+
+/**
+Writes the direction's buffered bytes to its destination.
+On Linux they are moved from the pipe to the socket (`splice()`).
+
+ @return	`false` if the transfer ended because of an error.
+*/
+bool	DccTransfer::drain(Direction& dir)
+{
+	ssize_t	n;
+
+#ifdef LINUX_OS
+	n = splice(dir.pipe[0], NULL, dir.to, NULL, dir.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+	n = write(dir.to, &dir.buffer[dir.offset], dir.pending);
+#endif
+	if (n >= 0)
+	{
+		dir.pending -= n;
+		dir.offset += n;
+		dir.bytes += n;
+		return true;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return true;
+	if (&dir == &_acks && _data.done)
+	{
+		dir.pending = 0; // Sender is gone after the last byte, its final acks do not matter
+		dir.eof = true;
+		return true;
+	}
+	fail(&dir == &_data ? "sending to recipient" : "sending to sender");
+	return false;
+}
+
+// Adds the tokens earned since the last refill; the bucket holds at most one second's worth.
+void	DccTransfer::refill(unsigned long nowMs)
+{
+	if (_rateLimit == 0)
+		return;
+
+	unsigned long	capacity = _rateLimit > getThreshold() ? _rateLimit : getThreshold();
+	unsigned long	elapsed = nowMs - _refilledAt;
+	unsigned long	earned = elapsed >= 1000 ? capacity : _rateLimit * elapsed / 1000;
+
+	if (earned == 0)
+		return; // Keep the fraction for the next refill
+	_tokens = (_tokens + earned > capacity) ? capacity : _tokens + earned;
+	_refilledAt = nowMs;
+}
+
+// Tokens needed before reading again: a tenth of a second's worth, at most one chunk.
+unsigned long	DccTransfer::getThreshold() const
+{
+	unsigned long	threshold = _rateLimit / 10;
+
+	if (threshold > DCC_CHUNK_SIZE)
+		threshold = DCC_CHUNK_SIZE;
+	return threshold > 0 ? threshold : 1;
+}
+
+// Marks the transfer as failed (message includes `errno`).
+DccTransfer::State	DccTransfer::fail(const std::string& what)
+{
+	_error = what + ": " + strerror(errno);
+	_state = DCC_FAILED;
+	return _state;
+}
+
+void	DccTransfer::closeFd(int& fd)
+{
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+}
+
+/////////////
+// Getters //
+/////////////
+
+DccTransfer::State	DccTransfer::getState() const
+{
+	return _state;
+}
+
+const std::string&	DccTransfer::getError() const
+{
+	return _error;
+}
+
+unsigned long	DccTransfer::getBytesToRecipient() const
+{
+	return _data.bytes;
+}
+
+unsigned long	DccTransfer::getBytesToSender() const
+{
+	return _acks.bytes;
+}
+
+unsigned long	DccTransfer::getLastActivity() const
+{
+	return _lastActivity;
+}
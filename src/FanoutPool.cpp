@@ -0,0 +1,184 @@
+#include <string>
+#include <vector>
+#include <csignal>		// sigset_t, sigfillset()
+#include <pthread.h>
+
+#include "../include/FanoutPool.hpp"
+#include "../include/User.hpp"
+#include "../include/defines.hpp"	// FANOUT_CHUNK
+
+FanoutPool::FanoutPool() : _job(NULL), _generation(0), _joined(0), _stopping(false)
+{
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wakeCond, NULL);
+	pthread_cond_init(&_doneCond, NULL);
+}
+
+FanoutPool::~FanoutPool()
+{
+	stop();
+	pthread_cond_destroy(&_doneCond);
+	pthread_cond_destroy(&_wakeCond);
+	pthread_mutex_destroy(&_mutex);
+}
+
+/**
+Starts the workers, with all signals blocked (see `BotWorkers::start()`).
+
+ @return	`false` if a thread could not be created (the pool is stopped
+			again; broadcasts then run on the event loop alone).
+*/
+bool	FanoutPool::start(int threads)
+{
+	sigset_t	all;
+	sigset_t	old;
+
+	_stopping = false;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (int i = 0; i < threads; ++i)
+	{
+		Worker*	worker = new Worker;
+		worker->owner = this;
+		worker->index = i + 1;
+		if (pthread_create(&worker->id, NULL, workerMain, worker) != 0)
+		{
+			delete worker;
+			break;
+		}
+		_workers.push_back(worker);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (static_cast<int>(_workers.size()) != threads)
+	{
+		stop();
+		return false;
+	}
+	return true;
+}
+
+// Stops and joins the workers (never while a `deliver()` runs: both are called by the event loop).
+void	FanoutPool::stop()
+{
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_broadcast(&_wakeCond);
+	pthread_mutex_unlock(&_mutex);
+
+	for (size_t i = 0; i < _workers.size(); ++i)
+	{
+		pthread_join(_workers[i]->id, NULL);
+		delete _workers[i];
+	}
+	_workers.clear();
+}
+
+// True while the workers run.
+bool	FanoutPool::isRunning() const
+{
+	return !_workers.empty();
+}
+
+/**
+Appends `line` to the output buffer of every recipient but `excluded`,
+together with the workers that wake up in time. Returns once all of them
+have it: the event loop goes on with the buffers as if it had filled them
+itself (each recipient still gets their lines in order).
+
+ @param recipients	Users with a socket on this server, each at most once.
+*/
+void	FanoutPool::deliver(const std::vector<User*>& recipients, const std::string& line, const User* excluded)
+{
+	Job		job;
+	size_t	count = recipients.size();
+	size_t	participants = _workers.size() + 1;
+
+	job.recipients = &recipients;
+	job.line = &line;
+	job.excluded = excluded;
+	job.ranges.resize(participants);
+	for (size_t i = 0; i < participants; ++i)
+	{
+		job.ranges[i].next = count * i / participants;
+		job.ranges[i].end = count * (i + 1) / participants;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_job = &job;
+	++_generation;
+	pthread_cond_broadcast(&_wakeCond);
+	pthread_mutex_unlock(&_mutex);
+
+	work(job, 0);
+
+	// Every chunk is claimed: close the job and wait for the workers still appending
+	pthread_mutex_lock(&_mutex);
+	_job = NULL;
+	while (_joined > 0)
+		pthread_cond_wait(&_doneCond, &_mutex);
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+Claims chunks of `FANOUT_CHUNK` recipients, from the participant's own range
+first, then from the others' (stealing), until every range is used up.
+*/
+void	FanoutPool::work(Job& job, size_t index)
+{
+	const std::vector<User*>&	recipients = *job.recipients;
+	size_t						participants = job.ranges.size();
+
+	for (size_t k = 0; k < participants; ++k)
+	{
+		Range&	range = job.ranges[(index + k) % participants];
+
+		while (true)
+		{
+			size_t	begin = __sync_fetch_and_add(&range.next, static_cast<size_t>(FANOUT_CHUNK));
+			if (begin >= range.end)
+				break;
+			size_t	end = begin + FANOUT_CHUNK < range.end ? begin + FANOUT_CHUNK : range.end;
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (recipients[i] != job.excluded)
+					recipients[i]->getOutputBuffer() += *job.line;
+			}
+		}
+	}
+}
+
+// Thread entry point.
+void*	FanoutPool::workerMain(void* arg)
+{
+	Worker*	worker = static_cast<Worker*>(arg);
+
+	worker->owner->workerLoop(worker->index);
+	return NULL;
+}
+
+// Waits for a job it has not joined yet, helps with it, and tells the event loop when it is the last one out.
+void	FanoutPool::workerLoop(size_t index)
+{
+	unsigned long	seen = 0;
+
+	pthread_mutex_lock(&_mutex);
+	while (true)
+	{
+		while (!_stopping && (_job == NULL || _generation == seen))
+			pthread_cond_wait(&_wakeCond, &_mutex);
+		if (_stopping)
+			break;
+		seen = _generation;
+		Job*	job = _job;
+		++_joined;
+		pthread_mutex_unlock(&_mutex);
+
+		work(*job, index);
+
+		pthread_mutex_lock(&_mutex);
+		if (--_joined == 0 && _job == NULL)
+			pthread_cond_signal(&_doneCond);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
@@ -0,0 +1,286 @@
+#include <string>
+#include <vector>
+#include <cerrno>		// errno
+#include <cstring>		// memcpy(), memcmp(), memset(), strerror()
+
+#include <unistd.h>		// read(), write(), close()
+
+#include "../include/Handoff.hpp"
+#include "../include/Binary.hpp"	// putU32(), BinaryReader
+#include "../include/utils.hpp"		// toString(), sendFds(), receiveFds()
+
+static const char	HANDOFF_MAGIC[8] = { 'I', 'R', 'C', 'H', 'A', 'N', 'D', 3 };
+static const size_t	FDS_PER_MSG = 250;	// SCM_MAX_FD is 253
+
+Handoff::Handoff()
+	:	listenFd(-1), startTime(0), peakUsers(0)
+{}
+
+Handoff::~Handoff()
+{}
+
+//////////////
+// Transfer //
+//////////////
+
+// Writes all of `data` to the socket, retrying after partial writes.
+static bool	writeAll(int sock, const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t	n = write(sock, data, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Reads exactly `size` bytes (never past them: what follows carries descriptors).
+static bool	readAll(int sock, char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t	n = read(sock, data, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			if (n == 0)
+				errno = ECONNRESET;
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+Sends the state, then all descriptors, to the new binary.
+
+ @param sock	Connected Unix stream socket.
+ @param error	Set to what went wrong.
+*/
+bool	Handoff::send(int sock, std::string& error) const
+{
+	std::string			blob;
+	std::vector<int>	fds;
+
+	encode(blob);
+	collectFds(fds);
+
+	uint64_t	size = blob.size();
+	if (!writeAll(sock, reinterpret_cast<const char*>(&size), sizeof(size)) || !writeAll(sock, blob.data(), size))
+	{
+		error = toString("sending state: ") + strerror(errno);
+		return false;
+	}
+	for (size_t i = 0; i < fds.size(); i += FDS_PER_MSG)
+	{
+		if (!sendFds(sock, &fds[i], fds.size() - i < FDS_PER_MSG ? fds.size() - i : FDS_PER_MSG))
+		{
+			error = toString("sending descriptors: ") + strerror(errno);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+Receives the state and the descriptors sent by `send()`. The records' `fd`s
+are set to the descriptors received for them.
+*/
+bool	Handoff::receive(int sock, std::string& error)
+{
+	uint64_t	size;
+	std::string	blob;
+
+	if (!readAll(sock, reinterpret_cast<char*>(&size), sizeof(size)))
+	{
+		error = toString("reading state: ") + strerror(errno);
+		return false;
+	}
+	blob.resize(size);
+	if (size > 0 && !readAll(sock, &blob[0], size))
+	{
+		error = toString("reading state: ") + strerror(errno);
+		return false;
+	}
+	if (!decode(blob))
+	{
+		error = "damaged state";
+		return false;
+	}
+
+	std::vector<int>	fds;
+	size_t				count = getFdCount();
+	fds.reserve(count);
+	while (fds.size() < count)
+	{
+		size_t	batch = count - fds.size() < FDS_PER_MSG ? count - fds.size() : FDS_PER_MSG;
+		if (!receiveFds(sock, fds, batch))
+		{
+			error = toString("receiving descriptors: ") + strerror(errno);
+			for (size_t i = 0; i < fds.size(); ++i)
+				close(fds[i]);
+			return false;
+		}
+	}
+	assignFds(fds);
+	return true;
+}
+
+// Returns the number of descriptors handed over (the listening socket included).
+size_t	Handoff::getFdCount() const
+{
+	return 1 + users.size() + pending.size();
+}
+
+void	Handoff::collectFds(std::vector<int>& fds) const
+{
+	fds.reserve(getFdCount());
+	fds.push_back(listenFd);
+	for (size_t i = 0; i < users.size(); ++i)
+		fds.push_back(users[i].fd);
+	for (size_t i = 0; i < pending.size(); ++i)
+		fds.push_back(pending[i].fd);
+}
+
+void	Handoff::assignFds(const std::vector<int>& fds)
+{
+	size_t	next = 0;
+
+	listenFd = fds[next++];
+	for (size_t i = 0; i < users.size(); ++i)
+		users[i].fd = fds[next++];
+	for (size_t i = 0; i < pending.size(); ++i)
+		pending[i].fd = fds[next++];
+}
+
+//////////////
+// Encoding //
+//////////////
+
+void	Handoff::encode(std::string& out) const
+{
+	out.assign(HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC));
+	putI64(out, static_cast<int64_t>(startTime));
+	putU64(out, peakUsers);
+
+	putU32(out, static_cast<uint32_t>(users.size()));
+	for (std::vector<UserHandoff>::const_iterator it = users.begin(); it != users.end(); ++it)
+	{
+		putString(out, it->nickname);
+		putString(out, it->username);
+		putString(out, it->realname);
+		putString(out, it->host);
+		putString(out, it->inputBuffer);
+		putString(out, it->outputBuffer);
+		putU64(out, it->lastActivity);
+		putU64(out, it->pingSentAt);
+		putU8(out, it->caps);
+	}
+
+	putU32(out, static_cast<uint32_t>(pending.size()));
+	for (std::vector<PendingHandoff>::const_iterator it = pending.begin(); it != pending.end(); ++it)
+	{
+		putU32(out, it->addr);
+		putString(out, it->nickname);
+		putString(out, it->username);
+		putString(out, it->realname);
+		putU8(out, it->hasPassed);
+		putU8(out, it->negotiating);
+		putU8(out, it->caps);
+		putString(out, it->inputBuffer);
+		putString(out, it->outputBuffer);
+	}
+
+	putU32(out, static_cast<uint32_t>(channels.size()));
+	for (std::vector<ChannelHandoff>::const_iterator it = channels.begin(); it != channels.end(); ++it)
+	{
+		StateLog::encodeState(out, it->state);
+		putI64(out, static_cast<int64_t>(it->createdAt));
+		putU32(out, static_cast<uint32_t>(it->members.size()));
+		for (size_t i = 0; i < it->members.size(); ++i)
+			putString(out, it->members[i]);
+		putU32(out, static_cast<uint32_t>(it->operators.size()));
+		for (size_t i = 0; i < it->operators.size(); ++i)
+			putString(out, it->operators[i]);
+	}
+}
+
+bool	Handoff::decode(const std::string& blob)
+{
+	BinaryReader	in(blob.data(), blob.data() + blob.size());
+	char			magic[sizeof(HANDOFF_MAGIC)];
+	int64_t			when;
+	uint64_t		value;
+	uint32_t		count;
+
+	if (!in.take(magic, sizeof(magic)) || memcmp(magic, HANDOFF_MAGIC, sizeof(magic)) != 0)
+		return false;
+	in.takeI64(when);
+	startTime = static_cast<time_t>(when);
+	in.takeU64(value);
+	peakUsers = value;
+
+	in.takeU32(count);
+	users.resize(in.ok ? count : 0);
+	for (std::vector<UserHandoff>::iterator it = users.begin(); in.ok && it != users.end(); ++it)
+	{
+		it->fd = -1;
+		in.takeString(it->nickname);
+		in.takeString(it->username);
+		in.takeString(it->realname);
+		in.takeString(it->host);
+		in.takeString(it->inputBuffer);
+		in.takeString(it->outputBuffer);
+		in.takeU64(value);
+		it->lastActivity = value;
+		in.takeU64(value);
+		it->pingSentAt = value;
+		in.takeU8(it->caps);
+	}
+
+	in.takeU32(count);
+	pending.resize(in.ok ? count : 0);
+	for (std::vector<PendingHandoff>::iterator it = pending.begin(); in.ok && it != pending.end(); ++it)
+	{
+		unsigned char	flag;
+		it->fd = -1;
+		in.takeU32(it->addr);
+		in.takeString(it->nickname);
+		in.takeString(it->username);
+		in.takeString(it->realname);
+		in.takeU8(flag);
+		it->hasPassed = flag;
+		in.takeU8(flag);
+		it->negotiating = flag;
+		in.takeU8(it->caps);
+		in.takeString(it->inputBuffer);
+		in.takeString(it->outputBuffer);
+	}
+
+	in.takeU32(count);
+	channels.resize(in.ok ? count : 0);
+	for (std::vector<ChannelHandoff>::iterator it = channels.begin(); in.ok && it != channels.end(); ++it)
+	{
+		StateLog::decodeState(in, it->state);
+		it->state.claimed = true;
+		in.takeI64(when);
+		it->createdAt = static_cast<time_t>(when);
+		in.takeU32(count);
+		it->members.resize(in.ok ? count : 0);
+		for (uint32_t i = 0; in.ok && i < count; ++i)
+			in.takeString(it->members[i]);
+		in.takeU32(count);
+		it->operators.resize(in.ok ? count : 0);
+		for (uint32_t i = 0; in.ok && i < count; ++i)
+			in.takeString(it->operators[i]);
+	}
+	return in.ok && in.pos == in.end;
+}
@@ -0,0 +1,563 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <cerrno>		// errno
+#include <csignal>		// sigset_t, sigfillset()
+
+#include <unistd.h>			// pipe(), read(), write(), close()
+#include <fcntl.h>			// fcntl(), O_NONBLOCK, FD_CLOEXEC
+#include <sys/socket.h>		// recv(), send()
+#include <sys/select.h>		// select(), fd_set, FD_* macros
+#include <pthread.h>
+
+#include "../include/IoWorkers.hpp"
+#include "../include/Command.hpp"	// Command::tokenize()
+#include "../include/defines.hpp"	// MAX_BUFFER_SIZE, IO_READ_SIZE, LOG_RAW_CMDS
+#include "../include/platform.hpp"	// MSG_NOSIGNAL
+
+// Creates a non-blocking self-pipe (as in `BotWorkers`), not inherited across an upgrade's `exec()`.
+static bool	openWakePipe(int wakePipe[2])
+{
+	if (pipe(wakePipe) == -1)
+		return false;
+	for (int i = 0; i < 2; ++i)
+	{
+		fcntl(wakePipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(wakePipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	return true;
+}
+
+static void	closeWakePipe(int wakePipe[2])
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		if (wakePipe[i] != -1)
+			close(wakePipe[i]);
+		wakePipe[i] = -1;
+	}
+}
+
+// Writes a wake-up byte; if the pipe is full, a wake-up is pending anyway.
+static void	signalWake(int wakePipe[2])
+{
+	char	byte = 1;
+
+	if (write(wakePipe[1], &byte, 1) == -1)
+		return;
+}
+
+// Empties the pipe; done before taking a stack, so a push after it writes a new byte.
+static void	drainWake(int wakePipe[2])
+{
+	char	drain[64];
+
+	while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+		; // Just emptying the pipe
+}
+
+IoWorkers::IoWorkers() : _events(NULL), _nextSerial(0)
+{
+	_wakePipe[0] = -1;
+	_wakePipe[1] = -1;
+}
+
+IoWorkers::~IoWorkers()
+{
+	std::vector<Leftover>	leftovers;
+
+	stop(leftovers);
+	for (Event* event = takeEvents(); event; )
+	{
+		Event*	next = event->next;
+		delete event;
+		event = next;
+	}
+	closeWakePipe(_wakePipe);
+}
+
+/**
+Starts the I/O threads, with all signals blocked (see `BotWorkers::start()`).
+
+ @return	`false` if a self-pipe or a thread could not be created (the
+			threads started are stopped again).
+*/
+bool	IoWorkers::start(int threads)
+{
+	sigset_t	all;
+	sigset_t	old;
+	bool		ok = true;
+
+	if (_wakePipe[0] == -1 && !openWakePipe(_wakePipe))
+		return false;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (int i = 0; i < threads && ok; ++i)
+	{
+		Thread*	thread = new Thread;
+		thread->owner = this;
+		thread->orders = NULL;
+		thread->stopping = false;
+		thread->woken = false;
+		thread->wakePipe[0] = -1;
+		thread->wakePipe[1] = -1;
+		if (!openWakePipe(thread->wakePipe) || pthread_create(&thread->id, NULL, threadMain, thread) != 0)
+		{
+			closeWakePipe(thread->wakePipe);
+			delete thread;
+			ok = false;
+			break;
+		}
+		_threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (!ok)
+	{
+		std::vector<Leftover>	leftovers;
+		stop(leftovers);
+	}
+	return ok;
+}
+
+/**
+Stops and joins the threads; the server takes their sockets back. Orders
+they had not taken yet are carried out here, and what they still held for
+each connection (a partial line, unsent output) goes to `leftovers`. Events
+already posted stay for `takeEvents()`.
+*/
+void	IoWorkers::stop(std::vector<Leftover>& leftovers)
+{
+	for (size_t i = 0; i < _threads.size(); ++i)
+	{
+		_threads[i]->stopping = true;
+		signalWake(_threads[i]->wakePipe);
+	}
+	for (size_t i = 0; i < _threads.size(); ++i)
+	{
+		Thread&	thread = *_threads[i];
+
+		pthread_join(thread.id, NULL);
+		applyOrders(thread, __sync_lock_test_and_set(&thread.orders, static_cast<Order*>(NULL)));
+		for (std::map<int, Connection>::iterator it = thread.connections.begin(); it != thread.connections.end(); ++it)
+		{
+			Leftover	leftover;
+			leftover.fd = it->first;
+			leftover.serial = it->second.serial;
+			leftover.input.swap(it->second.input);
+			if (!it->second.lost)
+				leftover.output = it->second.output.substr(it->second.outputOffset);
+			leftovers.push_back(leftover);
+		}
+		closeWakePipe(thread.wakePipe);
+		delete &thread;
+	}
+	_threads.clear();
+}
+
+// True while the I/O threads run.
+bool	IoWorkers::isRunning() const
+{
+	return !_threads.empty();
+}
+
+// The read end of the self-pipe, readable when events are waiting.
+int	IoWorkers::getWakeFd() const
+{
+	return _wakePipe[0];
+}
+
+////////////////////////////
+// Orders (server thread) //
+////////////////////////////
+
+/**
+Hands a connection to the next thread (round robin), along with input read
+before (`input` is emptied).
+
+ @return	The connection's serial, needed for everything that follows.
+*/
+unsigned long	IoWorkers::attach(int fd, std::string& input)
+{
+	Order*	order = new Order;
+
+	order->type = Order::IO_ATTACH;
+	order->fd = fd;
+	order->serial = ++_nextSerial;
+	order->data.swap(input);
+	order->notify = false;
+	push(*_threads[order->serial % _threads.size()], order);
+	return order->serial;
+}
+
+/**
+Hands output over to the connection's thread (`output` is emptied, nothing
+is copied). With `notifyDrained`, the thread posts `IO_DRAINED` once all of
+it is sent.
+*/
+void	IoWorkers::send(unsigned long serial, int fd, std::string& output, bool notifyDrained)
+{
+	Order*	order = new Order;
+
+	order->type = Order::IO_OUTPUT;
+	order->fd = fd;
+	order->serial = serial;
+	order->data.swap(output);
+	order->notify = notifyDrained;
+	push(*_threads[serial % _threads.size()], order);
+}
+
+/**
+Gives a connection up: its thread sends `output` if the socket takes it right
+away, then closes the socket. The fd cannot be reused before.
+*/
+void	IoWorkers::detach(unsigned long serial, int fd, std::string& output)
+{
+	Order*	order = new Order;
+
+	order->type = Order::IO_DETACH;
+	order->fd = fd;
+	order->serial = serial;
+	order->data.swap(output);
+	order->notify = false;
+	push(*_threads[serial % _threads.size()], order);
+}
+
+// Wakes the threads that got orders since the last call (once per event loop iteration).
+void	IoWorkers::wake()
+{
+	for (size_t i = 0; i < _threads.size(); ++i)
+	{
+		if (!_threads[i]->woken)
+			continue;
+		_threads[i]->woken = false;
+		signalWake(_threads[i]->wakePipe);
+	}
+}
+
+/**
+Pushes an order onto a thread's stack. The thread needs a wakeup only if
+the stack was empty; otherwise it has one pending.
+*/
+void	IoWorkers::push(Thread& thread, Order* order)
+{
+	Order*	head;
+
+	do
+	{
+		head = thread.orders;
+		order->next = head;
+	}
+	while (!__sync_bool_compare_and_swap(&thread.orders, head, order));
+	if (head == NULL)
+		thread.woken = true;
+}
+
+/**
+Detaches all events (server thread only), oldest first, linked through
+`next`; the caller deletes them. Events of one connection keep their order.
+*/
+IoWorkers::Event*	IoWorkers::takeEvents()
+{
+	Event*	head;
+	Event*	ordered = NULL;
+
+	if (_wakePipe[0] != -1)
+		drainWake(_wakePipe);
+	head = __sync_lock_test_and_set(&_events, static_cast<Event*>(NULL));
+	while (head)
+	{
+		Event*	next = head->next;
+		head->next = ordered;
+		ordered = head;
+		head = next;
+	}
+	return ordered;
+}
+
+////////////////////////
+// Threads (I/O side) //
+////////////////////////
+
+// Thread entry point.
+void*	IoWorkers::threadMain(void* arg)
+{
+	Thread*	thread = static_cast<Thread*>(arg);
+
+	thread->owner->threadLoop(*thread);
+	return NULL;
+}
+
+/**
+A thread's own event loop: waits for its sockets and its orders, reads and
+writes, and posts what it received once per iteration (one event per
+connection that sent something).
+*/
+void	IoWorkers::threadLoop(Thread& thread)
+{
+	while (!thread.stopping)
+	{
+		fd_set	readFds;
+		fd_set	writeFds;
+		int		maxFd = thread.wakePipe[0];
+
+		FD_ZERO(&readFds);
+		FD_ZERO(&writeFds);
+		FD_SET(thread.wakePipe[0], &readFds);
+		for (std::map<int, Connection>::iterator it = thread.connections.begin(); it != thread.connections.end(); ++it)
+		{
+			if (it->second.lost)
+				continue;
+			FD_SET(it->first, &readFds);
+			if (it->second.outputOffset < it->second.output.size())
+				FD_SET(it->first, &writeFds);
+			if (it->first > maxFd)
+				maxFd = it->first;
+		}
+		if (select(maxFd + 1, &readFds, &writeFds, NULL, NULL) == -1)
+			continue;
+
+		if (FD_ISSET(thread.wakePipe[0], &readFds))
+		{
+			drainWake(thread.wakePipe);
+			if (thread.stopping)
+				return;
+			applyOrders(thread, __sync_lock_test_and_set(&thread.orders, static_cast<Order*>(NULL)));
+		}
+
+		Event*	events = NULL;
+		for (std::map<int, Connection>::iterator it = thread.connections.begin(); it != thread.connections.end(); ++it)
+		{
+			if (!it->second.lost && FD_ISSET(it->first, &readFds))
+				readConnection(thread, it->first, it->second, events);
+			if (!it->second.lost && FD_ISSET(it->first, &writeFds))
+				writeConnection(thread, it->first, it->second, events);
+		}
+		post(events);
+	}
+}
+
+/**
+Carries out the server's orders, oldest first (they come as a stack). New
+output is sent right away; the socket usually takes it.
+*/
+void	IoWorkers::applyOrders(Thread& thread, Order* orders)
+{
+	Order*	ordered = NULL;
+	Event*	events = NULL;
+
+	while (orders)
+	{
+		Order*	next = orders->next;
+		orders->next = ordered;
+		ordered = orders;
+		orders = next;
+	}
+	while (ordered)
+	{
+		Order*										order = ordered;
+		std::map<int, Connection>::iterator			it = thread.connections.find(order->fd);
+		bool										known = it != thread.connections.end() && it->second.serial == order->serial;
+
+		ordered = order->next;
+		if (order->type == Order::IO_ATTACH)
+		{
+			Connection&	connection = thread.connections[order->fd];
+			connection.serial = order->serial;
+			connection.input.swap(order->data);
+			connection.output.clear();
+			connection.outputOffset = 0;
+			connection.lost = false;
+			connection.notify = false;
+			connection.discarding = false;
+		}
+		else if (known && !it->second.lost)
+		{
+			Connection&	connection = it->second;
+			if (connection.output.empty())
+				connection.output.swap(order->data);
+			else
+				connection.output += order->data;
+			connection.notify = connection.notify || order->notify;
+			writeConnection(thread, order->fd, connection, events);
+		}
+		if (order->type == Order::IO_DETACH)
+		{
+			close(order->fd);
+			if (known)
+				thread.connections.erase(it);
+		}
+		delete order;
+	}
+	post(events);
+}
+
+/**
+Reads what a user sent and cuts it into lines (optional `\r` stripped),
+tokenized here. The pending input is indexed once (see `ScanIndex`), and
+lines and tokens are cut from the index. Blank lines are dropped; a line
+longer than the protocol allows (RFC 1459, 2.3) is passed on without tokens,
+for the server to refuse.
+
+A partial line that is already too long is passed on (refused) right away
+and dropped, and so is the rest of it up to its newline, so a client that
+never sends one cannot grow the buffer without bound.
+*/
+void	IoWorkers::readConnection(Thread& thread, int fd, Connection& connection, Event*& events)
+{
+	char	buffer[IO_READ_SIZE];
+	ssize_t	bytesRead = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+	if (bytesRead <= 0)
+	{
+		if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		Event*	event = newEvent(Event::IO_CLOSED, fd, connection);
+		event->error = bytesRead < 0 ? errno : 0;
+		event->next = events;
+		events = event;
+		connection.lost = true;
+		return;
+	}
+	connection.input.append(buffer, bytesRead);
+
+	std::string&	input = connection.input;
+	Event*			event = NULL;
+	size_t			start = 0;
+	size_t			newlinePos;
+
+	thread.scan.build(input);
+	if (connection.discarding)
+	{
+		if ((newlinePos = thread.scan.nextNewline(0, input.size())) == std::string::npos)
+		{
+			input.clear();
+			return;
+		}
+		start = newlinePos + 1;
+		connection.discarding = false;
+	}
+	while ((newlinePos = thread.scan.nextNewline(start, input.size())) != std::string::npos)
+	{
+		size_t	end = newlinePos;
+		if (end > start && input[end - 1] == '\r')
+			--end;
+		size_t	length = end - start;
+		size_t	lineStart = start;
+		start = newlinePos + 1;
+
+		std::vector<std::string>	tokens;
+		if (length <= MAX_BUFFER_SIZE - 2)
+		{
+			tokens = Command::tokenize(input, lineStart, end, thread.scan);
+			if (tokens.empty())
+				continue;
+		}
+		if (!event)
+		{
+			event = newEvent(Event::IO_INPUT, fd, connection);
+			event->next = events;
+			events = event;
+		}
+		event->lines.push_back(Line());
+		Line&	line = event->lines.back();
+		line.tokens.swap(tokens);
+		line.length = length;
+		if (LOG_RAW_CMDS)
+			line.raw = input.substr(lineStart, length);
+	}
+	if (input.size() - start > MAX_BUFFER_SIZE)
+	{
+		if (!event)
+		{
+			event = newEvent(Event::IO_INPUT, fd, connection);
+			event->next = events;
+			events = event;
+		}
+		event->lines.push_back(Line());
+		event->lines.back().length = input.size() - start;
+		if (LOG_RAW_CMDS)
+			event->lines.back().raw = input.substr(start);
+		start = input.size();
+		connection.discarding = true;
+	}
+	input.erase(0, start);
+}
+
+/**
+Sends as much of a connection's output as the socket takes. Posts
+`IO_DRAINED` once all of it is sent (if asked), `IO_CLOSED` if the connection
+is broken.
+*/
+void	IoWorkers::writeConnection(Thread& thread, int fd, Connection& connection, Event*& events)
+{
+	(void)thread;
+	if (connection.outputOffset == connection.output.size())
+		return;
+
+	ssize_t	bytesSent = ::send(fd, connection.output.data() + connection.outputOffset,
+		connection.output.size() - connection.outputOffset, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (bytesSent < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return;
+		Event*	event = newEvent(Event::IO_CLOSED, fd, connection);
+		event->error = errno;
+		event->writing = true;
+		event->next = events;
+		events = event;
+		connection.lost = true;
+		return;
+	}
+	connection.outputOffset += bytesSent;
+	if (connection.outputOffset < connection.output.size())
+		return;
+	connection.output.clear();
+	connection.outputOffset = 0;
+	if (connection.notify)
+	{
+		connection.notify = false;
+		Event*	event = newEvent(Event::IO_DRAINED, fd, connection);
+		event->next = events;
+		events = event;
+	}
+}
+
+/**
+Pushes a chain of events (newest first, as they are collected) onto the
+server's stack in one go, and wakes the server if the stack was empty;
+otherwise a wakeup is already pending.
+*/
+void	IoWorkers::post(Event* events)
+{
+	Event*	oldest = events;
+	Event*	head;
+
+	if (!events)
+		return;
+	while (oldest->next)
+		oldest = oldest->next;
+	do
+	{
+		head = _events;
+		oldest->next = head;
+	}
+	while (!__sync_bool_compare_and_swap(&_events, head, events));
+
+	if (head == NULL)
+		signalWake(_wakePipe);
+}
+
+IoWorkers::Event*	IoWorkers::newEvent(Event::Type type, int fd, const Connection& connection)
+{
+	Event*	event = new Event;
+
+	event->next = NULL;
+	event->type = type;
+	event->fd = fd;
+	event->serial = connection.serial;
+	event->error = 0;
+	event->writing = false;
+	return event;
+}
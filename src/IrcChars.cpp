@@ -0,0 +1,198 @@
+#include <string>
+
+#ifdef __SSE2__
+# include <emmintrin.h>	// SSE2 intrinsics (baseline on x86-64)
+#endif
+
+#include "../include/IrcChars.hpp"
+
+////////////
+// Tables //
+////////////
+
+// Character classes (bits of `s_class`)
+enum
+{
+	CHAR_NICK_FIRST = 1,	// <letter>
+	CHAR_NICK = 2,			// <letter> | <number> | <special>
+	CHAR_NOT_CHANNEL = 4	// SPACE, BELL, NUL, CR, LF, comma
+};
+
+static unsigned char	s_fold[256];		// Byte -> lowercase byte, for the selected casemapping
+static unsigned char	s_class[256];		// Byte -> CHAR_* bits
+static char				s_foldLast;			// Last byte lowered ('Z', ']' or '^')
+static const char*		s_caseMapping;		// Its ISUPPORT name
+
+// Fills the class table (RFC 1459, 2.3.1), once before `main()`.
+static bool	buildClasses()
+{
+	const char*	special = "-[]\\`^{}";
+	const char*	notChannel = " \a\r\n,";
+
+	for (int c = 0; c < 256; ++c)
+	{
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))
+			s_class[c] = CHAR_NICK_FIRST | CHAR_NICK;
+		else if (c >= '0' && c <= '9')
+			s_class[c] = CHAR_NICK;
+	}
+	for (const char* p = special; *p; ++p)
+		s_class[static_cast<unsigned char>(*p)] |= CHAR_NICK;
+	for (const char* p = notChannel; *p; ++p)
+		s_class[static_cast<unsigned char>(*p)] |= CHAR_NOT_CHANNEL;
+	s_class[0] |= CHAR_NOT_CHANNEL;
+	return true;
+}
+
+static const bool	s_ready = buildClasses() && IrcChars::selectCaseMapping("rfc1459");
+
+/**
+Selects the casemapping names are folded with (`CASEMAPPING`): `rfc1459`,
+`strict-rfc1459` or `ascii`. Called once at startup, before any thread runs
+and before any name is stored: names folded with another mapping would not
+be found again.
+
+ @return	`false` for an unknown name (nothing changes).
+*/
+bool	IrcChars::selectCaseMapping(const std::string& name)
+{
+	char	last;
+
+	if (name == "rfc1459")
+		last = '^';
+	else if (name == "strict-rfc1459")
+		last = ']';
+	else if (name == "ascii")
+		last = 'Z';
+	else
+		return false;
+
+	for (int c = 0; c < 256; ++c)
+		s_fold[c] = static_cast<unsigned char>(c >= 'A' && c <= last ? c + 32 : c);
+	s_foldLast = last;
+	s_caseMapping = last == '^' ? "rfc1459" : last == ']' ? "strict-rfc1459" : "ascii";
+	return true;
+}
+
+// ISUPPORT name of the casemapping in use.
+const char*	IrcChars::getCaseMapping()
+{
+	return s_caseMapping;
+}
+
+/////////////
+// Folding //
+/////////////
+
+#ifdef __SSE2__
+
+// Lowers the bytes in ['A', `s_foldLast`] of 16 bytes (bytes >= 0x80 compare as negative: untouched).
+static inline __m128i	foldBlock(__m128i block)
+{
+	__m128i	upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+		_mm_cmplt_epi8(block, _mm_set1_epi8(static_cast<char>(s_foldLast + 1))));
+
+	return _mm_add_epi8(block, _mm_and_si128(upper, _mm_set1_epi8(32)));
+}
+
+#endif
+
+/**
+Folds `size` bytes at `data` to lowercase, in place. Longer names go 16
+bytes at a time; the last block overlaps the one before rather than taking
+a byte loop (folding is idempotent).
+*/
+void	IrcChars::fold(char* data, size_t size)
+{
+#ifdef __SSE2__
+	if (size >= 16)
+	{
+		for (size_t i = 0; i + 16 <= size; i += 16)
+		{
+			__m128i*	block = reinterpret_cast<__m128i*>(data + i);
+			_mm_storeu_si128(block, foldBlock(_mm_loadu_si128(block)));
+		}
+		__m128i*	last = reinterpret_cast<__m128i*>(data + size - 16);
+		_mm_storeu_si128(last, foldBlock(_mm_loadu_si128(last)));
+		return;
+	}
+#endif
+	for (size_t i = 0; i < size; ++i)
+		data[i] = static_cast<char>(s_fold[static_cast<unsigned char>(data[i])]);
+}
+
+// True if both names are the same once folded (no copy of either).
+bool	IrcChars::equal(const std::string& a, const std::string& b)
+{
+	size_t		size = a.size();
+	const char*	x = a.data();
+	const char*	y = b.data();
+
+	if (size != b.size())
+		return false;
+#ifdef __SSE2__
+	if (size >= 16)
+	{
+		for (size_t i = 0; i + 16 <= size; i += 16)
+		{
+			__m128i	same = _mm_cmpeq_epi8(foldBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))),
+				foldBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i))));
+			if (_mm_movemask_epi8(same) != 0xFFFF)
+				return false;
+		}
+		__m128i	same = _mm_cmpeq_epi8(foldBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + size - 16))),
+			foldBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + size - 16))));
+		return _mm_movemask_epi8(same) == 0xFFFF;
+	}
+#endif
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (s_fold[static_cast<unsigned char>(x[i])] != s_fold[static_cast<unsigned char>(y[i])])
+			return false;
+	}
+	return true;
+}
+
+////////////////
+// Validation //
+////////////////
+
+/**
+True if `data` is a letter followed by letters, digits and specials (see
+`isValidNick()`). Nicknames are at most `MAX_NICK_LENGTH` bytes, so the
+classes are just ANDed together, without a branch per byte.
+*/
+bool	IrcChars::isNickChars(const char* data, size_t size)
+{
+	if (size == 0)
+		return false;
+
+	unsigned char	all = s_class[static_cast<unsigned char>(data[0])] & CHAR_NICK_FIRST ? CHAR_NICK : 0;
+	for (size_t i = 1; i < size; ++i)
+		all &= s_class[static_cast<unsigned char>(data[i])];
+	return (all & CHAR_NICK) != 0;
+}
+
+// True if `data` holds none of the bytes a channel name cannot contain (see `isValidChannelName()`).
+bool	IrcChars::isChannelChars(const char* data, size_t size)
+{
+	size_t	i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i	block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i	bad = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8(','))),
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\a')), _mm_cmpeq_epi8(block, _mm_setzero_si128())));
+		bad = _mm_or_si128(bad,
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+		if (_mm_movemask_epi8(bad))
+			return false;
+	}
+#endif
+	unsigned char	any = 0;
+	for (; i < size; ++i)
+		any |= s_class[static_cast<unsigned char>(data[i])];
+	return !(any & CHAR_NOT_CHANNEL);
+}
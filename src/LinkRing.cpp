@@ -0,0 +1,323 @@
+#include <string>
+#include <cerrno>		// errno
+#include <cstring>		// memcpy(), strerror()
+
+#include <unistd.h>			// read(), write(), close(), ftruncate(), readlink()
+#include <fcntl.h>			// fcntl(), F_ADD_SEALS, F_GET_SEALS
+#include <sys/mman.h>		// memfd_create(), mmap(), munmap()
+#include <sys/stat.h>		// fstat()
+#ifdef LINUX_OS
+# include <sys/eventfd.h>	// eventfd()
+#endif
+
+#include "../include/LinkRing.hpp"
+#include "../include/defines.hpp"	// LINK_RING_SIZE
+#include "../include/utils.hpp"		// toString()
+
+#ifdef LINUX_OS
+// The memory may neither shrink (SIGBUS on access) nor grow once shared
+static const int	RING_SEALS = F_SEAL_SHRINK | F_SEAL_GROW;
+
+// True if the target of `/proc/self/fd/<fd>` starts with `prefix` (how the kernel names memfds and eventfds).
+static bool	isFdKind(int fd, const char* prefix)
+{
+	std::string	path = "/proc/self/fd/" + toString(fd);
+	char		target[64];
+	ssize_t		size = readlink(path.c_str(), target, sizeof(target) - 1);
+
+	if (size <= 0)
+		return false;
+	target[size] = '\0';
+	return strncmp(target, prefix, strlen(prefix)) == 0;
+}
+#endif
+
+LinkRing::LinkRing()
+	:	_memFd(-1), _memory(NULL), _mappedSize(0), _size(0), _tx(NULL), _txData(NULL), _rx(NULL), _rxData(NULL),
+		_wakeFd(-1), _peerWakeFd(-1)
+{}
+
+LinkRing::~LinkRing()
+{
+	if (_memory)
+		munmap(_memory, _mappedSize);
+	if (_memFd != -1)
+		close(_memFd);
+	if (_wakeFd != -1)
+		close(_wakeFd);
+	if (_peerWakeFd != -1)
+		close(_peerWakeFd);
+}
+
+#ifdef LINUX_OS
+/**
+Creates the shared memory (two rings of `LINK_RING_SIZE` bytes) and both
+`eventfd`s, for the side that connects. The memory is sealed at its size, so
+the peer can rely on it staying mapped. `getPeerFds()` returns what the other
+side needs to `attach()`.
+
+ @return	`NULL` on failure (`error` says why).
+*/
+LinkRing*	LinkRing::create(std::string& error)
+{
+	LinkRing*	ring = new LinkRing;
+
+	ring->_size = LINK_RING_SIZE;
+	ring->_memFd = memfd_create("ircserv-link", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	ring->_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ring->_peerWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->_memFd == -1 || ring->_wakeFd == -1 || ring->_peerWakeFd == -1
+		|| ftruncate(ring->_memFd, 2 * (sizeof(Ring) + ring->_size)) == -1
+		|| fcntl(ring->_memFd, F_ADD_SEALS, RING_SEALS | F_SEAL_SEAL) == -1)
+	{
+		error = toString("shared memory: ") + strerror(errno);
+		delete ring;
+		return NULL;
+	}
+	if (!ring->map(true, error))
+	{
+		delete ring;
+		return NULL;
+	}
+	return ring;
+}
+
+/**
+Attaches to the rings another server created, for the side that accepted.
+The ring size is taken from the memory, so both servers need not agree on
+`LINK_RING_SIZE`. The descriptors must be what the creator sends: a memfd
+sealed against shrinking and growing (the peer could otherwise cut the
+mapping from under this side), and two eventfds.
+
+ @param fds	As passed by the creator: the memory, this side's `eventfd`,
+			the creator's. Owned from now on (closed on failure, too).
+ @return	`NULL` on failure (`error` says why).
+*/
+LinkRing*	LinkRing::attach(const int fds[3], std::string& error)
+{
+	LinkRing*	ring = new LinkRing;
+	struct stat	info;
+
+	ring->_memFd = fds[0];
+	ring->_wakeFd = fds[1];
+	ring->_peerWakeFd = fds[2];
+	if (!isFdKind(ring->_wakeFd, "anon_inode:[eventfd]") || !isFdKind(ring->_peerWakeFd, "anon_inode:[eventfd]"))
+	{
+		error = "not an eventfd";
+		delete ring;
+		return NULL;
+	}
+	int	seals = fcntl(ring->_memFd, F_GET_SEALS);
+	if (!isFdKind(ring->_memFd, "/memfd:") || seals == -1 || (seals & RING_SEALS) != RING_SEALS)
+	{
+		error = "shared memory is not a sealed memfd";
+		delete ring;
+		return NULL;
+	}
+	if (fstat(ring->_memFd, &info) == -1 || info.st_size <= static_cast<off_t>(2 * sizeof(Ring)))
+	{
+		error = "invalid shared memory";
+		delete ring;
+		return NULL;
+	}
+	ring->_size = (info.st_size - 2 * sizeof(Ring)) / 2;
+	if ((ring->_size & (ring->_size - 1)) != 0 || !ring->map(false, error))
+	{
+		if (error.empty())
+			error = "invalid ring size";
+		delete ring;
+		return NULL;
+	}
+	return ring;
+}
+#else
+// Local links need memfds and eventfds (Linux): links always use TCP elsewhere.
+LinkRing*	LinkRing::create(std::string& error)
+{
+	error = "shared memory links need Linux";
+	return NULL;
+}
+
+LinkRing*	LinkRing::attach(const int fds[3], std::string& error)
+{
+	for (int i = 0; i < 3; ++i)
+		close(fds[i]);
+	error = "shared memory links need Linux";
+	return NULL;
+}
+#endif
+
+/**
+Maps the memory: both ring headers first, then both rings' data. The creator
+writes into the first ring and reads from the second; the other side the
+other way around.
+*/
+bool	LinkRing::map(bool creator, std::string& error)
+{
+	_mappedSize = 2 * (sizeof(Ring) + _size);
+	_memory = mmap(NULL, _mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, _memFd, 0);
+	if (_memory == MAP_FAILED)
+	{
+		_memory = NULL;
+		error = toString("mmap(): ") + strerror(errno);
+		return false;
+	}
+
+	Ring*	first = static_cast<Ring*>(_memory);
+	char*	data = static_cast<char*>(_memory) + 2 * sizeof(Ring);
+
+	_tx = creator ? first : first + 1;
+	_rx = creator ? first + 1 : first;
+	_txData = creator ? data : data + _size;
+	_rxData = creator ? data + _size : data;
+	return true;
+}
+
+//////////////
+// Transfer //
+//////////////
+
+/**
+Copies as much of `data` as fits into the outgoing ring. The peer is woken
+if it had read everything before (it may be asleep in `select()`); if the
+ring is full, it is asked to wake this side once it has made room.
+
+Each index is only written by one side, so plain stores do, with a full
+barrier (`__sync_synchronize()`) between publishing one index and reading
+the other: one of the two sides always sees the other's last move.
+
+ @return	Bytes written, -1 if the indices are corrupt (`EPROTO`: the peer
+			wrote to them).
+*/
+ssize_t	LinkRing::write(const char* data, size_t size)
+{
+	size_t	written = 0;
+	bool	wakePeer = false;
+
+	while (written < size)
+	{
+		uint32_t	head = _tx->head;
+		uint32_t	tail = _tx->tail;
+		if (head - tail > _size)
+		{
+			errno = EPROTO;
+			return -1;
+		}
+		size_t		count = _size - (head - tail);
+
+		if (count == 0)
+		{
+			_tx->wantSpace = 1;
+			__sync_synchronize();
+			if (_tx->tail == tail)
+				break; // Still full: the peer signals once it has read
+			_tx->wantSpace = 0;
+			continue;
+		}
+		if (count > size - written)
+			count = size - written;
+		__sync_synchronize(); // The peer is done with the bytes before they are overwritten
+
+		uint32_t	offset = head & (_size - 1);
+		size_t		first = count < _size - offset ? count : _size - offset;
+		memcpy(_txData + offset, data + written, first);
+		memcpy(_txData, data + written + first, count - first);
+
+		__sync_synchronize(); // The bytes are in place before the peer can see them
+		_tx->head = head + count;
+		__sync_synchronize();
+		if (_tx->tail == head)
+			wakePeer = true;
+		written += count;
+	}
+	if (wakePeer)
+		wake(_peerWakeFd);
+	return static_cast<ssize_t>(written);
+}
+
+/**
+Appends what the peer put into the incoming ring to `out`, and wakes the peer
+if it was waiting for room. At most one ring's worth is taken per call; if
+more is left, this side's own `eventfd` is signalled, so `select()` comes
+back to it right away.
+
+The indices live in memory the peer can write, so they are checked before
+they are used: more than a ring's worth of bytes would read past the mapping.
+
+ @return	Bytes read, -1 if the indices are corrupt (`EPROTO`).
+*/
+ssize_t	LinkRing::read(std::string& out)
+{
+	uint64_t	count;
+	size_t		total = 0;
+
+	if (::read(_wakeFd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+		return 0; // Cannot fail on a valid eventfd; the ring is read anyway on the next wakeup
+
+	while (true)
+	{
+		uint32_t	tail = _rx->tail;
+		uint32_t	head = _rx->head;
+		__sync_synchronize(); // The bytes published with `head` are visible
+		if (head == tail)
+			break;
+
+		uint32_t	size = head - tail;
+		if (size > _size)
+		{
+			errno = EPROTO;
+			return -1;
+		}
+		uint32_t	offset = tail & (_size - 1);
+		uint32_t	first = size < _size - offset ? size : _size - offset;
+		out.append(_rxData + offset, first);
+		out.append(_rxData, size - first);
+		total += size;
+
+		__sync_synchronize(); // Done with the bytes before the peer may overwrite them
+		_rx->tail = head;
+		__sync_synchronize();
+		if (_rx->wantSpace)
+		{
+			_rx->wantSpace = 0;
+			wake(_peerWakeFd);
+		}
+		if (total >= _size)
+		{
+			wake(_wakeFd);
+			break;
+		}
+	}
+	return static_cast<ssize_t>(total);
+}
+
+// Adds one to an `eventfd` (it only overflows after 2^64 - 2 wakeups nobody read).
+void	LinkRing::wake(int fd)
+{
+	uint64_t	one = 1;
+
+	if (::write(fd, &one, sizeof(one)) == -1)
+		return;
+}
+
+/////////////
+// Getters //
+/////////////
+
+// What `attach()` needs on the other side, in its order: the memory, the peer's wakeup, ours.
+void	LinkRing::getPeerFds(int fds[3]) const
+{
+	fds[0] = _memFd;
+	fds[1] = _peerWakeFd;
+	fds[2] = _wakeFd;
+}
+
+int	LinkRing::getWakeFd() const
+{
+	return _wakeFd;
+}
+
+size_t	LinkRing::getSize() const
+{
+	return _size;
+}
@@ -0,0 +1,155 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>	// strtol()
+#include <ctime>	// time()
+
+#include "../include/ListStream.hpp"
+#include "../include/Server.hpp"
+#include "../include/Channel.hpp"
+#include "../include/Numerics.hpp"	// reply<>(), ReplyWriter
+#include "../include/utils.hpp"		// normalize(), matchMask()
+
+ListStream::ListStream(Server* server, const std::string& nick)
+	:	_server(server), _nick(nick), _literal(false), _nextMask(0), _started(false), _now(time(NULL))
+{}
+
+/**
+Parses the `LIST` parameter: a comma-separated list of channels and ELIST conditions.
+
+ - `#chan`, `#42*`, `#ch?n`: channel names or masks (M); any of them must match.
+ - `!#42*`: channels that must not match (N).
+ - `>N`, `<N`: more / fewer than N users (U).
+ - `C>N`, `C<N`: created more / less than N minutes ago (C).
+ - `T>N`, `T<N`: topic set more / less than N minutes ago (T).
+
+Malformed conditions are ignored. If only exact channel names are given,
+those channels are looked up instead of scanning all channels.
+*/
+void	ListStream::parse(const std::string& params)
+{
+	size_t	start = 0;
+
+	while (start <= params.size())
+	{
+		size_t		end = params.find(',', start);
+		if (end == std::string::npos)
+			end = params.size();
+		std::string	item = params.substr(start, end - start);
+		start = end + 1;
+		if (item.empty())
+			continue;
+
+		size_t	op = (item[0] == 'C' || item[0] == 'T') ? 1 : 0;
+		if (op < item.size() && (item[op] == '>' || item[op] == '<'))
+		{
+			char*		numberEnd;
+			Condition	condition;
+			condition.field = op ? item[0] : 'U';
+			condition.above = item[op] == '>';
+			condition.value = strtol(item.c_str() + op + 1, &numberEnd, 10);
+			if (numberEnd != item.c_str() + op + 1 && *numberEnd == '\0')
+				_conditions.push_back(condition);
+		}
+		else if (item[0] == '!')
+			_notMasks.push_back(normalize(item.substr(1)));
+		else
+			_masks.push_back(normalize(item));
+	}
+
+	_literal = !_masks.empty();
+	for (size_t i = 0; i < _masks.size() && _literal; ++i)
+		_literal = _masks[i].find_first_of("*?") == std::string::npos;
+}
+
+/**
+Writes `322` lines for the next matching channels until about `maxBytes` were
+written, then `323` once all channels were looked at.
+Non-matching channels cost a comparison, nothing is copied.
+*/
+bool	ListStream::pump(std::string& out, size_t maxBytes)
+{
+	std::map<std::string, Channel*>&	channels = _server->getAllChannels();
+	size_t								startSize = out.size();
+	bool								done;
+
+	if (_literal)
+	{
+		while (_nextMask < _masks.size() && out.size() - startSize < maxBytes)
+		{
+			std::map<std::string, Channel*>::const_iterator	it = channels.find(_masks[_nextMask++]);
+			if (it != channels.end() && matches(it->first, *it->second))
+				writeChannel(out, *it->second);
+		}
+		done = _nextMask >= _masks.size();
+	}
+	else
+	{
+		std::map<std::string, Channel*>::const_iterator	it = _started ? channels.lower_bound(_nextKey)
+			: channels.begin();
+		for (; it != channels.end() && out.size() - startSize < maxBytes; ++it)
+		{
+			if (matches(it->first, *it->second))
+				writeChannel(out, *it->second);
+		}
+		done = it == channels.end();
+		if (!done)
+			_nextKey = it->first; // Resume here: still valid if channels come and go meanwhile
+	}
+	_started = true;
+
+	if (!done)
+		return true;
+	ReplyWriter	writer(out, _server->getReplyPrefix(), _nick);
+	reply<RPL_LISTEND>(&writer);
+	return false;
+}
+
+/**
+Evaluates the ELIST filters for one channel.
+
+ @param key		The channel's normalized name (its key in the index).
+ @param channel	The channel.
+*/
+bool	ListStream::matches(const std::string& key, const Channel& channel) const
+{
+	for (size_t i = 0; i < _notMasks.size(); ++i)
+	{
+		if (matchMask(_notMasks[i], key))
+			return false;
+	}
+	if (!_literal && !_masks.empty())
+	{
+		bool	found = false;
+		for (size_t i = 0; i < _masks.size() && !found; ++i)
+			found = matchMask(_masks[i], key);
+		if (!found)
+			return false;
+	}
+	for (size_t i = 0; i < _conditions.size(); ++i)
+	{
+		const Condition&	condition = _conditions[i];
+		long				value;
+
+		if (condition.field == 'U')
+			value = channel.get_connected_user_number();
+		else if (condition.field == 'C')
+			value = static_cast<long>(_now - channel.get_creation_time()) / 60;
+		else if (channel.get_topic_time() == 0)
+			return false; // No topic: no topic age to compare
+		else
+			value = static_cast<long>(_now - channel.get_topic_time()) / 60;
+
+		if (condition.above ? value <= condition.value : value >= condition.value)
+			return false;
+	}
+	return true;
+}
+
+// Writes the `322` line of a channel.
+void	ListStream::writeChannel(std::string& out, const Channel& channel) const
+{
+	ReplyWriter	writer(out, _server->getReplyPrefix(), _nick);
+
+	reply<RPL_LIST>(&writer, channel.get_name(), channel.get_connected_user_number(), channel.get_topic());
+}
@@ -0,0 +1,212 @@
+#include <string>
+#include <vector>
+#include <set>
+#include <cstring>		// memset(), memcpy()
+#include <stdint.h>		// uint64_t
+
+#include "../include/MaskSet.hpp"
+#include "../include/IrcChars.hpp"	// IrcChars::fold()
+
+static const size_t	INLINE_WORDS = 64;	// State vectors up to 4096 states are kept on the stack while matching
+
+// Sets bit `bit` of a state vector.
+static inline void	setState(std::vector<uint64_t>& states, size_t bit)
+{
+	states[bit / 64] |= static_cast<uint64_t>(1) << (bit % 64);
+}
+
+// Folds `text` to lowercase (see `IrcChars::fold()`).
+static std::string	folded(const std::string& text)
+{
+	std::string	result(text);
+
+	if (!result.empty())
+		IrcChars::fold(&result[0], result.size());
+	return result;
+}
+
+/////////////
+// MaskSet //
+/////////////
+
+MaskSet::MaskSet() : _words(0)
+{
+	memset(_rowOf, 0, sizeof(_rowOf));
+}
+
+MaskSet::~MaskSet()
+{}
+
+/**
+Builds the automaton of the masks of `entries` (duplicates, as folded, are
+compiled once). Row 0 of the table is for bytes no mask names literally;
+the states entered on `?` are set in every row.
+*/
+void	MaskSet::compile(const std::vector<MaskEntry>& entries)
+{
+	std::vector<std::string>	masks;
+	std::set<std::string>		seen;
+	size_t						states = 0;
+	size_t						rows = 1;
+
+	memset(_rowOf, 0, sizeof(_rowOf));
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		std::string	mask = folded(entries[i].mask);
+		if (!seen.insert(mask).second)
+			continue;
+		states += 1; // The start state
+		for (size_t k = 0; k < mask.size(); ++k)
+		{
+			unsigned char	c = static_cast<unsigned char>(mask[k]);
+			if (c == '*')
+				continue;
+			++states;
+			if (c != '?' && _rowOf[c] == 0)
+				_rowOf[c] = static_cast<unsigned char>(rows++);
+		}
+		masks.push_back(mask);
+	}
+
+	_words = (states + 63) / 64;
+	_table.assign(rows * _words, 0);
+	_loops.assign(_words, 0);
+	_start.assign(_words, 0);
+	_accept.assign(_words, 0);
+
+	size_t	state = 0;
+	for (size_t i = 0; i < masks.size(); ++i, ++state)
+	{
+		const std::string&	mask = masks[i];
+		setState(_start, state);
+		for (size_t k = 0; k < mask.size(); ++k)
+		{
+			unsigned char	c = static_cast<unsigned char>(mask[k]);
+			if (c == '*')
+			{
+				setState(_loops, state);
+				continue;
+			}
+			++state;
+			if (c != '?')
+			{
+				_table[_rowOf[c] * _words + state / 64] |= static_cast<uint64_t>(1) << (state % 64);
+				continue;
+			}
+			for (size_t r = 0; r < rows; ++r)
+				_table[r * _words + state / 64] |= static_cast<uint64_t>(1) << (state % 64);
+		}
+		setState(_accept, state);
+	}
+}
+
+/**
+True if `hostmask` (`nick!user@host`) matches at least one of the masks.
+
+All masks are run at once: a state becomes active when the state before it
+was and the byte is accepted (the shift carries between words), or stays
+active if it loops. Words with no active state and no carry in are skipped,
+and the run ends early once no state is active.
+*/
+bool	MaskSet::matches(const std::string& hostmask) const
+{
+	if (_words == 0)
+		return false;
+
+	std::string				subject = folded(hostmask);
+	uint64_t				inlineStates[INLINE_WORDS];
+	std::vector<uint64_t>	heapStates;
+	uint64_t*				active = inlineStates;
+	const uint64_t*			loops = &_loops[0];
+
+	if (_words > INLINE_WORDS)
+	{
+		heapStates.resize(_words);
+		active = &heapStates[0];
+	}
+	memcpy(active, &_start[0], _words * sizeof(uint64_t));
+
+	for (size_t i = 0; i < subject.size(); ++i)
+	{
+		const uint64_t*	row = &_table[_rowOf[static_cast<unsigned char>(subject[i])] * _words];
+		uint64_t		carry = 0;
+		uint64_t		any = 0;
+
+		for (size_t w = 0; w < _words; ++w)
+		{
+			uint64_t	states = active[w];
+			if (!(states | carry))
+				continue;
+			uint64_t	next = (((states << 1) | carry) & row[w]) | (states & loops[w]);
+			carry = states >> 63;
+			active[w] = next;
+			any |= next;
+		}
+		if (!any)
+			return false;
+	}
+	for (size_t w = 0; w < _words; ++w)
+	{
+		if (active[w] & _accept[w])
+			return true;
+	}
+	return false;
+}
+
+// True if no mask is compiled.
+bool	MaskSet::empty() const
+{
+	return _words == 0;
+}
+
+/**
+Completes a mask to the `nick!user@host` form, as ircds do: a bare word is
+a nickname, unless it looks like a host (`.` or `:`), `user@host` gets any
+nickname, `nick!user` any host. Empty parts become `*`, and runs of `*`
+are merged.
+
+For example `bob` -> `bob!*@*`, `*.example.com` -> `*!*@*.example.com`,
+`~bob@*` -> `*!~bob@*`.
+*/
+std::string	MaskSet::complete(const std::string& mask)
+{
+	size_t		bang = mask.find('!');
+	size_t		at = mask.find('@', bang == std::string::npos ? 0 : bang + 1);
+	std::string	nick;
+	std::string	user;
+	std::string	host;
+
+	if (bang == std::string::npos && at == std::string::npos)
+	{
+		if (mask.find_first_of(".:") != std::string::npos)
+			host = mask;
+		else
+			nick = mask;
+	}
+	else if (bang == std::string::npos)
+	{
+		user = mask.substr(0, at);
+		host = mask.substr(at + 1);
+	}
+	else if (at == std::string::npos)
+	{
+		nick = mask.substr(0, bang);
+		user = mask.substr(bang + 1);
+	}
+	else
+	{
+		nick = mask.substr(0, bang);
+		user = mask.substr(bang + 1, at - bang - 1);
+		host = mask.substr(at + 1);
+	}
+
+	std::string	full = (nick.empty() ? "*" : nick) + "!" + (user.empty() ? "*" : user) + "@"
+						+ (host.empty() ? "*" : host);
+	std::string	result;
+	for (size_t i = 0; i < full.size(); ++i)
+	{
+		if (full[i] != '*' || result.empty() || result[result.size() - 1] != '*')
+			result += full[i];
+	}
+	return result;
+}
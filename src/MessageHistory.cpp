@@ -0,0 +1,576 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <algorithm>	// std::sort(), std::unique(), std::binary_search()
+#include <cctype>		// isalnum(), tolower()
+#include <cstdio>		// snprintf(), sscanf()
+#include <cstdlib>		// strtoul()
+#include <cstring>		// memset()
+#include <ctime>		// gmtime_r(), timegm()
+#include <sys/time.h>	// gettimeofday()
+
+#include "../include/MessageHistory.hpp"
+#include "../include/User.hpp"		// CAP_BATCH, CAP_SERVER_TIME, CAP_MESSAGE_TAGS
+#include "../include/utils.hpp"		// toString()
+
+static const size_t	MIN_TERM_LENGTH = 2;	// Shorter words are not indexed
+static const size_t	MAX_TERM_LENGTH = 32;	// Longer words are indexed by their start
+
+// Wall clock time in milliseconds since the epoch (message `time` tags).
+static unsigned long	getWallMs()
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return static_cast<unsigned long>(tv.tv_sec) * 1000UL + tv.tv_usec / 1000;
+}
+
+// Formats `ms` since the epoch as an IRCv3 `server-time` (e.g. "2024-05-04T12:00:00.123Z").
+static std::string	formatServerTime(unsigned long ms)
+{
+	time_t		seconds = static_cast<time_t>(ms / 1000);
+	struct tm	tm;
+	char		buf[32];
+
+	gmtime_r(&seconds, &tm);
+	snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03luZ", tm.tm_year + 1900, tm.tm_mon + 1,
+		tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ms % 1000);
+	return buf;
+}
+
+// Parses an IRCv3 `server-time` (milliseconds optional) into `ms` since the epoch.
+static bool	parseServerTime(const std::string& str, unsigned long& ms)
+{
+	struct tm	tm;
+	int			millis = 0;
+	int			consumed = 0;
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(str.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+			&tm.tm_min, &tm.tm_sec, &consumed) != 6)
+		return false;
+
+	const char*	rest = str.c_str() + consumed;
+	if (*rest == '.')
+	{
+		char*	end;
+		millis = static_cast<int>(strtoul(rest + 1, &end, 10));
+		if (end - rest != 4) // Exactly 3 digits
+			return false;
+		rest = end;
+	}
+	if (rest[0] != 'Z' || rest[1] != '\0')
+		return false;
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	time_t	seconds = timegm(&tm);
+	if (seconds < 0)
+		return false;
+	ms = static_cast<unsigned long>(seconds) * 1000UL + millis;
+	return true;
+}
+
+/**
+ @param maxBytes		Budget of all channels together; the least recently used
+						channels lose their oldest lines first.
+ @param channelMaxBytes	Budget of a single channel (0 disables the history).
+ @param indexed			Keep a word index of each channel (`search()`).
+*/
+MessageHistory::MessageHistory(size_t maxBytes, size_t channelMaxBytes, bool indexed)
+	:	_maxBytes(maxBytes), _channelMaxBytes(channelMaxBytes), _indexed(indexed), _nextId(1), _lastTime(0)
+{
+	_stats.bytes = 0;
+	_stats.lines = 0;
+	_stats.channels = 0;
+	_stats.recorded = 0;
+	_stats.trimmed = 0;
+	_stats.evicted = 0;
+	_stats.indexTerms = 0;
+	_stats.indexPostings = 0;
+	_stats.indexBytes = 0;
+}
+
+MessageHistory::~MessageHistory()
+{
+	while (!_rings.empty())
+		drop(_rings.begin()->first);
+}
+
+/**
+Records a message sent to a channel, then trims its ring to `channelMaxBytes`
+and all rings to `maxBytes`.
+
+ @param channelKey	The normalized channel name.
+ @param line		The message as broadcast, without `\r\n`.
+*/
+void	MessageHistory::record(const std::string& channelKey, const std::string& line)
+{
+	if (_channelMaxBytes == 0)
+		return;
+
+	std::map<std::string, Ring*>::iterator	it = _rings.find(channelKey);
+	Ring*									ring;
+	if (it != _rings.end())
+		ring = it->second;
+	else
+	{
+		ring = new Ring();
+		ring->key = channelKey;
+		ring->bytes = 0;
+		ring->indexBytes = 0;
+		ring->lru = _lru.insert(_lru.begin(), ring);
+		_rings[channelKey] = ring;
+		++_stats.channels;
+	}
+
+	unsigned long	now = getWallMs();
+	Line*			entry = new Line();
+	entry->id = _nextId++;
+	entry->time = now > _lastTime ? now : _lastTime; // Keeps each ring sorted by time, too
+	entry->refs = 1;
+	_lastTime = entry->time;
+
+	std::string	tags = "@time=" + formatServerTime(entry->time) + ";msgid=" + toString(entry->id) + " ";
+	entry->text.reserve(tags.size() + line.size() + 2);
+	entry->text.append(tags).append(line).append("\r\n", 2);
+
+	ring->lines.push_back(entry);
+	ring->bytes += sizeof(Line) + entry->text.size();
+	_stats.bytes += sizeof(Line) + entry->text.size();
+	++_stats.lines;
+	++_stats.recorded;
+	if (_indexed)
+		indexLine(ring, entry, true);
+	use(ring);
+
+	while (ring->bytes > _channelMaxBytes && ring->lines.size() > 1)
+	{
+		popOldest(ring);
+		++_stats.trimmed;
+	}
+	while (_stats.bytes > _maxBytes && _stats.lines > 1)
+	{
+		Ring*	victim = _lru.back();
+		popOldest(victim);
+		++_stats.evicted;
+		if (victim->lines.empty())
+			drop(victim->key);
+	}
+}
+
+/**
+Selects lines of a channel for `CHATHISTORY`, oldest first.
+
+ - `QUERY_LATEST`: the newest `limit` lines, only ones after `ref` unless it is `*`.
+ - `QUERY_BEFORE`: the `limit` lines right before `ref`.
+ - `QUERY_AFTER`: the `limit` lines right after `ref`.
+
+ @param lines	Set to the selected lines, retained for the caller (see `release()`).
+*/
+void	MessageHistory::find(const std::string& channelKey, Query query, const Ref& ref, size_t limit,
+			std::vector<Line*>& lines)
+{
+	lines.clear();
+
+	std::map<std::string, Ring*>::iterator	it = _rings.find(channelKey);
+	if (it == _rings.end())
+		return;
+
+	Ring*	ring = it->second;
+	size_t	begin = 0;
+	size_t	end = ring->lines.size();
+
+	if (query == QUERY_BEFORE)
+	{
+		end = lowerBound(ring, ref, true);
+		begin = end > limit ? end - limit : 0;
+	}
+	else
+	{
+		if (ref.type != Ref::REF_NONE)
+			begin = lowerBound(ring, ref, false);
+		if (query == QUERY_AFTER && end - begin > limit)
+			end = begin + limit;
+		else if (query == QUERY_LATEST && end - begin > limit)
+			begin = end - limit;
+	}
+
+	lines.reserve(end - begin);
+	for (size_t i = begin; i < end; ++i)
+		lines.push_back(retain(ring->lines[i]));
+	use(ring);
+}
+
+/**
+Finds the newest lines of a channel that contain all `terms` (see `tokenize()`),
+and returns up to `limit` of them, oldest first.
+
+The rarest word's postings are walked from the newest line back, each one
+looked up in the other words' postings (binary search), so a query costs at
+most the rarest word's line count, however big the history is.
+
+ @param lines	Set to the matching lines, retained for the caller (see `release()`).
+*/
+void	MessageHistory::search(const std::string& channelKey, const std::vector<std::string>& terms, size_t limit,
+			std::vector<Line*>& lines)
+{
+	lines.clear();
+
+	std::map<std::string, Ring*>::iterator	it = _rings.find(channelKey);
+	if (it == _rings.end() || terms.empty())
+		return;
+
+	Ring*							ring = it->second;
+	std::vector<const Postings*>	lists;
+	for (size_t i = 0; i < terms.size(); ++i)
+	{
+		Index::const_iterator	term = ring->index.find(terms[i]);
+		if (term == ring->index.end())
+			return;
+		lists.push_back(&term->second);
+	}
+	std::sort(lists.begin(), lists.end(), hasFewerPostings);
+
+	const Postings&				rarest = *lists[0];
+	std::vector<unsigned long>	ids;
+	for (size_t i = rarest.ids.size(); i > rarest.head && ids.size() < limit; --i)
+	{
+		unsigned long	id = rarest.ids[i - 1];
+		size_t			j = 1;
+		while (j < lists.size()
+			&& std::binary_search(lists[j]->ids.begin() + lists[j]->head, lists[j]->ids.end(), id))
+			++j;
+		if (j == lists.size())
+			ids.push_back(id);
+	}
+
+	Ref	ref;
+	ref.type = Ref::REF_MSGID;
+	lines.reserve(ids.size());
+	for (size_t i = ids.size(); i > 0; --i)
+	{
+		ref.value = ids[i - 1];
+		lines.push_back(retain(ring->lines[lowerBound(ring, ref, true)]));
+	}
+	use(ring);
+}
+
+// Drops the history of a channel (e.g. once the channel is deleted).
+void	MessageHistory::drop(const std::string& channelKey)
+{
+	std::map<std::string, Ring*>::iterator	it = _rings.find(channelKey);
+	if (it == _rings.end())
+		return;
+
+	Ring*	ring = it->second;
+	while (!ring->lines.empty())
+		popOldest(ring);
+	_lru.erase(ring->lru);
+	_rings.erase(it);
+	delete ring;
+	--_stats.channels;
+}
+
+const MessageHistory::Stats&	MessageHistory::getStats() const
+{
+	return _stats;
+}
+
+size_t	MessageHistory::getChannelBytes(const std::string& channelKey) const
+{
+	std::map<std::string, Ring*>::const_iterator	it = _rings.find(channelKey);
+	return it == _rings.end() ? 0 : it->second->bytes;
+}
+
+size_t	MessageHistory::getChannelLines(const std::string& channelKey) const
+{
+	std::map<std::string, Ring*>::const_iterator	it = _rings.find(channelKey);
+	return it == _rings.end() ? 0 : it->second->lines.size();
+}
+
+size_t	MessageHistory::getChannelIndexBytes(const std::string& channelKey) const
+{
+	std::map<std::string, Ring*>::const_iterator	it = _rings.find(channelKey);
+	return it == _rings.end() ? 0 : it->second->indexBytes;
+}
+
+bool	MessageHistory::isIndexed() const
+{
+	return _indexed;
+}
+
+size_t	MessageHistory::getMaxBytes() const
+{
+	return _maxBytes;
+}
+
+size_t	MessageHistory::getChannelMaxBytes() const
+{
+	return _channelMaxBytes;
+}
+
+/**
+Parses a `CHATHISTORY` message reference: `*`, `msgid=<id>` or
+`timestamp=<YYYY-MM-DDThh:mm:ss.sssZ>`.
+
+ @return	`false` if `param` is none of these.
+*/
+bool	MessageHistory::parseRef(const std::string& param, Ref& ref)
+{
+	ref.type = Ref::REF_NONE;
+	ref.value = 0;
+	if (param == "*")
+		return true;
+	if (param.compare(0, 6, "msgid=") == 0)
+	{
+		char*	end;
+		ref.type = Ref::REF_MSGID;
+		ref.value = strtoul(param.c_str() + 6, &end, 10);
+		return param.size() > 6 && *end == '\0';
+	}
+	if (param.compare(0, 10, "timestamp=") == 0)
+	{
+		ref.type = Ref::REF_TIME;
+		return parseServerTime(param.substr(10), ref.value);
+	}
+	return false;
+}
+
+/**
+Splits text into the words the index knows: runs of letters and digits
+(and non-ASCII bytes, so UTF-8 words stay whole), lowercased, at least
+`MIN_TERM_LENGTH` and at most `MAX_TERM_LENGTH` bytes long.
+
+ @param terms	Set to the distinct words, sorted.
+*/
+void	MessageHistory::tokenize(const std::string& text, std::vector<std::string>& terms)
+{
+	std::string	term;
+
+	terms.clear();
+	for (size_t i = 0; i <= text.size(); ++i)
+	{
+		unsigned char	c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+		if (isalnum(c) || c >= 0x80)
+		{
+			if (term.size() < MAX_TERM_LENGTH)
+				term += static_cast<char>(tolower(c));
+		}
+		else if (!term.empty())
+		{
+			if (term.size() >= MIN_TERM_LENGTH)
+				terms.push_back(term);
+			term.clear();
+		}
+	}
+	std::sort(terms.begin(), terms.end());
+	terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+}
+
+// Adds an owner to a recorded line.
+MessageHistory::Line*	MessageHistory::retain(Line* line)
+{
+	++line->refs;
+	return line;
+}
+
+// Drops an owner of a recorded line; the last one deletes it.
+void	MessageHistory::release(Line* line)
+{
+	if (line && --line->refs == 0)
+		delete line;
+}
+
+// Removes the oldest line of a ring (it lives on while a replay still holds it).
+void	MessageHistory::popOldest(Ring* ring)
+{
+	Line*	line = ring->lines.front();
+	size_t	size = sizeof(Line) + line->text.size();
+
+	if (_indexed)
+		indexLine(ring, line, false);
+	ring->lines.pop_front();
+	ring->bytes -= size;
+	_stats.bytes -= size;
+	--_stats.lines;
+	release(line);
+}
+
+/**
+Adds a line to its ring's index (it is the newest line), or removes it (it is
+the oldest one). Postings are kept in `msgid` order, so both ends are O(1):
+removed ids only advance `head`, and the vector is compacted once half of it
+is dead.
+*/
+void	MessageHistory::indexLine(Ring* ring, const Line* line, bool add)
+{
+	static const size_t			termOverhead = sizeof(std::string) + sizeof(Postings) + 4 * sizeof(void*);
+	std::vector<std::string>	terms;
+	size_t						start = line->text.find(" :", line->text.find(' ') + 1); // Skips the tags
+
+	if (start == std::string::npos)
+		return;
+	tokenize(line->text.substr(start + 2, line->text.size() - start - 4), terms); // Without "\r\n"
+
+	for (size_t i = 0; i < terms.size(); ++i)
+	{
+		if (add)
+		{
+			std::pair<Index::iterator, bool>	inserted = ring->index.insert(std::make_pair(terms[i], Postings()));
+			Postings&							postings = inserted.first->second;
+			if (inserted.second)
+			{
+				postings.head = 0;
+				ring->indexBytes += termOverhead + terms[i].size();
+				_stats.indexBytes += termOverhead + terms[i].size();
+				++_stats.indexTerms;
+			}
+			postings.ids.push_back(line->id);
+			ring->indexBytes += sizeof(unsigned long);
+			_stats.indexBytes += sizeof(unsigned long);
+			++_stats.indexPostings;
+			continue;
+		}
+
+		Index::iterator	it = ring->index.find(terms[i]);
+		if (it == ring->index.end())
+			continue;
+		Postings&	postings = it->second;
+		++postings.head;
+		ring->indexBytes -= sizeof(unsigned long);
+		_stats.indexBytes -= sizeof(unsigned long);
+		--_stats.indexPostings;
+		if (postings.head == postings.ids.size())
+		{
+			ring->indexBytes -= termOverhead + terms[i].size();
+			_stats.indexBytes -= termOverhead + terms[i].size();
+			--_stats.indexTerms;
+			ring->index.erase(it);
+		}
+		else if (postings.head * 2 >= postings.ids.size())
+		{
+			postings.ids.erase(postings.ids.begin(), postings.ids.begin() + postings.head);
+			postings.head = 0;
+		}
+	}
+}
+
+// Orders postings by their live length (the rarest word drives a search).
+bool	MessageHistory::hasFewerPostings(const Postings* a, const Postings* b)
+{
+	return a->ids.size() - a->head < b->ids.size() - b->head;
+}
+
+// Marks a ring as most recently used.
+void	MessageHistory::use(Ring* ring)
+{
+	_lru.splice(_lru.begin(), _lru, ring->lru);
+}
+
+/**
+Binary search of a ring (sorted by `msgid` and by time alike).
+
+ @param inclusive	Stop at the first line at `ref` (`true`) or after it (`false`).
+ @return			Index of that line; the ring's size if there is none.
+*/
+size_t	MessageHistory::lowerBound(const Ring* ring, const Ref& ref, bool inclusive) const
+{
+	size_t	low = 0;
+	size_t	high = ring->lines.size();
+
+	while (low < high)
+	{
+		size_t			mid = low + (high - low) / 2;
+		const Line*		line = ring->lines[mid];
+		unsigned long	key = ref.type == Ref::REF_MSGID ? line->id : line->time;
+		if (inclusive ? key < ref.value : key <= ref.value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+///////////////////
+// HistoryStream //
+///////////////////
+
+/**
+ @param prefix		The server's reply prefix (":<server name> ").
+ @param batchType	"chathistory", or "search" for `SEARCH` results.
+ @param target		The channel, as the client named it.
+ @param batchId		Reference tag of the batch, unique on the connection.
+ @param lines		Lines retained by `MessageHistory::find()` / `search()`; the stream
+					takes them over (the vector is left empty) and releases them.
+ @param caps		The client's `CAP_*` bits: which of batch and tags it understands.
+*/
+HistoryStream::HistoryStream(const std::string& prefix, const std::string& batchType, const std::string& target,
+		const std::string& batchId, std::vector<MessageHistory::Line*>& lines, unsigned char caps)
+	:	_prefix(prefix), _batchType(batchType), _target(target), _batchId(batchId), _caps(caps), _next(0),
+		_started(false)
+{
+	_lines.swap(lines);
+}
+
+HistoryStream::~HistoryStream()
+{
+	for (size_t i = 0; i < _lines.size(); ++i)
+		MessageHistory::release(_lines[i]);
+}
+
+bool	HistoryStream::pump(std::string& out, size_t maxBytes)
+{
+	size_t	startSize = out.size();
+
+	if (!_started)
+	{
+		if (_caps & CAP_BATCH)
+			out.append(_prefix).append("BATCH +").append(_batchId).append(" ").append(_batchType).append(" ")
+				.append(_target).append("\r\n", 2);
+		_started = true;
+	}
+	while (_next < _lines.size() && out.size() - startSize < maxBytes)
+		writeLine(out, _lines[_next++]->text);
+	if (_next < _lines.size())
+		return true;
+	if (_caps & CAP_BATCH)
+		out.append(_prefix).append("BATCH -").append(_batchId).append("\r\n", 2);
+	return false;
+}
+
+/**
+Writes a recorded line ("@time=...;msgid=<id> <message>") with the tags the
+client negotiated: `batch` needs `batch`, `time` needs `server-time` or
+`message-tags`, `msgid` needs `message-tags`. Without any, the tags are cut.
+*/
+void	HistoryStream::writeLine(std::string& out, const std::string& text) const
+{
+	if ((_caps & (CAP_BATCH | CAP_SERVER_TIME | CAP_MESSAGE_TAGS)) == (CAP_BATCH | CAP_SERVER_TIME | CAP_MESSAGE_TAGS))
+	{
+		out.append("@batch=", 7).append(_batchId).append(";", 1).append(text, 1, std::string::npos);
+		return;
+	}
+
+	size_t	msgidStart = text.find(';') + 1;
+	size_t	messageStart = text.find(' ', msgidStart) + 1;
+	char	separator = '@';
+
+	if (_caps & CAP_BATCH)
+	{
+		out.append("@batch=", 7).append(_batchId);
+		separator = ';';
+	}
+	if (_caps & (CAP_SERVER_TIME | CAP_MESSAGE_TAGS))
+	{
+		out.append(1, separator).append(text, 1, msgidStart - 2);
+		separator = ';';
+	}
+	if (_caps & CAP_MESSAGE_TAGS)
+		out.append(1, separator).append(text, msgidStart, messageStart - 1 - msgidStart);
+	if (separator == ';')
+		out.append(" ", 1);
+	out.append(text, messageStart, std::string::npos);
+}
@@ -0,0 +1,199 @@
+#include <string>
+#include <cstring>	// memcpy(), strlen()
+
+#include "../include/Numerics.hpp"
+#include "../include/defines.hpp"	// MAX_LINE_LENGTH
+#include "../include/utils.hpp"		// toString()
+
+//////////////
+// ReplyArg //
+//////////////
+
+ReplyArg::ReplyArg(const std::string& str) : _data(str.data()), _size(str.size()) {}
+
+ReplyArg::ReplyArg(const char* str) : _data(str), _size(strlen(str)) {}
+
+ReplyArg::ReplyArg(long number)
+{
+	formatNumber(number < 0 ? -static_cast<unsigned long>(number) : number, number < 0);
+}
+
+ReplyArg::ReplyArg(unsigned long number)
+{
+	formatNumber(number, false);
+}
+
+ReplyArg::ReplyArg(int number)
+{
+	formatNumber(number < 0 ? -static_cast<unsigned long>(number) : number, number < 0);
+}
+
+// Copies keep pointing at their own digits, not at the original's
+ReplyArg::ReplyArg(const ReplyArg& other) : _data(other._data), _size(other._size)
+{
+	if (other._data >= other._digits && other._data < other._digits + sizeof(other._digits))
+	{
+		memcpy(_digits, other._digits, sizeof(_digits));
+		_data = _digits + (other._data - other._digits);
+	}
+}
+
+const char*	ReplyArg::data() const
+{
+	return _data;
+}
+
+size_t	ReplyArg::size() const
+{
+	return _size;
+}
+
+// Writes the decimal digits right-aligned into `_digits`.
+void	ReplyArg::formatNumber(unsigned long number, bool negative)
+{
+	char*	end = _digits + sizeof(_digits);
+	char*	p = end;
+
+	do
+	{
+		*--p = static_cast<char>('0' + number % 10);
+		number /= 10;
+	}
+	while (number > 0);
+	if (negative)
+		*--p = '-';
+	_data = p;
+	_size = end - p;
+}
+
+//////////////////
+// Reply Writer //
+//////////////////
+
+// Copies as much of `data` as fits before `end`.
+static void	put(char*& p, const char* end, const char* data, size_t size)
+{
+	if (size > static_cast<size_t>(end - p))
+		size = end - p;
+	memcpy(p, data, size);
+	p += size;
+}
+
+/**
+Appends a numeric reply line to `out`:
+`<prefix><code> <target>[ <format with parameters>]\r\n`.
+
+The line length is measured first, so the buffer grows at most once and the
+line is written in place without temporaries. Lines longer than
+`MAX_LINE_LENGTH` are cut (the `\r\n` is always kept).
+
+ @param out		The client's output buffer.
+ @param prefix	The precomputed server prefix (`:<server name> `).
+ @param code	The numeric code (written as 3 digits).
+ @param target	The client's nickname, or `*`.
+ @param format	Catalog format; each `%s` takes the next parameter.
+ @param args	The parameters.
+ @param count	Number of parameters.
+*/
+void	appendReply(std::string& out, const std::string& prefix, int code, const ReplyArg& target,
+			const char* format, const ReplyArg* const* args, int count)
+{
+	size_t	formatLength = 0;
+	int		argIndex = 0;
+
+	for (const char* f = format; *f; ++f)
+	{
+		if (f[0] == '%' && f[1] == 's' && argIndex < count)
+		{
+			formatLength += args[argIndex++]->size();
+			++f;
+		}
+		else
+			++formatLength;
+	}
+
+	size_t	length = prefix.size() + 4 + target.size() + (formatLength ? 1 + formatLength : 0) + 2;
+	if (length > MAX_LINE_LENGTH)
+		length = MAX_LINE_LENGTH;
+
+	size_t	start = out.size();
+	out.resize(start + length);
+	char*		p = &out[start];
+	const char*	end = p + length - 2; // Room for "\r\n"
+	char		codeDigits[4] = { static_cast<char>('0' + code / 100 % 10),
+		static_cast<char>('0' + code / 10 % 10), static_cast<char>('0' + code % 10), ' ' };
+
+	put(p, end, prefix.data(), prefix.size());
+	put(p, end, codeDigits, 4);
+	put(p, end, target.data(), target.size());
+	if (formatLength)
+	{
+		put(p, end, " ", 1);
+		argIndex = 0;
+		for (const char* f = format; *f; ++f)
+		{
+			if (f[0] == '%' && f[1] == 's' && argIndex < count)
+			{
+				put(p, end, args[argIndex]->data(), args[argIndex]->size());
+				++argIndex;
+				++f;
+			}
+			else
+				put(p, end, f, 1);
+		}
+	}
+	memcpy(p, "\r\n", 2);
+}
+
+/**
+Checks that every catalog format has exactly as many `%s` as its arity says.
+Called once at startup; the parameter count of each call is checked at compile time.
+
+ @param error	Set to the first broken entry.
+ @return		`false` if an entry is broken.
+*/
+bool	checkNumericCatalog(std::string& error)
+{
+	struct	Entry
+	{
+		const char*	name;
+		int			arity;
+		const char*	format;
+	};
+	static const Entry	entries[] =
+	{
+# define NUMERIC_ENTRY(name, code, arity, format)	{ #name, arity, format },
+		IRC_NUMERICS(NUMERIC_ENTRY)
+# undef NUMERIC_ENTRY
+	};
+
+	for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); ++i)
+	{
+		int	placeholders = 0;
+		for (const char* f = entries[i].format; *f; ++f)
+		{
+			if (f[0] == '%' && f[1] == 's')
+				++placeholders;
+		}
+		if (placeholders != entries[i].arity)
+		{
+			error = toString(entries[i].name) + " has " + toString(placeholders)
+				+ " placeholders but arity " + toString(entries[i].arity);
+			return false;
+		}
+	}
+	return true;
+}
+
+/////////////////
+// ReplyWriter //
+/////////////////
+
+ReplyWriter::ReplyWriter(std::string& out, const std::string& prefix, const std::string& target)
+	:	_out(out), _prefix(prefix), _target(target)
+{}
+
+void	ReplyWriter::writeReply(int code, const char* format, const ReplyArg* const* args, int count)
+{
+	appendReply(_out, _prefix, code, _target, format, args, count);
+}
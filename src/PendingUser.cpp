@@ -0,0 +1,224 @@
+#include <string>
+#include <cstring>		// strncpy()
+
+#include <netinet/in.h>	// in_addr
+#include <arpa/inet.h>	// inet_ntoa()
+
+#include "../include/PendingUser.hpp"
+#include "../include/User.hpp"		// User::writeLog()
+#include "../include/Server.hpp"
+#include "../include/Numerics.hpp"	// appendReply()
+
+PendingUser::PendingUser()
+	:	_fd(-1), _addr(0), _flags(0), _caps(0), _server(NULL), _connectedAt(0), _partialSince(0)
+{
+	_nickname[0] = '*';
+	_nickname[1] = '\0';
+}
+
+PendingUser::~PendingUser() {}
+
+/**
+(Re)initializes the record for a freshly accepted connection.
+Used both for new and for recycled records.
+*/
+void	PendingUser::reset(Server* server, int fd, uint32_t addr)
+{
+	_server = server;
+	_fd = fd;
+	_addr = addr;
+	_flags = 0;
+	_caps = 0;
+	_nickname[0] = '*';
+	_nickname[1] = '\0';
+	_connectedAt = 0;
+	_partialSince = 0;
+}
+
+/**
+Clears the record before it goes back to the pool.
+Buffers that grew beyond one IRC line are released, smaller ones keep
+their capacity so the next connection does not need to allocate.
+*/
+void	PendingUser::clear()
+{
+	if (_inputBuffer.capacity() > MAX_BUFFER_SIZE)
+		std::string().swap(_inputBuffer);
+	if (_outputBuffer.capacity() > MAX_BUFFER_SIZE)
+		std::string().swap(_outputBuffer);
+	_inputBuffer.clear();
+	_outputBuffer.clear();
+	_username.clear();
+	_realname.clear();
+	_fd = -1;
+}
+
+// Logs an action of this connection, in the same format as `User::logUserAction()`.
+void	PendingUser::logAction(const std::string& message) const
+{
+	User::writeLog(_server, _nickname, _fd, message);
+}
+
+// Appends a raw IRC message from the server to the output buffer (see `User::sendServerMsg()`).
+void	PendingUser::sendServerMsg(const std::string& message)
+{
+	_outputBuffer.append(_server->getReplyPrefix()).append(message).append("\r\n", 2);
+}
+
+// Appends a numeric reply (see `reply<>()`); the target is always `*` before registration.
+void	PendingUser::writeReply(int code, const char* format, const ReplyArg* const* args, int count)
+{
+	appendReply(_outputBuffer, _server->getReplyPrefix(), code, "*", format, args, count);
+}
+
+/////////////
+// Setters //
+/////////////
+
+// Stores the (already validated) nickname.
+void	PendingUser::setNickname(const std::string& nick)
+{
+	strncpy(_nickname, nick.c_str(), MAX_NICK_LENGTH);
+	_nickname[MAX_NICK_LENGTH] = '\0';
+	_flags |= HAS_NICK;
+}
+
+// Stores username (cut to `MAX_USER_LENGTH`) and realname as sent with `USER`.
+void	PendingUser::setUser(const std::string& username, const std::string& realname)
+{
+	_username = username.substr(0, MAX_USER_LENGTH);
+	_realname = realname;
+	_flags |= HAS_USER;
+}
+
+// Sets whether the connection has passed the password check.
+void	PendingUser::setHasPassed(bool b)
+{
+	if (b)
+		_flags |= HAS_PASSED;
+	else
+		_flags &= ~HAS_PASSED;
+}
+
+// Sets whether capability negotiation is in progress (registration waits for `CAP END`).
+void	PendingUser::setNegotiating(bool b)
+{
+	if (b)
+		_flags |= NEGOTIATING;
+	else
+		_flags &= ~NEGOTIATING;
+}
+
+// Sets the `CAP_*` bits the client requested; they carry over to the `User`.
+void	PendingUser::setCaps(unsigned char caps)
+{
+	_caps = caps;
+}
+
+// Records when the connection was accepted.
+void	PendingUser::setConnectedAt(unsigned long nowMs)
+{
+	_connectedAt = nowMs;
+}
+
+// Records since when an unterminated line is buffered (`0`: input buffer is empty).
+void	PendingUser::setPartialSince(unsigned long nowMs)
+{
+	_partialSince = nowMs;
+}
+
+/////////////
+// Getters //
+/////////////
+
+int	PendingUser::getFd() const
+{
+	return _fd;
+}
+
+uint32_t	PendingUser::getAddr() const
+{
+	return _addr;
+}
+
+// Returns the peer's IP address as dotted string.
+std::string	PendingUser::getHost() const
+{
+	in_addr	addr;
+
+	addr.s_addr = _addr;
+	return inet_ntoa(addr);
+}
+
+// Returns the nickname, or `*` if none was accepted yet.
+const char*	PendingUser::getNickname() const
+{
+	return _nickname;
+}
+
+const std::string&	PendingUser::getUsername() const
+{
+	return _username;
+}
+
+const std::string&	PendingUser::getRealname() const
+{
+	return _realname;
+}
+
+std::string&	PendingUser::getInputBuffer()
+{
+	return _inputBuffer;
+}
+
+std::string&	PendingUser::getOutputBuffer()
+{
+	return _outputBuffer;
+}
+
+// Returns the timer enforcing the registration and partial-line deadlines.
+TimerWheel::Timer&	PendingUser::getDeadlineTimer()
+{
+	return _deadlineTimer;
+}
+
+unsigned long	PendingUser::getConnectedAt() const
+{
+	return _connectedAt;
+}
+
+unsigned long	PendingUser::getPartialSince() const
+{
+	return _partialSince;
+}
+
+bool	PendingUser::hasNick() const
+{
+	return (_flags & HAS_NICK) != 0;
+}
+
+bool	PendingUser::hasUser() const
+{
+	return (_flags & HAS_USER) != 0;
+}
+
+bool	PendingUser::hasPassed() const
+{
+	return (_flags & HAS_PASSED) != 0;
+}
+
+bool	PendingUser::isNegotiating() const
+{
+	return (_flags & NEGOTIATING) != 0;
+}
+
+unsigned char	PendingUser::getCaps() const
+{
+	return _caps;
+}
+
+// True once PASS, NICK and USER have all been accepted, and capability negotiation (if any) has ended.
+bool	PendingUser::isComplete() const
+{
+	return _flags == (HAS_NICK | HAS_USER | HAS_PASSED);
+}
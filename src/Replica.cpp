@@ -0,0 +1,451 @@
+#include <string>
+#include <map>
+#include <set>
+#include <deque>
+#include <cerrno>		// errno
+#include <cstring>		// memcpy(), memset(), strerror()
+#include <stdint.h>		// uint32_t, int64_t
+
+#include <unistd.h>		// close()
+#include <poll.h>		// poll()
+#include <sys/socket.h>	// socket(), connect(), recv(), recvmsg(), SCM_RIGHTS
+#include <sys/un.h>		// sockaddr_un
+
+#include "../include/Replica.hpp"
+#include "../include/ReplicationStream.hpp"	// ReplicationRecord
+#include "../include/Binary.hpp"				// BinaryReader
+#include "../include/utils.hpp"				// normalize(), getMonotonicUs(), toString()
+
+static const size_t	RECEIVE_SIZE = 65536;	// Bytes read per `receive()`
+static const size_t	RECEIVE_FDS = 64;		// Descriptors accepted per `receive()` (one per record at most)
+
+Replica::Replica(const std::string& path)
+	:	_path(path), _fd(-1), _listenFd(-1), _startTime(0), _peakUsers(0)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+Replica::~Replica()
+{
+	reset();
+}
+
+////////////////
+// Connection //
+////////////////
+
+// Opens a Unix stream socket connected to `path`, or returns `-1`.
+static int	connectTo(const std::string& path)
+{
+	struct sockaddr_un	addr;
+
+	if (path.size() >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	int	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		int	saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+// Connects to the primary, which answers with a full sync.
+bool	Replica::connect(std::string& error)
+{
+	_fd = connectTo(_path);
+	if (_fd == -1)
+	{
+		error = _path + ": " + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+Tells whether a primary is serving at `path`. After the stream ended without
+a `REPL_BYE`, this tells a crashed primary (take over) from one that dropped
+this standby (sync again).
+
+Connecting is not enough: a dying process closes its descriptors one by
+one, so its listening socket may still take connections right after the
+stream ended. A live primary answers with the start of a sync within
+`timeoutMs`.
+*/
+bool	Replica::probe(const std::string& path, int timeoutMs)
+{
+	int	fd = connectTo(path);
+	if (fd == -1)
+		return false;
+
+	struct pollfd	pfd;
+	char			byte;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	int	ready;
+	do
+		ready = poll(&pfd, 1, timeoutMs);
+	while (ready == -1 && errno == EINTR);
+	bool	alive = ready == 1 && recv(fd, &byte, 1, MSG_PEEK) == 1;
+	close(fd);
+	return alive;
+}
+
+// Closes the stream and every socket held, and forgets the copy.
+void	Replica::reset()
+{
+	if (_fd != -1)
+		close(_fd);
+	_fd = -1;
+	if (_listenFd != -1)
+		close(_listenFd);
+	_listenFd = -1;
+	for (std::map<std::string, ReplicaUser>::iterator it = _users.begin(); it != _users.end(); ++it)
+		close(it->second.record.fd);
+	for (std::deque<int>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+		close(*it);
+	_users.clear();
+	_channels.clear();
+	_fds.clear();
+	_in.clear();
+}
+
+bool	Replica::isConnected() const
+{
+	return _fd != -1;
+}
+
+// True once the sync has passed the listening socket (only then can this standby take over).
+bool	Replica::isSynced() const
+{
+	return _listenFd != -1;
+}
+
+int	Replica::getFd() const
+{
+	return _fd;
+}
+
+size_t	Replica::getUserCount() const
+{
+	return _users.size();
+}
+
+size_t	Replica::getChannelCount() const
+{
+	return _channels.size();
+}
+
+const Replica::Stats&	Replica::getStats() const
+{
+	return _stats;
+}
+
+/**
+Reads what the primary has sent (one `recvmsg()`, so the caller's loop stays
+responsive) and applies every complete record. Descriptors arrive with the
+first byte of their record, so they are queued until the record is complete.
+*/
+Replica::Result	Replica::receive(std::string& error)
+{
+	char			buffer[RECEIVE_SIZE];
+	char			control[CMSG_SPACE(RECEIVE_FDS * sizeof(int))];
+	struct iovec	iov;
+	struct msghdr	msg;
+
+	iov.iov_base = buffer;
+	iov.iov_len = sizeof(buffer);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t	n = recvmsg(_fd, &msg, MSG_DONTWAIT);
+	if (n == -1)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return REPLICA_OK;
+		error = toString("recvmsg(): ") + strerror(errno);
+		return REPLICA_CLOSED;
+	}
+	if (n == 0)
+		return REPLICA_CLOSED;
+
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		size_t	count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < count; ++i)
+		{
+			int	fd;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			_fds.push_back(fd);
+		}
+	}
+	if (msg.msg_flags & MSG_CTRUNC)
+	{
+		error = "connections lost in transit (out of descriptors?)";
+		return REPLICA_ERROR;
+	}
+	_stats.bytes += n;
+	_in.append(buffer, n);
+
+	size_t	pos = 0;
+	Result	result = REPLICA_OK;
+	while (result == REPLICA_OK && _in.size() - pos >= sizeof(uint32_t))
+	{
+		uint32_t	size;
+		memcpy(&size, _in.data() + pos, sizeof(size));
+		if (size == 0)
+		{
+			error = "damaged stream";
+			return REPLICA_ERROR;
+		}
+		if (_in.size() - pos - sizeof(size) < size)
+			break; // Rest of the record still on its way
+		const char*		start = _in.data() + pos + sizeof(size);
+		BinaryReader	record(start + 1, start + size);
+		result = apply(static_cast<unsigned char>(*start), record);
+		if (result == REPLICA_ERROR)
+		{
+			error = "damaged record (type " + toString(static_cast<int>(*start)) + ")";
+			return REPLICA_ERROR;
+		}
+		pos += sizeof(size) + size;
+		++_stats.records;
+	}
+	_in.erase(0, pos);
+	return result;
+}
+
+// Claims the oldest received descriptor for the record being applied.
+bool	Replica::takeFd(int& fd)
+{
+	if (_fds.empty())
+		return false;
+	fd = _fds.front();
+	_fds.pop_front();
+	return true;
+}
+
+// Applies one record to the copy.
+Replica::Result	Replica::apply(unsigned char type, BinaryReader& in)
+{
+	std::string		key;
+	std::string		nick;
+	unsigned char	flag = 0;
+	int64_t			when;
+	uint64_t		value;
+
+	switch (type)
+	{
+		case REPL_LISTEN:
+		{
+			int	fd;
+			if (!takeFd(fd))
+				return REPLICA_ERROR;
+			if (_listenFd != -1)
+				close(_listenFd);
+			_listenFd = fd;
+			break;
+		}
+		case REPL_SERVER:
+			in.takeI64(when);
+			in.takeU64(value);
+			_startTime = static_cast<time_t>(when);
+			_peakUsers = value;
+			break;
+		case REPL_USER:
+		{
+			UserHandoff	record;
+			in.takeString(record.nickname);
+			in.takeString(record.username);
+			in.takeString(record.realname);
+			in.takeString(record.host);
+			if (!in.ok || !takeFd(record.fd))
+				return REPLICA_ERROR;
+			record.lastActivity = 0;
+			record.pingSentAt = 0;
+			record.caps = 0;
+			nick = normalize(record.nickname);
+			removeUser(nick); // A stale entry under the same nickname (not expected)
+			_users[nick].record = record;
+			break;
+		}
+		case REPL_NICK:
+		{
+			in.takeString(key);
+			in.takeString(nick);
+			std::map<std::string, ReplicaUser>::iterator	it = _users.find(key);
+			if (!in.ok || it == _users.end())
+				break;
+			std::string	nickLower = normalize(nick);
+			ReplicaUser&	user = _users[nickLower];
+			user.record = it->second.record;
+			user.record.nickname = nick;
+			user.channels.swap(it->second.channels);
+			_users.erase(it);
+			for (std::set<std::string>::iterator ch = user.channels.begin(); ch != user.channels.end(); ++ch)
+			{
+				ReplicaChannel&	channel = _channels[*ch];
+				if (channel.members.erase(key))
+					channel.members.insert(nickLower);
+				if (channel.operators.erase(key))
+					channel.operators.insert(nickLower);
+			}
+			break;
+		}
+		case REPL_QUIT:
+			if (in.takeString(nick))
+				removeUser(nick);
+			break;
+		case REPL_CHANNEL:
+		{
+			ChannelState	state;
+			if (!StateLog::decodeState(in, state) || !in.takeI64(when))
+				break;
+			ReplicaChannel&	channel = _channels[normalize(state.name)];
+			channel.state = state;
+			channel.state.claimed = true;
+			channel.createdAt = static_cast<time_t>(when);
+			break;
+		}
+		case REPL_JOIN:
+		case REPL_PART:
+		case REPL_OP:
+		{
+			in.takeString(key);
+			in.takeString(nick);
+			if (type == REPL_OP)
+				in.takeU8(flag);
+			std::map<std::string, ReplicaChannel>::iterator	it = _channels.find(key);
+			if (!in.ok || it == _channels.end())
+				break;
+			std::map<std::string, ReplicaUser>::iterator	user = _users.find(nick);
+			if (type == REPL_JOIN)
+			{
+				it->second.members.insert(nick);
+				if (user != _users.end())
+					user->second.channels.insert(key);
+			}
+			else if (type == REPL_PART)
+			{
+				it->second.members.erase(nick);
+				it->second.operators.erase(nick);
+				if (user != _users.end())
+					user->second.channels.erase(key);
+			}
+			else if (flag)
+				it->second.operators.insert(nick);
+			else
+				it->second.operators.erase(nick);
+			break;
+		}
+		case REPL_DROP:
+		{
+			if (!in.takeString(key))
+				break;
+			std::map<std::string, ReplicaChannel>::iterator	it = _channels.find(key);
+			if (it == _channels.end())
+				break;
+			for (std::set<std::string>::iterator mem = it->second.members.begin(); mem != it->second.members.end(); ++mem)
+			{
+				std::map<std::string, ReplicaUser>::iterator	user = _users.find(*mem);
+				if (user != _users.end())
+					user->second.channels.erase(key);
+			}
+			_channels.erase(it);
+			break;
+		}
+		case REPL_TICK:
+			if (in.takeU64(value))
+			{
+				unsigned long	nowUs = getMonotonicUs();
+				unsigned long	lagUs = nowUs > value ? nowUs - value : 0;
+				++_stats.ticks;
+				_stats.lagTotalUs += lagUs;
+				if (lagUs > _stats.lagMaxUs)
+					_stats.lagMaxUs = lagUs;
+			}
+			break;
+		case REPL_BYE:
+			if (in.takeU8(flag))
+				return flag ? REPLICA_HANDOVER : REPLICA_BYE;
+			break;
+		default:
+			return REPLICA_ERROR;
+	}
+	return in.ok && in.pos == in.end ? REPLICA_OK : REPLICA_ERROR;
+}
+
+// Forgets a user: closes the copy of their connection and takes them out of their channels.
+void	Replica::removeUser(const std::string& nickLower)
+{
+	std::map<std::string, ReplicaUser>::iterator	it = _users.find(nickLower);
+	if (it == _users.end())
+		return;
+	for (std::set<std::string>::iterator ch = it->second.channels.begin(); ch != it->second.channels.end(); ++ch)
+	{
+		std::map<std::string, ReplicaChannel>::iterator	channel = _channels.find(*ch);
+		if (channel == _channels.end())
+			continue;
+		channel->second.members.erase(nickLower);
+		channel->second.operators.erase(nickLower);
+	}
+	close(it->second.record.fd);
+	_users.erase(it);
+}
+
+///////////////
+// Promotion //
+///////////////
+
+/**
+Moves the copy into `handoff`, as if the primary had handed it over: the
+sockets now belong to the handoff, and the replica is left disconnected and
+empty. Users start with a fresh keepalive (the primary's timers are lost),
+and with empty buffers (what the primary had read or queued is lost).
+*/
+void	Replica::takeHandoff(Handoff& handoff)
+{
+	unsigned long	nowMs = getMonotonicMs();
+
+	handoff.listenFd = _listenFd;
+	handoff.startTime = _startTime;
+	handoff.peakUsers = _peakUsers;
+	_listenFd = -1;
+
+	handoff.users.reserve(_users.size());
+	for (std::map<std::string, ReplicaUser>::iterator it = _users.begin(); it != _users.end(); ++it)
+	{
+		handoff.users.push_back(it->second.record);
+		handoff.users.back().lastActivity = nowMs;
+	}
+	_users.clear();
+
+	handoff.channels.resize(_channels.size());
+	size_t	i = 0;
+	for (std::map<std::string, ReplicaChannel>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		ChannelHandoff&	record = handoff.channels[i++];
+		record.state = it->second.state;
+		record.createdAt = it->second.createdAt;
+		record.members.assign(it->second.members.begin(), it->second.members.end());
+		record.operators.assign(it->second.operators.begin(), it->second.operators.end());
+	}
+	_channels.clear();
+	reset();
+}
@@ -0,0 +1,483 @@
+#include <string>
+#include <deque>
+#include <cerrno>		// errno
+#include <cstring>		// memcpy(), memset(), strerror()
+#include <stdint.h>		// uint32_t
+
+#include <unistd.h>		// close(), dup(), unlink()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK
+#include <poll.h>		// poll()
+#include <sys/socket.h>	// socket(), bind(), listen(), accept(), send(), sendmsg(), SCM_RIGHTS
+#include <sys/un.h>		// sockaddr_un
+
+#include "../include/ReplicationStream.hpp"
+#include "../include/User.hpp"
+#include "../include/Channel.hpp"
+#include "../include/StateLog.hpp"	// ChannelState, StateLog::encodeState()
+#include "../include/Binary.hpp"	// putU32(), putString()
+#include "../include/defines.hpp"	// REPLICATION_MAX_BACKLOG
+#include "../include/utils.hpp"		// getMonotonicUs(), toString()
+#include "../include/platform.hpp"	// MSG_NOSIGNAL, noSigPipe()
+
+static const size_t	COMPACT_AT = 65536;		// Written bytes kept at the front of the queue before it is compacted
+static const int	BYE_TIMEOUT_MS = 1000;	// How long `close()` waits for the standby to take the rest
+
+ReplicationStream::ReplicationStream(const std::string& path)
+	:	_path(path), _listenFd(-1), _standbyFd(-1), _head(0), _batchStartUs(0)
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+ReplicationStream::~ReplicationStream()
+{
+	detach();
+	if (_listenFd != -1)
+		::close(_listenFd);
+}
+
+////////////////
+// Connection //
+////////////////
+
+/**
+Starts listening for a standby on the Unix socket at `_path`, replacing a
+socket file left behind by a previous run.
+*/
+bool	ReplicationStream::listen(std::string& error)
+{
+	struct sockaddr_un	addr;
+
+	if (_path.size() >= sizeof(addr.sun_path))
+	{
+		error = "socket path too long: " + _path;
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, _path.c_str(), _path.size());
+
+	_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_listenFd == -1)
+	{
+		error = toString("socket(): ") + strerror(errno);
+		return false;
+	}
+	unlink(_path.c_str());
+	if (bind(_listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1
+		|| ::listen(_listenFd, 1) == -1)
+	{
+		error = toString("bind(") + _path + "): " + strerror(errno);
+		::close(_listenFd);
+		_listenFd = -1;
+		return false;
+	}
+	fcntl(_listenFd, F_SETFL, O_NONBLOCK);
+	return true;
+}
+
+/**
+Stops replicating: tells the standby why (`REPL_BYE`), so it does not take
+over, gives it up to `BYE_TIMEOUT_MS` to read what is still queued, and
+stops listening.
+
+ @param upgrading	`true` on a hot upgrade: the standby waits for the new
+					binary and syncs from it.
+*/
+void	ReplicationStream::close(bool upgrading)
+{
+	if (_standbyFd != -1)
+	{
+		size_t	start = beginRecord(REPL_BYE);
+		putU8(_out, upgrading);
+		endRecord(start);
+
+		unsigned long	deadlineUs = getMonotonicUs() + BYE_TIMEOUT_MS * 1000UL;
+		std::string		error;
+		while (_standbyFd != -1 && _head < _out.size() && getMonotonicUs() < deadlineUs)
+		{
+			struct pollfd	pfd;
+			pfd.fd = _standbyFd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, BYE_TIMEOUT_MS) <= 0 || !flush(error))
+				break;
+		}
+		detach();
+	}
+	if (_listenFd != -1)
+	{
+		::close(_listenFd);
+		unlink(_path.c_str());
+		_listenFd = -1;
+	}
+}
+
+/**
+Accepts a standby knocking on the listening socket. The caller then queues
+the full state (the sync), followed by the changes as they happen.
+
+ @return	The standby's socket, or `-1` (`error` is left empty if nobody was
+			knocking after all).
+*/
+int	ReplicationStream::accept(std::string& error)
+{
+	int	fd = ::accept(_listenFd, NULL, NULL);
+	if (fd == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			error = toString("accept(): ") + strerror(errno);
+		return -1;
+	}
+	if (_standbyFd != -1)
+	{
+		::close(fd);
+		error = "a standby is already attached";
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	noSigPipe(fd);
+	_standbyFd = fd;
+	++_stats.standbys;
+	return fd;
+}
+
+// Lets go of the standby and of everything still queued for it.
+void	ReplicationStream::detach()
+{
+	if (_standbyFd != -1)
+		::close(_standbyFd);
+	_standbyFd = -1;
+	clearQueue();
+}
+
+bool	ReplicationStream::isListening() const
+{
+	return _listenFd != -1;
+}
+
+bool	ReplicationStream::isAttached() const
+{
+	return _standbyFd != -1;
+}
+
+// Returns true if records are waiting for the standby's socket to drain.
+bool	ReplicationStream::wantsWrite() const
+{
+	return _standbyFd != -1 && _head < _out.size();
+}
+
+int	ReplicationStream::getListenFd() const
+{
+	return _listenFd;
+}
+
+int	ReplicationStream::getStandbyFd() const
+{
+	return _standbyFd;
+}
+
+// Returns the bytes queued for the standby.
+size_t	ReplicationStream::getBacklog() const
+{
+	return _out.size() - _head;
+}
+
+const ReplicationStream::Stats&	ReplicationStream::getStats() const
+{
+	return _stats;
+}
+
+/////////////
+// Records //
+/////////////
+
+// Records are only queued while a standby is attached; a new standby starts from a full sync.
+
+void	ReplicationStream::saveListener(int fd)
+{
+	if (_standbyFd == -1)
+		return;
+	endRecord(beginRecord(REPL_LISTEN, fd));
+}
+
+void	ReplicationStream::saveServer(time_t startTime, unsigned long peakUsers)
+{
+	if (_standbyFd == -1)
+		return;
+	size_t	start = beginRecord(REPL_SERVER);
+	putI64(_out, static_cast<int64_t>(startTime));
+	putU64(_out, peakUsers);
+	endRecord(start);
+}
+
+// A user completed registration: their connection goes to the standby with the record.
+void	ReplicationStream::saveUser(const User& user)
+{
+	if (_standbyFd == -1 || user.getFd() == -1)
+		return;
+	size_t	start = beginRecord(REPL_USER, user.getFd());
+	putString(_out, user.getNickname());
+	putString(_out, user.getUsername());
+	putString(_out, user.getRealname());
+	putString(_out, user.getHost());
+	endRecord(start);
+}
+
+void	ReplicationStream::renameUser(const std::string& oldNickLower, const User& user)
+{
+	if (_standbyFd == -1 || user.getFd() == -1)
+		return;
+	size_t	start = beginRecord(REPL_NICK);
+	putString(_out, oldNickLower);
+	putString(_out, user.getNickname());
+	endRecord(start);
+}
+
+/**
+A user is about to be closed. If their connection has not been passed to
+the standby yet, a duplicate is queued instead (the number may be reused by
+the next `accept()` before the queue drains).
+
+ @return	`true` if the standby holds (or will hold) a copy of the
+			connection: closing it here would not end it, the caller must
+			`shutdown()` it.
+*/
+bool	ReplicationStream::removeUser(const User& user)
+{
+	if (_standbyFd == -1 || user.getFd() == -1)
+		return false;
+	for (std::deque<Attachment>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+	{
+		if (it->fd != user.getFd() || it->owned)
+			continue;
+		it->fd = dup(user.getFd());
+		it->owned = it->fd != -1;
+		if (it->fd == -1) // Out of descriptors: the standby could not follow anymore
+		{
+			detach();
+			++_stats.dropped;
+			return false;
+		}
+	}
+	size_t	start = beginRecord(REPL_QUIT);
+	putString(_out, user.getNicknameLower());
+	endRecord(start);
+	return true;
+}
+
+void	ReplicationStream::saveChannel(const Channel& channel)
+{
+	if (_standbyFd == -1)
+		return;
+	ChannelState	state;
+	channel.save_state(state);
+	size_t	start = beginRecord(REPL_CHANNEL);
+	StateLog::encodeState(_out, state);
+	putI64(_out, static_cast<int64_t>(channel.get_creation_time()));
+	endRecord(start);
+}
+
+void	ReplicationStream::join(const Channel& channel, const std::string& nickLower)
+{
+	if (_standbyFd == -1)
+		return;
+	size_t	start = beginRecord(REPL_JOIN);
+	putString(_out, channel.get_name_lower());
+	putString(_out, nickLower);
+	endRecord(start);
+}
+
+void	ReplicationStream::part(const Channel& channel, const std::string& nickLower)
+{
+	if (_standbyFd == -1)
+		return;
+	size_t	start = beginRecord(REPL_PART);
+	putString(_out, channel.get_name_lower());
+	putString(_out, nickLower);
+	endRecord(start);
+}
+
+void	ReplicationStream::setOperator(const Channel& channel, const std::string& nickLower, bool granted)
+{
+	if (_standbyFd == -1)
+		return;
+	size_t	start = beginRecord(REPL_OP);
+	putString(_out, channel.get_name_lower());
+	putString(_out, nickLower);
+	putU8(_out, granted);
+	endRecord(start);
+}
+
+void	ReplicationStream::dropChannel(const std::string& channelKey)
+{
+	if (_standbyFd == -1)
+		return;
+	size_t	start = beginRecord(REPL_DROP);
+	putString(_out, channelKey);
+	endRecord(start);
+}
+
+/**
+Starts a record in place at the end of the queue (its size is filled in by
+`endRecord()`), attaching `fd` to its first byte if given.
+
+ @return	Where the record starts.
+*/
+size_t	ReplicationStream::beginRecord(ReplicationRecord type, int fd)
+{
+	size_t	start = _out.size();
+
+	if (_batchStartUs == 0 && type != REPL_TICK)
+		_batchStartUs = getMonotonicUs();
+	if (fd != -1)
+	{
+		Attachment	attachment;
+		attachment.offset = start;
+		attachment.fd = fd;
+		attachment.owned = false;
+		_fds.push_back(attachment);
+	}
+	putU32(_out, 0);
+	putU8(_out, static_cast<unsigned char>(type));
+	++_stats.records;
+	return start;
+}
+
+void	ReplicationStream::endRecord(size_t start)
+{
+	uint32_t	size = static_cast<uint32_t>(_out.size() - start - sizeof(uint32_t));
+	memcpy(&_out[start], &size, sizeof(size));
+}
+
+//////////////
+// Transfer //
+//////////////
+
+/**
+Closes the current batch with a `REPL_TICK` and writes as much of the queue
+as the standby's socket takes without blocking. Called once per event loop
+iteration, and again whenever the socket drains.
+
+ @return	`false` if the standby was dropped (socket error, or more than
+			`REPLICATION_MAX_BACKLOG` bytes behind); `error` says why.
+*/
+bool	ReplicationStream::flush(std::string& error)
+{
+	if (_standbyFd == -1)
+		return true;
+	if (_batchStartUs != 0)
+	{
+		size_t	start = beginRecord(REPL_TICK);
+		putU64(_out, _batchStartUs);
+		endRecord(start);
+		_batchStartUs = 0;
+	}
+	if (_head == _out.size())
+		return true;
+
+	unsigned long	startUs = getMonotonicUs();
+	bool			written = writeQueued(error);
+	_stats.flushUs += getMonotonicUs() - startUs;
+	if (getBacklog() > _stats.maxBacklog)
+		_stats.maxBacklog = getBacklog();
+	if (written && getBacklog() > REPLICATION_MAX_BACKLOG)
+	{
+		error = "standby fell " + toString(getBacklog()) + " bytes behind";
+		written = false;
+	}
+	if (!written)
+	{
+		detach();
+		++_stats.dropped;
+	}
+	return written;
+}
+
+// Sends `size` bytes with one descriptor attached to the first of them.
+static ssize_t	sendWithFd(int sock, const char* data, size_t size, int fd)
+{
+	struct iovec	iov;
+	struct msghdr	msg;
+	char			control[CMSG_SPACE(sizeof(int))];
+
+	iov.iov_base = const_cast<char*>(data);
+	iov.iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr*	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+/**
+Writes the queue up to the first byte that cannot be written without
+blocking. Bytes carrying a descriptor are sent with `sendmsg()`, each up to
+the next such byte, the rest with plain `send()`s.
+*/
+bool	ReplicationStream::writeQueued(std::string& error)
+{
+	while (_head < _out.size())
+	{
+		bool	attach = !_fds.empty() && _fds.front().offset == _head;
+		size_t	end = _out.size();
+		if (!_fds.empty() && _fds.front().offset > _head)
+			end = _fds.front().offset;
+		else if (_fds.size() > 1)
+			end = _fds[1].offset;
+
+		ssize_t	n = attach ? sendWithFd(_standbyFd, &_out[_head], end - _head, _fds.front().fd)
+			: send(_standbyFd, &_out[_head], end - _head, MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			error = toString("send(): ") + strerror(errno);
+			return false;
+		}
+		if (attach)
+		{
+			if (_fds.front().owned)
+				::close(_fds.front().fd);
+			_fds.pop_front();
+		}
+		_head += n;
+		_stats.bytes += n;
+	}
+
+	if (_head == _out.size())
+	{
+		_out.clear();
+		_head = 0;
+	}
+	else if (_head >= COMPACT_AT)
+	{
+		_out.erase(0, _head);
+		for (std::deque<Attachment>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+			it->offset -= _head;
+		_head = 0;
+	}
+	return true;
+}
+
+// Drops everything queued, closing the duplicates made for users closed before being sent.
+void	ReplicationStream::clearQueue()
+{
+	for (std::deque<Attachment>::iterator it = _fds.begin(); it != _fds.end(); ++it)
+	{
+		if (it->owned)
+			::close(it->fd);
+	}
+	_fds.clear();
+	_out.clear();
+	_head = 0;
+	_batchStartUs = 0;
+}
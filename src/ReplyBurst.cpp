@@ -0,0 +1,160 @@
+#include <string>
+#include <vector>
+
+#include "../include/ReplyBurst.hpp"
+#include "../include/Numerics.hpp"	// appendReply()
+
+const std::string	ReplyBurst::nick("\0N", 2);
+const std::string	ReplyBurst::user("\0U", 2);
+const std::string	ReplyBurst::host("\0H", 2);
+
+ReplyBurst::ReplyBurst() : _refs(1)
+{
+	clear();
+}
+
+// Drops all lines (before the burst is rebuilt).
+void	ReplyBurst::clear()
+{
+	_segments.clear();
+	_lineStarts.clear();
+	_textSize = 0;
+	for (int i = 0; i < SLOT_COUNT; ++i)
+		_slotCount[i] = 0;
+}
+
+/**
+Appends a rendered line (including its `\r\n`) to the burst, cut at its slot markers.
+Every line starts a new segment, so a burst can also be written line by line.
+*/
+void	ReplyBurst::add(const std::string& line)
+{
+	size_t	start = 0;
+	size_t	marker;
+
+	_lineStarts.push_back(_segments.size());
+	while (true)
+	{
+		marker = line.find('\0', start);
+		size_t	end = (marker == std::string::npos || marker + 1 >= line.size()) ? line.size() : marker;
+
+		Segment	segment = { std::string(), SLOT_NONE };
+		_segments.push_back(segment);
+		_segments.back().text.append(line, start, end - start);
+		_textSize += end - start;
+		if (end == line.size())
+			break;
+
+		Slot	slot;
+		switch (line[marker + 1])
+		{
+			case 'N':	slot = SLOT_NICK; break;
+			case 'U':	slot = SLOT_USER; break;
+			default:	slot = SLOT_HOST; break;
+		}
+		_segments.back().slot = slot;
+		++_slotCount[slot];
+		start = marker + 2;
+	}
+}
+
+/**
+Appends the burst to a client's output buffer, with the slots filled in.
+
+ @param out			The client's output buffer (grown at most once).
+ @param nickValue	Written for `ReplyBurst::nick`.
+ @param userValue	Written for `ReplyBurst::user`.
+ @param hostValue	Written for `ReplyBurst::host`.
+*/
+void	ReplyBurst::write(std::string& out, const std::string& nickValue, const std::string& userValue,
+			const std::string& hostValue) const
+{
+	const std::string*	values[SLOT_COUNT] = { &nickValue, &userValue, &hostValue };
+
+	out.reserve(out.size() + _textSize + _slotCount[SLOT_NICK] * nickValue.size()
+		+ _slotCount[SLOT_USER] * userValue.size() + _slotCount[SLOT_HOST] * hostValue.size());
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		out.append(_segments[i].text);
+		if (_segments[i].slot != SLOT_NONE)
+			out.append(*values[_segments[i].slot]);
+	}
+}
+
+// Appends a burst that only has nickname slots (e.g. cached channel replies).
+void	ReplyBurst::write(std::string& out, const std::string& nickValue) const
+{
+	static const std::string	none;
+
+	write(out, nickValue, none, none);
+}
+
+/**
+Appends whole lines of a burst that only has nickname slots, starting at
+`firstLine`, until at least `maxBytes` were written (at least one line).
+
+ @return	The next line to write; `getLineCount()` once the burst is complete.
+*/
+size_t	ReplyBurst::write(std::string& out, size_t firstLine, size_t maxBytes, const std::string& nickValue) const
+{
+	size_t	startSize = out.size();
+	size_t	line = firstLine;
+
+	while (line < _lineStarts.size() && (line == firstLine || out.size() - startSize < maxBytes))
+	{
+		size_t	end = line + 1 < _lineStarts.size() ? _lineStarts[line + 1] : _segments.size();
+		for (size_t i = _lineStarts[line]; i < end; ++i)
+		{
+			out.append(_segments[i].text);
+			if (_segments[i].slot == SLOT_NICK)
+				out.append(nickValue);
+		}
+		++line;
+	}
+	return line;
+}
+
+size_t	ReplyBurst::getLineCount() const
+{
+	return _lineStarts.size();
+}
+
+// Returns the bytes the burst takes with a nickname of `nickLength` (other slots empty).
+size_t	ReplyBurst::getSize(size_t nickLength) const
+{
+	return _textSize + _slotCount[SLOT_NICK] * nickLength;
+}
+
+// Adds an owner to a shared burst.
+ReplyBurst*	ReplyBurst::retain()
+{
+	++_refs;
+	return this;
+}
+
+// Drops an owner of a shared burst; the last one deletes it.
+void	ReplyBurst::release(ReplyBurst* burst)
+{
+	if (burst && --burst->_refs == 0)
+		delete burst;
+}
+
+// True if a shared burst has more than one owner (it must not be changed then).
+bool	ReplyBurst::isShared() const
+{
+	return _refs > 1;
+}
+
+///////////////////
+// BurstRenderer //
+///////////////////
+
+BurstRenderer::BurstRenderer(ReplyBurst& burst, const std::string& prefix) : _burst(burst), _prefix(prefix) {}
+
+// Renders a reply (target: the nickname slot) and adds it to the burst.
+void	BurstRenderer::writeReply(int code, const char* format, const ReplyArg* const* args, int count)
+{
+	std::string	line;
+	appendReply(line, _prefix, code, ReplyBurst::nick, format, args, count);
+	_burst.add(line);
+}
@@ -0,0 +1,26 @@
+#include <string>
+
+#include "../include/ReplyStream.hpp"
+#include "../include/ReplyBurst.hpp"
+
+ReplyStream::~ReplyStream() {}
+
+/////////////////
+// BurstStream //
+/////////////////
+
+// Takes a reference on `burst`, so it outlives a rebuild by its owner.
+BurstStream::BurstStream(ReplyBurst* burst, const std::string& nick)
+	:	_burst(burst->retain()), _nick(nick), _line(0)
+{}
+
+BurstStream::~BurstStream()
+{
+	ReplyBurst::release(_burst);
+}
+
+bool	BurstStream::pump(std::string& out, size_t maxBytes)
+{
+	_line = _burst->write(out, _line, maxBytes, _nick);
+	return _line < _burst->getLineCount();
+}
@@ -0,0 +1,238 @@
+#include <string>
+#include <vector>
+#include <cstring>		// memcpy(), memset()
+#include <stdint.h>		// uint64_t, uint32_t
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>	// SSE2 / AVX2 intrinsics (each kernel enables its own target)
+# define SCAN_X86	1
+#else
+# define SCAN_X86	0
+#endif
+
+#include "../include/ScanIndex.hpp"
+
+////////////////////////////////////////////////////////////////
+// Kernels: `blocks` full 64-byte blocks, two masks per block //
+////////////////////////////////////////////////////////////////
+
+typedef void	(*ScanKernel)(const char* data, size_t blocks, uint64_t* masks);
+
+static const uint64_t	ONES = static_cast<uint64_t>(0x01010101) << 32 | 0x01010101;	// 0x01 in every byte
+static const uint64_t	GATHER = static_cast<uint64_t>(0x01020408) << 32 | 0x10204080;	// Bit 8i -> bit 56+i
+
+/**
+Marks the bytes of an 8-byte word that equal `c`: the high bit of each
+matching byte is set without carries between bytes, and the multiply
+gathers the 8 high bits into the top byte (bit `i`: byte `i`).
+*/
+static inline uint64_t	matchWord(uint64_t word, unsigned char c)
+{
+	const uint64_t	low7 = ONES * 0x7F;
+	uint64_t		x = word ^ (ONES * c);
+	uint64_t		t = ~(((x & low7) + low7) | x | low7);
+
+	return ((t >> 7) * GATHER) >> 56;
+}
+
+// Eight bytes per step in a 64-bit word (any little-endian CPU; one byte at a time otherwise).
+static void	scanScalar(const char* data, size_t blocks, uint64_t* masks)
+{
+	for (size_t b = 0; b < blocks; ++b, data += 64, masks += 2)
+	{
+		uint64_t	newlines = 0;
+		uint64_t	spaces = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		for (int k = 0; k < 8; ++k)
+		{
+			uint64_t	word;
+			memcpy(&word, data + 8 * k, sizeof(word));
+			newlines |= matchWord(word, '\n') << (8 * k);
+			spaces |= matchWord(word, ' ') << (8 * k);
+		}
+#else
+		for (int i = 0; i < 64; ++i)
+		{
+			newlines |= static_cast<uint64_t>(data[i] == '\n') << i;
+			spaces |= static_cast<uint64_t>(data[i] == ' ') << i;
+		}
+#endif
+		masks[0] = newlines;
+		masks[1] = spaces;
+	}
+}
+
+#if SCAN_X86
+
+// 16 bytes per compare: four loads per block.
+__attribute__((target("sse2")))
+static void	scanSse2(const char* data, size_t blocks, uint64_t* masks)
+{
+	const __m128i	newline = _mm_set1_epi8('\n');
+	const __m128i	space = _mm_set1_epi8(' ');
+
+	for (size_t b = 0; b < blocks; ++b, data += 64, masks += 2)
+	{
+		uint64_t	newlines = 0;
+		uint64_t	spaces = 0;
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128i	chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * k));
+			newlines |= static_cast<uint64_t>(static_cast<uint32_t>(
+				_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))) << (16 * k);
+			spaces |= static_cast<uint64_t>(static_cast<uint32_t>(
+				_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)))) << (16 * k);
+		}
+		masks[0] = newlines;
+		masks[1] = spaces;
+	}
+}
+
+// 32 bytes per compare: two loads per block.
+__attribute__((target("avx2")))
+static void	scanAvx2(const char* data, size_t blocks, uint64_t* masks)
+{
+	const __m256i	newline = _mm256_set1_epi8('\n');
+	const __m256i	space = _mm256_set1_epi8(' ');
+
+	for (size_t b = 0; b < blocks; ++b, data += 64, masks += 2)
+	{
+		__m256i	low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+		__m256i	high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+		masks[0] = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)))
+			| static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+		masks[1] = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, space)))
+			| static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, space)))) << 32;
+	}
+}
+
+#endif
+
+// The best kernel the CPU runs.
+static ScanKernel	selectKernel()
+{
+#if SCAN_X86
+	__builtin_cpu_init(); // Runs before the constructors that would otherwise do it
+	if (__builtin_cpu_supports("avx2"))
+		return scanAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return scanSse2;
+#endif
+	return scanScalar;
+}
+
+static ScanKernel	s_kernel = selectKernel();	// Set before `main()`, so before any thread reads it
+
+///////////////
+// ScanIndex //
+///////////////
+
+ScanIndex::ScanIndex() : _masks(_inline), _size(0)
+{}
+
+ScanIndex::~ScanIndex()
+{}
+
+/**
+Indexes `size` bytes at `data`. The last, partial block is scanned from a
+zero-padded copy, so the kernels never read past the buffer.
+*/
+void	ScanIndex::build(const char* data, size_t size)
+{
+	size_t	blocks = (size + 63) / 64;
+	size_t	full = size / 64;
+
+	if (blocks * SCAN_CLASSES <= sizeof(_inline) / sizeof(_inline[0]))
+		_masks = _inline;
+	else
+	{
+		if (_heap.size() < blocks * SCAN_CLASSES)
+			_heap.resize(blocks * SCAN_CLASSES);
+		_masks = &_heap[0];
+	}
+	_size = size;
+
+	s_kernel(data, full, _masks);
+	if (full < blocks)
+	{
+		char	tail[64];
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, data + full * 64, size - full * 64);
+		s_kernel(tail, 1, _masks + full * SCAN_CLASSES);
+	}
+}
+
+void	ScanIndex::build(const std::string& data)
+{
+	build(data.data(), data.size());
+}
+
+// Position of the first `\n` in [`from`, `to`), `std::string::npos` if none.
+size_t	ScanIndex::nextNewline(size_t from, size_t to) const
+{
+	return next(SCAN_NEWLINE, from, to);
+}
+
+// Position of the first space in [`from`, `to`), `std::string::npos` if none.
+size_t	ScanIndex::nextSpace(size_t from, size_t to) const
+{
+	return next(SCAN_SPACE, from, to);
+}
+
+/**
+Finds the next set bit of a class: the bits before `from` are masked off in
+its block, then each block takes one test, and the position within the first
+non-empty one is its count of trailing zeros.
+*/
+size_t	ScanIndex::next(int type, size_t from, size_t to) const
+{
+	if (to > _size)
+		to = _size;
+	if (from >= to)
+		return std::string::npos;
+
+	size_t		block = from / 64;
+	size_t		last = (to - 1) / 64;
+	uint64_t	mask = _masks[block * SCAN_CLASSES + type] & (~static_cast<uint64_t>(0) << (from % 64));
+
+	while (!mask)
+	{
+		if (++block > last)
+			return std::string::npos;
+		mask = _masks[block * SCAN_CLASSES + type];
+	}
+	size_t	pos = block * 64 + __builtin_ctzll(mask);
+	return pos < to ? pos : std::string::npos;
+}
+
+// Name of the kernel in use ("avx2", "sse2" or "scalar").
+const char*	ScanIndex::getKernelName()
+{
+#if SCAN_X86
+	if (s_kernel == scanAvx2)
+		return "avx2";
+	if (s_kernel == scanSse2)
+		return "sse2";
+#endif
+	return "scalar";
+}
+
+/**
+Switches to another kernel, to compare them (before any thread is started).
+
+ @return	`false` if this CPU cannot run it (nothing changes).
+*/
+bool	ScanIndex::useKernel(const std::string& name)
+{
+	if (name == "scalar")
+		s_kernel = scanScalar;
+#if SCAN_X86
+	else if (name == "sse2" && __builtin_cpu_supports("sse2"))
+		s_kernel = scanSse2;
+	else if (name == "avx2" && __builtin_cpu_supports("avx2"))
+		s_kernel = scanAvx2;
+#endif
+	else
+		return false;
+	return true;
+}
@@ -12,19 +12,50 @@
 
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
 #include "../include/Channel.hpp"
-#include "../include/defines.hpp"	// color formatting
-#include "../include/signal.hpp"	// g_running variable
+#include "../include/ScanIndex.hpp"	// ScanIndex::getKernelName()
+#include "../include/IrcChars.hpp"	// IrcChars::selectCaseMapping()
+#include "../include/Utf8.hpp"		// Utf8::getKernelName()
+#include "../include/Numerics.hpp"	// checkNumericCatalog()
+#include "../include/defines.hpp"	// color formatting, HISTORY_*, STATE_*, REPLICATION_SOCKET, CASEMAPPING, UTF8_*
+#include "../include/signal.hpp"	// g_running, g_reload, g_upgrade variables
 #include "../include/utils.hpp"		// getFormattedTime(), getTimestamp(), removeColorCodes()
 
 /// Constructor: Initializes the server socket and sets up the server state.
-Server::Server(int port, const std::string& password) 
-	:	_name(SERVER_NAME), _version(VERSION), _network(NETWORK),
-		_creationTime(getFormattedTime()), _port(port),
+Server::Server(int port, const std::string& password, bool standby, const std::string& name)
+	:	_name(name), _version(VERSION), _network(NETWORK),
+		_creationTime(getFormattedTime()), _replyPrefix(":" + _name + " "), _port(port),
 		_password(password), _fd(-1), _cModes(C_MODES), _uModes(U_MODES),
-		_maxChannels(MAX_CHANNELS), _botMode(false), _botFd(-1), _botUser(NULL)
+		_maxChannels(MAX_CHANNELS), _botMode(false), _botUser(NULL), _botPlugins(this),
+		_nowMs(getMonotonicMs()), _startTime(time(NULL)),
+		_pendingFd(FD_SETSIZE, static_cast<PendingUser*>(NULL)), _pendingCount(0), _unregCount(0),
+		_hasMotd(false), _peakUsers(0), _history(HISTORY_MAX_BYTES, HISTORY_CHANNEL_BYTES, HISTORY_INDEX),
+		_stateLog(STATE_SNAPSHOT_FILE, STATE_JOURNAL_FILE), _upgradeFd(takeUpgradeFd()), _handedOff(false),
+		_replication(REPLICATION_SOCKET), _replica(REPLICATION_SOCKET), _standby(standby && _upgradeFd == -1),
+		_localLinkFd(-1), _remoteUserCount(0), _peakGlobalUsers(0)
 {
-	initSocket();
+	std::string	catalogError;
+	if (!checkNumericCatalog(catalogError))
+		throw std::runtime_error("Broken numeric reply catalog: " + catalogError);
+	if (!IrcChars::selectCaseMapping(CASEMAPPING))
+		throw std::runtime_error(toString("Unknown CASEMAPPING: ") + CASEMAPPING);
+
+	_pendingPool.reserve(MAX_UNREG_TOTAL); // At most that many records ever exist
+	_reapStats.registrationTimeouts = 0;
+	_reapStats.partialLineTimeouts = 0;
+	_reapStats.rejectedPerHost = 0;
+	_reapStats.rejectedTotal = 0;
+	_dccStats.relayed = 0;
+	_dccStats.completed = 0;
+	_dccStats.failed = 0;
+	_dccStats.refused = 0;
+	_dccStats.bytes = 0;
+
+	// Otherwise the previous binary hands over its listening socket (see `resumeUpgrade()`),
+	// or the primary passes it to the standby (see `Replica`)
+	if (_upgradeFd == -1 && !_standby)
+		initSocket();
 	srand(time(0));
 }
 
@@ -36,10 +67,7 @@ Server::~Server()
 	if (_fd != -1)
 		close(_fd);
 
-	if (_botFd != -1)
-		close(_botFd);
-	
-	if (g_running == 0) // g_running set to 0 by SIGINT handler
+	if (g_running == 0 && !_handedOff) // g_running set to 0 by SIGINT handler
 	{
 		std::cout << std::endl;	// Just a newline for clean output after Ctrl+C
 		logServerMessage(BOT_COLOR + toString("SIGINT received") + RESET);
@@ -47,13 +75,48 @@ Server::~Server()
 
 	logServerMessage("Shutting down server...");
 
+	// After a hot upgrade, the connections live on in the new binary: close them quietly
+	std::string	closeMsg = _handedOff ? toString("handed over (") + YELLOW + "server upgrade" + RESET + ")"
+		: toString("disconnected (") + YELLOW + "server shutdown" + RESET + ")";
+
+	// Take the sockets back from the I/O threads, so they are closed (or handed over) here
+	stopIo();
+
+	// Tell the standby this is on purpose (after a hot upgrade, it was told already)
+	_replication.close(false);
+
+	// Save the channel states, then stop journaling: deleting the channels below must not drop them
+	if (_stateLog.isOpen())
+	{
+		writeStateSnapshot();
+		_timers.cancel(&_snapshotTimer);
+		_stateLog.close();
+	}
+
+	// Leave the network: the other servers drop our users, and we theirs
+	closeAllLinks("Server shutdown");
+	for (size_t i = 0; i < _linkTargets.size(); ++i)
+		delete _linkTargets[i];
+
+	// Abort all DCC relays
+	while (!_dccTransfers.empty())
+		closeDccTransfer(*_dccTransfers.begin(), "aborted (server shutdown)");
+
 	// Delete all dynamically allocated User objects
 	while (!_usersFd.empty())
-		deleteUser(_usersFd.begin()->first, toString("disconnected (") + YELLOW + "server shutdown" + RESET + ")");
+		deleteUser(_usersFd.begin()->first, closeMsg);
+
+	// Close all unregistered connections, then free the recycled records
+	for (int fd = 0; _pendingCount > 0 && fd < static_cast<int>(_pendingFd.size()); ++fd)
+		closePendingUser(fd, closeMsg);
+	for (size_t i = 0; i < _pendingPool.size(); ++i)
+		delete _pendingPool[i];
 
 	// Delete all dynamically allocated Channel objects
 	while (!_channels.empty())
-		deleteChannel(_channels.begin()->first, "server shutdown");
+		deleteChannel(_channels.begin()->first, _handedOff ? "handed over" : "server shutdown");
+
+	deleteBot();
 
 	logServerMessage("Server shutdown complete");
 
@@ -71,55 +134,137 @@ Starts the main server loop to handle incoming connections and client messages.
 Sets up the `fd_set` for `select()`, and continuously monitors:
  - The listening socket for new client connections.
  - All active user sockets for incoming messages.
+ - The timer wheel, which bounds how long `select()` may sleep.
 
 The loop runs until interrupted by `SIGINT` (Ctrl+C), at which point `g_running` becomes 0.
+`SIGHUP` sets `g_reload`, and the loop calls `reload()` before its next `select()`.
+`SIGUSR2` sets `g_upgrade`: the loop hands everything over to a new binary (`upgrade()`)
+and returns once it has taken over.
+In standby mode, the server first follows the primary (`runStandby()`) and only enters
+the loop once it has taken over.
 */
 void	Server::run()
 {
-	fd_set	readFds, writeFds;	// Sets of fds to monitor for readability and writability
-	int		maxFd;		// Highest fd in the set, used by select() to avoid scanning all fds
-	int		writeMaxFd;	// Highest fd in the write set
-	int		ready;		// Number of ready fds returned by select()
+	fd_set			readFds, writeFds;	// Sets of fds to monitor for readability and writability
+	int				maxFd;		// Highest fd in the set, used by select() to avoid scanning all fds
+	int				writeMaxFd;	// Highest fd in the write set
+	int				ready;		// Number of ready fds returned by select()
+	struct timeval	tv;			// Storage for the select() timeout
 
 	openLogFile();
-	logServerMessage(toString("Server ") + BOT_COLOR + _name + RESET + " running on port "
-		+ YELLOW + toString(getPort()) + RESET);
+	logServerMessage(toString("Server ") + BOT_COLOR + _name + RESET + (_standby ? " standing by for port "
+		: " running on port ") + YELLOW + toString(getPort()) + RESET);
+	logServerMessage(toString("Line scanner: ") + YELLOW + ScanIndex::getKernelName() + RESET);
+	if (UTF8_ONLY)
+		logServerMessage(toString("UTF-8 check: ") + YELLOW + Utf8::getKernelName() + RESET
+			+ (UTF8_REPLACE ? " (invalid text is repaired)" : " (invalid text is refused)"));
+	buildReplyBursts();
 
 	// Initializes the bot if bot mode is set.
 	#ifdef BOT_MODE
 		initBot();
 	#endif
 
+	// Take over the connections and channels of the previous binary (hot upgrade)
+	updateNow();
+	if (_upgradeFd != -1)
+		resumeUpgrade();
+	// Or follow a primary, until it is gone (standby mode)
+	else if (_standby && !runStandby())
+		return;
+	updateNow();
+	openStateLog();
+	openReplication();
+	openLinks();
+	startIo();
+	startFanout();
+
 	while (g_running)
 	{
+		if (g_reload)
+		{
+			g_reload = 0;
+			reload();
+		}
+		if (g_upgrade)
+		{
+			g_upgrade = 0;
+			if (upgrade())
+				return; // The new binary serves from now on
+		}
+
 		maxFd = prepareReadSet(readFds);
 		writeMaxFd = prepareWriteSet(writeFds);
 		if (writeMaxFd > maxFd) maxFd = writeMaxFd;
+		writeMaxFd = prepareDccSets(readFds, writeFds);
+		if (writeMaxFd > maxFd) maxFd = writeMaxFd;
+		writeMaxFd = prepareReplicationSets(readFds, writeFds);
+		if (writeMaxFd > maxFd) maxFd = writeMaxFd;
+		writeMaxFd = prepareLinkSets(readFds, writeFds);
+		if (writeMaxFd > maxFd) maxFd = writeMaxFd;
 
-		// Pause the program until a socket becomes readable or writable in any of the provided sets
-		// 'exceptional' set is not used (NULL), also no timeout set (NULL)
-		ready = select(maxFd + 1, &readFds, &writeFds, NULL, NULL);
+		// Pause the program until a socket becomes readable or writable in any of the provided sets,
+		// or until the next timer is due; 'exceptional' set is not used (NULL)
+		ready = select(maxFd + 1, &readFds, &writeFds, NULL, prepareTimeout(tv));
 		if (ready == -1) // Critical! Shut down server / end program
 		{
-			if (errno == EINTR) // If interrupted by signal (SIGINT), just return to main.
-				return;
+			if (errno == EINTR) // Interrupted by a signal: SIGINT returns to main, SIGHUP reloads
+			{
+				if (!g_running)
+					return;
+				continue;
+			}
 			std::string	errorMsg = "select() failed: " + toString(strerror(errno));
 			logServerMessage(RED + toString("ERROR: ") + errorMsg + RESET);
 			throw std::runtime_error("select() failed: " + toString(strerror(errno)));
 		}
+		updateNow(); // Before any handler, which may schedule timers
 
 		// New incoming connection?
 		if (FD_ISSET(_fd, &readFds)) // checks if server socket (_fd) is ready for reading -> new connection
 			acceptNewUser(); // Adds user to `_usersFd`
 
+		// Bot workers finished some jobs?
+		if (_botWorkers.isRunning() && FD_ISSET(_botWorkers.getWakeFd(), &readFds))
+			handleBotCompletions();
+
+		// Commands (and disconnections) the I/O threads have received
+		if (_ioWorkers.isRunning() && FD_ISSET(_ioWorkers.getWakeFd(), &readFds))
+			handleIoEvents();
+
 		// Handle user input for all active connections (messages, disconnections)
 		handleReadReadyUsers(readFds);
 		
 		// Handle pending output to be sent to users
 		handleWriteReadyUsers(writeFds);
+
+		// Move bytes of relayed DCC transfers
+		handleDccTransfers(readFds, writeFds);
+
+		// Exchange traffic with the other servers of the network
+		handleLinks(readFds, writeFds);
+
+		// Fire due timers (keepalive PINGs, ping timeouts, registration deadlines, link retries)
+		handleTimers();
+
+		// Attach a standby, and send it what changed in this iteration
+		handleReplication(readFds, writeFds);
+		flushReplication();
 	}
 }
 
+/**
+Reloads what can change without a restart (`SIGHUP`); no connection is touched.
+Currently these are the cached replies (MOTD) and the bot plugins (bot mode only).
+*/
+void	Server::reload(void)
+{
+	logServerMessage(BOT_COLOR + toString("SIGHUP received") + RESET + ", reloading");
+	buildReplyBursts();
+	if (_botMode)
+		_botPlugins.reload();
+}
+
 /////////////
 // LOGGING //
 /////////////
@@ -191,6 +336,12 @@ const std::string&	Server::getServerName() const
 	return _name;
 }
 
+// Returns ":<server name> ", the prefix of every server reply.
+const std::string&	Server::getReplyPrefix() const
+{
+	return _replyPrefix;
+}
+
 // Returns the server version.
 const std::string&	Server::getVersion() const
 {
@@ -257,6 +408,18 @@ std::ofstream&	Server::getLogFile()
 	return _logFile;
 }
 
+// Returns the recent messages of all channels (CHATHISTORY).
+MessageHistory&	Server::getHistory()
+{
+	return _history;
+}
+
+// Returns the channel states saved across restarts (STATS c).
+const StateLog&	Server::getStateLog() const
+{
+	return _stateLog;
+}
+
 //////////////////
 // Nick Mapping //
 //////////////////
@@ -2,24 +2,28 @@
 #include "../include/User.hpp"
 #include "../include/Command.hpp"
 #include "../include/utils.hpp"
-#include "../include/defines.hpp"	// BOT_NAME
+#include "../include/BotPlugins.hpp"
+#include "../include/defines.hpp"	// BOT_NAME, MAX_BUFFER_SIZE
 
 #include <stdexcept>	// std::runtime_error
-#include <cstring>		// memset(), strerror()
+#include <cstring>		// strerror()
 #include <cerrno>		// errno
-#include <sys/socket.h>	// socket(), bind(), listen(), accept(), setsockopt(), etc.
-#include <netinet/in.h>	// sockaddr_in, INADDR_ANY, htons()
+#include <new>			// std::bad_alloc
 #include <stack>
 #include <map>
-#include <cctype>		// isdigit()
+#include <cctype>		// isdigit(), toupper()
+#include <cstdlib>		// rand(), atoi()
 #include <sstream>		// std::ostringstream
 
 //////////////////
 // Bot commands //
 //////////////////
 
-static long	evaluateExpression(const std::string &expr);
-static bool	isValidExpression(const std::string &expr);
+static long			evaluateExpression(const std::string &expr);
+static bool			isValidExpression(const std::string &expr);
+static std::string	runCalc(const std::string& expression, const void* context);
+static std::string	runJoke(const std::string& index, const void* context);
+static std::string	runPluginVerb(const std::string& args, const void* context);
 
 /**
 Handles the custom IRCbot `CALC` command, evaluating a simple math expression and replying with the result.
@@ -65,6 +69,19 @@ void	Server::handleCalc(Server *server, User *user, const std::vector<std::strin
 		return;
 	}
 
+	user->logUserAction("sent CALC command");
+
+	// Evaluated by a bot worker; the result is sent as a PRIVMSG from the bot
+	server->submitBotJob(user, "CALC", runCalc, expression);
+}
+
+/**
+Bot job for handleCalc(), runs on a worker thread.
+Evaluates the (already validated) expression and returns the bot's reply.
+*/
+static std::string	runCalc(const std::string& expression, const void* context)
+{
+	(void)context;
 	long	result = 0;
 	try
 	{
@@ -72,22 +89,13 @@ void	Server::handleCalc(Server *server, User *user, const std::vector<std::strin
 	}
 	catch (const std::runtime_error &e) // Division by zero
 	{
-		user->logUserAction("sent CALC with an invalid math expression");
-		Command::handleMessageToUser(server, server->getBotUser(), user->getNickname(),
-			"Oh silly! Only Chuck Norris can divide by zero!", "PRIVMSG", "CALC"); // Division by zero
-		return;
+		return "Oh silly! Only Chuck Norris can divide by zero!";
 	}
 
 	// Convert result to string
 	std::ostringstream oss;
 	oss << result;
-	std::string resultStr = oss.str();
-
-	user->logUserAction("sent CALC command");
-
-	// Send result as a NOTICE from the bot
-	Command::handleMessageToUser(server, server->getBotUser(), user->getNickname(),
-		"The answer to " + expression + " is: " + resultStr, "PRIVMSG", "CALC");
+	return "The answer to " + expression + " is: " + oss.str();
 }
 
 /**
@@ -170,7 +178,7 @@ static bool	isValidExpression(const std::string &expr)
 /**
 Handles the custom IRCbot `JOKE` command, sending a `NOTICE` to the user with a stupid joke.
 
-This function sends a random joke (10 possible outcomes).
+This function sends a random joke (10 possible outcomes), built by a bot worker.
 
 Syntax:
 	JOKE
@@ -183,102 +191,361 @@ void	Server::handleJoke(Server *server, User *user)
 	if (!Command::checkRegistered(user, "JOKE"))
 		return ;
 
-	int			nbr = rand() % 10;
-	std::string	message;
+	user->logUserAction("sent JOKE command");
+
+	// rand() is not thread-safe: pick the joke here, let a worker build the reply
+	server->submitBotJob(user, "JOKE", runJoke, toString(rand() % 10));
+}
 
-	switch (nbr)
+/**
+Bot job for handleJoke(), runs on a worker thread.
+Returns the joke with the given number (0-9).
+*/
+static std::string	runJoke(const std::string& index, const void* context)
+{
+	(void)context;
+	switch (std::atoi(index.c_str()))
 	{
 		case 0:
-			message = "Why did the user leave the channel? Because I kept pinging them for attention! 😅"; break ;
+			return "Why did the user leave the channel? Because I kept pinging them for attention! 😅";
 		case 1:
-			message = "I told a joke in #general… Now I'm the only one still connected. 🤖💔"; break;
+			return "I told a joke in #general… Now I'm the only one still connected. 🤖💔";
 		case 2:
-			message = "My favorite command? /join #lonely — it's always empty, just how I like it."; break;
+			return "My favorite command? /join #lonely — it's always empty, just how I like it.";
 		case 3:
-			message = "Someone tried to mute me once… But I just reconnected. 😎"; break;
+			return "Someone tried to mute me once… But I just reconnected. 😎";
 		case 4:
-			message = "I asked the server for a date. It said: “451 — unavailable for legal reasons“"; break;
+			return "I asked the server for a date. It said: “451 — unavailable for legal reasons“";
 		case 5:
-			message = "Why did the IRC bot get kicked from the channel? It wouldn't stop repeating itself. It wouldn't stop repeating itself. It wouldn't stop repeating itself."; break;
+			return "Why did the IRC bot get kicked from the channel? It wouldn't stop repeating itself. It wouldn't stop repeating itself. It wouldn't stop repeating itself.";
 		case 6:
-			message = "I tried to join #philosophy, but they told me I don't exist. Now I'm stuck in #existential_crisis."; break;
+			return "I tried to join #philosophy, but they told me I don't exist. Now I'm stuck in #existential_crisis.";
 		case 7:
-			message = "Someone told me to “get a life.” So I joined a cron job."; break;
+			return "Someone told me to “get a life.” So I joined a cron job.";
 		case 8:
-			message = "“Bot, do you even have feelings?” Yeah — mostly disappointment and buffer overflow. 💔💾"; break;
-		case 9:
-			message = "“Hey bot, are you self-aware?” Only enough to regret being in this channel."; break;
+			return "“Bot, do you even have feelings?” Yeah — mostly disappointment and buffer overflow. 💔💾";
+		default:
+			return "“Hey bot, are you self-aware?” Only enough to regret being in this channel.";
 	}
+}
 
-	user->logUserAction("sent JOKE command");
-	Command::handleMessageToUser(server, server->getBotUser(), user->getNickname(), message, "PRIVMSG", "JOKE");
+/////////////////
+// Bot Plugins //
+/////////////////
+
+/**
+Runs a bot command provided by a plugin (see `BotPlugins`), if there is one.
+Called for every command the dispatcher does not know.
+
+Syntax:
+	<VERB> [<args>]
+
+ @param user	The user issuing the command.
+ @param tokens	The command and its arguments.
+ @return		`false` if no plugin provides the command (it is unknown).
+*/
+bool	Server::runBotVerb(User* user, const std::vector<std::string>& tokens)
+{
+	if (!_botMode || tokens.empty())
+		return false;
+
+	std::string	verb = tokens[0];
+	for (size_t i = 0; i < verb.size(); ++i)
+		verb[i] = static_cast<char>(toupper(static_cast<unsigned char>(verb[i])));
+
+	const BotPlugins::Binding*	binding = _botPlugins.find(verb);
+	if (!binding)
+		return false;
+	if (!Command::checkRegistered(user, verb))
+		return true;
+
+	std::string	args;
+	for (size_t i = 1; i < tokens.size(); ++i)
+		args += (i > 1 ? " " : "") + tokens[i];
+
+	user->logUserAction(toString("sent ") + YELLOW + verb + RESET + " command (plugin "
+		+ BOT_COLOR + binding->module->plugin->name + RESET + ")");
+	submitBotJob(user, verb, runPluginVerb, args, binding);
+	return true;
 }
 
+/**
+Bot job for runBotVerb(), runs on a worker thread.
+Calls the plugin verb (`context` is its `BotPlugins::Binding`) and returns its reply
+on a single line; a failed verb without a reply is answered with its usage.
+*/
+static std::string	runPluginVerb(const std::string& args, const void* context)
+{
+	const BotPluginVerb*	verb = static_cast<const BotPlugins::Binding*>(context)->verb;
+	char					out[MAX_BUFFER_SIZE];
 
-//////////////////////
-// Initializing Bot //
-//////////////////////
+	out[0] = '\0';
+	int	status = verb->run(args.c_str(), out, sizeof(out));
+	out[sizeof(out) - 1] = '\0';
+
+	std::string	reply = out;
+	for (size_t i = 0; i < reply.size(); ++i)
+	{
+		if (reply[i] == '\r' || reply[i] == '\n')
+			reply[i] = ' '; // A reply must not inject further IRC lines
+	}
+	if (status != 0 && reply.empty())
+		reply = toString("Usage: ") + (verb->usage ? verb->usage : verb->name);
+	return reply;
+}
+
+////////////////
+// Bot Events //
+////////////////
+
+/**
+Called when a user has joined a channel: the bot welcomes them with a few `NOTICE`s.
+
+ @param user		The user who joined.
+ @param channelName	The channel as given in the `JOIN` command.
+*/
+void	Server::botOnChannelJoin(User* user, const std::string& channelName)
+{
+	Command::handleMessageToUser(this, _botUser, user->getNicknameLower(),
+		"Welcome to " + channelName + ", dear " + user->getNickname() + "!", "NOTICE");
+	Command::handleMessageToUser(this, _botUser, user->getNicknameLower(),
+		"I am a friendly IRCbot and I'm pleased to meet you!", "NOTICE");
+	Command::handleMessageToUser(this, _botUser, user->getNicknameLower(),
+		"Use command 'joke' or 'calc <expression>' (e.g. 'calc 40 + 2', int only) and see what happens!", "NOTICE");
+}
 
 /**
-Initializes and connects the internal bot socket.
+Called when a user sends a `PRIVMSG` or `NOTICE` directly to the bot.
+
+A `PRIVMSG` starting with `joke`, `calc` or a plugin verb is handled like the
+corresponding command, anything else is answered with a short usage hint.
+A `NOTICE` is never answered (RFC 1459, 4.4.2).
+
+ @param sender		The user who sent the message.
+ @param message		The message text.
+ @param commandName	"PRIVMSG" or "NOTICE".
+*/
+void	Server::botOnDirectMessage(User* sender, const std::string& message, const std::string& commandName)
+{
+	if (commandName != "PRIVMSG" || sender->getIsBot())
+		return;
 
-This function creates a new TCP socket dedicated to the server’s built-in bot.
-The bot connects to the same IRC server instance via the local loopback interface
-(127.0.0.1) using the server’s own listening port.
+	std::vector<std::string>	tokens = Command::tokenize(message);
+	std::string					cmd = tokens.empty() ? "" : tokens[0];
 
-Steps:
- - 1. Create a socket using AF_INET (IPv4) and SOCK_STREAM (TCP).
- - 2. Configure the socket address to point to localhost and the server port.
- - 3. Attempt to connect the bot socket to the server.
+	for (size_t i = 0; i < cmd.size(); ++i)
+		cmd[i] = static_cast<char>(toupper(static_cast<unsigned char>(cmd[i])));
+
+	if (cmd == "JOKE")
+		handleJoke(this, sender);
+	else if (cmd == "CALC")
+		handleCalc(this, sender, tokens);
+	else if (!runBotVerb(sender, tokens))
+		Command::handleMessageToUser(this, _botUser, sender->getNicknameLower(),
+			"Try 'joke' or 'calc <expression>' (e.g. 'calc 40 + 2', int only)!", "NOTICE");
+}
+
+//////////////
+// Bot Jobs //
+//////////////
+
+/**
+Runs a bot command on the bot workers; the user gets the result as a `PRIVMSG`
+from the bot once the job completes (see `handleBotCompletions()`).
+
+Each user may have at most `BOT_MAX_JOBS` uncompleted jobs. A job still running
+after `BOT_JOB_TIMEOUT` seconds is answered with a timeout; its late result is
+dropped, but it keeps its slot until a worker has really finished it, so slow
+jobs cannot pile up on the workers.
+If the workers are not running, the job is run right away on the event loop.
+
+ @param user	The user who issued the command.
+ @param command	The bot command (for the reply and logs).
+ @param func	The job, run on a worker thread.
+ @param input	The job's input.
+ @param plugin	The plugin verb the job runs (passed to `func` as its context), or `NULL`.
+				Its module stays loaded until the job has completed.
 */
-void	Server::initBotSocket(void)
+void	Server::submitBotJob(User* user, const std::string& command, BotWorkers::JobFunc func,
+							const std::string& input, const BotPlugins::Binding* plugin)
 {
-	_botFd = socket(AF_INET, SOCK_STREAM, 0);
-	if (_botFd < 0)
+	int&	inFlight = _botJobsPerFd[user->getFd()];
+
+	if (inFlight >= BOT_MAX_JOBS)
 	{
-		std::string	errorMsg = "socket() for bot failed: " + std::string(strerror(errno));
-		logServerMessage(RED + toString("ERROR: ") + errorMsg + RESET);
-		throw std::runtime_error(errorMsg);
+		user->logUserAction(toString("hit the bot job limit with ") + YELLOW + command + RESET);
+		Command::handleMessageToUser(this, _botUser, user->getNicknameLower(),
+			"Slow down! I'm still working on your last " + toString(BOT_MAX_JOBS) + " requests.", "NOTICE");
+		return;
 	}
 
-	sockaddr_in	addr;
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(_port);
-	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // 127.0.0.1
+	BotWorkers::Job*	job = new BotWorkers::Job();
+	job->fd = user->getFd();
+	job->command = command;
+	job->func = func;
+	job->input = input;
+	job->context = plugin;
 
-	if (connect(_botFd, (sockaddr*)&addr, sizeof(addr)) < 0)
+	if (!_botWorkers.isRunning())
 	{
-		std::string	errorMsg = "connect() for bot failed: " + std::string(strerror(errno));
-		logServerMessage(RED + toString("ERROR: ") + errorMsg + RESET);
-		throw std::runtime_error(errorMsg);
+		job->result = func(input, plugin);
+		++inFlight;
+		deliverBotJob(job);
+		releaseBotJobSlot(job->fd);
+		delete job;
+		return;
 	}
+
+	++inFlight;
+	if (plugin)
+		_botPlugins.acquire(plugin);
+	_botJobs.insert(job);
+	job->timer.type = TIMER_BOT_JOB;
+	job->timer.fd = job->fd;
+	job->timer.data = job;
+	_timers.schedule(&job->timer, BOT_JOB_TIMEOUT * 1000UL);
+	_botWorkers.submit(job);
 }
 
-/*Accepts the bot user connection and adds it to the server's user lists
-(_usersFd, _usersNick) by creating a new User object. Also sets the bot credentials and registers it.*/
-void	Server::initBotCredentials(void)
+/**
+Collects all jobs the bot workers have finished and sends their results.
+Called when the workers' wake-up pipe is readable.
+*/
+void	Server::handleBotCompletions(void)
 {
-	std::string	botName = BOT_NAME;
+	BotWorkers::Job*	job = _botWorkers.takeCompleted();
+
+	while (job)
+	{
+		BotWorkers::Job*	next = job->next;
+
+		_timers.cancel(&job->timer);
+		_botJobs.erase(job);
+		if (job->context)
+			_botPlugins.release(static_cast<const BotPlugins::Binding*>(job->context));
+		if (!job->timedOut)
+			deliverBotJob(job);
+		releaseBotJobSlot(job->fd);
+		delete job;
+		job = next;
+	}
+}
+
+/**
+A bot job did not finish in time: tell the user now, drop the result later.
+The job keeps its slot until `handleBotCompletions()` collects it.
+*/
+void	Server::handleBotJobTimeout(BotWorkers::Job* job)
+{
+	User*	user = job->fd >= 0 ? getUser(job->fd) : NULL;
+
+	job->timedOut = true;
+	if (!user)
+		return;
+
+	user->logUserAction(toString("bot job ") + YELLOW + job->command + RESET + " timed out");
+	Command::handleMessageToUser(this, _botUser, user->getNicknameLower(),
+		"Sorry, that took me too long. Please try again later!", "PRIVMSG", job->command);
+}
+
+// Sends a finished bot job's result to the user who requested it (if still connected).
+void	Server::deliverBotJob(BotWorkers::Job* job)
+{
+	User*	user = job->fd >= 0 ? getUser(job->fd) : NULL;
+	if (!user)
+		return;
+
+	Command::handleMessageToUser(this, _botUser, user->getNicknameLower(), job->result, "PRIVMSG", job->command);
+}
+
+// Frees one of a user's `BOT_MAX_JOBS` slots once a job has completed (`fd` -1: user is gone).
+void	Server::releaseBotJobSlot(int fd)
+{
+	std::map<int, int>::iterator	it = _botJobsPerFd.find(fd);
+
+	if (it != _botJobsPerFd.end() && --it->second <= 0)
+		_botJobsPerFd.erase(it);
+}
 
-	if (acceptNewUser()) // Allocating of bot user object successful
+// Detaches all bot jobs of a user who is about to be deleted; their results are dropped.
+void	Server::cancelBotJobs(int fd)
+{
+	if (_botJobsPerFd.erase(fd) == 0)
+		return; // Never had bot jobs
+
+	for (std::set<BotWorkers::Job*>::iterator it = _botJobs.begin(); it != _botJobs.end(); ++it)
 	{
-		// As the bot is the first user, it will be the first in the map.
-		std::map<int, User*>::iterator	it = _usersFd.begin();
-		_botUser = it->second;
-		_botUser->setIsBotToTrue();
-		_botUser->setNickname(botName, normalize(botName));
-		_botUser->setRealname(botName);
-		_botUser->setUsername(botName);
-		_botUser->setHasPassed(true);
-		_botUser->tryRegister();
+		if ((*it)->fd == fd)
+		{
+			_timers.cancel(&(*it)->timer);
+			(*it)->fd = -1;
+		}
 	}
 }
 
-/*Initializes bot socket and connects to server socket, sets bot credentials, and 
-registers the bot user. Also sets _botMode to true.*/
+//////////////////////
+// Initializing Bot //
+//////////////////////
+
+/**
+Creates the server bot as a virtual user and registers it.
+
+The bot has no socket (fd `-1`): it is only known by its nickname
+(`_usersNick`), so it shows up in channels and can be messaged, but nothing
+is ever serialized to it. `sendServerMsg()` / `sendMsgFromUser()` drop
+anything addressed to it and `broadcastToChannel()` skips it. Instead, the
+server calls the bot's event hooks (`botOnChannelJoin()`, `botOnDirectMessage()`).
+*/
 void	Server::initBot(void)
 {
+	std::string	botName = BOT_NAME;
+
+	try
+	{
+		_botUser = new User(-1, this); // 'new' throws std::bad_alloc on failure
+	}
+	catch (const std::bad_alloc&)
+	{
+		logServerMessage(RED + toString("ERROR: Failed to allocate memory for ") + BOT_COLOR
+			+ "server bot" + RESET); // Server keeps running without bot
+		return;
+	}
+
 	_botMode = true;
-	initBotSocket();
-	initBotCredentials();
+	_botUser->setIsBotToTrue();
+	_botUser->setHost("localhost");
+	_botUser->setNickname(botName, normalize(botName));
+	_botUser->setRealname(botName);
+	_botUser->setUsername(botName);
+	_botUser->setHasPassed(true);
+	_botUser->tryRegister();
+
+	if (!_botWorkers.start(BOT_WORKERS))
+		logServerMessage(RED + toString("ERROR: Failed to start bot workers: ") + strerror(errno)
+			+ RESET + " (bot commands run on the event loop)");
+	_botPlugins.reload();
+}
+
+// Stops the bot workers, drops unfinished bot jobs, unloads the plugins,
+// and removes the bot from the nickname map (server shutdown).
+void	Server::deleteBot(void)
+{
+	_botWorkers.stop();
+	for (std::set<BotWorkers::Job*>::iterator it = _botJobs.begin(); it != _botJobs.end(); ++it)
+	{
+		_timers.cancel(&(*it)->timer);
+		delete *it;
+	}
+	_botJobs.clear();
+	_botJobsPerFd.clear();
+	_botPlugins.unloadAll();
+
+	if (!_botUser)
+		return;
+
+	_botUser->logUserAction(toString("disconnected (") + YELLOW + "server shutdown" + RESET + ")", true);
+	_usersNick.erase(_botUser->getNicknameLower());
+	delete _botUser;
+	_botUser = NULL;
+	_botMode = false;
 }
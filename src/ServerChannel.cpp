@@ -1,8 +1,12 @@
+#include <ctime>		// time()
+#include <unistd.h>		// sysconf()
+
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
 #include "../include/Channel.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/utils.hpp"		// logServerMessage
-#include "../include/defines.hpp"	// color formatting
+#include "../include/defines.hpp"	// color formatting, STATE_*, FANOUT_THREADS
 
 /**
 Retrieves an `Channel` object by its name.
@@ -47,6 +51,10 @@ Channel*	Server::getOrCreateChannel(const std::string& channelName, User* user,
 	{
 		channel = new Channel(channelName);
 		_channels[normalize(channelName)] = channel; // Add to the server's channel map
+		channel->set_state_log(&_stateLog);	// Topic, mode and invite changes are journaled
+		channel->set_replication(&_replication);	// ... and all changes streamed to the standby
+		channel->set_fanout(&_fanout);	// Very large channels are broadcast to by several threads
+		_replication.saveChannel(*channel);
 		user->logUserAction(toString("created ") + BLUE + channelName + RESET);
 
 		if (wasCreated)
@@ -57,7 +65,7 @@ Channel*	Server::getOrCreateChannel(const std::string& channelName, User* user,
 		user->logUserAction(RED + toString("ERROR: Failed to allocate memory for new channel ")
 			+ BLUE + channelName + RESET);
 		
-		user->sendError(500, "", "Internal server error while creating channel " + channelName);
+		reply<ERR_CHANNELCREATE>(user, channelName);
 		if (wasCreated)
 			*wasCreated = false;
 		return NULL;
@@ -73,6 +81,9 @@ void	Server::deleteChannel(const std::string& channelName, std::string reason)
 	{
 		logServerMessage(toString("Channel ") + BLUE + it->second->get_name() + RESET
 			+ " deleted (" + YELLOW + reason + RESET + ")");
+		_history.drop(it->first);	// A new channel of that name starts without history
+		_stateLog.drop(it->first);	// ... and with default modes after a restart
+		_replication.dropChannel(it->first);
 		delete it->second;		// Free memory for the channel
 		_channels.erase(it);	// Remove from the map
 	}
@@ -82,3 +93,92 @@ std::map<std::string, Channel*>&	Server::getAllChannels()
 {
 	return _channels;
 }
+
+/**
+Gives a channel just created by `user` the topic, modes and invite list it had
+before the server restarted (see `StateLog`), if any.
+
+ @return	`true` if a saved state was restored.
+*/
+bool	Server::restoreChannelState(Channel* channel, User* user)
+{
+	if (!_stateLog.restore(channel))
+		return false;
+	_replication.saveChannel(*channel);
+	user->logUserAction(toString("restored the saved state of ") + BLUE + channel->get_name() + RESET);
+	return true;
+}
+
+/////////////////////////
+// Channel persistence //
+/////////////////////////
+
+/**
+Loads the channel states saved by the previous run (`STATE_SNAPSHOT_FILE`
+and `STATE_JOURNAL_FILE`) and starts journaling, if `STATE_PERSIST` is set.
+Damaged files are logged; whatever could be read is kept.
+*/
+void	Server::openStateLog()
+{
+	if (!STATE_PERSIST)
+		return;
+
+	std::string	error;
+	if (!_stateLog.open(error))
+		logServerMessage(YELLOW + toString("WARNING: Channel state: ") + error + RESET);
+	if (!_stateLog.isOpen())
+		return;
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+		_stateLog.claim(*it->second); // Taken over by a hot upgrade, with the state saved by the previous binary
+
+	const StateLog::Stats&	stats = _stateLog.getStats();
+	logServerMessage(toString("Channel state loaded: ") + YELLOW + toString(_stateLog.getChannelCount()) + RESET
+		+ " channels (" + toString(stats.snapshotRecords) + " snapshot records, " + toString(stats.journalRecords)
+		+ " journal records) in " + YELLOW + toString(stats.loadUs / 1000) + "." + toString(stats.loadUs / 100 % 10)
+		+ " ms" + RESET);
+
+	_snapshotTimer.type = TIMER_STATE_SNAPSHOT;
+	_timers.schedule(&_snapshotTimer, STATE_SNAPSHOT_INTERVAL * 1000UL);
+}
+
+/**
+Writes a new snapshot of all channel states and empties the journal
+(every `STATE_SNAPSHOT_INTERVAL` seconds, and on shutdown). Once the server
+has run for `STATE_RESTORE_WINDOW` seconds, saved states no channel has
+claimed are forgotten.
+*/
+void	Server::writeStateSnapshot()
+{
+	bool		dropUnclaimed = time(NULL) - _startTime >= STATE_RESTORE_WINDOW;
+	size_t		unclaimed = _stateLog.getUnclaimedCount();
+	std::string	error;
+
+	if (!_stateLog.writeSnapshot(dropUnclaimed, error))
+		logServerMessage(RED + toString("ERROR: Channel state snapshot failed: ") + error + RESET);
+	else if (dropUnclaimed && unclaimed > 0)
+		logServerMessage(toString("Channel state: forgot ") + YELLOW + toString(unclaimed) + RESET
+			+ " unclaimed channels");
+	_timers.schedule(&_snapshotTimer, STATE_SNAPSHOT_INTERVAL * 1000UL);
+}
+
+////////////////////
+// Channel fanout //
+////////////////////
+
+/**
+Starts the threads that help broadcasting to very large channels: up to
+`FANOUT_THREADS`, but no more than the cores the event loop leaves free.
+On a single core they could only take turns with it, so broadcasts stay on
+the event loop.
+*/
+void	Server::startFanout()
+{
+	long	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int		threads = FANOUT_THREADS < cores - 1 ? FANOUT_THREADS : static_cast<int>(cores - 1);
+
+	if (threads <= 0)
+		return;
+	if (!_fanout.start(threads))
+		logServerMessage(RED + toString("ERROR: Failed to start fanout threads") + RESET
+			+ " (broadcasts run on the event loop)");
+}
@@ -0,0 +1,266 @@
+#include <string>
+#include <cerrno>		// errno
+#include <cstring>		// memset(), strerror()
+#include <cstdlib>		// strtoul()
+
+#include <unistd.h>		// close()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK
+#include <sys/socket.h>	// socket(), bind(), listen(), getsockname(), getpeername()
+#include <netinet/in.h>	// sockaddr_in, INADDR_ANY, htons(), ntohs(), ntohl()
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/DccTransfer.hpp"
+#include "../include/defines.hpp"	// DCC_*, color formatting
+#include "../include/utils.hpp"		// toString()
+
+/**
+Parses a DCC SEND offer (`\x01DCC SEND <filename> <ip> <port> <size>\x01`).
+The filename may contain spaces, so the numeric fields are taken from the end.
+
+ @return	`false` if the offer is malformed or passive (port 0), i.e. cannot be relayed.
+*/
+static bool	parseDccSend(const std::string& message, std::string& fileName, unsigned long& port,
+						std::string& size)
+{
+	std::string	inner = message.substr(1); // Leading \x01
+	if (!inner.empty() && inner[inner.size() - 1] == '\x01')
+		inner.erase(inner.size() - 1);
+	if (inner.compare(0, 9, "DCC SEND ") != 0)
+		return false;
+
+	size_t	sizePos = inner.rfind(' ');
+	size_t	portPos = inner.rfind(' ', sizePos - 1);
+	size_t	ipPos = inner.rfind(' ', portPos - 1);
+	if (ipPos == std::string::npos || ipPos < 9)
+		return false;
+
+	std::string	portStr = inner.substr(portPos + 1, sizePos - portPos - 1);
+	size = inner.substr(sizePos + 1);
+	fileName = inner.substr(9, ipPos - 9);
+	if (portStr.empty() || size.empty() || portStr.find_first_not_of("0123456789") != std::string::npos
+		|| size.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+
+	port = strtoul(portStr.c_str(), NULL, 10);
+	return port > 0 && port <= 65535;
+}
+
+/**
+Opens a non-blocking socket listening on an ephemeral port for the recipient.
+
+ @param port	Set to the port the socket listens on.
+ @return		The socket, or -1 (`errno` is set).
+*/
+static int	openRelayListener(unsigned short& port)
+{
+	int			fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in	addr;
+	socklen_t	len = sizeof(addr);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(0);	// Let the kernel pick a free port
+	addr.sin_addr.s_addr = INADDR_ANY;
+	if (fd >= FD_SETSIZE || fcntl(fd, F_SETFL, O_NONBLOCK) == -1
+		|| bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+		|| listen(fd, 1) == -1
+		|| getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == -1)
+	{
+		int	savedErrno = fd >= FD_SETSIZE ? EMFILE : errno;
+		close(fd);
+		errno = savedErrno;
+		return -1;
+	}
+	port = ntohs(addr.sin_port);
+	return fd;
+}
+
+/**
+Relays a DCC SEND offer through the server (only if `DCC_RELAY` is enabled).
+
+Instead of the sender's own address, the recipient is offered a relay port on
+this server, at the address the recipient uses to reach the server. Once the
+recipient connects, the server connects to the sender's DCC port (at the
+address the sender is connected from, which also fixes offers carrying a
+private or wrong IP) and pipes the bytes between both connections.
+
+If `DCC_MAX_TRANSFERS` relays are already running, or the offer cannot be
+relayed (malformed, passive DCC), it is forwarded unchanged.
+
+ @param sender		The user offering the file.
+ @param recipient	The user the offer is sent to.
+ @param message		The CTCP `DCC SEND` message.
+ @return			The message to forward to the recipient.
+*/
+std::string	Server::relayDccOffer(User* sender, User* recipient, const std::string& message)
+{
+	std::string		fileName;
+	std::string		size;
+	unsigned long	senderPort;
+
+	if (!DCC_RELAY || sender->getIsBot() || recipient->getIsBot()
+		|| !parseDccSend(message, fileName, senderPort, size))
+		return message;
+
+	if (_dccTransfers.size() >= DCC_MAX_TRANSFERS)
+	{
+		++_dccStats.refused;
+		sender->sendServerMsg("NOTICE " + sender->getNickname() + " :DCC relay is busy ("
+			+ toString(DCC_MAX_TRANSFERS) + " transfers), " + fileName + " is offered for a direct transfer");
+		sender->logUserAction(toString("hit the DCC relay limit with ") + YELLOW + fileName + RESET);
+		return message;
+	}
+
+	sockaddr_in		senderAddr;
+	sockaddr_in		recipientAddr;
+	sockaddr_in		relayAddr;
+	socklen_t		len = sizeof(senderAddr);
+	unsigned short	relayPort;
+	int				listenFd;
+
+	if (getpeername(sender->getFd(), reinterpret_cast<sockaddr*>(&senderAddr), &len) == -1
+		|| (len = sizeof(recipientAddr), getpeername(recipient->getFd(), reinterpret_cast<sockaddr*>(&recipientAddr), &len)) == -1
+		|| (len = sizeof(relayAddr), getsockname(recipient->getFd(), reinterpret_cast<sockaddr*>(&relayAddr), &len)) == -1
+		|| (listenFd = openRelayListener(relayPort)) == -1)
+	{
+		logServerMessage(RED + toString("ERROR: Cannot relay DCC-SEND: ") + strerror(errno) + RESET);
+		return message;
+	}
+	senderAddr.sin_port = htons(static_cast<unsigned short>(senderPort));
+
+	DccTransfer*	transfer = new DccTransfer(listenFd, senderAddr, recipientAddr.sin_addr, DCC_RATE_LIMIT);
+	transfer->fileName = fileName;
+	transfer->senderNick = sender->getNickname();
+	transfer->recipientNick = recipient->getNickname();
+	transfer->deadline.type = TIMER_DCC_DEADLINE;
+	transfer->deadline.data = transfer;
+	transfer->throttle.type = TIMER_DCC_THROTTLE;
+	transfer->throttle.data = transfer;
+	_timers.schedule(&transfer->deadline, DCC_ACCEPT_TIMEOUT * 1000UL);
+	_dccTransfers.insert(transfer);
+	++_dccStats.relayed;
+
+	sender->logUserAction(toString("DCC-SEND of ") + YELLOW + fileName + RESET + " to "
+		+ GREEN + recipient->getNickname() + RESET + " relayed via port " + YELLOW + toString(relayPort) + RESET);
+	return "\x01" "DCC SEND " + fileName + " " + toString(ntohl(relayAddr.sin_addr.s_addr)) + " "
+		+ toString(relayPort) + " " + size + "\x01";
+}
+
+/**
+Adds the sockets of all DCC relays to the `select()` sets. Token buckets are
+refilled up to this loop iteration's `_nowMs`, the clock of the timer wheel
+that wakes throttled relays.
+
+ @return	The highest fd added, or -1 if none.
+*/
+int	Server::prepareDccSets(fd_set& readFds, fd_set& writeFds)
+{
+	int	maxFd = -1;
+
+	for (std::set<DccTransfer*>::iterator it = _dccTransfers.begin(); it != _dccTransfers.end(); ++it)
+	{
+		int	fd = (*it)->prepareFds(readFds, writeFds, _nowMs);
+		if (fd > maxFd)
+			maxFd = fd;
+	}
+	return maxFd;
+}
+
+/**
+Moves the bytes of all DCC relays whose sockets are ready, closes finished
+ones, and arms the throttle timer of relays waiting for their token bucket.
+*/
+void	Server::handleDccTransfers(fd_set& readFds, fd_set& writeFds)
+{
+	std::set<DccTransfer*>::iterator	it = _dccTransfers.begin();
+
+	while (it != _dccTransfers.end())
+	{
+		DccTransfer*		transfer = *it++; // Advance first: the transfer may be deleted
+		DccTransfer::State	before = transfer->getState();
+		DccTransfer::State	state = transfer->handleEvents(readFds, writeFds, _nowMs);
+
+		if (state == DccTransfer::DCC_FINISHED)
+		{
+			closeDccTransfer(transfer, "finished");
+			continue;
+		}
+		if (state == DccTransfer::DCC_FAILED)
+		{
+			closeDccTransfer(transfer, "failed: " + transfer->getError());
+			continue;
+		}
+		if (before == DccTransfer::DCC_LISTENING && state != DccTransfer::DCC_LISTENING)
+			_timers.schedule(&transfer->deadline, DCC_IDLE_TIMEOUT * 1000UL); // From now on: idle timeout
+
+		long	throttleMs = transfer->getThrottleMs();
+		if (throttleMs >= 0 && !transfer->throttle.isArmed())
+			_timers.schedule(&transfer->throttle, throttleMs);
+	}
+}
+
+/**
+Handles an expired DCC relay timer.
+
+ - Throttle: nothing to do, the loop just had to wake up; the relay's
+   socket is watched again now that its token bucket has refilled.
+ - Deadline: closes a relay that was not accepted or could not reach the
+   sender in time, or that has been idle for `DCC_IDLE_TIMEOUT` seconds.
+*/
+void	Server::handleDccTimer(DccTransfer* transfer, int type)
+{
+	if (type == TIMER_DCC_THROTTLE)
+		return;
+
+	switch (transfer->getState())
+	{
+		case DccTransfer::DCC_LISTENING:
+			closeDccTransfer(transfer, "not accepted within " + toString(DCC_ACCEPT_TIMEOUT) + " seconds");
+			return;
+		case DccTransfer::DCC_CONNECTING:
+			closeDccTransfer(transfer, "sender not reachable");
+			return;
+		default:
+			break;
+	}
+
+	unsigned long	idleMs = _nowMs - transfer->getLastActivity();
+	if (idleMs < DCC_IDLE_TIMEOUT * 1000UL)
+		_timers.schedule(&transfer->deadline, DCC_IDLE_TIMEOUT * 1000UL - idleMs);
+	else
+		closeDccTransfer(transfer, "idle for " + toString(DCC_IDLE_TIMEOUT) + " seconds");
+}
+
+// Logs and counts a relay that has ended, then closes its sockets.
+void	Server::closeDccTransfer(DccTransfer* transfer, const std::string& reason)
+{
+	if (transfer->getState() == DccTransfer::DCC_FINISHED)
+		++_dccStats.completed;
+	else
+		++_dccStats.failed;
+	_dccStats.bytes += transfer->getBytesToRecipient() + transfer->getBytesToSender();
+
+	logServerMessage(toString("DCC relay of ") + YELLOW + transfer->fileName + RESET + " from "
+		+ GREEN + transfer->senderNick + RESET + " to " + GREEN + transfer->recipientNick + RESET + " "
+		+ reason + " (" + toString(transfer->getBytesToRecipient()) + " bytes)");
+
+	_timers.cancel(&transfer->deadline);
+	_timers.cancel(&transfer->throttle);
+	_dccTransfers.erase(transfer);
+	delete transfer;
+}
+
+// Returns the DCC relay counters (STATS d).
+const Server::DccStats&	Server::getDccStats() const
+{
+	return _dccStats;
+}
+
+// Returns the number of DCC relays currently set up or running.
+size_t	Server::getDccTransferCount() const
+{
+	return _dccTransfers.size();
+}
@@ -0,0 +1,120 @@
+#include <string>
+#include <vector>
+#include <cerrno>		// errno
+#include <cstring>		// strerror()
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/IoWorkers.hpp"
+#include "../include/defines.hpp"	// IO_THREADS, MAX_BUFFER_SIZE, LOG_RAW_CMDS, color formatting
+#include "../include/utils.hpp"		// toString()
+
+/**
+Starts the I/O threads (`IO_THREADS`, none by default). From then on each
+registered user's socket is handed to one of them the next time the read set
+is prepared (see `prepareReadSet()`): the thread reads and parses, the event
+loop only runs the commands (`handleIoEvents()`), and the output is handed
+back in one piece per iteration (see `prepareWriteSet()`). Unregistered
+connections, links, DCC relays and the bot stay on the event loop.
+
+If the threads cannot be started, the event loop keeps serving every socket.
+*/
+void	Server::startIo()
+{
+	if (IO_THREADS <= 0 || _ioWorkers.isRunning())
+		return;
+	if (!_ioWorkers.start(IO_THREADS))
+		logServerMessage(RED + toString("ERROR: Failed to start I/O threads: ") + strerror(errno)
+			+ RESET + " (users are served by the event loop)");
+}
+
+/**
+Stops the I/O threads and takes the sockets back into the event loop (before
+a hot upgrade hands them over, and on shutdown). What the threads had
+received is processed first; unsent output goes back in front of the user's
+output buffer, a partial line into the input buffer.
+*/
+void	Server::stopIo()
+{
+	if (!_ioWorkers.isRunning())
+		return;
+
+	std::vector<IoWorkers::Leftover>	leftovers;
+	_ioWorkers.stop(leftovers);
+	handleIoEvents();
+	for (size_t i = 0; i < leftovers.size(); ++i)
+	{
+		User*	user = getUser(leftovers[i].fd);
+		if (!user || user->getIoSerial() != leftovers[i].serial)
+			continue; // Disconnected meanwhile
+		user->getOutputBuffer().insert(0, leftovers[i].output);
+		user->getInputBuffer().swap(leftovers[i].input);
+	}
+	for (std::map<int, User*>::iterator it = _usersFd.begin(); it != _usersFd.end(); ++it)
+		it->second->setIoSerial(0);
+}
+
+// True if the user's socket is served by an I/O thread (it must not be read, written or closed here).
+bool	Server::isIoAttached(const User* user) const
+{
+	return user->getIoSerial() != 0 && _ioWorkers.isRunning();
+}
+
+/**
+Processes what the I/O threads have posted. An event about a socket that was
+let go since (another user may have the fd by now) is recognized by its
+serial and dropped.
+*/
+void	Server::handleIoEvents()
+{
+	IoWorkers::Event*	event = _ioWorkers.takeEvents();
+
+	while (event)
+	{
+		IoWorkers::Event*	next = event->next;
+		User*				user = getUser(event->fd);
+
+		if (user && user->getIoSerial() == event->serial)
+			handleIoEvent(user, *event);
+		delete event;
+		event = next;
+	}
+}
+
+/**
+Handles one event of a user's I/O thread:
+ - `IO_INPUT`: runs the received commands, as `processUserInput()` does.
+ - `IO_DRAINED`: continues long replies (NAMES), as after a `send()` here.
+ - `IO_CLOSED`: disconnects the user.
+*/
+void	Server::handleIoEvent(User* user, IoWorkers::Event& event)
+{
+	int	fd = user->getFd();
+
+	if (event.type == IoWorkers::Event::IO_INPUT)
+	{
+		user->setLastActivity(_nowMs); // Any traffic proves the peer is alive (keepalive)
+		for (size_t i = 0; i < event.lines.size(); ++i)
+		{
+			if (getUser(fd) != user)
+				return; // User quit while processing this batch
+			if (LOG_RAW_CMDS)
+				user->logUserAction(BOLD + event.lines[i].raw + RESET);
+			if (event.lines[i].length > MAX_BUFFER_SIZE - 2)
+				rejectOverlongLine(user, event.lines[i].length);
+			else
+				dispatchUserCommand(user, event.lines[i].tokens);
+		}
+	}
+	else if (event.type == IoWorkers::Event::IO_DRAINED)
+		user->pumpReplyStreams();
+	else if (event.error == 0)
+		disconnectUser(fd, "Connection closed");
+	else
+	{
+		std::string	error = strerror(event.error);
+		user->logUserAction(RED + toString("ERROR: ") + (event.writing ? "send()" : "recv()") + " failed: "
+			+ error + RESET);
+		disconnectUser(fd, (event.writing ? "Write error: " : "Read error: ") + error);
+	}
+}
@@ -0,0 +1,274 @@
+#include <string>
+#include <cerrno>		// errno
+#include <cstring>		// strerror()
+
+#include <unistd.h>		// close()
+#include <sys/socket.h>	// recv(), send(), getsockopt()
+
+#include "../include/ServerLink.hpp"
+#include "../include/defines.hpp"	// LINK_READ_SIZE
+
+/**
+ @param fd		Connected (or connecting) non-blocking socket, owned from now on.
+ @param address	"<host>:<port>" of the peer, for the logs.
+ @param target	The `--link` target of an outgoing link, `NULL` for an accepted one.
+ @param ring	Shared memory rings of a local link (owned from now on), `NULL` for TCP.
+*/
+ServerLink::ServerLink(int fd, const std::string& address, LinkTarget* target, LinkRing* ring)
+	:	_fd(fd), _state(target && !ring ? LINK_CONNECTING : LINK_HANDSHAKE), _name("*"), _address(address),
+		_target(target), _ring(ring), _hasPassed(false), _inputOffset(0), _outputOffset(0), _lastActivity(0), _pingSentAt(0)
+{
+	_stats.linesIn = 0;
+	_stats.linesOut = 0;
+	_stats.bytesIn = 0;
+	_stats.bytesOut = 0;
+}
+
+ServerLink::~ServerLink()
+{
+	delete _ring;
+	if (_fd != -1)
+		close(_fd);
+}
+
+// The non-blocking connect() has completed: checks its result.
+bool	ServerLink::finishConnect(std::string& error)
+{
+	int			result = 0;
+	socklen_t	len = sizeof(result);
+
+	if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &result, &len) == -1)
+		result = errno;
+	if (result != 0)
+	{
+		error = std::string("connect(): ") + strerror(result);
+		return false;
+	}
+	_state = LINK_HANDSHAKE;
+	return true;
+}
+
+/**
+Reads what the peer sent (up to `LINK_READ_SIZE` bytes; a local link takes
+what is in its ring) into the input buffer.
+
+ @return	`false` if the peer closed the link or the read failed (`error` says which).
+*/
+bool	ServerLink::receive(std::string& error)
+{
+	if (_ring)
+	{
+		ssize_t	bytesRead = _ring->read(_inputBuffer);
+		if (bytesRead < 0)
+		{
+			error = "Corrupt shared memory ring";
+			return false;
+		}
+		_stats.bytesIn += bytesRead;
+		return true;
+	}
+
+	char	buffer[LINK_READ_SIZE];
+	ssize_t	bytesRead = recv(_fd, buffer, sizeof(buffer), 0);
+
+	if (bytesRead == 0)
+	{
+		error = "Connection closed";
+		return false;
+	}
+	if (bytesRead < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return true;
+		error = std::string("Read error: ") + strerror(errno);
+		return false;
+	}
+	_inputBuffer.append(buffer, bytesRead);
+	_stats.bytesIn += bytesRead;
+	return true;
+}
+
+/**
+Takes the next complete line (optional `\r` stripped) off the input buffer.
+Lines are consumed by moving an offset; the buffer is only cut once all of
+it is consumed, so a large read is not shifted once per line.
+*/
+bool	ServerLink::popLine(std::string& line)
+{
+	size_t	newlinePos = _inputBuffer.find('\n', _inputOffset);
+
+	if (newlinePos == std::string::npos)
+	{
+		_inputBuffer.erase(0, _inputOffset);
+		_inputOffset = 0;
+		return false;
+	}
+	line.assign(_inputBuffer, _inputOffset, newlinePos - _inputOffset);
+	_inputOffset = newlinePos + 1;
+	if (!line.empty() && line[line.size() - 1] == '\r')
+		line.erase(line.size() - 1);
+	++_stats.linesIn;
+	return true;
+}
+
+/**
+Writes as much of the output buffer as the socket (or the ring) takes. The
+sent part is only cut off once it is large, so a busy link does not shift its
+buffer on every write.
+
+ @return	`false` if the link is broken.
+*/
+bool	ServerLink::flush(std::string& error)
+{
+	if (_outputOffset == _outputBuffer.size())
+		return true;
+
+	ssize_t	bytesSent;
+	if (_ring)
+		bytesSent = _ring->write(_outputBuffer.data() + _outputOffset, _outputBuffer.size() - _outputOffset);
+	else
+		bytesSent = ::send(_fd, _outputBuffer.data() + _outputOffset, _outputBuffer.size() - _outputOffset, 0);
+	if (bytesSent < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return true;
+		error = std::string("Write error: ") + strerror(errno);
+		return false;
+	}
+	_outputOffset += bytesSent;
+	_stats.bytesOut += bytesSent;
+	if (_outputOffset == _outputBuffer.size())
+	{
+		_outputBuffer.clear();
+		_outputOffset = 0;
+	}
+	else if (_outputOffset >= LINK_READ_SIZE)
+	{
+		_outputBuffer.erase(0, _outputOffset);
+		_outputOffset = 0;
+	}
+	return true;
+}
+
+// Queues a line for the peer (without trailing "\r\n").
+void	ServerLink::send(const std::string& line)
+{
+	_outputBuffer += line;
+	_outputBuffer += "\r\n";
+	++_stats.linesOut;
+}
+
+/////////////
+// Setters //
+/////////////
+
+void	ServerLink::setState(State state)
+{
+	_state = state;
+}
+
+// Records who is on the other end, as announced by their `SERVER`.
+void	ServerLink::setPeer(const std::string& name, const std::string& info)
+{
+	_name = name;
+	_info = info;
+}
+
+void	ServerLink::setHasPassed(bool hasPassed)
+{
+	_hasPassed = hasPassed;
+}
+
+void	ServerLink::setLastActivity(unsigned long nowMs)
+{
+	_lastActivity = nowMs;
+}
+
+void	ServerLink::setPingSentAt(unsigned long nowMs)
+{
+	_pingSentAt = nowMs;
+}
+
+/////////////
+// Getters //
+/////////////
+
+int	ServerLink::getFd() const
+{
+	return _fd;
+}
+
+ServerLink::State	ServerLink::getState() const
+{
+	return _state;
+}
+
+const std::string&	ServerLink::getName() const
+{
+	return _name;
+}
+
+const std::string&	ServerLink::getInfo() const
+{
+	return _info;
+}
+
+const std::string&	ServerLink::getAddress() const
+{
+	return _address;
+}
+
+LinkTarget*	ServerLink::getTarget() const
+{
+	return _target;
+}
+
+// The peer runs on this host and the link goes through shared memory.
+bool	ServerLink::isLocal() const
+{
+	return _ring != NULL;
+}
+
+// The `eventfd` the peer of a local link signals (-1 for TCP).
+int	ServerLink::getWakeFd() const
+{
+	return _ring ? _ring->getWakeFd() : -1;
+}
+
+bool	ServerLink::hasPassed() const
+{
+	return _hasPassed;
+}
+
+// Appends input that arrived before the link existed (read while it was an unregistered connection).
+void	ServerLink::appendInput(const std::string& input)
+{
+	_inputBuffer += input;
+}
+
+// Bytes received, not consumed as lines yet.
+size_t	ServerLink::getRecvQ() const
+{
+	return _inputBuffer.size() - _inputOffset;
+}
+
+// Bytes queued for the peer, not sent yet.
+size_t	ServerLink::getSendQ() const
+{
+	return _outputBuffer.size() - _outputOffset;
+}
+
+unsigned long	ServerLink::getLastActivity() const
+{
+	return _lastActivity;
+}
+
+unsigned long	ServerLink::getPingSentAt() const
+{
+	return _pingSentAt;
+}
+
+const ServerLink::Stats&	ServerLink::getStats() const
+{
+	return _stats;
+}
@@ -0,0 +1,916 @@
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <cerrno>		// errno
+#include <cstring>		// memset(), strerror()
+#include <cstddef>		// offsetof()
+#include <stdexcept>	// std::runtime_error
+
+#include <unistd.h>		// close(), geteuid()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK
+#include <netdb.h>		// getaddrinfo()
+#include <sys/socket.h>	// socket(), connect(), accept4(), getsockopt(), struct ucred
+#include <sys/un.h>		// sockaddr_un
+#include <sys/select.h>	// fd_set, FD_* macros
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
+#include "../include/Channel.hpp"
+#include "../include/Command.hpp"
+#include "../include/ServerLink.hpp"
+#include "../include/IrcChars.hpp"	// IrcChars::equal()
+#include "../include/LinkRing.hpp"
+#include "../include/defines.hpp"	// LINK_*, PING_*, REGISTRATION_TIMEOUT, color formatting
+#include "../include/utils.hpp"		// toString(), normalize(), parsePort(), sendFds(), receiveFds()
+
+static const size_t	MAX_PENDING_LOCAL_LINKS = 8;	// Local link sockets that may wait for their rings at once
+
+/**
+Adds a server to link to (`--link <host>:<port>`). The address is resolved
+right away, so a typo stops the server from starting; the connection is
+opened once the server runs (`openLinks()`), and again `LINK_RETRY` seconds
+after it drops.
+*/
+void	Server::addLinkTarget(const std::string& address)
+{
+	size_t	colon = address.rfind(':');
+	if (colon == std::string::npos || colon == 0)
+		throw std::runtime_error("Invalid link (expected <host>:<port>): " + address);
+
+	std::string			host = address.substr(0, colon);
+	int					port = parsePort(address.c_str() + colon + 1);
+	struct addrinfo		hints;
+	struct addrinfo*	result;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	int	status = getaddrinfo(host.c_str(), NULL, &hints, &result);
+	if (status != 0)
+		throw std::runtime_error("Cannot resolve link " + address + ": " + gai_strerror(status));
+
+	LinkTarget*	target = new LinkTarget;
+	target->address = address;
+	memcpy(&target->addr, result->ai_addr, sizeof(target->addr));
+	target->addr.sin_port = htons(port);
+	target->link = NULL;
+	target->retry.type = TIMER_LINK_RETRY;
+	target->retry.data = target;
+	freeaddrinfo(result);
+	_linkTargets.push_back(target);
+}
+
+// Takes local servers' rings, and connects to every `--link` target (once the server is serving).
+void	Server::openLinks()
+{
+	if (LINK_LOCAL)
+		listenLocalLinks();
+	for (size_t i = 0; i < _linkTargets.size(); ++i)
+		connectLink(_linkTargets[i]);
+}
+
+/**
+Opens a non-blocking connection to a `--link` target; the handshake is sent
+once connect() completes (see `handleLinks()`). On failure, the next attempt
+is scheduled `LINK_RETRY` seconds later.
+*/
+void	Server::connectLink(LinkTarget* target)
+{
+	if (target->link || connectLocalLink(target))
+		return;
+
+	int	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1 || fd >= FD_SETSIZE || fcntl(fd, F_SETFL, O_NONBLOCK) == -1
+		|| (connect(fd, reinterpret_cast<sockaddr*>(&target->addr), sizeof(target->addr)) == -1
+			&& errno != EINPROGRESS))
+	{
+		std::string	error = fd >= FD_SETSIZE ? "too many open connections" : strerror(errno);
+		if (fd != -1)
+			close(fd);
+		logServerMessage(YELLOW + toString("Link: cannot connect to ") + target->address + ": " + error
+			+ ", retrying in " + toString(LINK_RETRY) + " s" + RESET);
+		_timers.schedule(&target->retry, LINK_RETRY * 1000UL);
+		return;
+	}
+
+	ServerLink*	link = new ServerLink(fd, target->address, target, NULL);
+	target->link = link;
+	_links[fd] = link;
+	link->keepalive.type = TIMER_LINK_KEEPALIVE;
+	link->keepalive.data = link;
+	_timers.schedule(&link->keepalive, REGISTRATION_TIMEOUT * 1000UL);
+	logServerMessage(toString("Link: connecting to ") + YELLOW + target->address + RESET);
+}
+
+/////////////////
+// Local links //
+/////////////////
+
+#ifdef LINUX_OS
+// Fills in the abstract Unix socket address (no file to clean up) where the server on `port` takes rings.
+static socklen_t	localLinkAddress(int port, struct sockaddr_un& addr)
+{
+	std::string	name = LINK_LOCAL_SOCKET + toString(port);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path + 1, name.c_str(), name.size()); // sun_path[0] stays '\0'
+	return offsetof(struct sockaddr_un, sun_path) + 1 + name.size();
+}
+
+/**
+Starts taking links from servers on this host (`LINK_LOCAL_SOCKET` plus the
+client port). Without it, they link over TCP as usual.
+*/
+void	Server::listenLocalLinks()
+{
+	struct sockaddr_un	addr;
+	socklen_t			len = localLinkAddress(getPort(), addr);
+
+	if (_localLinkFd != -1)
+		return;
+	_localLinkFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (_localLinkFd == -1 || _localLinkFd >= FD_SETSIZE
+		|| bind(_localLinkFd, reinterpret_cast<struct sockaddr*>(&addr), len) == -1 || listen(_localLinkFd, 8) == -1)
+	{
+		logServerMessage(YELLOW + toString("WARNING: Local links over TCP only (") + strerror(errno) + ")" + RESET);
+		if (_localLinkFd != -1)
+			close(_localLinkFd);
+		_localLinkFd = -1;
+	}
+}
+
+/**
+Links to a `--link` target on this host through shared memory: creates the
+rings, hands them to the target over its local link socket, and sends the
+handshake through them. The socket is kept only to notice when the peer is
+gone.
+
+ @return	`false` if the target is not on the loopback address or does not
+			take local links (an older binary, `LINK_LOCAL` off): TCP then.
+*/
+bool	Server::connectLocalLink(LinkTarget* target)
+{
+	if (!LINK_LOCAL || (ntohl(target->addr.sin_addr.s_addr) >> 24) != 127)
+		return false;
+
+	struct sockaddr_un	addr;
+	socklen_t			len = localLinkAddress(ntohs(target->addr.sin_port), addr);
+	std::string			error;
+	int					fds[3];
+
+	int	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1 || fd >= FD_SETSIZE || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), len) == -1)
+	{
+		if (fd != -1)
+			close(fd);
+		return false;
+	}
+	LinkRing*	ring = LinkRing::create(error);
+	if (ring)
+		ring->getPeerFds(fds);
+	if (!ring || !sendFds(fd, fds, 3))
+	{
+		logServerMessage(YELLOW + toString("Link: no shared memory for ") + target->address + ": "
+			+ (ring ? std::string(strerror(errno)) : error) + ", using TCP" + RESET);
+		delete ring;
+		close(fd);
+		return false;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	ServerLink*	link = new ServerLink(fd, target->address, target, ring);
+	target->link = link;
+	_links[fd] = link;
+	link->keepalive.type = TIMER_LINK_KEEPALIVE;
+	link->keepalive.data = link;
+	_timers.schedule(&link->keepalive, REGISTRATION_TIMEOUT * 1000UL);
+	link->setLastActivity(_nowMs);
+	sendHandshake(link);
+	logServerMessage(toString("Link: connecting to ") + YELLOW + target->address + RESET + " (shared memory, "
+		+ toString(ring->getSize() / 1024) + " KiB rings)");
+	return true;
+}
+
+/**
+Accepts a connection on the local link socket. The socket is abstract (no
+file permissions), so only processes of this server's own user are taken
+(`SO_PEERCRED`); the rings they send are received once the socket is
+readable (`receiveLocalLink()`), never waited for here.
+*/
+void	Server::acceptLocalLink()
+{
+	struct ucred	cred;
+	socklen_t		len = sizeof(cred);
+
+	int	fd = accept4(_localLinkFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd == -1)
+		return;
+	if (fd >= FD_SETSIZE || _localLinkPending.size() >= MAX_PENDING_LOCAL_LINKS
+		|| getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 || cred.uid != geteuid())
+	{
+		close(fd);
+		logServerMessage(YELLOW + toString("Link: local link refused (")
+			+ (fd >= FD_SETSIZE || _localLinkPending.size() >= MAX_PENDING_LOCAL_LINKS ? "too many connections"
+				: "not the server's user") + ")" + RESET);
+		return;
+	}
+	_localLinkPending[fd] = _nowMs;
+}
+
+/**
+Takes the rings a local server hands over (see `connectLocalLink()`). The
+link then waits for its `PASS` and `SERVER` like an outgoing one, and answers
+with this server's own once they check out.
+*/
+void	Server::receiveLocalLink(int fd)
+{
+	std::vector<int>	fds;
+	std::string			error;
+
+	if (!receiveFds(fd, fds, 3) && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	_localLinkPending.erase(fd);
+	if (fds.size() != 3)
+	{
+		for (size_t i = 0; i < fds.size(); ++i)
+			close(fds[i]);
+		close(fd);
+		logServerMessage(YELLOW + toString("Link: local link refused (no rings received)") + RESET);
+		return;
+	}
+
+	LinkRing*	ring = LinkRing::attach(&fds[0], error);
+	if (!ring)
+	{
+		close(fd);
+		logServerMessage(YELLOW + toString("Link: local link refused (") + error + ")" + RESET);
+		return;
+	}
+
+	ServerLink*	link = new ServerLink(fd, "local", NULL, ring);
+	_links[fd] = link;
+	link->keepalive.type = TIMER_LINK_KEEPALIVE;
+	link->keepalive.data = link;
+	_timers.schedule(&link->keepalive, REGISTRATION_TIMEOUT * 1000UL);
+	link->setLastActivity(_nowMs);
+}
+#else
+// Local links need memfds, eventfds, abstract sockets and SO_PEERCRED (Linux): TCP elsewhere.
+void	Server::listenLocalLinks()
+{}
+
+bool	Server::connectLocalLink(LinkTarget*)
+{
+	return false;
+}
+
+void	Server::acceptLocalLink()
+{}
+
+void	Server::receiveLocalLink(int)
+{}
+#endif
+
+/**
+Turns an unregistered connection that sent `SERVER` (after a valid `PASS`)
+into a server link: the connection leaves the pending table without being
+closed, answers with its own `PASS` and `SERVER`, and registers the peer.
+*/
+void	Server::acceptServerLink(PendingUser* pending, const std::string& name, const std::string& info)
+{
+	int			fd = pending->getFd();
+	ServerLink*	link = new ServerLink(fd, pending->getHost(), NULL, NULL);
+
+	link->appendInput(pending->getInputBuffer()); // The peer may have sent more already
+	pending->logAction(toString("is a server: ") + YELLOW + name + RESET);
+	releasePendingUser(pending);
+	fcntl(fd, F_SETFL, O_NONBLOCK); // Client sockets block (select() says when); a link reads and writes until EAGAIN
+
+	_links[fd] = link;
+	link->keepalive.type = TIMER_LINK_KEEPALIVE;
+	link->keepalive.data = link;
+	_timers.schedule(&link->keepalive, REGISTRATION_TIMEOUT * 1000UL);
+	sendHandshake(link);
+	registerServerLink(link, name, info);
+}
+
+// Introduces this server to a peer: `PASS` (if a password is set) and `SERVER`.
+void	Server::sendHandshake(ServerLink* link)
+{
+	if (!_password.empty())
+		link->send("PASS :" + _password);
+	link->send("SERVER " + _name + " 1 :" + _network + " (" + _version + ")");
+}
+
+/**
+The peer of `link` has introduced itself as `name`: unless a server of that
+name is already part of the network (which would close a loop), the link
+becomes active, the rest of the network learns about the new server, and the
+peer gets the burst (see `sendBurst()`).
+
+ @return	`false` if the link was refused (and closed).
+*/
+bool	Server::registerServerLink(ServerLink* link, const std::string& name, const std::string& info)
+{
+	if (!isValidServerName(name))
+	{
+		closeLink(link, "Invalid server name: " + name);
+		return false;
+	}
+	if (isServerNameInUse(name))
+	{
+		closeLink(link, "Server " + name + " already exists");
+		return false;
+	}
+
+	link->setPeer(name, info);
+	link->setState(ServerLink::LINK_ACTIVE);
+	link->setLastActivity(_nowMs);
+	_timers.schedule(&link->keepalive, PING_INTERVAL * 1000UL);
+	addRemoteServer(link, name, _name, 1, info);
+	propagate(":" + _name + " SERVER " + name + " 2 :" + info, link);
+	logServerMessage(toString("Link: ") + BOT_COLOR + name + RESET + " linked (" + YELLOW
+		+ link->getAddress() + RESET + ")");
+	sendBurst(link);
+	return true;
+}
+
+/**
+Closes a server link and forgets everything behind it: its servers leave the
+network (the rest of it is told with a `SQUIT`), and their users quit the
+channels here with the usual netsplit reason ("<our name> <their name>").
+An outgoing link is retried `LINK_RETRY` seconds later.
+*/
+void	Server::closeLink(ServerLink* link, const std::string& reason)
+{
+	int	fd = link->getFd();
+
+	if (link->getState() == ServerLink::LINK_ACTIVE)
+	{
+		std::set<std::string>	lost;
+		for (std::map<std::string, RemoteServer>::iterator it = _remoteServers.begin(); it != _remoteServers.end(); ++it)
+		{
+			if (it->second.link == link)
+				lost.insert(it->first);
+		}
+		propagate("SQUIT " + link->getName() + " :" + reason, link);
+		dropServers(lost, link, _name + " " + link->getName());
+	}
+
+	std::string	error;
+	link->send("ERROR :Closing link: " + reason);
+	link->flush(error); // Best effort: the socket is closed right after
+	_timers.cancel(&link->keepalive);
+	_links.erase(fd);
+	logServerMessage(YELLOW + toString("Link: ") + link->getName() + " (" + link->getAddress() + ") closed: "
+		+ reason + RESET);
+
+	LinkTarget*	target = link->getTarget();
+	if (target)
+	{
+		target->link = NULL;
+		_timers.schedule(&target->retry, LINK_RETRY * 1000UL);
+	}
+	delete link;
+}
+
+/**
+Closes every server link (shutdown, hot upgrade) and stops taking local ones;
+the retries stay off until the loop runs again.
+*/
+void	Server::closeAllLinks(const std::string& reason)
+{
+	while (!_links.empty())
+		closeLink(_links.begin()->second, reason);
+	for (size_t i = 0; i < _linkTargets.size(); ++i)
+		_timers.cancel(&_linkTargets[i]->retry);
+	if (_localLinkFd != -1)
+		close(_localLinkFd);
+	_localLinkFd = -1;
+	for (std::map<int, unsigned long>::iterator it = _localLinkPending.begin(); it != _localLinkPending.end(); ++it)
+		close(it->first);
+	_localLinkPending.clear();
+}
+
+/////////////////
+// Propagation //
+/////////////////
+
+// Sends a line to every active link but `except` (the one it came from).
+void	Server::propagate(const std::string& line, ServerLink* except)
+{
+	for (std::map<int, ServerLink*>::iterator it = _links.begin(); it != _links.end(); ++it)
+	{
+		if (it->second != except && it->second->getState() == ServerLink::LINK_ACTIVE)
+			it->second->send(line);
+	}
+}
+
+/**
+Sends a channel message to the links with members of `channel` behind them,
+once per link (but not back to `except`): links without members never see
+the channel's traffic.
+*/
+void	Server::propagateToChannel(Channel* channel, const std::string& line, ServerLink* except)
+{
+	const std::map<ServerLink*, int>&	links = channel->get_links();
+
+	for (std::map<ServerLink*, int>::const_iterator it = links.begin(); it != links.end(); ++it)
+	{
+		if (it->first != except)
+			it->first->send(line);
+	}
+}
+
+// Announces a channel created here to the network, as in a burst.
+void	Server::propagateChannel(Channel* channel)
+{
+	std::vector<std::string>	lines;
+
+	buildChannelBurst(channel, lines);
+	for (size_t i = 0; i < lines.size(); ++i)
+		propagate(lines[i]);
+}
+
+/**
+Formats the `NICK` line introducing a user to the network (RFC 2813, 4.1.3):
+	NICK <nickname> <hopcount> <username> <host> <server> <umode> :<realname>
+*/
+std::string	Server::buildNickIntro(const User* user) const
+{
+	const RemoteServer*	home = user->getLink() ? getRemoteServer(user->getServerName()) : NULL;
+
+	return "NICK " + user->getNickname() + " " + toString(home ? home->hops + 1 : 1) + " "
+		+ user->getUsername() + " " + user->getHost() + " " + user->getServerName() + " + :"
+		+ user->getRealname();
+}
+
+/**
+Sends a freshly linked peer everything it needs to know (RFC 2813, 5.1):
+ 1. the other servers, nearest first (an uplink is always known before its servers),
+ 2. every user but the bot, which stays local to each server,
+ 3. every channel: members and operators (`NJOIN`), modes, and topic.
+*/
+void	Server::sendBurst(ServerLink* link)
+{
+	int		maxHops = 0;
+	size_t	lines = link->getStats().linesOut;
+
+	for (std::map<std::string, RemoteServer>::iterator it = _remoteServers.begin(); it != _remoteServers.end(); ++it)
+	{
+		if (it->second.hops > maxHops)
+			maxHops = it->second.hops;
+	}
+	for (int hops = 1; hops <= maxHops; ++hops)
+	{
+		for (std::map<std::string, RemoteServer>::iterator it = _remoteServers.begin(); it != _remoteServers.end(); ++it)
+		{
+			const RemoteServer&	remote = it->second;
+			if (remote.hops == hops && remote.link != link)
+				link->send(":" + remote.uplink + " SERVER " + remote.name + " " + toString(hops + 1)
+					+ " :" + remote.info);
+		}
+	}
+
+	for (std::map<std::string, User*>::iterator it = _usersNick.begin(); it != _usersNick.end(); ++it)
+	{
+		User*	user = it->second;
+		if (!user->getIsBot() && user->getLink() != link)
+			link->send(buildNickIntro(user));
+	}
+
+	std::vector<std::string>	channelLines;
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+		buildChannelBurst(it->second, channelLines);
+	for (size_t i = 0; i < channelLines.size(); ++i)
+		link->send(channelLines[i]);
+
+	logServerMessage(toString("Link: burst to ") + BOT_COLOR + link->getName() + RESET + ": "
+		+ YELLOW + toString(link->getStats().linesOut - lines) + RESET + " lines");
+}
+
+/**
+Appends the lines describing a channel to the network to `lines`:
+	NJOIN <channel> :[@]<nickname>,...	(split to stay within an IRC line)
+	:<server> MODE <channel> +<modes> [<limit>] [<key>]
+	:<server> MODE <channel> +bbb <mask> <mask> <mask>	(and `e`, `I`; as many per line as fit)
+	:<server> TOPIC <channel> <set at> <set by> :<topic>
+A channel with nobody in it but the bot is left out.
+*/
+void	Server::buildChannelBurst(Channel* channel, std::vector<std::string>& lines) const
+{
+	const std::string&					name = channel->get_name();
+	const std::map<std::string, User*>&	members = channel->get_members();
+	std::string							prefix = "NJOIN " + name + " :";
+	std::string							line;
+
+	for (std::map<std::string, User*>::const_iterator it = members.begin(); it != members.end(); ++it)
+	{
+		User*	member = it->second;
+		if (!member || member->getIsBot())
+			continue;
+
+		std::string	entry = (channel->is_user_operator(member) ? "@" : "") + member->getNickname();
+		if (!line.empty() && line.size() + 1 + entry.size() > MAX_BUFFER_SIZE - 2)
+		{
+			lines.push_back(line);
+			line.clear();
+		}
+		line += (line.empty() ? prefix : ",") + entry;
+	}
+	if (line.empty())
+		return;
+	lines.push_back(line);
+
+	std::string	modes;
+	std::string	params;
+	if (channel->is_invite_only())
+		modes += "i";
+	if (channel->has_topic_protection())
+		modes += "t";
+	if (channel->has_user_limit())
+	{
+		modes += "l";
+		params += " " + toString(channel->get_user_limit());
+	}
+	if (channel->has_password())
+	{
+		modes += "k";
+		params += " " + channel->get_password();
+	}
+	if (!modes.empty())
+		lines.push_back(":" + _name + " MODE " + name + " +" + modes + params);
+
+	const char*	listModes = "beI";
+	for (int list = 0; list < Channel::MASK_LISTS; ++list)
+	{
+		const std::vector<MaskEntry>&	entries = channel->get_masks(static_cast<Channel::MaskList>(list));
+		std::string						modePrefix = ":" + _name + " MODE " + name + " +";
+		modes.clear();
+		params.clear();
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (!modes.empty() && modePrefix.size() + modes.size() + params.size() + 2 + entries[i].mask.size()
+					> MAX_BUFFER_SIZE - 2)
+			{
+				lines.push_back(modePrefix + modes + params);
+				modes.clear();
+				params.clear();
+			}
+			modes += listModes[list];
+			params += " " + entries[i].mask;
+		}
+		if (!modes.empty())
+			lines.push_back(modePrefix + modes + params);
+	}
+
+	if (!channel->get_topic().empty())
+	{
+		ChannelState	state;
+		channel->save_state(state);
+		lines.push_back(":" + _name + " TOPIC " + name + " " + toString(state.topicSetAt) + " "
+			+ (state.topicSetBy.empty() ? _name : state.topicSetBy) + " :" + state.topic);
+	}
+}
+
+//////////////////////////////
+// Remote Users and Servers //
+//////////////////////////////
+
+// Adds a user of another server, reached through `link`.
+User*	Server::addRemoteUser(ServerLink* link, const std::string& serverName, const std::string& nickname,
+	const std::string& username, const std::string& host, const std::string& realname)
+{
+	User*	user = new User(this, link, serverName, nickname, username, host, realname);
+
+	_usersNick[normalize(nickname)] = user;
+	++_remoteUserCount;
+	if (_usersNick.size() > _peakGlobalUsers)
+		_peakGlobalUsers = _usersNick.size();
+	return user;
+}
+
+// Removes a user of another server (QUIT, KILL, netsplit); their channels here see them quit.
+void	Server::removeRemoteUser(User* user, const std::string& reason)
+{
+	quitChannels(user, reason);
+	_usersNick.erase(user->getNicknameLower());
+	--_remoteUserCount;
+	delete user;
+}
+
+/**
+Removes a user from the network on another server's word (`KILL`, nickname
+collision). Nothing is propagated from here: the `KILL` travels on its own.
+A local user is told why and disconnected.
+*/
+void	Server::killUser(User* user, const std::string& reason)
+{
+	if (user->getLink())
+	{
+		removeRemoteUser(user, reason);
+		return;
+	}
+	if (user->getIsBot())
+		return;
+
+	int	fd = user->getFd();
+	user->getOutputBuffer() += "ERROR :Closing Link: " + user->getHost() + " (" + reason + ")\r\n";
+	if (!isIoAttached(user)) // Otherwise its I/O thread sends it when `deleteUser()` lets the socket go
+		sendOutputBuffer(fd, user->getOutputBuffer());
+	quitChannels(user, reason);
+	deleteUser(fd, toString("killed: ") + YELLOW + reason + RESET);
+}
+
+// Adds a server of the network, `hops` away, reached through `link`.
+void	Server::addRemoteServer(ServerLink* link, const std::string& name, const std::string& uplink,
+	int hops, const std::string& info)
+{
+	RemoteServer&	remote = _remoteServers[normalize(name)];
+
+	remote.name = name;
+	remote.uplink = uplink;
+	remote.info = info;
+	remote.hops = hops;
+	remote.link = link;
+}
+
+/**
+Removes a server that left the network (`SQUIT`), along with the servers
+linked behind it and all their users.
+*/
+void	Server::removeRemoteServer(const std::string& name, const std::string& reason)
+{
+	const RemoteServer*	remote = getRemoteServer(name);
+	if (!remote)
+		return;
+
+	std::set<std::string>	lost;
+	bool					grew = true;
+	std::string				quitReason = remote->uplink + " " + remote->name;
+
+	lost.insert(normalize(name));
+	while (grew)
+	{
+		grew = false;
+		for (std::map<std::string, RemoteServer>::iterator it = _remoteServers.begin(); it != _remoteServers.end(); ++it)
+		{
+			if (!lost.count(it->first) && lost.count(normalize(it->second.uplink)))
+			{
+				lost.insert(it->first);
+				grew = true;
+			}
+		}
+	}
+	logServerMessage(YELLOW + toString("Link: ") + name + " left the network: " + reason + RESET);
+	dropServers(lost, NULL, quitReason);
+}
+
+// Forgets the `lost` servers and the users on them (or behind `link`, if given).
+void	Server::dropServers(const std::set<std::string>& lost, ServerLink* link, const std::string& quitReason)
+{
+	std::vector<User*>	users;
+
+	for (std::map<std::string, User*>::iterator it = _usersNick.begin(); it != _usersNick.end(); ++it)
+	{
+		User*	user = it->second;
+		if (user->getLink() && ((link && user->getLink() == link) || lost.count(normalize(user->getServerName()))))
+			users.push_back(user);
+	}
+	for (size_t i = 0; i < users.size(); ++i)
+		removeRemoteUser(users[i], quitReason);
+	for (std::set<std::string>::const_iterator it = lost.begin(); it != lost.end(); ++it)
+		_remoteServers.erase(*it);
+	if (!users.empty())
+		logServerMessage(toString("Link: netsplit (") + quitReason + "): " + YELLOW + toString(users.size())
+			+ RESET + " users and " + toString(lost.size()) + " servers lost");
+}
+
+// Returns the server of the network called `name` (not this one), or `NULL`.
+const RemoteServer*	Server::getRemoteServer(const std::string& name) const
+{
+	std::map<std::string, RemoteServer>::const_iterator	it = _remoteServers.find(normalize(name));
+
+	return it != _remoteServers.end() ? &it->second : NULL;
+}
+
+// True if `name` is this server's name or that of another server of the network.
+bool	Server::isServerNameInUse(const std::string& name) const
+{
+	return IrcChars::equal(name, _name) || _remoteServers.count(normalize(name));
+}
+
+/////////////////
+// Link Events //
+/////////////////
+
+// Returns the link on `fd`, or `NULL`.
+ServerLink*	Server::getLink(int fd) const
+{
+	std::map<int, ServerLink*>::const_iterator	it = _links.find(fd);
+
+	return it != _links.end() ? it->second : NULL;
+}
+
+/**
+Adds the links to the select() sets: writable once connected (or with output
+queued), readable otherwise. A local link waits on its `eventfd` for both
+(its socket only becomes readable when the peer is gone); what was queued for
+it since it was handled is moved into its ring here, so it leaves before
+`select()` sleeps (if the ring is full, the peer wakes this side once it has
+made room).
+*/
+int	Server::prepareLinkSets(fd_set& readFds, fd_set& writeFds)
+{
+	int	maxFd = _localLinkFd;
+
+	if (_localLinkFd != -1)
+		FD_SET(_localLinkFd, &readFds);
+	for (std::map<int, unsigned long>::iterator it = _localLinkPending.begin(); it != _localLinkPending.end(); ++it)
+	{
+		FD_SET(it->first, &readFds);
+		if (it->first > maxFd)
+			maxFd = it->first;
+	}
+	for (std::map<int, ServerLink*>::iterator it = _links.begin(); it != _links.end(); ++it)
+	{
+		ServerLink*	link = it->second;
+		int			wakeFd = link->getWakeFd();
+		std::string	error;
+
+		if (wakeFd != -1 && link->getSendQ() > 0)
+			link->flush(error); // A ring takes what fits; corrupt indices fail again in `handleLinks()`
+		if (link->getState() != ServerLink::LINK_CONNECTING)
+			FD_SET(it->first, &readFds);
+		if (link->getState() == ServerLink::LINK_CONNECTING || (link->getSendQ() > 0 && wakeFd == -1))
+			FD_SET(it->first, &writeFds);
+		if (wakeFd != -1)
+			FD_SET(wakeFd, &readFds);
+		if (it->first > maxFd)
+			maxFd = it->first;
+		if (wakeFd > maxFd)
+			maxFd = wakeFd;
+	}
+	return maxFd;
+}
+
+/**
+Moves the links along: completes connects (and sends the handshake), reads
+and processes what peers sent, writes what is queued for them, and takes new
+local links (their rings once sent; a socket that sent none within
+`REGISTRATION_TIMEOUT` seconds is closed). A link whose peer does not read fast enough (`LINK_SENDQ`
+queued) is closed.
+*/
+void	Server::handleLinks(fd_set& readFds, fd_set& writeFds)
+{
+	std::vector<int>	fds;
+	std::string			error;
+
+	for (std::map<int, ServerLink*>::iterator it = _links.begin(); it != _links.end(); ++it)
+		fds.push_back(it->first);
+
+	for (size_t i = 0; i < fds.size(); ++i)
+	{
+		int			fd = fds[i];
+		ServerLink*	link = getLink(fd);
+		if (!link)
+			continue; // Closed while handling another link (netsplit)
+		int			wakeFd = link->getWakeFd();
+		bool		hangup = wakeFd != -1 && FD_ISSET(fd, &readFds); // A local link's socket only carries the close
+
+		if (link->getState() == ServerLink::LINK_CONNECTING)
+		{
+			if (!FD_ISSET(fd, &writeFds))
+				continue;
+			if (!link->finishConnect(error))
+			{
+				closeLink(link, error);
+				continue;
+			}
+			link->setLastActivity(_nowMs);
+			sendHandshake(link);
+		}
+		else if (FD_ISSET(fd, &readFds) || (wakeFd != -1 && FD_ISSET(wakeFd, &readFds)))
+		{
+			if (!link->receive(error))
+			{
+				closeLink(link, error);
+				continue;
+			}
+			link->setLastActivity(_nowMs);
+			processLinkInput(link);
+			if (getLink(fd) != link)
+				continue;
+			if (hangup) // After the peer's last lines (its ERROR)
+			{
+				closeLink(link, "Connection closed");
+				continue;
+			}
+		}
+
+		if (!link->flush(error))
+			closeLink(link, error);
+		else if (link->getSendQ() > LINK_SENDQ)
+			closeLink(link, "SendQ exceeded");
+	}
+	fds.clear();
+	for (std::map<int, unsigned long>::iterator it = _localLinkPending.begin(); it != _localLinkPending.end(); ++it)
+		fds.push_back(it->first);
+	for (size_t i = 0; i < fds.size(); ++i)
+	{
+		if (FD_ISSET(fds[i], &readFds))
+			receiveLocalLink(fds[i]);
+		else if (_nowMs - _localLinkPending[fds[i]] >= REGISTRATION_TIMEOUT * 1000UL)
+		{
+			close(fds[i]);
+			_localLinkPending.erase(fds[i]);
+			logServerMessage(YELLOW + toString("Link: local link refused (no rings received)") + RESET);
+		}
+	}
+	if (_localLinkFd != -1 && FD_ISSET(_localLinkFd, &readFds))
+		acceptLocalLink(); // Last: its socket was not part of this select()
+}
+
+/**
+Processes the complete lines a peer sent, one at a time; stops if a line
+closed the link. A peer that sends an unterminated line longer than
+`LINK_SENDQ` is dropped.
+*/
+void	Server::processLinkInput(ServerLink* link)
+{
+	int			fd = link->getFd();
+	std::string	line;
+
+	while (link->popLine(line))
+	{
+		if (LOG_RAW_CMDS)
+			logServerMessage(BOT_COLOR + link->getName() + RESET + " >> " + line);
+		Command::handleServerMessage(this, link, line);
+		if (getLink(fd) != link)
+			return;
+	}
+	if (link->getRecvQ() > LINK_SENDQ)
+		closeLink(link, "Input line too long");
+}
+
+/**
+Handles an expired link keepalive timer, like `handleKeepalive()` for users:
+ - The handshake is not complete: the peer took too long, drop it.
+ - A PING is outstanding and nothing was received since: the link is dead.
+ - The peer was active within `PING_INTERVAL`: re-arm for the remaining idle time.
+ - Otherwise: send a PING and give the peer `PING_TIMEOUT` seconds to answer.
+*/
+void	Server::handleLinkKeepalive(ServerLink* link)
+{
+	if (link->getState() != ServerLink::LINK_ACTIVE)
+	{
+		closeLink(link, "Handshake timed out");
+		return;
+	}
+
+	unsigned long	lastActivity = link->getLastActivity();
+	if (link->getPingSentAt() != 0)
+	{
+		if (lastActivity < link->getPingSentAt())
+		{
+			closeLink(link, "Ping timeout: " + toString((_nowMs - link->getPingSentAt()) / 1000) + " seconds");
+			return;
+		}
+		link->setPingSentAt(0);
+	}
+
+	unsigned long	idleMs = _nowMs - lastActivity;
+	if (idleMs < PING_INTERVAL * 1000UL)
+	{
+		_timers.schedule(&link->keepalive, PING_INTERVAL * 1000UL - idleMs);
+		return;
+	}
+	link->send("PING :" + _name);
+	link->setPingSentAt(_nowMs);
+	_timers.schedule(&link->keepalive, PING_TIMEOUT * 1000UL);
+}
+
+/////////////
+// Getters //
+/////////////
+
+// Returns the links to neighbouring servers, by fd (STATS l).
+const std::map<int, ServerLink*>&	Server::getLinks() const
+{
+	return _links;
+}
+
+// Returns the number of servers in the network, this one included (LUSERS).
+size_t	Server::getServerCount() const
+{
+	return _remoteServers.size() + 1;
+}
+
+// Returns the number of users on other servers (LUSERS).
+size_t	Server::getRemoteUserCount() const
+{
+	return _remoteUserCount;
+}
@@ -0,0 +1,302 @@
+#include <string>
+#include <cstring>		// strerror()
+#include <cerrno>		// errno
+#include <map>
+#include <vector>
+#include <new>			// std::bad_alloc
+
+#include <unistd.h>		// close()
+#include <sys/select.h>	// FD_* macros
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
+#include "../include/Command.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/defines.hpp"
+#include "../include/utils.hpp"	// toString(), normalize()
+
+////////////////////////////////////
+// Accepting Unregistered Clients //
+////////////////////////////////////
+
+/**
+Registers a freshly accepted (and admitted) connection as a `PendingUser`.
+
+Records are taken from `_pendingPool` when possible, so in steady state
+accepting and dropping unregistered connections does not allocate.
+
+ @param fd		The accepted socket.
+ @param addr	The peer's IPv4 address (network byte order).
+ @return		`true` if the connection was added, `false` if it was closed.
+*/
+bool	Server::acceptPendingUser(int fd, uint32_t addr)
+{
+	PendingUser*	pending;
+
+	if (fd >= static_cast<int>(_pendingFd.size())) // select() cannot watch this fd
+	{
+		close(fd);
+		logServerMessage(RED + toString("ERROR: fd ") + toString(fd)
+			+ " exceeds FD_SETSIZE. Connection closed" + RESET);
+		return false;
+	}
+
+	if (_pendingPool.empty())
+	{
+		try
+		{
+			pending = new PendingUser(); // 'new' throws std::bad_alloc on failure
+		}
+		catch (const std::bad_alloc&)
+		{
+			close(fd);
+			logServerMessage(RED + toString("ERROR: Failed to allocate memory for new user. Connection closed")
+				+ RESET);
+			return false; // Keep server running
+		}
+	}
+	else
+	{
+		pending = _pendingPool.back();
+		_pendingPool.pop_back();
+	}
+
+	pending->reset(this, fd, addr);
+	_pendingFd[fd] = pending;
+	++_pendingCount;
+
+	pending->logAction(toString("connected from ") + YELLOW + pending->getHost() + RESET);
+	trackUnregistered(pending);	// Registration deadline + per-host accounting
+
+	// Set as "password-passed" when server requires no password
+	if (_password.empty())
+		pending->setHasPassed(true);
+	return true;
+}
+
+// Returns the unregistered connection on `fd`, or `NULL` if there is none.
+PendingUser*	Server::getPendingUser(int fd) const
+{
+	if (fd < 0 || fd >= static_cast<int>(_pendingFd.size()))
+		return NULL;
+	return _pendingFd[fd];
+}
+
+///////////////////////////
+// Nicknames & Promotion //
+///////////////////////////
+
+/**
+Checks whether a nickname is taken, either by a registered user
+or by a connection that is still registering.
+
+ @param normNick	The normalized nickname.
+*/
+bool	Server::isNickInUse(const std::string& normNick) const
+{
+	return _usersNick.count(normNick) > 0 || _pendingNicks.count(normNick) > 0;
+}
+
+/**
+Reserves a nickname for an unregistered connection, releasing the one it held before.
+The caller must have checked `isNickInUse()`.
+*/
+void	Server::reservePendingNick(PendingUser* pending, const std::string& normNick)
+{
+	if (pending->hasNick())
+		_pendingNicks.erase(normalize(pending->getNickname()));
+	_pendingNicks[normNick] = pending->getFd();
+}
+
+/**
+Turns a connection that has sent PASS, NICK and USER into a full `User`.
+
+The user takes over the pending record's identity and buffers, the record
+goes back to the pool, and `User::tryRegister()` sends the welcome burst.
+
+ @param pending	The completed unregistered connection.
+ @return		The new user, or `NULL` if allocation failed (connection closed).
+*/
+User*	Server::promotePendingUser(PendingUser* pending)
+{
+	int		fd = pending->getFd();
+	User*	user;
+
+	try
+	{
+		user = new User(fd, this, *pending); // 'new' throws std::bad_alloc on failure
+	}
+	catch (const std::bad_alloc&)
+	{
+		logServerMessage(RED + toString("ERROR: Failed to allocate memory for new user from ") + YELLOW
+			+ pending->getHost() + RESET + ". Connection closed");
+		closePendingUser(fd, toString("disconnected: ") + YELLOW + "out of memory" + RESET);
+		return NULL;
+	}
+
+	releasePendingUser(pending);
+	_usersFd[fd] = user;
+	_usersNick[normalize(user->getNickname())] = user;
+	user->tryRegister();
+	return user;
+}
+
+///////////////////////////////////
+// Removing Unregistered Clients //
+///////////////////////////////////
+
+/**
+Detaches a pending record from its connection (without closing the socket)
+and returns it to the pool.
+*/
+void	Server::releasePendingUser(PendingUser* pending)
+{
+	int	fd = pending->getFd();
+
+	untrackUnregistered(pending);
+	if (pending->hasNick())
+		_pendingNicks.erase(normalize(pending->getNickname()));
+
+	_pendingFd[fd] = NULL;
+	--_pendingCount;
+	pending->clear();
+	_pendingPool.push_back(pending); // Capacity reserved for MAX_UNREG_TOTAL records, never reallocates
+}
+
+// Closes an unregistered connection (quit, read/write error, reaped, server shutdown).
+void	Server::closePendingUser(int fd, const std::string& logMsg)
+{
+	PendingUser*	pending = getPendingUser(fd);
+	if (!pending)
+		return;
+
+	pending->logAction(logMsg);
+	close(fd);
+	releasePendingUser(pending);
+}
+
+/////////////////////////////////
+// Handling Unregistered Input //
+/////////////////////////////////
+
+/**
+Removes the next complete line (terminated by `\n`, optional `\r` stripped)
+from `buffer` and stores it in `line`.
+
+ @return	`false` if the buffer holds no complete line.
+*/
+static bool	popLine(std::string& buffer, std::string& line)
+{
+	size_t	newlinePos = buffer.find('\n');
+
+	if (newlinePos == std::string::npos)
+		return false;
+
+	line.assign(buffer, 0, newlinePos);
+	buffer.erase(0, newlinePos + 1);
+	if (!line.empty() && line[line.size() - 1] == '\r')
+		line.erase(line.size() - 1);
+	return true;
+}
+
+/**
+Handles input readiness for all unregistered connections,
+see `handleReadReadyUsers()`.
+*/
+void	Server::handleReadReadyPending(fd_set& readFds)
+{
+	for (int fd = 0; _pendingCount > 0 && fd < static_cast<int>(_pendingFd.size()); ++fd)
+	{
+		if (!_pendingFd[fd] || !FD_ISSET(fd, &readFds))
+			continue;
+
+		UserInputResult	result = handlePendingInput(fd);
+		if (result == INPUT_DISCONNECTED)
+			closePendingUser(fd, toString("disconnected: ") + YELLOW + "Connection closed" + RESET);
+		else if (result == INPUT_ERROR)
+			closePendingUser(fd, RED + toString("ERROR: recv() failed: ") + toString(strerror(errno)) + RESET);
+	}
+}
+
+/**
+Handles output readiness for all unregistered connections,
+see `handleWriteReadyUsers()`.
+*/
+void	Server::handleWriteReadyPending(fd_set& writeFds)
+{
+	for (int fd = 0; _pendingCount > 0 && fd < static_cast<int>(_pendingFd.size()); ++fd)
+	{
+		PendingUser*	pending = _pendingFd[fd];
+
+		if (pending && FD_ISSET(fd, &writeFds) && !pending->getOutputBuffer().empty()
+			&& !sendOutputBuffer(fd, pending->getOutputBuffer()))
+			closePendingUser(fd, RED + toString("ERROR: send() failed: ") + toString(strerror(errno)) + RESET);
+	}
+}
+
+// Reads from an unregistered connection and processes what it sent.
+Server::UserInputResult	Server::handlePendingInput(int fd)
+{
+	PendingUser*	pending = getPendingUser(fd);
+	UserInputResult	result = receiveInput(fd, pending->getInputBuffer());
+
+	if (result == INPUT_OK)
+		processPendingInput(pending);
+	return result;
+}
+
+/**
+Processes the buffered lines of an unregistered connection, one at a time.
+
+Lines are taken off the buffer one by one, so if the connection gets promoted
+mid-batch, the remaining input is still in the buffer the new `User` took over
+and is processed as regular user input (or as server traffic, for a link).
+An unterminated line longer than an IRC message closes the connection.
+*/
+void	Server::processPendingInput(PendingUser* pending)
+{
+	int			fd = pending->getFd();
+	std::string	msg;
+
+	while (popLine(pending->getInputBuffer(), msg))
+	{
+		// Check if line is too long (more than 510 + CRLF = 512); see RFC 1459, 2.3
+		if (msg.size() > MAX_BUFFER_SIZE - 2)
+		{
+			pending->logAction(toString("sent an overlong line (") + YELLOW
+				+ toString(msg.size()) + RESET + " > 512 bytes)");
+			reply<ERR_INPUTTOOLONG>(pending);
+			continue;
+		}
+		if (LOG_RAW_CMDS)
+			pending->logAction(BOLD + msg + RESET);
+
+		std::vector<std::string>	tokens = Command::tokenize(msg);
+		if (tokens.empty())
+			continue; // Skip empty/space-only lines
+		if (!Command::handlePendingCommand(this, pending, tokens))
+		{
+			pending->logAction(toString("sent unknown command: ") + RED + tokens[0] + RESET);
+			reply<ERR_UNKNOWNCOMMAND>(pending, tokens[0]);
+		}
+
+		if (getPendingUser(fd) != pending) // Promoted, linked as a server, or quit
+		{
+			User*		user = getUser(fd);
+			ServerLink*	link = getLink(fd);
+			if (user)
+				processUserInput(user); // Rest of the batch
+			else if (link)
+				processLinkInput(link);
+			return;
+		}
+	}
+
+	if (pending->getInputBuffer().size() > MAX_BUFFER_SIZE)
+	{
+		reapUser(fd, "Input line was too long");
+		return;
+	}
+	updatePartialLine(pending); // Slowloris protection
+}
@@ -0,0 +1,204 @@
+#include <string>
+#include <map>
+#include <cstring>		// strlen()
+#include <cstdio>		// snprintf()
+
+#include <unistd.h>		// close()
+#include <sys/socket.h>	// send(), MSG_* flags
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
+#include "../include/defines.hpp"	// REGISTRATION_TIMEOUT, PARTIAL_LINE_TIMEOUT, MAX_UNREG_*
+#include "../include/utils.hpp"		// toString()
+#include "../include/platform.hpp"	// MSG_NOSIGNAL
+
+//////////////////////////////
+// Unregistered Connections //
+//////////////////////////////
+
+/**
+Decides whether a freshly accepted connection may stay, based on how many
+unregistered connections its class (source IP) and the whole server already hold.
+
+Refused connections are closed right away, before any record is taken
+from the pool; this path does not allocate.
+
+ @param fd		The accepted socket.
+ @param addr	The peer's IPv4 address (connection class), network byte order.
+ @return		`true` if the connection is admitted, `false` if it was closed.
+*/
+bool	Server::admitUnregistered(int fd, uint32_t addr)
+{
+	const char*	reason = NULL;
+
+	if (_unregCount >= MAX_UNREG_TOTAL)
+	{
+		++_reapStats.rejectedTotal;
+		reason = "ERROR :Closing Link: Too many unregistered connections\r\n";
+	}
+	else
+	{
+		std::map<uint32_t, int>::const_iterator	it = _unregPerHost.find(addr);
+		if (it != _unregPerHost.end() && it->second >= MAX_UNREG_PER_HOST)
+		{
+			++_reapStats.rejectedPerHost;
+			reason = "ERROR :Closing Link: Too many unregistered connections from your host\r\n";
+		}
+	}
+
+	if (!reason)
+		return true;
+
+	send(fd, reason, strlen(reason), MSG_DONTWAIT | MSG_NOSIGNAL); // best effort
+	close(fd);
+	return false;
+}
+
+/**
+Starts tracking a newly accepted (unregistered) connection: counts it against
+its connection class and arms the registration deadline.
+*/
+void	Server::trackUnregistered(PendingUser* pending)
+{
+	TimerWheel::Timer&	timer = pending->getDeadlineTimer();
+
+	++_unregPerHost[pending->getAddr()];
+	++_unregCount;
+
+	pending->setConnectedAt(_nowMs);
+	timer.type = TIMER_REGISTRATION;
+	timer.fd = pending->getFd();
+	_timers.schedule(&timer, REGISTRATION_TIMEOUT * 1000UL);
+}
+
+// Stops tracking an unregistered connection (promoted or about to be closed).
+// `connectedAt == 0` marks records the reaper no longer tracks.
+void	Server::untrackUnregistered(PendingUser* pending)
+{
+	if (pending->getConnectedAt() == 0)
+		return; // Not tracked
+
+	_timers.cancel(&pending->getDeadlineTimer());
+	pending->setConnectedAt(0);
+
+	std::map<uint32_t, int>::iterator	it = _unregPerHost.find(pending->getAddr());
+	if (it != _unregPerHost.end() && --it->second <= 0)
+		_unregPerHost.erase(it);
+	--_unregCount;
+}
+
+/**
+Called by `User::tryRegister()` once a user is registered:
+the keepalive takes over from the registration deadline, the peak user
+count (`LUSERS`) is updated, the user is replicated to the standby and
+introduced to the other servers of the network.
+*/
+void	Server::finishRegistration(User* user)
+{
+	if (_usersNick.size() - _remoteUserCount > _peakUsers)
+		_peakUsers = _usersNick.size() - _remoteUserCount;
+	if (_usersNick.size() > _peakGlobalUsers)
+		_peakGlobalUsers = _usersNick.size();
+	if (!user->getIsBot())
+	{
+		armKeepalive(user);
+		propagate(buildNickIntro(user));	// The rest of the network learns about the user
+	}
+	_replication.saveUser(*user);	// The standby gets a copy of the connection
+}
+
+/**
+Tracks unterminated input of an unregistered connection (slowloris protection).
+
+Called after each read: if a partial line is left in the input buffer, the
+deadline timer is pulled forward to `PARTIAL_LINE_TIMEOUT` seconds after
+the partial line started. A drained buffer resets the partial-line clock.
+*/
+void	Server::updatePartialLine(PendingUser* pending)
+{
+	if (pending->getInputBuffer().empty())
+	{
+		pending->setPartialSince(0);
+		return;
+	}
+	if (pending->getPartialSince() != 0)
+		return; // Deadline already pulled forward for this partial line
+
+	pending->setPartialSince(_nowMs);
+
+	unsigned long	registrationLeft = pending->getConnectedAt() + REGISTRATION_TIMEOUT * 1000UL - _nowMs;
+	if (PARTIAL_LINE_TIMEOUT * 1000UL < registrationLeft)
+		_timers.schedule(&pending->getDeadlineTimer(), PARTIAL_LINE_TIMEOUT * 1000UL);
+}
+
+/**
+Handles an expired deadline timer of an unregistered connection.
+
+Closes the connection if the registration deadline or the partial-line deadline
+has passed, otherwise re-arms the timer for whichever deadline comes next
+(the partial line may have been completed in the meantime).
+*/
+void	Server::handleRegistrationTimer(int fd)
+{
+	PendingUser*	pending = getPendingUser(fd);
+	if (!pending)
+		return;
+
+	unsigned long	registrationDeadline = pending->getConnectedAt() + REGISTRATION_TIMEOUT * 1000UL;
+	unsigned long	nextDeadline = registrationDeadline;
+
+	if (_nowMs >= registrationDeadline)
+	{
+		++_reapStats.registrationTimeouts;
+		reapUser(fd, "Registration timeout");
+		return;
+	}
+
+	if (pending->getPartialSince() != 0)
+	{
+		unsigned long	partialDeadline = pending->getPartialSince() + PARTIAL_LINE_TIMEOUT * 1000UL;
+		if (_nowMs >= partialDeadline)
+		{
+			++_reapStats.partialLineTimeouts;
+			reapUser(fd, "Partial line timeout");
+			return;
+		}
+		if (partialDeadline < nextDeadline)
+			nextDeadline = partialDeadline;
+	}
+
+	_timers.schedule(&pending->getDeadlineTimer(), nextDeadline - _nowMs);
+}
+
+/**
+Closes an unregistered connection. No `QUIT` fanout is needed, as an
+unregistered connection is in no channels and nobody can see it.
+Sends a best-effort `ERROR` line straight to the socket; the line is
+formatted on the stack and the record goes back to the pool.
+*/
+void	Server::reapUser(int fd, const char* reason)
+{
+	char	errorLine[128];
+	int		len = snprintf(errorLine, sizeof(errorLine), "ERROR :Closing Link: %s\r\n", reason);
+
+	if (len > 0 && static_cast<size_t>(len) < sizeof(errorLine))
+		send(fd, errorLine, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	closePendingUser(fd, toString("reaped: ") + YELLOW + reason + RESET);
+}
+
+/////////////
+// Getters //
+/////////////
+
+// Returns the counters of connections closed by the registration reaper.
+const Server::ReapStats&	Server::getReapStats() const
+{
+	return _reapStats;
+}
+
+// Returns the number of connections that have not completed registration yet.
+size_t	Server::getUnregisteredCount() const
+{
+	return _unregCount;
+}
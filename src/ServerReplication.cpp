@@ -0,0 +1,266 @@
+#include <string>
+#include <map>
+#include <cerrno>		// errno
+#include <cstring>		// strerror()
+
+#include <poll.h>		// poll()
+#include <sys/socket.h>	// recv()
+#include <sys/select.h>	// fd_set, FD_* macros
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/Channel.hpp"
+#include "../include/signal.hpp"	// g_running
+#include "../include/defines.hpp"	// REPLICATION*, color formatting
+#include "../include/utils.hpp"		// toString(), getMonotonicMs(), getMonotonicUs()
+
+static const int			STANDBY_RETRY_MS = 1000;		// Between attempts to reach a primary
+static const unsigned long	STANDBY_REPORT_MS = 60000;		// Between two lag reports of the standby
+
+// Returns the replication stream to a standby (channels and users report their changes to it).
+ReplicationStream&	Server::getReplication()
+{
+	return _replication;
+}
+
+/////////////
+// Primary //
+/////////////
+
+// Starts listening for a standby on `REPLICATION_SOCKET`, if `REPLICATION` is set.
+void	Server::openReplication()
+{
+	if (!REPLICATION)
+		return;
+
+	std::string	error;
+	if (!_replication.listen(error))
+	{
+		logServerMessage(YELLOW + toString("WARNING: Replication: ") + error + RESET);
+		return;
+	}
+	logServerMessage(toString("Replication: a standby can attach at ") + YELLOW + REPLICATION_SOCKET + RESET);
+}
+
+// Adds the replication sockets to the select() sets: the listening one, and the standby's
+// (readable when it goes away, writable when it can take more records).
+int	Server::prepareReplicationSets(fd_set& readFds, fd_set& writeFds)
+{
+	int	maxFd = -1;
+
+	if (_replication.isListening())
+	{
+		FD_SET(_replication.getListenFd(), &readFds);
+		maxFd = _replication.getListenFd();
+	}
+	if (_replication.isAttached())
+	{
+		int	fd = _replication.getStandbyFd();
+		FD_SET(fd, &readFds);
+		if (_replication.wantsWrite())
+			FD_SET(fd, &writeFds);
+		if (fd > maxFd)
+			maxFd = fd;
+	}
+	return maxFd;
+}
+
+/**
+Attaches a standby knocking on the listening socket (and syncs it), notices
+one going away, and writes queued records when its socket has drained.
+*/
+void	Server::handleReplication(fd_set& readFds, fd_set& writeFds)
+{
+	std::string	error;
+
+	if (_replication.isAttached())
+	{
+		int	fd = _replication.getStandbyFd();
+		if (FD_ISSET(fd, &readFds))
+		{
+			char	byte;
+			ssize_t	n = recv(fd, &byte, 1, MSG_DONTWAIT); // The standby never writes: this is its end
+			if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			{
+				_replication.detach();
+				logServerMessage(YELLOW + toString("Replication: standby detached") + RESET);
+			}
+		}
+		else if (FD_ISSET(fd, &writeFds))
+			flushReplication();
+	}
+
+	if (_replication.isListening() && FD_ISSET(_replication.getListenFd(), &readFds))
+	{
+		if (_replication.accept(error) != -1)
+			syncStandby();
+		else if (!error.empty())
+			logServerMessage(YELLOW + toString("WARNING: Replication: ") + error + RESET);
+	}
+}
+
+/**
+Queues the full state for a standby that just attached: the listening
+socket, every registered user with their connection, and every channel with
+its members and operators. Changes follow as they happen.
+*/
+void	Server::syncStandby()
+{
+	unsigned long	startUs = getMonotonicUs();
+
+	_replication.saveListener(_fd);
+	_replication.saveServer(_startTime, _peakUsers);
+	for (std::map<int, User*>::iterator it = _usersFd.begin(); it != _usersFd.end(); ++it)
+	{
+		if (it->second->isRegistered())
+			_replication.saveUser(*it->second);
+	}
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		Channel*							channel = it->second;
+		const std::map<std::string, User*>&	members = channel->get_members();
+
+		_replication.saveChannel(*channel);
+		for (std::map<std::string, User*>::const_iterator mem = members.begin(); mem != members.end(); ++mem)
+		{
+			if (mem->second->getLink())
+				continue; // Users of other servers are not replicated
+			_replication.join(*channel, mem->first);
+			if (channel->is_user_operator(mem->second))
+				_replication.setOperator(*channel, mem->first, true);
+		}
+	}
+
+	size_t	bytes = _replication.getBacklog();
+	flushReplication();
+	unsigned long	elapsedUs = getMonotonicUs() - startUs;
+	logServerMessage(toString("Replication: standby attached, synced ") + YELLOW + toString(_usersFd.size())
+		+ RESET + " users and " + YELLOW + toString(_channels.size()) + RESET + " channels ("
+		+ toString(bytes) + " bytes) in " + YELLOW + toString(elapsedUs / 1000) + "."
+		+ toString(elapsedUs / 100 % 10) + " ms" + RESET);
+}
+
+// Sends the records queued by this loop iteration; a standby that cannot keep up is dropped.
+void	Server::flushReplication()
+{
+	std::string	error;
+
+	if (!_replication.flush(error))
+		logServerMessage(YELLOW + toString("Replication: standby dropped: ") + error + RESET);
+}
+
+/////////////
+// Standby //
+/////////////
+
+// Logs how far behind the primary the standby has been.
+static std::string	describeLag(const Replica::Stats& stats)
+{
+	unsigned long	averageUs = stats.ticks ? stats.lagTotalUs / stats.ticks : 0;
+
+	return toString(stats.records) + " records, " + toString(stats.bytes) + " bytes, lag "
+		+ YELLOW + toString(averageUs) + " us" + RESET + " on average, " + YELLOW + toString(stats.lagMaxUs)
+		+ " us" + RESET + " at worst";
+}
+
+/**
+Standby mode (`ircserv <port> <password> --standby`): follows the primary
+through `REPLICATION_SOCKET` instead of serving, until the primary is gone.
+
+ - A primary that shuts down or hands over to a new binary says so; the
+   standby drops its copy and waits for the next primary (or the new binary).
+ - A stream that just ends means the primary died, unless it still answers
+   on the socket (then it only dropped this standby, which syncs again).
+   The standby then takes over (`promoteStandby()`).
+
+ @return	`true` once promoted, `false` if interrupted by `SIGINT`.
+*/
+bool	Server::runStandby()
+{
+	std::string		error;
+	bool			waiting = false;
+	unsigned long	reportMs = getMonotonicMs() + STANDBY_REPORT_MS;
+	unsigned long	reportedRecords = 0;
+
+	logServerMessage(toString("Standing by: following the primary at ") + YELLOW + REPLICATION_SOCKET + RESET);
+	while (g_running)
+	{
+		if (!_replica.isConnected())
+		{
+			if (!_replica.connect(error))
+			{
+				if (!waiting)
+					logServerMessage(toString("Standby: waiting for a primary (") + error + ")");
+				waiting = true;
+				poll(NULL, 0, STANDBY_RETRY_MS);
+				continue;
+			}
+			waiting = false;
+			logServerMessage("Standby: connected to the primary, syncing");
+		}
+
+		struct pollfd	pfd;
+		pfd.fd = _replica.getFd();
+		pfd.events = POLLIN;
+		int	ready = poll(&pfd, 1, STANDBY_RETRY_MS);
+		if (getMonotonicMs() >= reportMs)
+		{
+			if (_replica.getStats().records != reportedRecords)
+				logServerMessage(toString("Standby: ") + toString(_replica.getUserCount()) + " users, "
+					+ toString(_replica.getChannelCount()) + " channels; " + describeLag(_replica.getStats()));
+			reportedRecords = _replica.getStats().records;
+			reportMs = getMonotonicMs() + STANDBY_REPORT_MS;
+		}
+		if (ready <= 0)
+			continue;
+
+		Replica::Result	result = _replica.receive(error);
+		if (result == Replica::REPLICA_OK)
+			continue;
+		if (result == Replica::REPLICA_BYE || result == Replica::REPLICA_HANDOVER)
+		{
+			logServerMessage(result == Replica::REPLICA_BYE ? "Standby: the primary shut down, waiting for the next one"
+				: "Standby: the primary is upgrading, syncing from the new binary");
+			_replica.reset();
+			continue;
+		}
+		if (result == Replica::REPLICA_ERROR || !_replica.isSynced() || Replica::probe(REPLICATION_SOCKET, STANDBY_RETRY_MS))
+		{
+			logServerMessage(YELLOW + toString("Standby: stream lost") + (error.empty() ? "" : ": " + error)
+				+ ", syncing again" + RESET);
+			_replica.reset();
+			continue;
+		}
+		promoteStandby();
+		return true;
+	}
+	_replica.reset();
+	return false;
+}
+
+/**
+The primary died: takes over its listening socket and its users'
+connections, and rebuilds users and channels from the replicated copy (the
+same way a hot upgrade does, see `adoptHandoff()`).
+
+Lost with the primary: what it had read from clients but not processed yet,
+what it had queued for them, unregistered connections, DCC relays, and the
+message history.
+*/
+void	Server::promoteStandby()
+{
+	unsigned long	startUs = getMonotonicUs();
+	Handoff			handoff;
+
+	logServerMessage(RED + toString("Standby: the primary is gone, taking over") + RESET + " ("
+		+ describeLag(_replica.getStats()) + ")");
+	_replica.takeHandoff(handoff);
+	adoptHandoff(handoff);
+	_standby = false;
+
+	unsigned long	elapsedUs = getMonotonicUs() - startUs;
+	logServerMessage(toString("Took over ") + YELLOW + toString(_usersFd.size()) + RESET + " users and "
+		+ YELLOW + toString(_channels.size()) + RESET + " channels in "
+		+ YELLOW + toString(elapsedUs / 1000) + "." + toString(elapsedUs / 100 % 10) + " ms" + RESET
+		+ ", now serving port " + YELLOW + toString(_port) + RESET);
+}
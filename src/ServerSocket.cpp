@@ -10,6 +10,7 @@
 
 #include "../include/Server.hpp"
 #include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
 #include "../include/utils.hpp"	// toString()
 
 /////////////////
@@ -120,6 +121,10 @@ Prepares the read fd_set for use with select().
 Read set includes:
  - Server listening socket: A new user wants to connect.
  - User sockets: Clients have sent messages waiting to be read.
+ - Unregistered connections: Still sending PASS / NICK / USER.
+ - Bot workers' wake-up pipe: Bot jobs have completed.
+ - I/O threads' wake-up pipe: Input arrived on the sockets they serve
+   (those are not in the set; see `startIo()`).
 
  @param readFds	Reference to the fd_set to be passed to select().
  @return		The highest file descriptor value among all monitored fds.
@@ -130,14 +135,44 @@ int	Server::prepareReadSet(fd_set& readFds)
 	FD_SET(_fd, &readFds);	// Add the listening socket fd to the read set
 	int maxFd = _fd;
 
-	// Add all active user sockets to readFds for monitoring
+	// Add all active user sockets to readFds for monitoring (or hand them to the I/O threads)
 	for (std::map<int, User*>::const_iterator it = _usersFd.begin(); it != _usersFd.end(); ++it)
 	{
+		if (_ioWorkers.isRunning() && !it->second->getIoSerial())
+			it->second->setIoSerial(_ioWorkers.attach(it->first, it->second->getInputBuffer()));
+		if (isIoAttached(it->second))
+			continue;
 		FD_SET(it->first, &readFds);
 		if (it->first > maxFd) // Update maxFd if this user fd is larger
 			maxFd = it->first;
 	}
 
+	// Add the bot workers' wake-up pipe
+	if (_botWorkers.isRunning())
+	{
+		FD_SET(_botWorkers.getWakeFd(), &readFds);
+		if (_botWorkers.getWakeFd() > maxFd)
+			maxFd = _botWorkers.getWakeFd();
+	}
+
+	// Add the I/O threads' wake-up pipe
+	if (_ioWorkers.isRunning())
+	{
+		FD_SET(_ioWorkers.getWakeFd(), &readFds);
+		if (_ioWorkers.getWakeFd() > maxFd)
+			maxFd = _ioWorkers.getWakeFd();
+	}
+
+	// Add all unregistered connections
+	for (int fd = 0; _pendingCount > 0 && fd < static_cast<int>(_pendingFd.size()); ++fd)
+	{
+		if (!_pendingFd[fd])
+			continue;
+		FD_SET(fd, &readFds);
+		if (fd > maxFd)
+			maxFd = fd;
+	}
+
 	return maxFd;
 }
 
@@ -147,6 +182,7 @@ Only includes users that have data in their output buffer.
 
 Write set includes:
  - User sockets: Ready to accept outgoing data without blocking.
+Users served by an I/O thread get their output handed over instead.
 
  @param writeFds	Reference to the fd_set to be passed to select().
  @return			The highest file descriptor value among all monitored fds.
@@ -160,6 +196,13 @@ int	Server::prepareWriteSet(fd_set& writeFds)
 	for (std::map<int, User*>::const_iterator it = _usersFd.begin(); it != _usersFd.end(); ++it)
 	{
 		User* user = it->second;
+		if (user && isIoAttached(user))
+		{
+			// Served by an I/O thread: hand it all the output of this iteration at once
+			if (!user->getOutputBuffer().empty())
+				_ioWorkers.send(user->getIoSerial(), it->first, user->getOutputBuffer(), user->hasReplyStreams());
+			continue;
+		}
 		if (user && !user->getOutputBuffer().empty())
 		{
 			FD_SET(it->first, &writeFds); // add user fd to write set if output buffer is not empty
@@ -168,5 +211,19 @@ int	Server::prepareWriteSet(fd_set& writeFds)
 		}
 	}
 
+	// Same for unregistered connections (error replies, PONGs)
+	for (int fd = 0; _pendingCount > 0 && fd < static_cast<int>(_pendingFd.size()); ++fd)
+	{
+		if (_pendingFd[fd] && !_pendingFd[fd]->getOutputBuffer().empty())
+		{
+			FD_SET(fd, &writeFds);
+			if (fd > maxFd)
+				maxFd = fd;
+		}
+	}
+
+	// Wake the I/O threads that got work (connections, output, sockets to close) in this iteration
+	_ioWorkers.wake();
+
 	return maxFd;
 }
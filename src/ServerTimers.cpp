@@ -0,0 +1,130 @@
+#include <string>
+#include <sys/time.h>	// struct timeval
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/defines.hpp"	// PING_INTERVAL, PING_TIMEOUT
+#include "../include/utils.hpp"		// toString(), getMonotonicMs()
+
+/**
+Fills `tv` with the time `select()` may block before the next timer is due.
+
+ @param tv	Storage for the timeout.
+ @return	Pointer to `tv`, or `NULL` (block indefinitely) if no timers are armed.
+*/
+struct timeval*	Server::prepareTimeout(struct timeval& tv)
+{
+	long	timeoutMs = _timers.getTimeoutMs(getMonotonicMs());
+
+	if (timeoutMs < 0)
+		return NULL;
+
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+	return &tv;
+}
+
+/**
+Takes the time of a new event loop iteration (`_nowMs`) and turns the timer
+wheel to it, before any handler runs: timers scheduled by the handlers then
+count from now, not from where the wheel stopped before `select()`.
+*/
+void	Server::updateNow()
+{
+	_nowMs = getMonotonicMs();
+	_timers.advance(_nowMs);
+}
+
+/**
+Dispatches all timers that expired when the wheel was turned (`updateNow()`).
+
+Expired timers are popped one at a time, so a handler that deletes a user
+(and thereby cancels that user's other timers) never leaves a dangling entry.
+*/
+void	Server::handleTimers()
+{
+	TimerWheel::Timer*	timer;
+
+	while ((timer = _timers.popExpired()) != NULL)
+	{
+		switch (timer->type)
+		{
+			case TIMER_KEEPALIVE:		handleKeepalive(timer->fd); break;
+			case TIMER_REGISTRATION:	handleRegistrationTimer(timer->fd); break;
+			case TIMER_BOT_JOB:			handleBotJobTimeout(static_cast<BotWorkers::Job*>(timer->data)); break;
+			case TIMER_DCC_DEADLINE:
+			case TIMER_DCC_THROTTLE:	handleDccTimer(static_cast<DccTransfer*>(timer->data), timer->type); break;
+			case TIMER_STATE_SNAPSHOT:	writeStateSnapshot(); break;
+			case TIMER_LINK_RETRY:		connectLink(static_cast<LinkTarget*>(timer->data)); break;
+			case TIMER_LINK_KEEPALIVE:	handleLinkKeepalive(static_cast<ServerLink*>(timer->data)); break;
+		}
+	}
+}
+
+// Returns the monotonic time (ms) of the current event loop iteration.
+unsigned long	Server::getNowMs() const
+{
+	return _nowMs;
+}
+
+// Returns the wall clock time the server was started.
+time_t	Server::getStartTime() const
+{
+	return _startTime;
+}
+
+/**
+Starts the PING/PONG keepalive for a freshly registered user.
+
+Instead of rescheduling on every received line, the timer is armed once for
+`PING_INTERVAL` and, when it fires, compares against the user's last activity.
+*/
+void	Server::armKeepalive(User* user)
+{
+	TimerWheel::Timer&	timer = user->getKeepaliveTimer();
+
+	timer.type = TIMER_KEEPALIVE;
+	timer.fd = user->getFd();
+	user->setLastActivity(_nowMs);
+	_timers.schedule(&timer, PING_INTERVAL * 1000UL);
+}
+
+/**
+Handles an expired keepalive timer.
+
+ - A PING is outstanding and nothing was received since: the peer is dead,
+   so the user is disconnected (`QUIT` is broadcast to their channels).
+ - The user was active within `PING_INTERVAL`: re-arm for the remaining idle time.
+ - Otherwise: send a PING and give the user `PING_TIMEOUT` seconds to answer.
+*/
+void	Server::handleKeepalive(int fd)
+{
+	User*	user = getUser(fd);
+	if (!user)
+		return;
+
+	TimerWheel::Timer&	timer = user->getKeepaliveTimer();
+	unsigned long		lastActivity = user->getLastActivity();
+
+	if (user->getPingSentAt() != 0)
+	{
+		if (lastActivity < user->getPingSentAt())
+		{
+			disconnectUser(fd, "Ping timeout: " + toString((_nowMs - user->getPingSentAt()) / 1000)
+				+ " seconds");
+			return;
+		}
+		user->setPingSentAt(0); // Peer answered (PONG or any other traffic)
+	}
+
+	unsigned long	idleMs = _nowMs - lastActivity;
+	if (idleMs < PING_INTERVAL * 1000UL)
+	{
+		_timers.schedule(&timer, PING_INTERVAL * 1000UL - idleMs);
+		return;
+	}
+
+	user->sendServerMsg("PING :" + _name);
+	user->setPingSentAt(_nowMs);
+	_timers.schedule(&timer, PING_TIMEOUT * 1000UL);
+}
@@ -0,0 +1,393 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>	// std::runtime_error
+#include <cerrno>		// errno
+#include <cstring>		// strerror()
+#include <cstdlib>		// getenv(), strtol()
+#include <csignal>		// kill(), SIGKILL
+
+#include <unistd.h>		// fork(), execve(), dup2(), close(), read(), write(), sysconf()
+#include <poll.h>		// poll()
+#include <sys/socket.h>	// socketpair()
+#include <sys/wait.h>	// waitpid()
+#include <sys/select.h>	// FD_SETSIZE
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
+#include "../include/Channel.hpp"
+#include "../include/Handoff.hpp"
+#include "../include/defines.hpp"	// UPGRADE_TIMEOUT, color formatting
+#include "../include/utils.hpp"		// toString(), normalize(), getMonotonicUs()
+
+extern char**	environ;
+
+static const char	UPGRADE_FD_ENV[] = "IRCSERV_UPGRADE_FD";	// Tells the new binary where to take over
+static const int	UPGRADE_FD = 3;		// Descriptor of the handoff socket in the new binary
+
+// Sets the binary a hot upgrade executes (the path the server was started as, i.e. `argv[0]`).
+void	Server::setBinaryPath(const std::string& path)
+{
+	_binaryPath = path;
+}
+
+/**
+Returns the handoff socket if this process was started by a hot upgrade
+(`IRCSERV_UPGRADE_FD` is set), `-1` otherwise. The variable is removed, so
+a later upgrade of this process starts from a clean environment.
+*/
+int	Server::takeUpgradeFd()
+{
+	const char*	value = getenv(UPGRADE_FD_ENV);
+	if (!value)
+		return -1;
+
+	char*	end;
+	long	fd = strtol(value, &end, 10);
+	unsetenv(UPGRADE_FD_ENV);
+	if (*end != '\0' || fd < 0 || fd >= FD_SETSIZE)
+		return -1;
+	return static_cast<int>(fd);
+}
+
+////////////////
+// Old binary //
+////////////////
+
+/**
+Runs in the forked child: moves the handoff socket to `UPGRADE_FD`, closes
+every other inherited descriptor (the sockets arrive again, with `SCM_RIGHTS`,
+and must not stay open twice), and executes the new binary. Only async-signal-
+safe calls: the bot worker threads did not survive the fork.
+*/
+static void	execUpgrade(int sock, long maxFd, char* const* argv, char* const* envp)
+{
+	if (sock != UPGRADE_FD && dup2(sock, UPGRADE_FD) == -1)
+		_exit(127);
+	for (long fd = UPGRADE_FD + 1; fd < maxFd; ++fd)
+		close(fd);
+	execve(argv[0], argv, envp);
+	_exit(127);
+}
+
+/**
+Waits up to `UPGRADE_TIMEOUT` seconds for the new binary to confirm that it
+has taken over (one byte on the handoff socket).
+*/
+static bool	waitForTakeover(int sock, std::string& error)
+{
+	struct pollfd	pfd;
+	char			ack;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	int	ready;
+	do
+		ready = poll(&pfd, 1, UPGRADE_TIMEOUT * 1000);
+	while (ready == -1 && errno == EINTR);
+	if (ready == 0)
+	{
+		error = "new binary did not take over within " + toString(UPGRADE_TIMEOUT) + " seconds";
+		return false;
+	}
+	if (ready == -1 || read(sock, &ack, 1) != 1)
+	{
+		error = "new binary exited before taking over";
+		return false;
+	}
+	return true;
+}
+
+/**
+Collects what the new binary needs: the listening socket, every registered
+user and unregistered connection with its buffers, and every channel.
+*/
+void	Server::collectHandoff(Handoff& handoff)
+{
+	handoff.listenFd = _fd;
+	handoff.startTime = _startTime;
+	handoff.peakUsers = _peakUsers;
+
+	handoff.users.resize(_usersFd.size());
+	size_t	i = 0;
+	for (std::map<int, User*>::iterator it = _usersFd.begin(); it != _usersFd.end(); ++it)
+		it->second->saveHandoff(handoff.users[i++]);
+
+	handoff.pending.reserve(_pendingCount);
+	for (size_t fd = 0; fd < _pendingFd.size(); ++fd)
+	{
+		PendingUser*	pending = _pendingFd[fd];
+		if (!pending)
+			continue;
+		handoff.pending.push_back(PendingHandoff());
+		PendingHandoff&	record = handoff.pending.back();
+		record.fd = pending->getFd();
+		record.addr = pending->getAddr();
+		record.nickname = pending->hasNick() ? pending->getNickname() : "";
+		record.username = pending->hasUser() ? pending->getUsername() : "";
+		record.realname = pending->getRealname();
+		record.hasPassed = pending->hasPassed();
+		record.negotiating = pending->isNegotiating();
+		record.caps = pending->getCaps();
+		record.inputBuffer = pending->getInputBuffer();
+		record.outputBuffer = pending->getOutputBuffer();
+	}
+
+	handoff.channels.resize(_channels.size());
+	i = 0;
+	for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
+	{
+		ChannelHandoff&						record = handoff.channels[i++];
+		const std::map<std::string, User*>&	members = it->second->get_members();
+
+		it->second->save_state(record.state);
+		record.createdAt = it->second->get_creation_time();
+		record.members.reserve(members.size());
+		for (std::map<std::string, User*>::const_iterator mem = members.begin(); mem != members.end(); ++mem)
+		{
+			record.members.push_back(mem->first);
+			if (it->second->is_user_operator(mem->second))
+				record.operators.push_back(mem->first);
+		}
+	}
+}
+
+/**
+Hot upgrade (`SIGUSR2`): starts the binary at `_binaryPath` (e.g. a new build
+copied over the old one) and hands everything over to it, so clients never
+notice the switch:
+
+ 1. DCC relays are aborted (their sockets are not handed over) and a channel
+	state snapshot is written, so the new binary has a short journal to replay.
+	A standby (see `ReplicationStream`) is told to sync from the new binary.
+	Server links are closed: the network sees a short netsplit, and the new
+	binary links again (with the same `--name` and `--link`s).
+ 2. A Unix socket pair is created, and the child executes the new binary with
+	`IRCSERV_UPGRADE_FD` naming its end.
+ 3. All state is sent, then all sockets (see `Handoff`).
+ 4. Once the new binary confirms, this process stops serving and exits
+	without touching the connections.
+
+If anything fails, the child is killed and this process keeps serving as if
+nothing happened; the reason is logged.
+
+ @return	`true` if the new binary has taken over.
+*/
+bool	Server::upgrade()
+{
+	unsigned long	startUs = getMonotonicUs();
+
+	logServerMessage(BOT_COLOR + toString("SIGUSR2 received") + RESET + ", upgrading to " + YELLOW
+		+ _binaryPath + RESET);
+	if (_binaryPath.empty())
+	{
+		logServerMessage(RED + toString("ERROR: Upgrade failed: binary path unknown") + RESET);
+		return false;
+	}
+
+	while (!_dccTransfers.empty())
+		closeDccTransfer(*_dccTransfers.begin(), "aborted (server upgrade)");
+	if (_stateLog.isOpen())
+		writeStateSnapshot();
+	_replication.close(true); // The standby syncs again from the new binary (or from this one if it fails)
+	closeAllLinks("Server upgrade"); // Relinked by the new binary (or by this one if it fails)
+	stopIo(); // The sockets are handed over from here (the I/O threads start again if it fails)
+
+	// Everything execve() needs is prepared here: after fork(), the child must not allocate
+	std::string			fdVar = toString(UPGRADE_FD_ENV) + "=" + toString(UPGRADE_FD);
+	std::string			port = toString(_port);
+	std::vector<char*>	argv;
+	std::vector<char*>	envp;
+	argv.push_back(const_cast<char*>(_binaryPath.c_str()));
+	argv.push_back(const_cast<char*>(port.c_str()));
+	argv.push_back(const_cast<char*>(_password.c_str()));
+	argv.push_back(const_cast<char*>("--name"));
+	argv.push_back(const_cast<char*>(_name.c_str()));
+	for (size_t i = 0; i < _linkTargets.size(); ++i)
+	{
+		argv.push_back(const_cast<char*>("--link"));
+		argv.push_back(const_cast<char*>(_linkTargets[i]->address.c_str()));
+	}
+	argv.push_back(NULL);
+	for (char** env = environ; *env; ++env)
+		envp.push_back(*env);
+	envp.push_back(const_cast<char*>(fdVar.c_str()));
+	envp.push_back(NULL);
+	long	maxFd = sysconf(_SC_OPEN_MAX);
+
+	int	sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+	{
+		logServerMessage(RED + toString("ERROR: Upgrade failed: socketpair(): ") + strerror(errno) + RESET);
+		openReplication();
+		openLinks();
+		startIo();
+		return false;
+	}
+	pid_t	pid = fork();
+	if (pid == -1)
+	{
+		logServerMessage(RED + toString("ERROR: Upgrade failed: fork(): ") + strerror(errno) + RESET);
+		close(sv[0]);
+		close(sv[1]);
+		openReplication();
+		openLinks();
+		startIo();
+		return false;
+	}
+	if (pid == 0)
+		execUpgrade(sv[1], maxFd > 0 ? maxFd : FD_SETSIZE, &argv[0], &envp[0]);
+	close(sv[1]);
+
+	Handoff		handoff;
+	std::string	error;
+	collectHandoff(handoff);
+	bool	tookOver = handoff.send(sv[0], error) && waitForTakeover(sv[0], error);
+	close(sv[0]);
+	if (!tookOver)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		logServerMessage(RED + toString("ERROR: Upgrade failed: ") + error + RESET + " (still serving)");
+		openReplication();
+		openLinks();
+		startIo();
+		return false;
+	}
+
+	unsigned long	elapsedUs = getMonotonicUs() - startUs;
+	logServerMessage(toString("Handed over ") + YELLOW + toString(handoff.users.size()) + RESET + " users, "
+		+ YELLOW + toString(handoff.pending.size()) + RESET + " unregistered connections and "
+		+ YELLOW + toString(handoff.channels.size()) + RESET + " channels to pid " + toString(pid) + " in "
+		+ YELLOW + toString(elapsedUs / 1000) + "." + toString(elapsedUs / 100 % 10) + " ms" + RESET);
+
+	// The new binary owns the state files now
+	_timers.cancel(&_snapshotTimer);
+	_stateLog.close();
+	_handedOff = true;
+	return true;
+}
+
+////////////////
+// New binary //
+////////////////
+
+/**
+Takes over from the previous binary (started by its `upgrade()`): receives
+the state and the sockets, rebuilds users, unregistered connections and
+channels, then confirms, which lets the previous binary exit.
+
+The message history (`CHATHISTORY`) is not handed over and starts empty.
+
+ @throws std::runtime_error	if the handoff fails; the previous binary then
+							keeps serving.
+*/
+void	Server::resumeUpgrade()
+{
+	unsigned long	startUs = getMonotonicUs();
+	Handoff			handoff;
+	std::string		error;
+
+	if (!handoff.receive(_upgradeFd, error))
+	{
+		close(_upgradeFd);
+		_upgradeFd = -1;
+		throw std::runtime_error("Upgrade failed: " + error);
+	}
+	adoptHandoff(handoff);
+
+	char	ack = 'K';
+	if (write(_upgradeFd, &ack, 1) != 1)
+		logServerMessage(YELLOW + toString("WARNING: Could not confirm the upgrade: ") + strerror(errno) + RESET);
+	close(_upgradeFd);
+	_upgradeFd = -1;
+
+	unsigned long	elapsedUs = getMonotonicUs() - startUs;
+	logServerMessage(toString("Took over ") + YELLOW + toString(_usersFd.size()) + RESET + " users, "
+		+ YELLOW + toString(_pendingCount) + RESET + " unregistered connections and "
+		+ YELLOW + toString(_channels.size()) + RESET + " channels in "
+		+ YELLOW + toString(elapsedUs / 1000) + "." + toString(elapsedUs / 100 % 10) + " ms" + RESET);
+}
+
+/**
+Rebuilds users, unregistered connections and channels from a handoff, with
+the sockets it carries: from the previous binary on a hot upgrade, or from
+the replicated copy when a standby takes over (`promoteStandby()`).
+*/
+void	Server::adoptHandoff(Handoff& handoff)
+{
+	_fd = handoff.listenFd;
+	_startTime = handoff.startTime;
+	_peakUsers = handoff.peakUsers;
+
+	for (size_t i = 0; i < handoff.users.size(); ++i)
+	{
+		UserHandoff&	record = handoff.users[i];
+		if (record.fd >= FD_SETSIZE) // select() cannot watch it (the descriptors got renumbered)
+		{
+			close(record.fd);
+			logServerMessage(RED + toString("ERROR: fd ") + toString(record.fd) + " exceeds FD_SETSIZE. "
+				+ record.nickname + " lost the connection" + RESET);
+			continue;
+		}
+		User*	user = new User(record.fd, this, record);
+		_usersFd[record.fd] = user;
+		_usersNick[user->getNicknameLower()] = user;
+		armKeepalive(user);
+		user->setLastActivity(record.lastActivity);
+	}
+
+	for (size_t i = 0; i < handoff.pending.size(); ++i)
+	{
+		PendingHandoff&	record = handoff.pending[i];
+		if (!acceptPendingUser(record.fd, record.addr))
+			continue;
+		PendingUser*	pending = getPendingUser(record.fd);
+		if (!record.nickname.empty())
+		{
+			reservePendingNick(pending, normalize(record.nickname));
+			pending->setNickname(record.nickname);
+		}
+		if (!record.username.empty())
+			pending->setUser(record.username, record.realname);
+		pending->setHasPassed(record.hasPassed);
+		pending->setNegotiating(record.negotiating);
+		pending->setCaps(record.caps);
+		pending->getInputBuffer().swap(record.inputBuffer);
+		pending->getOutputBuffer().swap(record.outputBuffer);
+		updatePartialLine(pending);
+	}
+
+	for (size_t i = 0; i < handoff.channels.size(); ++i)
+	{
+		ChannelHandoff&	record = handoff.channels[i];
+		Channel*		channel = new Channel(record.state.name);
+
+		_channels[channel->get_name_lower()] = channel;
+		channel->restore_state(record.state);
+		channel->set_creation_time(record.createdAt);
+		channel->set_state_log(&_stateLog);
+		channel->set_replication(&_replication);
+		channel->set_fanout(&_fanout);
+		for (size_t j = 0; j < record.members.size(); ++j)
+		{
+			std::map<std::string, User*>::iterator	it = _usersNick.find(record.members[j]);
+			User*	member = it != _usersNick.end() ? it->second
+				: (_botUser && _botUser->getNicknameLower() == record.members[j] ? _botUser : NULL);
+			if (!member)
+				continue; // Lost above
+			channel->add_user(member);
+			member->addChannel(channel->get_name());
+		}
+		const std::map<std::string, User*>&	members = channel->get_members();
+		for (size_t j = 0; j < record.operators.size(); ++j)
+		{
+			std::map<std::string, User*>::const_iterator	it = members.find(record.operators[j]);
+			if (it != members.end())
+				channel->make_user_operator(it->second);
+		}
+		if (channel->get_connected_user_number() == 0)
+			deleteChannel(channel->get_name(), "no connected users");
+	}
+}
@@ -7,14 +7,15 @@
 
 #include <unistd.h>		// close()
 #include <sys/types.h>	// size_t, ssize_t
-#include <sys/socket.h>	// accept(), recv(), send(), FD_* macros
+#include <sys/socket.h>	// accept(), recv(), send(), shutdown(), FD_* macros
 #include <netinet/in.h>	// sockaddr_in, ntohs()
-#include <arpa/inet.h>	// inet_ntoa()
 
 #include "../include/Server.hpp"
 #include "../include/Channel.hpp"
 #include "../include/User.hpp"
 #include "../include/Command.hpp"
+#include "../include/ScanIndex.hpp"
+#include "../include/Numerics.hpp"	// reply<>()
 #include "../include/defines.hpp"
 #include "../include/utils.hpp"	// toString()
 
@@ -23,21 +24,22 @@
 ///////////////////////////////
 
 /**
-Accepts a new user connection and adds them to the server's user lists
-(`_usersFd`, `_usersNick`) by creating a new `User` object.
+Accepts a new connection.
+
+Clients start out as a lightweight `PendingUser` record (see `acceptPendingUser()`)
+and only become a full `User` once registered.
 
 `accepts()` uses the server's listening socket (`_fd`) to identify and accept 
 any pending incoming connection requests.
 
- @return	`true` if a new user was successfully accepted and added,
-			`false` if an error occurred (e.g. memory allocation failure).
+ @return	`true` if a new connection was successfully accepted,
+			`false` if it was refused or an error occurred (e.g. memory allocation failure).
 */
 bool	Server::acceptNewUser()
 {
 	int			userFd;		// fd for the accepted user connection
 	sockaddr_in	userAddr;	// Init user address structure
 	socklen_t	userLen = sizeof(userAddr);
-	bool		BotFirstUser = getBotMode() && _usersFd.empty();
 
 	userFd = accept(_fd, reinterpret_cast<sockaddr*>(&userAddr), &userLen);
 	if (userFd == -1) // Critical! Shut down server / end program
@@ -47,37 +49,9 @@ bool	Server::acceptNewUser()
 		throw std::runtime_error(errorMsg);
 	}
 
-	std::string	userIp = inet_ntoa(userAddr.sin_addr);
-
-	try
-	{
-		User*	newUser = new User(userFd, this); // 'new' throws std::bad_alloc on failure
-
-		newUser->logUserAction(toString("connected from ") + YELLOW
-			+ toString(userIp) + RESET, BotFirstUser);
-
-		_usersFd[userFd] = newUser;
-		newUser->setHost(userIp);	
-
-		// Set as "password-passed" when server requires no password
-		if (_password.empty())
-			newUser->setHasPassed(true);
-	}
-	catch(const std::bad_alloc&)
-	{
-		std::string	user = "new user";
-		if (getBotMode() && _usersFd.empty())
-		{
-			user = BOT_COLOR + toString("server bot") + RED;
-			_botMode = false; // Server keeps running without bot
-		}
-
-		close(userFd);
-		logServerMessage(RED + toString("ERROR: Failed to allocate memory for " + user 
-			+ " from ") + YELLOW + toString(userIp) + RESET + ". Connection closed");
-		return false; // Keep server running
-	}
-	return true;
+	// Too many unregistered connections from this host / overall? Closed right away.
+	return admitUnregistered(userFd, userAddr.sin_addr.s_addr)
+		&& acceptPendingUser(userFd, userAddr.sin_addr.s_addr);
 }
 
 /////////////////////////
@@ -85,28 +59,18 @@ bool	Server::acceptNewUser()
 /////////////////////////
 
 /**
-Handles incoming data from a user socket.
+Reads available data from a socket and appends it to the given input buffer.
 
-This function reads data from the specified fd into a temporary buffer,
-appends it to the user's persistent input buffer, and processes complete messages
-delimited by newline characters (`\n`). Each complete message is then broadcast to all other users.
-
- @param fd		The fd of the user to read input from.
- @return		`true` if input was successfully handled,
-				`false` if the user disconnected or an error occurred.
+ @param fd			The socket to read from.
+ @param inputBuffer	The connection's persistent input buffer.
+ @return			`INPUT_OK` if data was appended (or none was available yet),
+					`INPUT_DISCONNECTED` if the peer closed the connection,
+					`INPUT_ERROR` if `recv()` failed.
 */
-Server::UserInputResult	Server::handleUserInput(int fd)
+Server::UserInputResult	Server::receiveInput(int fd, std::string& inputBuffer)
 {
-	char						buffer[MAX_BUFFER_SIZE]; // Temp buffer on the stack for incoming data
-	ssize_t						bytesRead = recv(fd, buffer, sizeof(buffer) - 1, 0); // Read from user socket
-	std::vector<std::string>	messages;
-	User*						user = getUser(fd);
-
-	if (!user) // Should never happen, but just to be safe
-	{
-		logServerMessage(RED + toString("ERROR: No user found for fd ") + toString(fd) + RESET);
-		return INPUT_ERROR;
-	}
+	char		buffer[MAX_BUFFER_SIZE]; // Temp buffer on the stack for incoming data
+	ssize_t		bytesRead = recv(fd, buffer, sizeof(buffer) - 1, 0); // Read from user socket
 
 	if (bytesRead == 0) // Connection closed by the user
 		return INPUT_DISCONNECTED;
@@ -121,75 +85,151 @@ Server::UserInputResult	Server::handleUserInput(int fd)
 		return INPUT_ERROR;
 	}	
 
-	// Append the received bytes to the user's input buffer
-	user->getInputBuffer().append(buffer, bytesRead);
+	// Append the received bytes to the input buffer
+	inputBuffer.append(buffer, bytesRead);
+	return INPUT_OK;
+}
+
+/**
+Handles incoming data from a registered user's socket.
 
+This function reads data from the specified fd into the user's persistent
+input buffer and processes all complete messages (see `processUserInput()`).
 
-	messages = extractMessagesFromBuffer(user);
+ @param fd		The fd of the user to read input from.
+ @return		`INPUT_OK` if input was successfully handled,
+				`INPUT_DISCONNECTED` / `INPUT_ERROR` if the user disconnected or an error occurred.
+*/
+Server::UserInputResult	Server::handleUserInput(int fd)
+{
+	User*	user = getUser(fd);
 
-	// Process each complete message
-	for (size_t i = 0; i < messages.size(); ++i)
+	if (!user) // Should never happen, but just to be safe
 	{
-		if (LOG_RAW_CMDS)
-			user->logUserAction(BOLD + messages[i] + RESET);
-		std::vector<std::string>	tokens = Command::tokenize(messages[i]);
-		if (tokens.empty())
-			continue; // Skip empty/space-only lines
-		if (!Command::handleCommand(this, user, tokens))
-		{
-			std::string	cmd = tokens[0];
-
-			user->logUserAction(toString("sent unknown command: ") + RED + cmd + RESET);	
-			user->sendError(421, cmd, "Unknown command");
-		}
+		logServerMessage(RED + toString("ERROR: No user found for fd ") + toString(fd) + RESET);
+		return INPUT_ERROR;
 	}
+
+	UserInputResult	result = receiveInput(fd, user->getInputBuffer());
+	if (result != INPUT_OK)
+		return result;
+
+	user->setLastActivity(_nowMs); // Any traffic proves the peer is alive (keepalive)
+	processUserInput(user);
 	return INPUT_OK;
 }
 
 /**
-Extracts complete IRC messages from the user's input buffer.
+Processes all complete messages in a user's input buffer, delimited by
+newline characters (`\n`). Each message is tokenized and dispatched.
+
+The complete part of the buffer is taken out in one piece (only the partial
+line after it stays), indexed once (see `ScanIndex`), and framed and
+tokenized in place from the index: no per-line copy, no per-line search.
+
+Technically, IRC messages end with CRLF (\r\n), but many clients just use
+LF (\n); also makes usage with terminal tools like netcat easier. An optional
+`\r` before the newline is stripped. Postel's Law: Be conservative in what
+you send, liberal in what you accept.
 
- @param user	Pointer to the user whose input buffer is being processed.
- @return		A vector of complete, cleaned IRC messages.
+Stops early if the user quit while processing the batch. The partial line
+left over is capped (see `capPartialLine()`).
+
+ @param user	The user whose buffered input is processed.
 */
-std::vector<std::string>	Server::extractMessagesFromBuffer(User* user)
+void	Server::processUserInput(User* user)
 {
-	std::string&				buffer = user->getInputBuffer(); // Reference to the user's input buffer
-	std::vector<std::string>	messages;
-	std::string					msg;
-	size_t						newlinePos;
-
-	// Extract complete messages (terminated by '\n')
-	// Technically, IRC messages end with CRLF (\r\n), but many clients
-	// just use LF (\n); also makes usage with terminal tools like netcat easier.
-	// We will handle optional '\r' when processing each line below.
-	// Postel's Law: Be conservative in what you send, liberal in what you accept.
-	while ((newlinePos = buffer.find('\n')) != std::string::npos)
+	int				fd = user->getFd();
+	std::string		lines;
+	std::string&	input = user->getInputBuffer();
+
+	if (user->isDiscardingLine())
+	{
+		size_t	newline = input.find('\n');
+		input.erase(0, newline == std::string::npos ? newline : newline + 1);
+		if (newline == std::string::npos)
+			return;
+		user->setDiscardingLine(false);
+	}
+
+	size_t	complete = input.rfind('\n');
+	if (complete == std::string::npos)
 	{
-		// Get the next full line (up to the newline)
-		msg = buffer.substr(0, newlinePos);
+		capPartialLine(user); // No complete message yet
+		return;
+	}
+	++complete;
+	lines.swap(input);
+	input.assign(lines, complete, std::string::npos);
+
+	ScanIndex	index;
+	size_t		start = 0;
+	size_t		newlinePos;
 
-		// Remove it from the input buffer (including the newline)
-		buffer.erase(0, newlinePos + 1);
+	index.build(lines.data(), complete);
+	while ((newlinePos = index.nextNewline(start, complete)) != std::string::npos)
+	{
+		if (getUser(fd) != user)
+			return; // User quit while processing this batch
 
-		// Handle optional carriage return (\r) for \r\n line endings
-		// (as per IRC spec for server-client communication)
-		if (!msg.empty() && msg[msg.size() - 1] == '\r')
-			msg.erase(msg.size() - 1);
+		size_t	end = newlinePos;
+		if (end > start && lines[end - 1] == '\r')
+			--end;
+		size_t	lineStart = start;
+		start = newlinePos + 1;
 
 		// Check if line is too long (more than 510 + CRLF = 512); see RFC 1459, 2.3
-		if (msg.size() > MAX_BUFFER_SIZE - 2)
+		if (end - lineStart > MAX_BUFFER_SIZE - 2)
 		{
-			user->logUserAction(toString("sent an overlong line (") + YELLOW
-				+ toString(msg.size()) + RESET + " > 512 bytes)");
-			user->sendError(417, "", "Input line was too long");
-			continue; // Skip this message, do not add to vector
-			}
+			rejectOverlongLine(user, end - lineStart);
+			continue;
+		}
+		if (LOG_RAW_CMDS)
+			user->logUserAction(BOLD + lines.substr(lineStart, end - lineStart) + RESET);
+		std::vector<std::string>	tokens = Command::tokenize(lines, lineStart, end, index);
+		if (tokens.empty())
+			continue; // Skip empty/space-only lines
+		dispatchUserCommand(user, tokens);
+	}
+	if (getUser(fd) == user)
+		capPartialLine(user);
+}
+
+// Runs a registered user's command, or tells them it is unknown.
+void	Server::dispatchUserCommand(User* user, std::vector<std::string>& tokens)
+{
+	if (!Command::handleCommand(this, user, tokens))
+	{
+		std::string	cmd = tokens[0];
 
-		// Store the clean message in vector
-		messages.push_back(msg);
+		user->logUserAction(toString("sent unknown command: ") + RED + cmd + RESET);	
+		reply<ERR_UNKNOWNCOMMAND>(user, cmd);
 	}
-	return messages;
+}
+
+/**
+Refuses the partial line at the end of a user's input buffer as soon as it
+is longer than a line may be, instead of buffering it until its newline
+arrives (which may be never). It is dropped, and so is the rest of it up to
+its newline as it comes in, so that rest never runs as a command.
+*/
+void	Server::capPartialLine(User* user)
+{
+	std::string&	input = user->getInputBuffer();
+
+	if (input.size() <= MAX_BUFFER_SIZE)
+		return;
+	rejectOverlongLine(user, input.size());
+	std::string().swap(input);
+	user->setDiscardingLine(true);
+}
+
+// Refuses a line longer than 510 + CRLF = 512 bytes; see RFC 1459, 2.3.
+void	Server::rejectOverlongLine(User* user, size_t length)
+{
+	user->logUserAction(toString("sent an overlong line (") + YELLOW
+		+ toString(length) + RESET + " > 512 bytes)");
+	reply<ERR_INPUTTOOLONG>(user);
 }
 
 //////////////////////////
@@ -223,12 +263,17 @@ void	Server::handleReadReadyUsers(fd_set& readFds)
 				disconnectUser(userFd, "Connection closed");
 			else if (result == INPUT_ERROR)
 			{
-				getUser(userFd)->logUserAction(RED + toString("ERROR: recv() failed: ")
-					+ toString(strerror(errno)) + RESET);
+				if (getUser(userFd))
+					getUser(userFd)->logUserAction(RED + toString("ERROR: recv() failed: ")
+						+ toString(strerror(errno)) + RESET);
 				disconnectUser(userFd, "Read error: " + toString(strerror(errno)));
 			}
 		}
 	}
+
+	// Unregistered connections last: those promoted to a `User` in the process
+	// must not be read again within this iteration
+	handleReadReadyPending(readFds);
 }
 
 /**
@@ -252,24 +297,38 @@ void	Server::handleWriteReadyUsers(fd_set& writeFds)
 		User*	user = it->second;
 		++it;	// go to next user in map in advance
 
-		if (FD_ISSET(userFd, &writeFds) && user && !user->getOutputBuffer().empty())
+		if (!FD_ISSET(userFd, &writeFds) || !user || user->getOutputBuffer().empty())
+			continue;
+		if (!sendOutputBuffer(userFd, user->getOutputBuffer()))
 		{
-			std::string&	outputBuffer = user->getOutputBuffer(); // output buffer: What the server has prepared to send to client
-			ssize_t			bytesSent = send(userFd, outputBuffer.c_str(), outputBuffer.length(), 0);
-
-			if (bytesSent > 0) // Successfully sent some data. Remove it from the buffer.
-				outputBuffer.erase(0, bytesSent);
-			else if (bytesSent == -1) // send() failed
-			{
-				if (errno == EPIPE || errno == ECONNRESET)
-				{
-					user->logUserAction(RED + toString("ERROR: send() failed: ") + toString(strerror(errno)) + RESET);
-					disconnectUser(userFd, "Write error: " + toString(strerror(errno)));
-				}
-				// If errno is EAGAIN or EWOULDBLOCK, do nothing (temporary issue), just try again in next select() loop
-			}
+			user->logUserAction(RED + toString("ERROR: send() failed: ") + toString(strerror(errno)) + RESET);
+			disconnectUser(userFd, "Write error: " + toString(strerror(errno)));
+			continue;
 		}
+		user->pumpReplyStreams(); // Continue long replies (NAMES) as the buffer drains
 	}
+
+	handleWriteReadyPending(writeFds);
+}
+
+/**
+Sends as much of an output buffer as the socket accepts and removes the sent part.
+
+ @param fd				The socket to write to.
+ @param outputBuffer	What the server has prepared to send to the client.
+ @return				`false` if the connection is broken (`EPIPE`, `ECONNRESET`),
+						`true` otherwise (if errno is `EAGAIN` or `EWOULDBLOCK`, the rest
+						is just sent in the next `select()` loop).
+*/
+bool	Server::sendOutputBuffer(int fd, std::string& outputBuffer)
+{
+	ssize_t	bytesSent = send(fd, outputBuffer.c_str(), outputBuffer.length(), 0);
+
+	if (bytesSent > 0) // Successfully sent some data. Remove it from the buffer.
+		outputBuffer.erase(0, bytesSent);
+	else if (bytesSent == -1 && (errno == EPIPE || errno == ECONNRESET)) // send() failed
+		return false;
+	return true;
 }
 
 //////////////
@@ -326,7 +385,14 @@ void	Server::deleteUser(int fd, std::string logMsg)
 	// Log before we close and erase everything
 	user->logUserAction(logMsg, user->getIsBot());
 
-	close(fd);
+	if (_replication.removeUser(*user))
+		shutdown(fd, SHUT_RDWR);	// The standby holds a copy: closing ours alone would not end the connection
+	if (isIoAttached(user))
+		_ioWorkers.detach(user->getIoSerial(), fd, user->getOutputBuffer()); // Its thread closes the socket
+	else
+		close(fd);
+	_timers.cancel(&user->getKeepaliveTimer());
+	cancelBotJobs(fd);
 	user->markDisconnected();
 	_usersFd.erase(fd);
 	_usersNick.erase(nick);
@@ -336,7 +402,7 @@ void	Server::deleteUser(int fd, std::string logMsg)
 /**
 Handles the full disconnection process for a user.
 This is the central point for all disconnections (quit and error).
-It broadcasts the QUIT message and cleans up all server resources.
+It broadcasts the QUIT message (to the other servers too) and cleans up all server resources.
 */
 void	Server::disconnectUser(int fd, const std::string& reason)
 {
@@ -344,6 +410,21 @@ void	Server::disconnectUser(int fd, const std::string& reason)
 	if (!user)
 		return; // User already disconnected
 
+	if (user->isRegistered())
+		propagate(":" + user->getNickname() + " QUIT :" + reason);
+	quitChannels(user, reason);
+
+	// Finally, delete the user from the server
+	deleteUser(fd, toString("disconnected: ") + YELLOW + reason + RESET);
+}
+
+/**
+Sends a user's QUIT to the local members of their channels, removes them from
+each channel, and deletes the channels nobody is left in (apart from the bot).
+Used for local users leaving and for users of other servers (QUIT, KILL, netsplit).
+*/
+void	Server::quitChannels(User* user, const std::string& reason)
+{
 	// Build unique set of users to notify
 	std::set<User*>					recipients;
 	const std::set<std::string>		channels = user->getChannels();
@@ -358,12 +439,13 @@ void	Server::disconnectUser(int fd, const std::string& reason)
 			for (std::map<std::string, User*>::const_iterator mem_it = members.begin(); mem_it != members.end(); ++mem_it)
 			{
 				User*	member = mem_it->second;
-				if (member)
+				if (member && !member->getLink()) // Other servers send their users the QUIT themselves
 					recipients.insert(member);
 			}
 		}
 	}
 	recipients.erase(user); // Don't send QUIT to the user who is quitting
+	recipients.erase(_botUser); // Virtual user, nothing to deliver
 
 	// Broadcast the quit message to all collected recipients
 	for (std::set<User*>::iterator it = recipients.begin(); it != recipients.end(); ++it)
@@ -377,14 +459,18 @@ void	Server::disconnectUser(int fd, const std::string& reason)
 			channel->remove_user(user);
 	}
 
-	// If quitter was last user in any channel, delete that channel
+	// If quitter was last user in any channel (apart from the bot), delete that channel
 	for (std::set<std::string>::const_iterator it = channels.begin(); it != channels.end(); ++it)
 	{
 		Channel*	channel = getChannel(*it);
-		if (channel && !channel->get_connected_user_number())
+		if (!channel)
+			continue;
+		if (_botMode && channel->get_connected_user_number() == 1 && channel->is_user_member(_botUser))
+		{
+			_botUser->removeChannel(*it);
+			deleteChannel(*it, "no connected users");
+		}
+		else if (!channel->get_connected_user_number())
 			deleteChannel(*it, "no connected users");
 	}
-
-	// Finally, delete the user from the server
-	deleteUser(fd, toString("disconnected: ") + YELLOW + reason + RESET);
 }
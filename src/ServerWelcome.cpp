@@ -0,0 +1,239 @@
+#include <string>
+#include <vector>
+#include <cerrno>		// errno
+#include <cstring>		// strerror(), memchr()
+
+#include <fcntl.h>		// open()
+#include <unistd.h>		// close()
+#include <sys/mman.h>	// mmap(), munmap()
+#include <sys/stat.h>	// fstat()
+
+#include "../include/Server.hpp"
+#include "../include/User.hpp"
+#include "../include/ReplyBurst.hpp"
+#include "../include/IrcChars.hpp"	// IrcChars::getCaseMapping()
+#include "../include/Numerics.hpp"	// reply<>()
+#include "../include/defines.hpp"	// MOTD_FILE, MAX_*, HISTORY_*, UTF8_ONLY, MAX_CHANNEL_LIST, color formatting
+#include "../include/utils.hpp"		// toString()
+
+/**
+Returns the `CHANMODES` ISUPPORT value for the supported channel modes:
+list modes, modes that always take a parameter, modes that take one only
+when set, and flags (`o` is a membership prefix, see `PREFIX`).
+*/
+static std::string	getChanModesToken(const std::string& cModes)
+{
+	std::string	lists;
+	std::string	alwaysParam;
+	std::string	setParam;
+	std::string	flags;
+
+	for (size_t i = 0; i < cModes.size(); ++i)
+	{
+		if (cModes[i] == 'o')
+			continue;
+		if (cModes[i] == 'b' || cModes[i] == 'e' || cModes[i] == 'I')
+			lists += cModes[i];
+		else if (cModes[i] == 'k')
+			alwaysParam += cModes[i];
+		else if (cModes[i] == 'l')
+			setParam += cModes[i];
+		else
+			flags += cModes[i];
+	}
+	return "CHANMODES=" + lists + "," + alwaysParam + "," + setParam + "," + flags;
+}
+
+// Escapes an ISUPPORT value (spaces and backslashes as `\xHH`).
+static std::string	escapeISupport(const std::string& value)
+{
+	std::string	result;
+
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		if (value[i] == ' ')
+			result += "\\x20";
+		else if (value[i] == '\\')
+			result += "\\x5C";
+		else
+			result += value[i];
+	}
+	return result;
+}
+
+/**
+Reads the MOTD file through a read-only memory mapping.
+
+ @param path		The MOTD file.
+ @param lines		Set to its lines (without line endings, cut to `maxLength` bytes).
+ @param maxLength	Longest line text that still fits into a `372` reply.
+ @return			`false` if the file cannot be read (`errno` is set).
+*/
+static bool	mapMotdFile(const char* path, std::vector<std::string>& lines, size_t maxLength)
+{
+	struct stat	st;
+	int			error = 0;
+	int			fd = open(path, O_RDONLY);
+
+	if (fd == -1)
+		return false;
+	if (fstat(fd, &st) == -1)
+		error = errno;
+	else if (!S_ISREG(st.st_mode))
+		error = EINVAL;
+	if (error)
+	{
+		close(fd);
+		errno = error;
+		return false;
+	}
+	if (st.st_size == 0) // Nothing to map: an empty MOTD
+	{
+		close(fd);
+		return true;
+	}
+
+	size_t	size = static_cast<size_t>(st.st_size);
+	void*	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping stays valid
+	if (map == MAP_FAILED)
+		return false;
+
+	const char*	p = static_cast<const char*>(map);
+	const char*	end = p + size;
+	while (p < end)
+	{
+		const char*	eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char*	next = eol ? eol + 1 : end;
+		if (!eol)
+			eol = end;
+		if (eol > p && eol[-1] == '\r')
+			--eol;
+
+		std::string	line;
+		for (; p < eol && line.size() < maxLength; ++p)
+		{
+			if (*p != '\0')
+				line += *p;
+		}
+		lines.push_back(line);
+		p = next;
+	}
+	munmap(map, size);
+	return true;
+}
+
+/**
+Serializes the server-constant replies once (startup and `SIGHUP`), so a
+registration burst only needs to fill in the client's nickname:
+
+ - Welcome burst: `001`–`004` and the ISUPPORT tokens (`005`).
+ - MOTD (`375`, `372`, `376`), read from `MOTD_FILE`; if it cannot be read,
+   `422` is sent instead.
+*/
+void	Server::buildReplyBursts(void)
+{
+	BurstRenderer	welcome(_welcomeBurst, _replyPrefix);
+
+	_welcomeBurst.clear();
+	reply<RPL_WELCOME>(&welcome, _network, ReplyBurst::nick, ReplyBurst::user, ReplyBurst::host);
+	reply<RPL_YOURHOST>(&welcome, _name, _version);
+	reply<RPL_CREATED>(&welcome, _creationTime);
+	reply<RPL_MYINFO>(&welcome, _name, _version, _uModes, _cModes);
+
+	std::vector<std::string>	tokens;
+	tokens.push_back(toString("CASEMAPPING=") + IrcChars::getCaseMapping());
+	tokens.push_back("CHANTYPES=#&");
+	tokens.push_back(getChanModesToken(_cModes));
+	tokens.push_back("PREFIX=(o)@");
+	tokens.push_back("CHANLIMIT=#&:" + toString(_maxChannels));
+	tokens.push_back("NICKLEN=" + toString(MAX_NICK_LENGTH));
+	tokens.push_back("CHANNELLEN=" + toString(MAX_CHANNEL_LENGTH));
+	tokens.push_back("USERLEN=" + toString(MAX_USER_LENGTH));
+	tokens.push_back("NETWORK=" + escapeISupport(_network));
+	tokens.push_back("ELIST=CMNTU");	// LIST filters (see `ListStream::parse()`)
+	tokens.push_back("SAFELIST");		// LIST is streamed, it cannot flood the client's buffer
+	tokens.push_back("CHATHISTORY=" + toString(HISTORY_MAX_REPLAY));
+	tokens.push_back("MSGREFTYPES=msgid,timestamp");
+	tokens.push_back("EXCEPTS=e");
+	tokens.push_back("INVEX=I");
+	tokens.push_back("MAXLIST=beI:" + toString(MAX_CHANNEL_LIST));
+	if (UTF8_ONLY)
+		tokens.push_back("UTF8ONLY");	// See `Command::checkUtf8()`
+	for (size_t i = 0; i < tokens.size(); i += ISUPPORT_PER_LINE)
+	{
+		std::string	line = tokens[i];
+		for (size_t j = i + 1; j < tokens.size() && j < i + ISUPPORT_PER_LINE; ++j)
+			line += " " + tokens[j];
+		reply<RPL_ISUPPORT>(&welcome, line);
+	}
+
+	std::vector<std::string>	lines;
+	size_t						maxLength = MAX_LINE_LENGTH - _replyPrefix.size() - 4 - MAX_NICK_LENGTH - 4 - 2;
+	BurstRenderer				motd(_motdBurst, _replyPrefix);
+
+	_motdBurst.clear();
+	_hasMotd = mapMotdFile(MOTD_FILE, lines, maxLength);
+	if (!_hasMotd)
+	{
+		logServerMessage(YELLOW + toString("WARNING: No MOTD (") + MOTD_FILE + ": " + strerror(errno) + ")"
+			+ RESET);
+		return;
+	}
+	reply<RPL_MOTDSTART>(&motd, _name);
+	for (size_t i = 0; i < lines.size(); ++i)
+		reply<RPL_MOTD>(&motd, lines[i]);
+	reply<RPL_ENDOFMOTD>(&motd);
+	logServerMessage(toString("MOTD loaded: ") + YELLOW + toString(lines.size()) + RESET + " lines from "
+		+ YELLOW + MOTD_FILE + RESET);
+}
+
+/**
+Appends the registration burst to a new user's output buffer: the cached
+welcome replies (`001`–`005`), the user counts (`LUSERS`) and the MOTD.
+*/
+void	Server::sendWelcomeBurst(User* user)
+{
+	_welcomeBurst.write(user->getOutputBuffer(), user->getNickname(), user->getUsername(), user->getHost());
+	sendLusers(user);
+	sendMotd(user);
+}
+
+/**
+Sends the user and channel counts (`251`, `253`–`255`, `265`, `266`).
+Local counts are this server's users, global ones the whole network's.
+*/
+void	Server::sendLusers(User* user)
+{
+	unsigned long	global = _usersNick.size();
+	unsigned long	users = global - _remoteUserCount;
+	unsigned long	peak = _peakUsers > users ? _peakUsers : users; // Peak is updated after the burst
+	unsigned long	globalPeak = _peakGlobalUsers > global ? _peakGlobalUsers : global;
+	unsigned long	servers = 0; // Directly linked
+
+	for (std::map<int, ServerLink*>::const_iterator it = _links.begin(); it != _links.end(); ++it)
+	{
+		if (it->second->getState() == ServerLink::LINK_ACTIVE)
+			++servers;
+	}
+
+	reply<RPL_LUSERCLIENT>(user, global, static_cast<unsigned long>(getServerCount()));
+	if (_unregCount > 0)
+		reply<RPL_LUSERUNKNOWN>(user, static_cast<unsigned long>(_unregCount));
+	if (!_channels.empty())
+		reply<RPL_LUSERCHANNELS>(user, static_cast<unsigned long>(_channels.size()));
+	reply<RPL_LUSERME>(user, users, servers);
+	reply<RPL_LOCALUSERS>(user, users, peak, users, peak);
+	reply<RPL_GLOBALUSERS>(user, global, globalPeak, global, globalPeak);
+}
+
+// Sends the cached MOTD, or `422` if there is none.
+void	Server::sendMotd(User* user)
+{
+	if (!_hasMotd)
+	{
+		reply<ERR_NOMOTD>(user);
+		return;
+	}
+	_motdBurst.write(user->getOutputBuffer(), user->getNickname(), user->getUsername(), user->getHost());
+}
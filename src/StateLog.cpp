@@ -0,0 +1,576 @@
+#include <string>
+#include <set>
+#include <map>
+#include <utility>		// std::make_pair
+#include <cerrno>		// errno
+#include <cstring>		// memcmp(), strerror()
+#include <stdint.h>		// uint32_t, int64_t
+
+#include <fcntl.h>		// open()
+#include <unistd.h>		// write(), close(), ftruncate(), fsync()
+#include <sys/mman.h>	// mmap(), munmap()
+#include <sys/stat.h>	// fstat()
+#include <stdio.h>		// rename()
+
+#include "../include/StateLog.hpp"
+#include "../include/Channel.hpp"
+#include "../include/Binary.hpp"		// putU32(), BinaryReader
+#include "../include/utils.hpp"		// getMonotonicUs(), toString()
+
+static const char	SNAPSHOT_MAGIC[8] = { 'I', 'R', 'C', 'S', 'N', 'A', 'P', 3 };
+static const char	JOURNAL_MAGIC[8] = { 'I', 'R', 'C', 'J', 'R', 'N', 'L', 3 };
+
+////////////////////
+// Binary records //
+////////////////////
+
+// A record is `<u32 size><u8 type><fields>`, the first field being the normalized
+// channel name (encoding: see `Binary.hpp`).
+
+// Prepends the size to a record's payload.
+static std::string	frame(const std::string& payload)
+{
+	std::string	record;
+
+	record.reserve(sizeof(uint32_t) + payload.size());
+	putU32(record, static_cast<uint32_t>(payload.size()));
+	return record.append(payload);
+}
+
+static std::string	encodeRecord(const std::string& channelKey, const ChannelState& state)
+{
+	std::string	payload;
+
+	putU8(payload, 1); // RECORD_STATE
+	putString(payload, channelKey);
+	StateLog::encodeState(payload, state);
+	return frame(payload);
+}
+
+// The list of `state` a mask record names (a `Channel::MaskList`), or `NULL`.
+static std::vector<MaskEntry>*	maskList(ChannelState& state, unsigned char list)
+{
+	switch (list)
+	{
+		case Channel::BAN_LIST:		return &state.bans;
+		case Channel::EXCEPT_LIST:	return &state.exceptions;
+		case Channel::INVEX_LIST:	return &state.inviteExceptions;
+	}
+	return NULL;
+}
+
+// Adds or removes (by the mask as stored) a mask of a saved list.
+static void	applyMask(std::vector<MaskEntry>& masks, const MaskEntry& entry, bool added)
+{
+	if (added)
+	{
+		masks.push_back(entry);
+		return;
+	}
+	for (size_t i = 0; i < masks.size(); ++i)
+	{
+		if (masks[i].mask == entry.mask)
+		{
+			masks.erase(masks.begin() + i);
+			return;
+		}
+	}
+}
+
+// Moves a decoded state into its place in the map (no copies of the strings or the lists).
+static void	moveState(ChannelState& from, ChannelState& to)
+{
+	to.name.swap(from.name);
+	to.topic.swap(from.topic);
+	to.topicSetBy.swap(from.topicSetBy);
+	to.topicSetAt = from.topicSetAt;
+	to.inviteOnly = from.inviteOnly;
+	to.topicProtection = from.topicProtection;
+	to.userLimit = from.userLimit;
+	to.key.swap(from.key);
+	to.invites.swap(from.invites);
+	to.bans.swap(from.bans);
+	to.exceptions.swap(from.exceptions);
+	to.inviteExceptions.swap(from.inviteExceptions);
+	to.claimed = from.claimed;
+	from.invites.clear();
+	from.bans.clear();
+	from.exceptions.clear();
+	from.inviteExceptions.clear();
+}
+
+// Writes all of `data`, retrying after partial writes.
+static bool	writeAll(int fd, const std::string& data)
+{
+	size_t	done = 0;
+
+	while (done < data.size())
+	{
+		ssize_t	n = write(fd, data.data() + done, data.size() - done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+//////////////
+// StateLog //
+//////////////
+
+StateLog::StateLog(const std::string& snapshotPath, const std::string& journalPath)
+	:	_snapshotPath(snapshotPath), _journalPath(journalPath), _journalFd(-1), _journalSize(0),
+		_unclaimed(0)
+{
+	_stats.snapshotRecords = 0;
+	_stats.journalRecords = 0;
+	_stats.loadUs = 0;
+	_stats.journalWrites = 0;
+	_stats.snapshots = 0;
+}
+
+StateLog::~StateLog()
+{
+	close();
+}
+
+/**
+Loads the snapshot, replays the journal over it, and opens the journal for
+appending (cut back to its last complete record).
+
+ @param error	Set to what went wrong, if anything; the states read so far
+				are kept and the journal is opened all the same.
+ @return		`false` if a file could not be read or was damaged.
+*/
+bool	StateLog::open(std::string& error)
+{
+	unsigned long	startUs = getMonotonicUs();
+	bool			loaded;
+
+	close();
+	_states.clear();
+	_journalSize = 0;
+	loaded = loadFile(_snapshotPath, true, error);
+	loaded = loadFile(_journalPath, false, error) && loaded;
+	_stats.loadUs = getMonotonicUs() - startUs;
+	_unclaimed = _states.size();
+
+	_journalFd = ::open(_journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (_journalFd == -1 || ftruncate(_journalFd, _journalSize) == -1
+		|| (_journalSize == 0 && !writeAll(_journalFd, std::string(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)))))
+	{
+		error = _journalPath + ": " + strerror(errno);
+		close();
+		return false;
+	}
+	if (_journalSize == 0)
+		_journalSize = sizeof(JOURNAL_MAGIC);
+	return loaded;
+}
+
+// Stops journaling (e.g. on shutdown, so channels deleted then are not dropped).
+void	StateLog::close()
+{
+	if (_journalFd != -1)
+		::close(_journalFd);
+	_journalFd = -1;
+}
+
+/**
+Writes the state of all channels to a new snapshot, then empties the journal.
+The snapshot is written to a temporary file and renamed over the old one, so
+a crash leaves either snapshot intact (and the journal replays over both).
+
+ @param dropUnclaimed	Leave out restored states no channel has claimed.
+*/
+bool	StateLog::writeSnapshot(bool dropUnclaimed, std::string& error)
+{
+	if (_journalFd == -1 || (!hasChanges() && (!dropUnclaimed || _unclaimed == 0)))
+		return true; // The snapshot is up to date
+
+	std::string	data(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	std::map<std::string, ChannelState>::iterator	it = _states.begin();
+	while (it != _states.end())
+	{
+		if (dropUnclaimed && !it->second.claimed)
+			_states.erase(it++);
+		else
+		{
+			data += encodeRecord(it->first, it->second);
+			++it;
+		}
+	}
+	if (dropUnclaimed)
+		_unclaimed = 0;
+
+	std::string	tmpPath = _snapshotPath + ".tmp";
+	int			fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1 || !writeAll(fd, data) || fsync(fd) == -1 || ::close(fd) == -1
+		|| rename(tmpPath.c_str(), _snapshotPath.c_str()) == -1)
+	{
+		error = tmpPath + ": " + strerror(errno);
+		if (fd != -1)
+			::close(fd);
+		return false;
+	}
+	++_stats.snapshots;
+
+	if (ftruncate(_journalFd, 0) == -1 || !writeAll(_journalFd, std::string(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC))))
+	{
+		error = _journalPath + ": " + strerror(errno);
+		return false;
+	}
+	_journalSize = sizeof(JOURNAL_MAGIC);
+	return true;
+}
+
+// Journals the full state of a channel (after a topic or mode change).
+void	StateLog::save(const Channel& channel)
+{
+	if (_journalFd == -1)
+		return;
+
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channel.get_name_lower());
+	if (it == _states.end())
+		it = _states.insert(std::make_pair(channel.get_name_lower(), ChannelState())).first;
+	else if (!it->second.claimed)
+		--_unclaimed; // Changed before it was restored: the new state wins
+
+	ChannelState&	state = it->second;
+	channel.save_state(state);
+	state.claimed = true;
+	append(encodeRecord(it->first, state));
+}
+
+// Journals a nickname added to a channel's invite list.
+void	StateLog::saveInvite(const Channel& channel, const std::string& nickLower)
+{
+	if (_journalFd == -1)
+		return;
+
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channel.get_name_lower());
+	if (it == _states.end() || !it->second.claimed)
+	{
+		save(channel); // First change of this channel: its full state
+		return;
+	}
+	it->second.invites.insert(nickLower);
+
+	std::string	payload;
+	putU8(payload, RECORD_INVITE);
+	putString(payload, channel.get_name_lower());
+	putString(payload, nickLower);
+	append(frame(payload));
+}
+
+/**
+Journals a mask added to or removed from a channel's ban, exception or
+invite-exception list (`list` is a `Channel::MaskList`), instead of the
+whole state with all its lists.
+*/
+void	StateLog::saveMask(const Channel& channel, int list, const MaskEntry& entry, bool added)
+{
+	if (_journalFd == -1)
+		return;
+
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channel.get_name_lower());
+	if (it == _states.end() || !it->second.claimed)
+	{
+		save(channel); // First change of this channel: its full state
+		return;
+	}
+	applyMask(*maskList(it->second, static_cast<unsigned char>(list)), entry, added);
+
+	std::string	payload;
+	putU8(payload, added ? RECORD_MASK_ADD : RECORD_MASK_REMOVE);
+	putString(payload, channel.get_name_lower());
+	putU8(payload, static_cast<unsigned char>(list));
+	putString(payload, entry.mask);
+	if (added)
+	{
+		putString(payload, entry.setBy);
+		putI64(payload, static_cast<int64_t>(entry.setAt));
+	}
+	append(frame(payload));
+}
+
+// Journals that a channel was deleted: its state is gone.
+void	StateLog::drop(const std::string& channelKey)
+{
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channelKey);
+	if (_journalFd == -1 || it == _states.end())
+		return;
+	if (!it->second.claimed)
+		--_unclaimed;
+	_states.erase(it);
+
+	std::string	payload;
+	putU8(payload, RECORD_DROP);
+	putString(payload, channelKey);
+	append(frame(payload));
+}
+
+/**
+Gives a newly created channel the state it had before the restart, if any.
+
+ @return	`true` if a state was restored.
+*/
+bool	StateLog::restore(Channel* channel)
+{
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channel->get_name_lower());
+
+	if (it == _states.end() || it->second.claimed)
+		return false;
+	channel->restore_state(it->second);
+	it->second.claimed = true;
+	--_unclaimed;
+	return true;
+}
+
+/**
+Marks the saved state of a live channel as claimed without applying it: the
+channel was taken over by a hot upgrade and already has that state.
+*/
+void	StateLog::claim(const Channel& channel)
+{
+	std::map<std::string, ChannelState>::iterator	it = _states.find(channel.get_name_lower());
+
+	if (it == _states.end() || it->second.claimed)
+		return;
+	it->second.claimed = true;
+	--_unclaimed;
+}
+
+bool	StateLog::isOpen() const
+{
+	return _journalFd != -1;
+}
+
+// True if the journal holds changes that are not in the snapshot yet.
+bool	StateLog::hasChanges() const
+{
+	return _journalSize > sizeof(JOURNAL_MAGIC);
+}
+
+// Returns the number of channels with a saved state (claimed or not).
+size_t	StateLog::getChannelCount() const
+{
+	return _states.size();
+}
+
+// Returns the number of restored states still waiting for their channel.
+size_t	StateLog::getUnclaimedCount() const
+{
+	return _unclaimed;
+}
+
+const StateLog::Stats&	StateLog::getStats() const
+{
+	return _stats;
+}
+
+/**
+Reads the snapshot or the journal through a read-only memory mapping and
+applies its records. A missing file is not an error (nothing saved yet).
+In the journal, the valid records are counted in `_journalSize`, so a record
+cut short by a crash is truncated when the journal is reopened.
+*/
+bool	StateLog::loadFile(const std::string& path, bool isSnapshot, std::string& error)
+{
+	const char*	magic = isSnapshot ? SNAPSHOT_MAGIC : JOURNAL_MAGIC;
+	struct stat	st;
+	int			fd = ::open(path.c_str(), O_RDONLY);
+
+	if (fd == -1)
+	{
+		if (errno == ENOENT)
+			return true;
+		error = path + ": " + strerror(errno);
+		return false;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size == 0)
+	{
+		::close(fd);
+		return true;
+	}
+
+	size_t	size = static_cast<size_t>(st.st_size);
+	void*	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping stays valid
+	if (map == MAP_FAILED)
+	{
+		error = path + ": " + strerror(errno);
+		return false;
+	}
+
+	const char*	start = static_cast<const char*>(map);
+	BinaryReader	file(start, start + size);
+	char			header[sizeof(SNAPSHOT_MAGIC)];
+	if (!file.take(header, sizeof(header)) || memcmp(header, magic, sizeof(header)) != 0)
+	{
+		munmap(map, size);
+		error = path + ": not a channel state file";
+		return false;
+	}
+
+	uint32_t		recordSize;
+	ChannelState	state;	// Decoded into, then moved into `_states` (keeps its buffers between records)
+	while (file.pos < file.end)
+	{
+		const char*	recordStart = file.pos;
+		if (!file.takeU32(recordSize) || static_cast<size_t>(file.end - file.pos) < recordSize)
+		{
+			file.ok = false;
+			file.pos = recordStart;
+			break;
+		}
+
+		BinaryReader	record(file.pos, file.pos + recordSize);
+		unsigned char	type = 0;
+		unsigned char	list = 0;
+		std::string		name;
+		std::string		nick;
+		MaskEntry		entry;
+		int64_t			setAt = 0;
+		record.takeU8(type);
+		if (type == RECORD_STATE && record.takeString(name) && StateLog::decodeState(record, state))
+		{
+			// The snapshot is written in key order: hinting at the end makes each insert O(1)
+			std::map<std::string, ChannelState>::iterator	it
+				= _states.insert(_states.end(), std::make_pair(name, ChannelState()));
+			moveState(state, it->second);
+		}
+		else if (type == RECORD_INVITE && record.takeString(name) && record.takeString(nick))
+		{
+			std::map<std::string, ChannelState>::iterator	it = _states.find(name);
+			if (it != _states.end())
+				it->second.invites.insert(nick);
+		}
+		else if (type == RECORD_DROP && record.takeString(name))
+			_states.erase(name);
+		else if ((type == RECORD_MASK_ADD || type == RECORD_MASK_REMOVE) && record.takeString(name)
+			&& record.takeU8(list) && record.takeString(entry.mask)
+			&& (type == RECORD_MASK_REMOVE || (record.takeString(entry.setBy) && record.takeI64(setAt))))
+		{
+			std::map<std::string, ChannelState>::iterator	it = _states.find(name);
+			entry.setAt = static_cast<time_t>(setAt);
+			if (list >= Channel::MASK_LISTS)
+				record.ok = false;
+			else if (it != _states.end())
+				applyMask(*maskList(it->second, list), entry, type == RECORD_MASK_ADD);
+		}
+		else
+			record.ok = false;
+		if (!record.ok)
+		{
+			file.ok = false;
+			file.pos = recordStart;
+			break;
+		}
+		file.pos = record.end;
+		++(isSnapshot ? _stats.snapshotRecords : _stats.journalRecords);
+	}
+
+	if (!isSnapshot)
+		_journalSize = file.pos - start;
+	munmap(map, size);
+	if (!file.ok)
+		error = path + ": damaged record at offset " + toString(file.pos - start) + ", ignored from there on";
+	return file.ok;
+}
+
+// Appends a ban, exception or invite-exception list to `out`.
+static void	encodeMasks(std::string& out, const std::vector<MaskEntry>& masks)
+{
+	putU32(out, static_cast<uint32_t>(masks.size()));
+	for (size_t i = 0; i < masks.size(); ++i)
+	{
+		putString(out, masks[i].mask);
+		putString(out, masks[i].setBy);
+		putI64(out, static_cast<int64_t>(masks[i].setAt));
+	}
+}
+
+// Reads a list written by `encodeMasks()` into `masks`.
+static void	decodeMasks(BinaryReader& in, std::vector<MaskEntry>& masks)
+{
+	uint32_t	count = 0;
+	int64_t		setAt;
+
+	in.takeU32(count);
+	for (uint32_t i = 0; in.ok && i < count; ++i)
+	{
+		masks.push_back(MaskEntry());
+		in.takeString(masks.back().mask);
+		in.takeString(masks.back().setBy);
+		in.takeI64(setAt);
+		masks.back().setAt = static_cast<time_t>(setAt);
+	}
+}
+
+// Appends the fields of a channel state to `out` (see `Binary.hpp`).
+void	StateLog::encodeState(std::string& out, const ChannelState& state)
+{
+	putString(out, state.name);
+	putString(out, state.topic);
+	putString(out, state.topicSetBy);
+	putI64(out, static_cast<int64_t>(state.topicSetAt));
+	putU8(out, (state.inviteOnly ? 1 : 0) | (state.topicProtection ? 2 : 0));
+	putU32(out, static_cast<uint32_t>(state.userLimit));
+	putString(out, state.key);
+	putU32(out, static_cast<uint32_t>(state.invites.size()));
+	for (std::set<std::string>::const_iterator it = state.invites.begin(); it != state.invites.end(); ++it)
+		putString(out, *it);
+	encodeMasks(out, state.bans);
+	encodeMasks(out, state.exceptions);
+	encodeMasks(out, state.inviteExceptions);
+}
+
+/**
+Reads the fields written by `encodeState()` into `state` (unclaimed).
+`state.invites` and the mask lists must be empty.
+
+ @return	`false` if the input ended early.
+*/
+bool	StateLog::decodeState(BinaryReader& in, ChannelState& state)
+{
+	int64_t			setAt;
+	unsigned char	flags;
+	uint32_t		limit;
+	uint32_t		invites;
+	std::string		nick;
+
+	in.takeString(state.name);
+	in.takeString(state.topic);
+	in.takeString(state.topicSetBy);
+	in.takeI64(setAt);
+	in.takeU8(flags);
+	in.takeU32(limit);
+	in.takeString(state.key);
+	in.takeU32(invites);
+	for (uint32_t i = 0; in.ok && i < invites; ++i)
+	{
+		in.takeString(nick);
+		state.invites.insert(state.invites.end(), nick); // Written in order
+	}
+	decodeMasks(in, state.bans);
+	decodeMasks(in, state.exceptions);
+	decodeMasks(in, state.inviteExceptions);
+	state.topicSetAt = static_cast<time_t>(setAt);
+	state.inviteOnly = flags & 1;
+	state.topicProtection = flags & 2;
+	state.userLimit = static_cast<int>(limit);
+	state.claimed = false;
+	return in.ok;
+}
+
+// Appends a record to the journal.
+void	StateLog::append(const std::string& record)
+{
+	if (!writeAll(_journalFd, record))
+		return; // The change lives on in memory and makes it into the next snapshot
+	_journalSize += record.size();
+	++_stats.journalWrites;
+}
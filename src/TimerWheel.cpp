@@ -0,0 +1,232 @@
+#include "../include/TimerWheel.hpp"
+#include "../include/defines.hpp"	// TIMER_TICK_MS
+
+#include <cstddef>	// NULL
+
+///////////
+// Timer //
+///////////
+
+TimerWheel::Timer::Timer()
+	:	prev(NULL), next(NULL), expires(0), type(0), fd(-1), data(NULL)
+{}
+
+// A timer is armed while it is linked into one of the wheel's lists.
+bool	TimerWheel::Timer::isArmed() const
+{
+	return next != NULL;
+}
+
+////////////////
+// TimerWheel //
+////////////////
+
+TimerWheel::TimerWheel() : _currentTick(0), _count(0)
+{
+	for (int level = 0; level < LEVELS; ++level)
+		for (int slot = 0; slot < SLOTS; ++slot)
+			initList(&_slots[level][slot]);
+	initList(&_expired);
+}
+
+// Timers are owned by their embedding objects; only detach whatever is still linked.
+TimerWheel::~TimerWheel()
+{
+	for (int level = 0; level < LEVELS; ++level)
+		for (int slot = 0; slot < SLOTS; ++slot)
+			while (_slots[level][slot].next != &_slots[level][slot])
+				unlink(_slots[level][slot].next);
+	while (_expired.next != &_expired)
+		unlink(_expired.next);
+}
+
+/**
+Arms `timer` to fire `delayMs` milliseconds from the wheel's current time.
+An already armed timer is rescheduled.
+
+The delay is rounded up to whole ticks, so a timer never fires early.
+*/
+void	TimerWheel::schedule(Timer* timer, unsigned long delayMs)
+{
+	if (timer->isArmed())
+		cancel(timer);
+
+	unsigned long	ticks = (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	timer->expires = _currentTick + ticks;
+	insert(timer);
+	++_count;
+}
+
+// Disarms `timer`, wherever it currently is (wheel slot or expired list). No-op if not armed.
+void	TimerWheel::cancel(Timer* timer)
+{
+	if (!timer->isArmed())
+		return;
+	unlink(timer);
+	--_count;
+}
+
+/**
+Turns the wheel up to `nowMs`, moving every due timer to the expired list.
+
+If no timers are armed, the wheel simply jumps ahead, so an idle server
+does not replay hours of empty ticks after a long `select()`.
+*/
+void	TimerWheel::advance(unsigned long nowMs)
+{
+	unsigned long	nowTick = msToTick(nowMs);
+
+	if (_count == 0)
+	{
+		if (nowTick >= _currentTick)
+			_currentTick = nowTick + 1;
+		return;
+	}
+
+	while (_currentTick <= nowTick)
+		processTick();
+}
+
+// Detaches and returns the next expired timer, or `NULL` if there is none.
+TimerWheel::Timer*	TimerWheel::popExpired()
+{
+	if (_expired.next == &_expired)
+		return NULL;
+
+	Timer*	timer = _expired.next;
+	cancel(timer);
+	return timer;
+}
+
+/**
+Returns how long `select()` may sleep before the wheel needs to turn again.
+
+Only the level-0 slots up to the next cascade boundary are inspected (at most 64),
+so the cost is constant no matter how many timers are armed.
+
+ @param nowMs	Current monotonic time in milliseconds.
+ @return		Milliseconds to sleep, `0` if timers are already due,
+				`-1` if no timers are armed (block indefinitely).
+*/
+long	TimerWheel::getTimeoutMs(unsigned long nowMs) const
+{
+	if (_count == 0)
+		return -1;
+	if (_expired.next != &_expired)
+		return 0;
+
+	int				index = static_cast<int>(_currentTick & SLOT_MASK);
+	unsigned long	targetTick = _currentTick + (SLOTS - index); // next cascade boundary
+
+	for (int slot = index; slot < SLOTS; ++slot)
+	{
+		if (_slots[0][slot].next != &_slots[0][slot])
+		{
+			targetTick = _currentTick + (slot - index);
+			break;
+		}
+	}
+
+	unsigned long	targetMs = targetTick * TIMER_TICK_MS;
+	if (targetMs <= nowMs)
+		return 0;
+	return static_cast<long>(targetMs - nowMs);
+}
+
+// Returns the number of armed timers.
+size_t	TimerWheel::size() const
+{
+	return _count;
+}
+
+/////////////
+// HELPERS //
+/////////////
+
+// Puts `timer` into the slot matching its distance from the current tick.
+void	TimerWheel::insert(Timer* timer)
+{
+	unsigned long	expires = timer->expires;
+	Timer*			head;
+
+	if (expires < _currentTick) // Already due: fire on the next processed tick
+		head = &_slots[0][_currentTick & SLOT_MASK];
+	else
+	{
+		unsigned long	delta = expires - _currentTick;
+		int				level = 0;
+
+		while (level < LEVELS - 1 && delta >= (1UL << (SLOT_BITS * (level + 1))))
+			++level;
+
+		// Clamp timers beyond the wheel's horizon to its furthest slot
+		unsigned long	horizon = (1UL << (SLOT_BITS * LEVELS)) - 1;
+		if (delta > horizon)
+			expires = timer->expires = _currentTick + horizon;
+
+		head = &_slots[level][(expires >> (SLOT_BITS * level)) & SLOT_MASK];
+	}
+	linkBefore(head, timer);
+}
+
+// Re-inserts all timers of the current slot at `level`; they land in finer levels.
+void	TimerWheel::cascade(int level)
+{
+	Timer*	head = &_slots[level][(_currentTick >> (SLOT_BITS * level)) & SLOT_MASK];
+
+	while (head->next != head)
+	{
+		Timer*	timer = head->next;
+		unlink(timer);
+		insert(timer);
+	}
+}
+
+// Processes a single tick: cascades coarser levels on wrap-around and expires level 0.
+void	TimerWheel::processTick()
+{
+	int	index = static_cast<int>(_currentTick & SLOT_MASK);
+
+	for (int level = 1; level < LEVELS && index == 0; ++level)
+	{
+		cascade(level);
+		index = static_cast<int>((_currentTick >> (SLOT_BITS * level)) & SLOT_MASK);
+	}
+
+	Timer*	head = &_slots[0][_currentTick & SLOT_MASK];
+	while (head->next != head)
+	{
+		Timer*	timer = head->next;
+		unlink(timer);
+		linkBefore(&_expired, timer);
+	}
+	++_currentTick;
+}
+
+void	TimerWheel::initList(Timer* head)
+{
+	head->prev = head;
+	head->next = head;
+}
+
+// Appends `timer` to the circular list headed by `head`.
+void	TimerWheel::linkBefore(Timer* head, Timer* timer)
+{
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+void	TimerWheel::unlink(Timer* timer)
+{
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->prev = NULL;
+	timer->next = NULL;
+}
+
+unsigned long	TimerWheel::msToTick(unsigned long ms)
+{
+	return ms / TIMER_TICK_MS;
+}
@@ -4,17 +4,62 @@
 #include <sstream>		// std::ostringstream
 
 #include "../include/User.hpp"
+#include "../include/PendingUser.hpp"
 #include "../include/Server.hpp"
-#include "../include/defines.hpp"	// color formatting
+#include "../include/ReplyStream.hpp"
+#include "../include/Handoff.hpp"	// UserHandoff
+#include "../include/defines.hpp"	// color formatting, SENDQ_WATERMARK
 #include "../include/utils.hpp"		// getTimestamp(), toString()
 
 // '*' is default nickname for unregistered users
 User::User(int fd, Server* server)
-	:	_fd(fd), _nickname("*"), _server(server), _hasNick(false),
-		_hasUser(false), _hasPassed(false), _isRegistered(false), _isBot(false)
+	:	_fd(fd), _nickname("*"), _server(server), _link(NULL), _discardingLine(false), _hasNick(false),
+		_hasUser(false), _hasPassed(false), _isRegistered(false), _isBot(false), _caps(0),
+		_lastActivity(0), _pingSentAt(0), _ioSerial(0)
 {}
 
-User::~User() {}
+// Creates the full user for a connection that just completed registration.
+// The pending record's buffers are taken over (swapped), not copied.
+User::User(int fd, Server* server, PendingUser& pending)
+	:	_fd(fd), _nickname(pending.getNickname()), _nicknameLower(normalize(_nickname)),
+		_username(pending.getUsername()), _hasUsername(true), _realname(pending.getRealname()),
+		_host(pending.getHost()), _server(server), _link(NULL), _discardingLine(false), _hasNick(true), _hasUser(true),
+		_hasPassed(true), _isRegistered(false), _isBot(false), _caps(pending.getCaps()), _lastActivity(0), _pingSentAt(0),
+		_ioSerial(0)
+{
+	_inputBuffer.swap(pending.getInputBuffer());
+	_outputBuffer.swap(pending.getOutputBuffer());
+}
+
+// Takes over a user handed over by a hot upgrade (already registered, no welcome burst).
+// The buffers are taken over (swapped), not copied.
+User::User(int fd, Server* server, UserHandoff& handoff)
+	:	_fd(fd), _nickname(handoff.nickname), _nicknameLower(normalize(_nickname)),
+		_username(handoff.username), _hasUsername(true), _realname(handoff.realname),
+		_host(handoff.host), _server(server), _link(NULL), _discardingLine(false), _hasNick(true), _hasUser(true),
+		_hasPassed(true), _isRegistered(true), _isBot(false), _caps(handoff.caps), _lastActivity(handoff.lastActivity),
+		_pingSentAt(handoff.pingSentAt), _ioSerial(0)
+{
+	_inputBuffer.swap(handoff.inputBuffer);
+	_outputBuffer.swap(handoff.outputBuffer);
+}
+
+// A user connected to another server of the network, introduced over `link` (see `Server::addRemoteUser()`).
+// Registered from the start; has no socket (fd -1) and never gets a welcome burst.
+User::User(Server* server, ServerLink* link, const std::string& serverName, const std::string& nickname,
+		const std::string& username, const std::string& host, const std::string& realname)
+	:	_fd(-1), _nickname(nickname), _nicknameLower(normalize(nickname)), _username(username),
+		_hasUsername(true), _realname(realname), _host(host), _server(server), _link(link),
+		_serverName(serverName), _discardingLine(false), _hasNick(true), _hasUser(true), _hasPassed(true), _isRegistered(true),
+		_isBot(false), _caps(0), _lastActivity(0), _pingSentAt(0), _ioSerial(0)
+{}
+
+// Destructor: drops the long replies that were still being sent.
+User::~User()
+{
+	for (size_t i = 0; i < _replyStreams.size(); ++i)
+		delete _replyStreams[i];
+}
 
 // Returns the hostmask in the format: nickname!username@host
 std::string	User::buildHostmask() const
@@ -22,15 +67,24 @@ std::string	User::buildHostmask() const
 	return _nickname + "!" + _username + "@" + _host;
 }
 
+// Logs an action of this user (see `writeLog()`).
+void	User::logUserAction(const std::string& message, bool botMode)
+{
+	writeLog(_server, _nickname, _fd, message, botMode);
+}
+
 /**
-Formats a log line with timestamp, aligned nickname and fd columns.
+Formats a log line with timestamp, aligned nickname and fd columns,
+and writes it to the console and the server's log file.
+Shared by `User` and `PendingUser`.
 
+ @param server	The server owning the log file
  @param nick	The user's nickname
  @param fd		The user's socket fd
  @param message	The message to log
  @param botMode	True if bot mode is active (to color bot messages differently)
 */
-void	User::logUserAction(const std::string& message, bool botMode)
+void	User::writeLog(Server* server, const std::string& nick, int fd, const std::string& message, bool botMode)
 {
 	std::string			logColor = GREEN;
 	std::ostringstream	fileLog;
@@ -39,19 +93,19 @@ void	User::logUserAction(const std::string& message, bool botMode)
 		logColor = BOT_COLOR;
 
 	std::cout	<< "[" << CYAN << getTimestamp() << RESET << "] "
-				<< logColor << std::left << std::setw(MAX_NICK_LENGTH + 1) << _nickname << RESET
-				<< "(" << MAGENTA << "fd " << std::right << std::setw(3) << _fd << RESET << ") "
+				<< logColor << std::left << std::setw(MAX_NICK_LENGTH + 1) << nick << RESET
+				<< "(" << MAGENTA << "fd " << std::right << std::setw(3) << fd << RESET << ") "
 				<< message << std::endl;
 
 	fileLog		<< "[" << getTimestamp() << "] "
-				<< std::left << std::setw(MAX_NICK_LENGTH + 1) << _nickname
-				<< "(fd " << std::right << std::setw(3) << _fd << ") "
+				<< std::left << std::setw(MAX_NICK_LENGTH + 1) << nick
+				<< "(fd " << std::right << std::setw(3) << fd << ") "
 				<< removeColorCodes(message) << "\n";
 
-	if (_server->getLogFile().is_open())
+	if (server->getLogFile().is_open())
 	{
-		_server->getLogFile() << fileLog.str();
-		_server->getLogFile().flush(); // Write immediately to disk
+		server->getLogFile() << fileLog.str();
+		server->getLogFile().flush(); // Write immediately to disk
 	}
 	
 }
@@ -82,20 +136,25 @@ void	User::setNickname(const std::string& displayNick, const std::string& normNi
 	logUserAction(toString("set nickname to ") + nickColor + displayNick + RESET, _isBot);
 
 	// If the user already had a nickname, remove the old one
+	std::string	oldNickLower = _nicknameLower;
 	if (_hasNick)
-		_server->removeNickMapping(_nickname);
+		_server->removeNickMapping(_nicknameLower);
 
 	// Add the new nickname to the server's user map and update the user object
 	_server->getNickMap()[normNick] = this;
 	_nickname = displayNick;
 	_nicknameLower = normNick;
 	_hasNick = true;
+
+	// A registered user is known to the standby under the old nickname (remote users are not replicated)
+	if (_isRegistered && !_link)
+		_server->getReplication().renameUser(oldNickLower, *this);
 }
 
-// Set the username for the user
+// Set the username for the user (cut to `MAX_USER_LENGTH`, advertised as USERLEN)
 void	User::setUsername(const std::string& username)
 {
-	_username = username;
+	_username = username.substr(0, MAX_USER_LENGTH);
 	_hasUser = true;
 }
 
@@ -123,6 +182,38 @@ void	User::setIsBotToTrue(void)
 	_isBot = true;
 }
 
+// Sets the `CAP_*` bits the client enabled (see `Command::handleCap()`).
+void	User::setCaps(unsigned char caps)
+{
+	_caps = caps;
+}
+
+/**
+Copies what a hot upgrade hands over to the new binary into `handoff`.
+Long replies still being generated are finished into the output buffer
+first: streams cannot be handed over, their output can.
+*/
+void	User::saveHandoff(UserHandoff& handoff)
+{
+	while (!_replyStreams.empty())
+	{
+		while (_replyStreams.front()->pump(_outputBuffer, SENDQ_WATERMARK))
+			;
+		delete _replyStreams.front();
+		_replyStreams.pop_front();
+	}
+	handoff.fd = _fd;
+	handoff.nickname = _nickname;
+	handoff.username = _username;
+	handoff.realname = _realname;
+	handoff.host = _host;
+	handoff.inputBuffer = _inputBuffer;
+	handoff.outputBuffer = _outputBuffer;
+	handoff.lastActivity = _lastActivity;
+	handoff.pingSentAt = _pingSentAt;
+	handoff.caps = _caps;
+}
+
 /////////////
 // Getters //
 /////////////
@@ -175,6 +266,17 @@ std::string&	User::getInputBuffer()
 	return _inputBuffer;
 }
 
+// True while the rest of an overlong line is dropped (see `Server::capPartialLine()`).
+bool	User::isDiscardingLine() const
+{
+	return _discardingLine;
+}
+
+void	User::setDiscardingLine(bool discarding)
+{
+	_discardingLine = discarding;
+}
+
 // Returns the output buffer where outgoing messages are queued.
 std::string&	User::getOutputBuffer()
 {
@@ -187,6 +289,79 @@ bool	User::getIsBot() const
 	return _isBot;
 }
 
+unsigned char	User::getCaps() const
+{
+	return _caps;
+}
+
+// Returns the link a remote user is reached through, or `NULL` for a user connected here.
+ServerLink*	User::getLink() const
+{
+	return _link;
+}
+
+// Returns the name of the server the user is connected to (this one for local users).
+const std::string&	User::getServerName() const
+{
+	return _link ? _serverName : _server->getServerName();
+}
+
+///////////////
+// Keepalive //
+///////////////
+
+// Returns the timer driving this user's PING/PONG keepalive.
+TimerWheel::Timer&	User::getKeepaliveTimer()
+{
+	return _keepaliveTimer;
+}
+
+// Records the time data was last received from the user.
+void	User::setLastActivity(unsigned long nowMs)
+{
+	_lastActivity = nowMs;
+}
+
+// Returns the time data was last received from the user.
+unsigned long	User::getLastActivity() const
+{
+	return _lastActivity;
+}
+
+// Records when a PING was sent to the user (`0` once it was answered).
+void	User::setPingSentAt(unsigned long nowMs)
+{
+	_pingSentAt = nowMs;
+}
+
+// Returns when the pending PING was sent, or `0` if none is pending.
+unsigned long	User::getPingSentAt() const
+{
+	return _pingSentAt;
+}
+
+/////////////////
+// I/O threads //
+/////////////////
+
+// Records the serial the I/O threads gave the user's socket (`0`: served by the event loop).
+void	User::setIoSerial(unsigned long serial)
+{
+	_ioSerial = serial;
+}
+
+// Returns the serial of the user's socket on the I/O threads, or `0` if the event loop serves it.
+unsigned long	User::getIoSerial() const
+{
+	return _ioSerial;
+}
+
+// True while long replies (NAMES) are still being generated into the output buffer.
+bool	User::hasReplyStreams() const
+{
+	return !_replyStreams.empty();
+}
+
 ////////////////////////
 // Channel management //
 ////////////////////////
@@ -1,48 +1,41 @@
-#include <sstream>	// std::ostringstream()
 #include "../include/User.hpp"
 #include "../include/Server.hpp"
+#include "../include/Numerics.hpp"	// appendReply()
+#include "../include/ReplyStream.hpp"
+#include "../include/defines.hpp"	// SENDQ_WATERMARK
 
 /**
-Appends the standard IRC welcome messages (numeric `001`–`004`) to user's output buffer
-after a user successfully completes registration.
+Appends the registration burst (welcome `001`–`005`, `LUSERS`, MOTD) to user's
+output buffer after a user successfully completes registration.
+The constant parts are serialized once by the server (see `Server::buildReplyBursts()`).
 
 Source: https://dd.ircdocs.horse/refs/numerics/
-
- @param server	Pointer to the Server object (used to get server name, version, modes, etc.)
 */
 void	User::sendWelcome()
 {
-	sendServerMsg("001 " + _nickname + " :Welcome to the " + _server->getNetwork()
-		+ " Network, " + _nickname	 + "!" + _username + "@" + _host); // username@host might be not needed, check with HexChat
-
-	sendServerMsg("002 " + _nickname + " :Your host is " + _server->getServerName()
-		+ ", running version " + _server->getVersion());
-
-	sendServerMsg("003 " + _nickname + " :This server was created " + _server->getCreationTime());
+	if (_fd == -1) // User not connected
+		return;
 
-	sendServerMsg("004 " + _nickname + " " + _server->getServerName() + " "
-		+ _server->getVersion() + " " + _server->getUModes() + " " + _server->getCModes());
+	_server->sendWelcomeBurst(this);
 }
 
 /**
-Appends an IRC numeric error to the user's output buffer (eventually flushed via `send()`).
-
- @param code		Numeric IRC error code (e.g. 464, 462, 433)
- @param param		Optional parameter for the error (e.g. nickname when invalid)
- @param message		Human-readable message to display
+Appends a numeric reply to the user's output buffer (eventually flushed via `send()`).
+Called by the `reply<>()` writer (see `Numerics.hpp`); the target is the
+user's nickname, or `*` before registration.
+
+ @param code	Numeric code (e.g. 464, 462, 433).
+ @param format	Catalog format of the reply.
+ @param args	The reply's parameters.
+ @param count	Number of parameters.
 */
-void	User::sendError(int code, const std::string& param, const std::string& message)
+void	User::writeReply(int code, const char* format, const ReplyArg* const* args, int count)
 {
-	std::ostringstream	oss;
-	std::string			target = isRegistered() ? _nickname : "*";	// If no nickname yet, use '*'
-
-	// Build message: <code> <target> [<param>] :<message>
-	oss << code << " " << target;
-	if (!param.empty())
-		oss << " " << param;
-	oss << " :" << message;
+	if (_fd == -1) // User not connected
+		return;
 
-	sendServerMsg(oss.str());
+	appendReply(_outputBuffer, _server->getReplyPrefix(), code,
+		isRegistered() ? ReplyArg(_nickname) : ReplyArg("*"), format, args, count);
 }
 
 /**
@@ -50,15 +43,16 @@ Appends a raw IRC message from the server to the user's output buffer,
 which is eventually flushed via `send()`.
 Automatically prefixes the message with the server name and appends `\r\n`.
 
- @param message	The already-formatted reply (e.g. "001 Alex :Welcome...")
+ @param message	The already-formatted message (e.g. "NOTICE Alex :Hello")
 */
 void	User::sendServerMsg(const std::string& message)
 {
 	if (_fd == -1) // User not connected
 		return;
 
-	std::string	fullMessage = ":" + _server->getServerName() + " " + message + "\r\n";
-	_outputBuffer += fullMessage;
+	const std::string&	prefix = _server->getReplyPrefix();
+	_outputBuffer.reserve(_outputBuffer.size() + prefix.size() + message.size() + 2);
+	_outputBuffer.append(prefix).append(message).append("\r\n", 2);
 }
 
 /**
@@ -76,3 +70,36 @@ void	User::sendMsgFromUser(const User* sender, const std::string& message)
 	std::string	fullMessage = ":" + sender->buildHostmask() + " " + message + "\r\n";
 	_outputBuffer += fullMessage;
 }
+
+/**
+Queues a long reply that is generated as the output buffer drains
+(see `ReplyStream`); takes ownership of `stream`. The first lines are
+written right away.
+*/
+void	User::queueReplyStream(ReplyStream* stream)
+{
+	if (_fd == -1) // User not connected
+	{
+		delete stream;
+		return;
+	}
+
+	_replyStreams.push_back(stream);
+	pumpReplyStreams();
+}
+
+/**
+Tops the output buffer up to `SENDQ_WATERMARK` bytes from the queued reply
+streams, oldest first. Called after each `send()` to the user.
+*/
+void	User::pumpReplyStreams()
+{
+	while (!_replyStreams.empty() && _outputBuffer.size() < SENDQ_WATERMARK)
+	{
+		if (!_replyStreams.front()->pump(_outputBuffer, SENDQ_WATERMARK - _outputBuffer.size()))
+		{
+			delete _replyStreams.front();
+			_replyStreams.pop_front();
+		}
+	}
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "../include/User.hpp"
+#include "../include/Server.hpp"
 #include "../include/utils.hpp"	// logUserAction()
 
 // Sets status of whether the user has passed the password check to `b`.
@@ -27,5 +28,6 @@ void	User::tryRegister()
 		_isRegistered = true;
 		logUserAction("successfully registered", _isBot);
 		sendWelcome();	// Send welcome messages
+		_server->finishRegistration(this);	// Stop the registration deadline, start keepalive
 	}
 }
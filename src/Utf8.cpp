@@ -0,0 +1,319 @@
+#include <string>
+#include <cstring>		// memcpy(), memset()
+#include <stdint.h>		// uint64_t
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>	// AVX2 intrinsics (the kernel enables its own target)
+# define UTF8_X86	1
+#else
+# define UTF8_X86	0
+#endif
+
+#include "../include/Utf8.hpp"
+
+////////////
+// Scalar //
+////////////
+
+static const uint64_t	HIGH_BITS = static_cast<uint64_t>(0x80808080) << 32 | 0x80808080;	// 0x80 in every byte
+
+/**
+Measures the sequence at `p` (`avail` bytes left), as Unicode 3.9, D93b has
+it: a valid sequence is taken whole (`valid` set), an invalid one only up to
+its longest valid beginning, at least 1 byte (one U+FFFD each).
+*/
+static size_t	measureSequence(const unsigned char* p, size_t avail, bool& valid)
+{
+	unsigned char	lead = p[0];
+	unsigned char	low = 0x80;		// Range of the first continuation byte
+	unsigned char	high = 0xBF;
+	size_t			need;
+
+	valid = false;
+	if (lead < 0x80)
+	{
+		valid = true;
+		return 1;
+	}
+	if (lead >= 0xC2 && lead <= 0xDF)
+		need = 1;
+	else if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		need = 2;
+		if (lead == 0xE0)
+			low = 0xA0;		// Overlong
+		else if (lead == 0xED)
+			high = 0x9F;	// Surrogates
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		need = 3;
+		if (lead == 0xF0)
+			low = 0x90;		// Overlong
+		else if (lead == 0xF4)
+			high = 0x8F;	// Above U+10FFFF
+	}
+	else
+		return 1; // Continuation byte, C0, C1, F5-FF
+
+	for (size_t k = 1; k <= need; ++k)
+	{
+		if (k >= avail || p[k] < low || p[k] > high)
+			return k;
+		low = 0x80;
+		high = 0xBF;
+	}
+	valid = true;
+	return need + 1;
+}
+
+// Byte at a time, but 8 at once while they are ASCII.
+static bool	validateScalar(const unsigned char* data, size_t size)
+{
+	size_t	i = 0;
+
+	while (i < size)
+	{
+		if (i + 8 <= size)
+		{
+			uint64_t	word;
+			memcpy(&word, data + i, sizeof(word));
+			if (!(word & HIGH_BITS))
+			{
+				i += 8;
+				continue;
+			}
+		}
+		bool	valid;
+		i += measureSequence(data + i, size - i, valid);
+		if (!valid)
+			return false;
+	}
+	return true;
+}
+
+//////////
+// AVX2 //
+//////////
+
+#if UTF8_X86
+
+// Error bits of a pair of bytes (previous byte, byte), one per kind of error
+enum
+{
+	TOO_SHORT = 1 << 0,		// 11______ 0_______ / 11______ 11______
+	TOO_LONG = 1 << 1,		// 0_______ 10______
+	OVERLONG_3 = 1 << 2,	// 11100000 100_____
+	TOO_LARGE = 1 << 3,		// 11110100 1001____ and above
+	SURROGATE = 1 << 4,		// 11101101 101_____
+	OVERLONG_2 = 1 << 5,	// 1100000_ 10______
+	TOO_LARGE_1000 = 1 << 6,	// 11110101 1000____ and above
+	OVERLONG_4 = 1 << 6,	// 11110000 1000____
+	TWO_CONTS = 1 << 7,		// 10______ 10______
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS	// Errors that do not depend on the low nibble of the previous byte
+};
+
+// By high nibble of the previous byte
+static const unsigned char	BYTE1_HIGH[16] =
+{
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+// By low nibble of the previous byte
+static const unsigned char	BYTE1_LOW[16] =
+{
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+// By high nibble of the byte
+static const unsigned char	BYTE2_HIGH[16] =
+{
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// The 32 bytes ending `n` bytes before the end of `input` (the last ones of `prev` shift in)
+# define UTF8_PREV(input, prev, n)	_mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - (n))
+
+// A 16-entry table in both lanes, for `_mm256_shuffle_epi8()`
+__attribute__((target("avx2")))
+static inline __m256i	loadTable(const unsigned char* table)
+{
+	return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+/**
+Error bits of one block (non-zero: invalid). The tables catch every bad pair
+of bytes; a byte that must be the 2nd continuation of a 3-byte lead or the
+3rd of a 4-byte lead (high bit after the subtraction) is an error unless the
+pair says "two continuations", and the XOR flips exactly that.
+*/
+__attribute__((target("avx2")))
+static inline __m256i	checkBlock(__m256i input, __m256i prev, __m256i byte1High, __m256i byte1Low,
+	__m256i byte2High)
+{
+	const __m256i	nibble = _mm256_set1_epi8(0x0F);
+	__m256i			prev1 = UTF8_PREV(input, prev, 1);
+	__m256i			special = _mm256_and_si256(_mm256_and_si256(
+		_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+		_mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+		_mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+	__m256i			third = _mm256_subs_epu8(UTF8_PREV(input, prev, 2), _mm256_set1_epi8(0xE0 - 0x80));
+	__m256i			fourth = _mm256_subs_epu8(UTF8_PREV(input, prev, 3), _mm256_set1_epi8(0xF0 - 0x80));
+	__m256i			must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+		_mm256_set1_epi8(static_cast<char>(0x80)));
+
+	return _mm256_xor_si256(must23, special);
+}
+
+/**
+Checks 32 bytes per step; a block that is ASCII, after one that was, is
+skipped. The partial last block is checked from a zero-padded copy, and one
+more block of zeros catches a sequence cut off at the end.
+*/
+__attribute__((target("avx2")))
+static bool	validateAvx2(const unsigned char* data, size_t size)
+{
+	const __m256i	byte1High = loadTable(BYTE1_HIGH);
+	const __m256i	byte1Low = loadTable(BYTE1_LOW);
+	const __m256i	byte2High = loadTable(BYTE2_HIGH);
+	__m256i			prev = _mm256_setzero_si256();
+	__m256i			error = _mm256_setzero_si256();
+	size_t			i = 0;
+
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i	input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		if (_mm256_movemask_epi8(_mm256_or_si256(input, prev)) != 0)
+			error = _mm256_or_si256(error, checkBlock(input, prev, byte1High, byte1Low, byte2High));
+		prev = input;
+	}
+	if (i < size)
+	{
+		unsigned char	tail[32];
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, data + i, size - i);
+		__m256i	input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+		error = _mm256_or_si256(error, checkBlock(input, prev, byte1High, byte1Low, byte2High));
+		prev = input;
+	}
+	error = _mm256_or_si256(error, checkBlock(_mm256_setzero_si256(), prev, byte1High, byte1Low, byte2High));
+	return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif
+
+///////////////////
+// Kernel choice //
+///////////////////
+
+typedef bool	(*Utf8Kernel)(const unsigned char* data, size_t size);
+
+// The best kernel the CPU runs.
+static Utf8Kernel	selectKernel()
+{
+#if UTF8_X86
+	__builtin_cpu_init(); // Runs before the constructors that would otherwise do it
+	if (__builtin_cpu_supports("avx2"))
+		return validateAvx2;
+#endif
+	return validateScalar;
+}
+
+static Utf8Kernel	s_kernel = selectKernel();	// Set before `main()`, so before any thread reads it
+
+//////////
+// Utf8 //
+//////////
+
+// True if `text` is well-formed UTF-8 (no overlong forms, surrogates or code points above U+10FFFF).
+bool	Utf8::isValid(const std::string& text)
+{
+	return s_kernel(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+}
+
+/**
+Replaces every ill-formed part of `text` with U+FFFD (one per maximal part,
+as recommended by Unicode 3.9, D93b); valid text is not copied.
+
+ @return	The number of replacements.
+*/
+size_t	Utf8::repair(std::string& text)
+{
+	if (isValid(text))
+		return 0;
+
+	const unsigned char*	data = reinterpret_cast<const unsigned char*>(text.data());
+	std::string				repaired;
+	size_t					replaced = 0;
+	size_t					i = 0;
+
+	repaired.reserve(text.size() + 8);
+	while (i < text.size())
+	{
+		bool	valid;
+		size_t	length = measureSequence(data + i, text.size() - i, valid);
+		if (valid)
+			repaired.append(text, i, length);
+		else
+		{
+			repaired += "\xEF\xBF\xBD";
+			++replaced;
+		}
+		i += length;
+	}
+	text.swap(repaired);
+	return replaced;
+}
+
+// Name of the kernel in use ("avx2" or "scalar").
+const char*	Utf8::getKernelName()
+{
+#if UTF8_X86
+	if (s_kernel == validateAvx2)
+		return "avx2";
+#endif
+	return "scalar";
+}
+
+/**
+Switches to another kernel, to compare them (before any thread is started).
+
+ @return	`false` if this CPU cannot run it (nothing changes).
+*/
+bool	Utf8::useKernel(const std::string& name)
+{
+	if (name == "scalar")
+		s_kernel = validateScalar;
+#if UTF8_X86
+	else if (name == "avx2" && __builtin_cpu_supports("avx2"))
+		s_kernel = validateAvx2;
+#endif
+	else
+		return false;
+	return true;
+}
@@ -1,33 +1,69 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <stdexcept>	// std::runtime_error
 
 #include "../include/Server.hpp"
 #include "../include/defines.hpp"	// for color definitions
 #include "../include/signal.hpp"	// for setupSignalHandler()
-#include "../include/utils.hpp"		// for parsePort()
+#include "../include/utils.hpp"		// for parsePort(), isValidServerName()
+
+// Prints how to start the server.
+static int	usage(const char* binary)
+{
+	std::cerr	<< YELLOW << "Usage: " << binary
+				<< " <port> <password> [--standby] [--name <server name>] [--link <host>:<port>]...\n"
+				<< "Example: " << binary << " 6667 pw123" << RESET << std::endl;
+	return 1;
+}
 
 /**
 Entry point for the IRC server.
 
 Expects two command-line arguments:
  - port: 		The port number to listen on (1–65535)
- - password: 	The server password required for clients to connect
+ - password: 	The server password required for clients to connect (and servers to link)
+
+Optional ones after them:
+ - `--standby`: starts a hot standby, which follows the server running in the
+   same directory and takes over if that one dies.
+ - `--name <server name>`: the server's name (default `SERVER_NAME`); every
+   server of a network needs its own.
+ - `--link <host>:<port>`: another server to link to, kept connected (repeatable).
 
 Sets up signal handling, initializes the server, and starts the main loop.
 */
 int	main(int argc, char** argv)
 {
-	if (argc != 3)
+	bool						standby = false;
+	std::string					name = SERVER_NAME;
+	std::vector<std::string>	links;
+
+	if (argc < 3)
+		return usage(argv[0]);
+	for (int i = 3; i < argc; ++i)
 	{
-		std::cerr	<< YELLOW << "Usage: " << argv[0] << " <port> <password>\n"
-					<< "Example: " << argv[0] << " 6667 pw123" << RESET << std::endl;
-		return 1;
+		std::string	option = argv[i];
+		if (option == "--standby")
+			standby = true;
+		else if (option == "--name" && i + 1 < argc)
+			name = argv[++i];
+		else if (option == "--link" && i + 1 < argc)
+			links.push_back(argv[++i]);
+		else
+			return usage(argv[0]);
 	}
 
 	try
 	{
+		if (!isValidServerName(name))
+			throw std::runtime_error("Invalid server name: " + name + " (a hostname with at least one '.')");
+
 		int			port = parsePort(argv[1]);	// Parse and validate port number
-		Server		server(port, argv[2]);	// Initialize the server with port, password, and default settings
+		Server		server(port, argv[2], standby, name);	// Initialize the server with port, password, and default settings
+		server.setBinaryPath(argv[0]);	// Executed again on a hot upgrade (SIGUSR2)
+		for (size_t i = 0; i < links.size(); ++i)
+			server.addLinkTarget(links[i]);
 
 		setupSignalHandler();	// Set up signal handler for graceful shutdown via SIGINT
 		server.run();			// Start the server loop, only interrupted by SIGINT or throwing exceptions
@@ -2,6 +2,8 @@
 #include <stdexcept>	// std::runtime_error
 
 volatile sig_atomic_t	g_running = 1;
+volatile sig_atomic_t	g_reload = 0;
+volatile sig_atomic_t	g_upgrade = 0;
 
 // Handles `SIGINT` (Ctrl+C)
 static void	handleSignal(int signum)
@@ -10,9 +12,31 @@ static void	handleSignal(int signum)
 	g_running = 0;
 }
 
-// Sets up a signal handler for `SIGINT` to gracefully shut down the server.
+// Handles `SIGHUP`: the main loop reloads before its next `select()`
+static void	handleReload(int signum)
+{
+	(void)signum;
+	g_reload = 1;
+}
+
+// Handles `SIGUSR2`: the main loop hands over to a new binary before its next `select()`
+static void	handleUpgrade(int signum)
+{
+	(void)signum;
+	g_upgrade = 1;
+}
+
+// Sets up signal handlers for `SIGINT` (graceful shutdown), `SIGHUP` (reload) and
+// `SIGUSR2` (hot upgrade), ignores `SIGPIPE`.
 void	setupSignalHandler()
 {
 	if (std::signal(SIGINT, handleSignal) == SIG_ERR)
 		throw std::runtime_error("Failed to register signal handler (SIGINT)");
+	if (std::signal(SIGHUP, handleReload) == SIG_ERR)
+		throw std::runtime_error("Failed to register signal handler (SIGHUP)");
+	if (std::signal(SIGUSR2, handleUpgrade) == SIG_ERR)
+		throw std::runtime_error("Failed to register signal handler (SIGUSR2)");
+	// Writing to a closed socket (e.g. splice() in the DCC relay) fails with EPIPE instead of killing the server
+	if (std::signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		throw std::runtime_error("Failed to ignore SIGPIPE");
 }
@@ -1,5 +1,6 @@
 #include "../include/utils.hpp"		// toString()
 #include "../include/defines.hpp"	// MAX_NICK_LENGTH, color formatting
+#include "../include/IrcChars.hpp"	// casemapping and name character tables
 
 #include <iostream>		// std::cout
 #include <ctime>		// time_t, gmtime, strftime
@@ -8,9 +9,13 @@
 #include <cctype>		// For ::isalpha(), ::isdigit()
 #include <cstddef>		// size_t
 #include <cstdlib>		// strtol
-#include <algorithm>	// std::transform
 #include <sstream>		// std::stringstream
 #include <string>		// std::string
+#include <vector>		// std::vector
+#include <cerrno>		// errno
+#include <cstring>		// memcpy(), memset()
+#include <time.h>		// clock_gettime(), CLOCK_MONOTONIC
+#include <sys/socket.h>	// sendmsg(), recvmsg(), SCM_RIGHTS
 
 // Parses and validates a port number gitfrom a C-style string (argument)
 int	parsePort(const char* arg)
@@ -75,6 +80,29 @@ std::string	getTimestamp()
 	return std::string(buffer);
 }
 
+/**
+Returns a monotonic timestamp in milliseconds (unaffected by wall clock changes).
+Used to drive the server's timers.
+*/
+unsigned long	getMonotonicMs()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000UL
+		+ static_cast<unsigned long>(ts.tv_nsec) / 1000000UL;
+}
+
+// Returns a monotonic timestamp in microseconds, for measuring short operations.
+unsigned long	getMonotonicUs()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000000UL
+		+ static_cast<unsigned long>(ts.tv_nsec) / 1000UL;
+}
+
 // Checks if a character is a letter (`a-z`, `A-Z`)
 // Returns true if the character is a letter, false otherwise.
 static bool	isLetter(char c)
@@ -89,27 +117,6 @@ static bool	isDigit(char c)
 	return std::isdigit(static_cast<unsigned char>(c));
 }
 
-// Checks if a character is a special character
-// (`-`, `[`, `]`, `\`, `` ` ``, `^`, `{`, `}`).
-// Returns true if the character is a special character, false otherwise.
-static bool	isSpecial(char c)
-{
-	switch (c)
-	{
-		case '-':
-		case '[':
-		case ']':
-		case '\\':
-		case '`':
-		case '^':
-		case '{':
-		case '}':
-			return true;
-		default:
-			return false;
-	}
-}
-
 /**
 Check if the nickname is valid according to IRC rules
  - Must not be empty
@@ -123,19 +130,9 @@ See RFC 1459, section 2.3.1:
 */
 bool	isValidNick(const std::string& nick)
 {
-	if (nick.empty() || nick.length() > MAX_NICK_LENGTH)
-		return false;
-
-	if (!isLetter(nick[0])) // IRC rule: must start with a letter
+	if (nick.length() > MAX_NICK_LENGTH)
 		return false;
-
-	for (unsigned int i = 1; i < nick.length(); ++i)
-	{
-		char	c = nick[i];
-		if (!isLetter(c) && !isDigit(c) && !isSpecial(c))
-			return false;
-	}
-	return true;
+	return IrcChars::isNickChars(nick.data(), nick.length()); // Table lookups, see `IrcChars`
 }
 
 /**
@@ -159,40 +156,90 @@ bool	isValidChannelName(const std::string& channelName)
 	if (channelName[0] != '#' && channelName[0] != '&')
 		return false;
 
-	// Check each character in the channel name (after prefix)
-	for (size_t i = 1; i < channelName.length(); ++i)
-	{
-		char	c = channelName[i];
+	// Check the characters after the prefix (16 at a time, see `IrcChars`)
+	return IrcChars::isChannelChars(channelName.data() + 1, channelName.length() - 1);
+}
+
+/**
+Check if the server name is valid (RFC 2812, section 2.3.1: a hostname)
+ - Max length is 63 characters
+ - Must contain at least one '.' (which tells it apart from a nickname)
+ - Letters, digits, '-' and '.' only, not starting or ending with '.' or '-'
+*/
+bool	isValidServerName(const std::string& serverName)
+{
+	if (serverName.empty() || serverName.length() > 63 || serverName.find('.') == std::string::npos)
+		return false;
 
-		// Reject SPACE, BELL, NUL, CR, LF, and comma
-		 if (c == ' ' || c == '\a' || c == '\0' || c == '\r' || c == '\n' || c == ',')
+	char	first = serverName[0];
+	char	last = serverName[serverName.length() - 1];
+	if (first == '.' || first == '-' || last == '.' || last == '-')
+		return false;
+
+	for (size_t i = 0; i < serverName.length(); ++i)
+	{
+		char	c = serverName[i];
+		if (!isLetter(c) && !isDigit(c) && c != '-' && c != '.')
 			return false;
 	}
 	return true;
 }
 
-// IRC-specific case mapping for lowercase conversion.
-// See RFC 1459, section 2.2.2
-static char	ircToLowerChar(char c)
-{
-	if (c >= 'A' && c <= 'Z') return c + 32; // A-Z → a-z
-	if (c == '[') return '{';
-	if (c == ']') return '}';
-	if (c == '\\') return '|';
-	if (c == '~') return '^';
-	return c;
-}
-
-// Normalizes a nicknames or channels for case-insensitive storage and lookup
-// lowercase letters and certain special characters are mapped
-// to their lowercase equivalents as per IRC case-mapping rules.
+// Normalizes a nicknames or channels for case-insensitive storage and lookup:
+// uppercase letters (and, depending on `CASEMAPPING`, `[]\^`) are mapped to
+// their lowercase equivalents; see `IrcChars`.
 std::string	normalize(const std::string& name)
 {
 	std::string	result = name;
-	std::transform(result.begin(), result.end(), result.begin(), ircToLowerChar);
+	if (!result.empty())
+		IrcChars::fold(&result[0], result.size());
 	return result;
 }
 
+/**
+Matches a string against an IRC wildcard mask: `*` matches any run of
+characters (also none), `?` exactly one. Both are compared as they are, so
+callers pass normalized strings for a case-insensitive match.
+
+Runs without recursion or copies: on a mismatch, the last `*` just
+swallows one more character.
+
+ @param mask	The mask, e.g. `#42*` or `#ch?n`.
+ @param str		The string to match.
+ @return		`true` if the whole string matches the mask.
+*/
+bool	matchMask(const std::string& mask, const std::string& str)
+{
+	size_t	m = 0;
+	size_t	s = 0;
+	size_t	star = std::string::npos;	// Position of the last '*' in `mask`
+	size_t	starMatch = 0;				// Where the text matched by that '*' ends
+
+	while (s < str.size())
+	{
+		if (m < mask.size() && mask[m] == '*') // Before the literal test: the string may hold a '*' too
+		{
+			star = m++;
+			starMatch = s;
+		}
+		else if (m < mask.size() && (mask[m] == '?' || mask[m] == str[s]))
+		{
+			++m;
+			++s;
+		}
+		else if (star != std::string::npos)
+		{
+			m = star + 1;
+			s = ++starMatch;
+		}
+		else
+			return false;
+	}
+	while (m < mask.size() && mask[m] == '*')
+		++m;
+	return m == mask.size();
+}
+
 /**
 Removes all ANSI escape code sequences from a given string.
 
@@ -227,3 +274,83 @@ std::string	removeColorCodes(const std::string& str)
 	}
 	return result;
 }
+
+// Sends `count` descriptors with a single message (one byte of payload carries them).
+bool	sendFds(int sock, const int* fds, size_t count)
+{
+	char			byte = 'F';
+	struct iovec	iov;
+	struct msghdr	msg;
+	std::vector<char>	control(CMSG_SPACE(count * sizeof(int)), 0);
+
+	iov.iov_base = &byte;
+	iov.iov_len = 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control[0];
+	msg.msg_controllen = control.size();
+
+	struct cmsghdr*	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+
+	ssize_t	n;
+	do
+		n = sendmsg(sock, &msg, 0);
+	while (n == -1 && errno == EINTR);
+	return n == 1;
+}
+
+/**
+Receives one message of descriptors sent by `sendFds()` and appends them to `fds`.
+If the kernel had to drop some (`MSG_CTRUNC`, e.g. `RLIMIT_NOFILE` reached),
+the handoff fails: a client would silently lose its connection.
+*/
+bool	receiveFds(int sock, std::vector<int>& fds, size_t count)
+{
+	char			byte;
+	struct iovec	iov;
+	struct msghdr	msg;
+	std::vector<char>	control(CMSG_SPACE(count * sizeof(int)), 0);
+
+	iov.iov_base = &byte;
+	iov.iov_len = 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = &control[0];
+	msg.msg_controllen = control.size();
+
+	ssize_t	n;
+	do
+		n = recvmsg(sock, &msg, 0);
+	while (n == -1 && errno == EINTR);
+	if (n != 1)
+	{
+		if (n == 0)
+			errno = ECONNRESET;
+		return false;
+	}
+
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		size_t	received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < received; ++i)
+		{
+			int	fd;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			fds.push_back(fd);
+		}
+	}
+	if (msg.msg_flags & MSG_CTRUNC)
+	{
+		errno = EMFILE;
+		return false;
+	}
+	return true;
+}
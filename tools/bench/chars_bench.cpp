@@ -0,0 +1,228 @@
+#include <cstdio>		// printf()
+#include <cstdlib>		// rand(), srand()
+#include <string>
+#include <time.h>		// clock_gettime()
+
+#include "../../include/IrcChars.hpp"
+
+/**
+Name folding and validation (`make bench`), for each casemapping.
+
+`IrcChars` takes 16 bytes at a time (SSE2) from 16 bytes on, and goes
+through its tables below that. First, for `ascii`, `strict-rfc1459` and
+`rfc1459` (which differ at `[\]` and `^`), 200k random strings of bytes
+around the mapped ranges (`@AZ[\]^_` and their lowercase, names' specials,
+the bytes channel names refuse, bytes >= 0x80) are checked at lengths up to
+80: `fold()`, `equal()` and `isChannelChars()` against the same calls one
+byte at a time (the table path), and all of them, `isNickChars()` too,
+against the RFC 1459 rules written out here. Then folding, checking and
+comparing a nickname, a channel name and a 200-byte name are timed, the
+first two also one byte at a time.
+*/
+
+static const char*	MAPPINGS[] = { "ascii", "strict-rfc1459", "rfc1459" };	// Each maps more than the one before
+static const int	FUZZ_STRINGS = 200000;
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lowercase of `c` under `MAPPINGS[mapping]`, by the definitions (not through `IrcChars`).
+static char	lower(char c, int mapping)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c + 32;
+	if (mapping >= 1 && (c == '[' || c == '\\' || c == ']'))
+		return c + 32;
+	if (mapping >= 2 && c == '^')
+		return '~';
+	return c;
+}
+
+// Uppercase of `c`: the other byte `lower()` folds to the same one (or `c`).
+static char	upper(char c, int mapping)
+{
+	for (int u = 'A'; u <= '^'; ++u)
+		if (u != c && lower(static_cast<char>(u), mapping) == c)
+			return static_cast<char>(u);
+	return c;
+}
+
+// A nickname by RFC 1459: <letter> { <letter> | <number> | <special> }
+static bool	isNick(const std::string& name)
+{
+	static const std::string	special = "-[]\\`^{}";
+
+	if (name.empty() || !((name[0] >= 'A' && name[0] <= 'Z') || (name[0] >= 'a' && name[0] <= 'z')))
+		return false;
+	for (size_t i = 1; i < name.size(); ++i)
+	{
+		char	c = name[i];
+		if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+			&& special.find(c) == std::string::npos)
+			return false;
+	}
+	return true;
+}
+
+// A channel name's characters: no SPACE, BELL, NUL, CR, LF or comma.
+static bool	isChannel(const std::string& name)
+{
+	return name.find_first_of(std::string(" \a\r\n,\0", 6)) == std::string::npos;
+}
+
+static std::string	randomName(size_t length)
+{
+	static const char	bytes[] = "@AZ[\\]^_`az{|}~Mm09-\x7F\x80\xC3\xFF ,\a\r\n";
+	std::string			name;
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		if (rand() % 200 == 0)
+			name += '\0';
+		else
+			name += bytes[rand() % (sizeof(bytes) - 1)];
+	}
+	return name;
+}
+
+static bool	fail(const char* mapping, const char* what, int string)
+{
+	printf("chars: %s: %s differs on string %d\n", mapping, what, string);
+	return false;
+}
+
+// Checks `MAPPINGS[mapping]` (selected) on random strings; `false` on the first difference.
+static bool	fuzz(int mapping)
+{
+	const char*	name = MAPPINGS[mapping];
+	char		uppers[256];
+
+	for (int c = 0; c < 256; ++c)
+		uppers[c] = upper(static_cast<char>(c), mapping);
+	srand(48);
+	for (int i = 0; i < FUZZ_STRINGS; ++i)
+	{
+		std::string	text = randomName(rand() % 81);
+		std::string	expected = text;
+		std::string	folded = text;
+		std::string	byByte = text;
+		std::string	other = text;
+
+		for (size_t j = 0; j < text.size(); ++j)
+		{
+			expected[j] = lower(text[j], mapping);
+			IrcChars::fold(&byByte[j], 1);
+			if (rand() % 2)
+				other[j] = uppers[static_cast<unsigned char>(expected[j])];
+		}
+		if (!text.empty() && rand() % 4 == 0)
+			other[rand() % text.size()] ^= 1; // Sometimes a different name
+		IrcChars::fold(&folded[0], folded.size());
+		if (folded != expected || byByte != expected)
+			return fail(name, "fold()", i);
+
+		std::string	otherFolded = other;
+		for (size_t j = 0; j < other.size(); ++j)
+			otherFolded[j] = lower(other[j], mapping);
+		bool	same = otherFolded == expected;
+		bool	sameByByte = true;
+		for (size_t j = 0; j < text.size(); ++j)
+			sameByByte = sameByByte && IrcChars::equal(text.substr(j, 1), other.substr(j, 1));
+		if (IrcChars::equal(text, other) != same || sameByByte != same)
+			return fail(name, "equal()", i);
+
+		bool	channel = isChannel(text);
+		bool	channelByByte = true;
+		for (size_t j = 0; j < text.size(); ++j)
+			channelByByte = channelByByte && IrcChars::isChannelChars(&text[j], 1);
+		if (IrcChars::isChannelChars(text.data(), text.size()) != channel || channelByByte != channel)
+			return fail(name, "isChannelChars()", i);
+
+		std::string	nick = text.substr(0, 9);
+		if (IrcChars::isNickChars(nick.data(), nick.size()) != isNick(nick))
+			return fail(name, "isNickChars()", i);
+	}
+	return true;
+}
+
+// Times folding and checking `name` in one call and one byte at a time (the table path), and comparing it.
+static void	timeName(const char* label, const std::string& name)
+{
+	std::string		copy = name;
+	std::string		other = name;
+	int				reps = 1000000;
+	volatile size_t	sink = 0;
+	double			foldNs[2];
+	double			checkNs[2];
+
+	for (int byByte = 0; byByte < 2; ++byByte)
+	{
+		double	start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+		{
+			copy[0] = name[0];
+			if (byByte)
+				for (size_t i = 0; i < copy.size(); ++i)
+					IrcChars::fold(&copy[i], 1);
+			else
+				IrcChars::fold(&copy[0], copy.size());
+			sink += copy[copy.size() - 1];
+		}
+		foldNs[byByte] = (nowSeconds() - start) / reps * 1e9;
+
+		start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+		{
+			bool	valid = true;
+			if (byByte)
+				for (size_t i = 0; i < name.size(); ++i)
+					valid = IrcChars::isChannelChars(&name[i], 1) && valid;
+			else
+				valid = IrcChars::isChannelChars(name.data(), name.size());
+			sink += valid;
+		}
+		checkNs[byByte] = (nowSeconds() - start) / reps * 1e9;
+	}
+
+	double	start = nowSeconds();
+	for (int r = 0; r < reps; ++r)
+		sink += IrcChars::equal(name, other);
+	double	equalNs = (nowSeconds() - start) / reps * 1e9;
+
+	printf("chars: %-12s (%3lu bytes) fold %5.1f ns (byte a time %6.1f), channel chars %5.1f ns (%6.1f),"
+		" equal %5.1f ns\n", label, static_cast<unsigned long>(name.size()), foldNs[0], foldNs[1], checkNs[0], checkNs[1], equalNs);
+	(void)sink;
+}
+
+int	main()
+{
+	for (int m = 0; m < static_cast<int>(sizeof(MAPPINGS) / sizeof(MAPPINGS[0])); ++m)
+	{
+		if (!IrcChars::selectCaseMapping(MAPPINGS[m]) || !fuzz(m))
+			return 1;
+		printf("chars: %-14s fuzz ok (%d strings)\n", MAPPINGS[m], FUZZ_STRINGS);
+	}
+
+	IrcChars::selectCaseMapping("rfc1459");
+	const char*	names[][2] =
+	{
+		{ "nickname", "Nick^Name" },
+		{ "channel name", "#Some[Channel]Name-42\\ok" },
+		{ "200 bytes", "" }
+	};
+	std::string	longName;
+	while (longName.size() < 200)
+		longName += "#[Long]^Channel^Name-";
+	longName.resize(200);
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+	{
+		std::string	name = *names[i][1] ? names[i][1] : longName;
+		timeName(names[i][0], name);
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include <cstdio>		// printf()
+#include <cstdlib>		// atoi()
+#include <string>
+#include <vector>
+#include <time.h>		// clock_gettime()
+#include <unistd.h>		// sysconf()
+
+#include "../../include/FanoutPool.hpp"
+#include "../../include/User.hpp"
+
+/**
+Broadcast cost to very large channels (`make bench`): one ~85-byte line
+appended to the output buffers of 1k, 10k and 100k recipients, inline (as
+small channels are served) and through a `FanoutPool`.
+
+The buffers are warmed up first and cleared every 20 rounds, outside the
+timing. On a single CPU the pool's threads only take turns with the caller,
+so the numbers then show its overhead, not its scaling.
+
+Usage: fanout_bench [threads]	(default 2)
+*/
+
+static const size_t	SIZES[] = { 1000, 10000, 100000 };
+static const int	CLEAR_EVERY = 20;	// Rounds between clearing the buffers
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void	clearBuffers(const std::vector<User*>& users)
+{
+	for (size_t i = 0; i < users.size(); ++i)
+		users[i]->getOutputBuffer().clear();
+}
+
+// Returns the seconds per broadcast, inline (`pool` NULL) or through `pool`.
+static double	timeBroadcasts(const std::vector<User*>& users, const std::string& line, FanoutPool* pool,
+								int rounds)
+{
+	double	elapsed = 0;
+	double	start = nowSeconds();
+
+	for (int round = 0; round < rounds; ++round)
+	{
+		if (round % CLEAR_EVERY == 0)
+		{
+			elapsed += nowSeconds() - start;
+			clearBuffers(users);
+			start = nowSeconds();
+		}
+		if (pool)
+			pool->deliver(users, line, NULL);
+		else
+			for (size_t i = 0; i < users.size(); ++i)
+				users[i]->getOutputBuffer() += line;
+	}
+	elapsed += nowSeconds() - start;
+	return elapsed / rounds;
+}
+
+int	main(int argc, char** argv)
+{
+	int			threads = argc > 1 ? atoi(argv[1]) : 2;
+	std::string	line = ":nick!user@127.0.0.1 PRIVMSG #big :a fairly ordinary chat line of about eighty bytes\r\n";
+	FanoutPool	pool;
+
+	if (threads < 1 || !pool.start(threads))
+	{
+		printf("fanout: cannot start %d threads\n", threads);
+		return 1;
+	}
+	printf("fanout: %d pool threads, %ld CPUs online\n", threads, sysconf(_SC_NPROCESSORS_ONLN));
+	for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); ++s)
+	{
+		std::vector<User*>	users;
+		for (size_t i = 0; i < SIZES[s]; ++i)
+			users.push_back(new User(static_cast<int>(i) + 10, NULL));
+		int	rounds = static_cast<int>(2000000 / SIZES[s]) + 10;
+
+		for (int warm = 0; warm < CLEAR_EVERY; ++warm)
+			for (size_t i = 0; i < users.size(); ++i)
+				users[i]->getOutputBuffer() += line;
+		double	inlineSeconds = timeBroadcasts(users, line, NULL, rounds);
+		double	poolSeconds = timeBroadcasts(users, line, &pool, rounds);
+
+		printf("fanout: %6lu members  inline %9.1f us/msg  pool %9.1f us/msg\n",
+			static_cast<unsigned long>(SIZES[s]), inlineSeconds * 1e6, poolSeconds * 1e6);
+		for (size_t i = 0; i < users.size(); ++i)
+			delete users[i];
+	}
+	pool.stop();
+	return 0;
+}
@@ -0,0 +1,278 @@
+#include <cstdio>		// printf()
+#include <string>
+#include <time.h>		// clock_gettime()
+#include <unistd.h>		// fork(), close(), _exit()
+#include <fcntl.h>		// fcntl()
+#include <sys/select.h>	// select()
+#include <sys/socket.h>	// socket(), send(), recv()
+#include <sys/wait.h>	// waitpid()
+#include <netinet/in.h>	// sockaddr_in
+#include <arpa/inet.h>	// htonl()
+
+#include "../../include/LinkRing.hpp"
+#include "../../include/platform.hpp"	// MSG_NOSIGNAL
+
+/**
+Transport of a link between two servers on the same host (`make bench`):
+the shared memory rings (`LinkRing`) against a loopback TCP connection.
+
+The two ends run in two processes, as two servers would, and wait in
+`select()` the way the event loop does. First one end streams lines of
+server-to-server traffic to the other, 64 per write (one event loop
+iteration's worth), until the other has seen every byte; then one line goes
+back and forth between them, which is what a link adds to the latency of a
+message. Where the rings cannot be set up (not Linux), only TCP is measured.
+*/
+
+static const char	LINE[] = ":alice PRIVMSG #bench :message number 42 with some padding text\r\n";
+static const size_t	LINE_SIZE = sizeof(LINE) - 1;
+static const int	STREAM_LINES = 20000000;
+static const int	BATCH_LINES = 64;
+static const int	ROUND_TRIPS = 50000;
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Waits until `fd` is readable (`forWrite` false) or writable.
+static void	waitFd(int fd, bool forWrite)
+{
+	fd_set	fds;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	select(fd + 1, forWrite ? NULL : &fds, forWrite ? &fds : NULL, NULL, NULL);
+}
+
+// One end of a link, as `ServerLink` sees it
+class	Endpoint
+{
+	public:
+		virtual ~Endpoint() {}
+
+		virtual size_t	put(const char* data, size_t size) = 0;	// Bytes taken, 0 if there is no room now
+		virtual size_t	get(std::string& out) = 0;				// Bytes appended, 0 if there is nothing now
+		virtual void	waitToGet() = 0;
+		virtual void	waitToPut() = 0;
+};
+
+class	RingEndpoint : public Endpoint
+{
+	public:
+		explicit RingEndpoint(LinkRing* ring) : _ring(ring) {}
+		~RingEndpoint() { delete _ring; }
+
+		size_t	put(const char* data, size_t size)
+		{
+			ssize_t	count = _ring->write(data, size);
+			return count > 0 ? count : 0;
+		}
+		size_t	get(std::string& out)
+		{
+			ssize_t	count = _ring->read(out);
+			return count > 0 ? count : 0;
+		}
+		void	waitToGet()		{ waitFd(_ring->getWakeFd(), false); }
+		void	waitToPut()
+		{
+			std::string	none;
+			waitFd(_ring->getWakeFd(), false);
+			_ring->read(none); // Clears the wakeup (nothing comes back while streaming)
+		}
+
+	private:
+		LinkRing*	_ring;
+};
+
+class	TcpEndpoint : public Endpoint
+{
+	public:
+		explicit TcpEndpoint(int fd) : _fd(fd)
+		{
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			noSigPipe(fd);
+		}
+		~TcpEndpoint() { close(_fd); }
+
+		size_t	put(const char* data, size_t size)
+		{
+			ssize_t	count = send(_fd, data, size, MSG_NOSIGNAL);
+			return count > 0 ? count : 0;
+		}
+		size_t	get(std::string& out)
+		{
+			char	buffer[65536];
+			ssize_t	count = recv(_fd, buffer, sizeof(buffer), 0);
+			if (count <= 0)
+				return 0;
+			out.append(buffer, count);
+			return count;
+		}
+		void	waitToGet()		{ waitFd(_fd, false); }
+		void	waitToPut()		{ waitFd(_fd, true); }
+
+	private:
+		int		_fd;
+};
+
+// Writes all of `data`, waiting for room as needed.
+static void	putAll(Endpoint& end, const char* data, size_t size)
+{
+	size_t	done = 0;
+
+	while (done < size)
+	{
+		size_t	count = end.put(data + done, size - done);
+		if (count == 0)
+			end.waitToPut();
+		done += count;
+	}
+}
+
+// Reads until `size` bytes have arrived (kept in `out`, which is cleared).
+static void	getAll(Endpoint& end, size_t size, std::string& out)
+{
+	out.clear();
+	while (out.size() < size)
+		if (end.get(out) == 0)
+			end.waitToGet();
+}
+
+// The receiving server: takes the stream, acknowledges it with one byte, then echoes every line.
+static void	runReceiver(Endpoint& end)
+{
+	std::string	input;
+	size_t		total = static_cast<size_t>(STREAM_LINES) * LINE_SIZE;
+	size_t		received = 0;
+
+	while (received < total)
+	{
+		size_t	count = end.get(input);
+		if (count == 0)
+			end.waitToGet();
+		received += count;
+		input.clear();
+	}
+	putAll(end, "\n", 1);
+	for (int i = 0; i < ROUND_TRIPS; ++i)
+	{
+		getAll(end, LINE_SIZE, input);
+		putAll(end, input.data(), input.size());
+	}
+}
+
+// The sending server: times the stream and the round trips.
+static void	runSender(const char* name, Endpoint& end)
+{
+	std::string	batch;
+	std::string	input;
+
+	for (int i = 0; i < BATCH_LINES; ++i)
+		batch += LINE;
+
+	double	start = nowSeconds();
+	for (int sent = 0; sent < STREAM_LINES; sent += BATCH_LINES)
+		putAll(end, batch.data(), batch.size());
+	getAll(end, 1, input);
+	double	streamSeconds = nowSeconds() - start;
+
+	start = nowSeconds();
+	for (int i = 0; i < ROUND_TRIPS; ++i)
+	{
+		putAll(end, LINE, LINE_SIZE);
+		getAll(end, LINE_SIZE, input);
+	}
+	double	roundTripUs = (nowSeconds() - start) / ROUND_TRIPS * 1e6;
+
+	printf("link: %-13s %5.2f M lines/s (%6.0f MB/s), round trip %5.1f us\n", name,
+		STREAM_LINES / streamSeconds / 1e6, STREAM_LINES * LINE_SIZE / streamSeconds / 1e6, roundTripUs);
+}
+
+// Waits for the receiver; `false` if it did not finish cleanly.
+static bool	reapReceiver(pid_t pid)
+{
+	int	status;
+
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool	benchRing()
+{
+	std::string	error;
+	LinkRing*	ring = LinkRing::create(error);
+
+	if (!ring)
+	{
+		printf("link: shared memory not available (%s), only TCP is measured\n", error.c_str());
+		return true;
+	}
+
+	pid_t	pid = fork();
+	if (pid == -1)
+		return false;
+	if (pid == 0)
+	{
+		int	fds[3];
+		ring->getPeerFds(fds); // Inherited, as the accepting server gets them with `SCM_RIGHTS`
+		LinkRing*	peer = LinkRing::attach(fds, error);
+		if (!peer)
+			_exit(1);
+		RingEndpoint	receiver(peer);
+		runReceiver(receiver);
+		_exit(0);
+	}
+	RingEndpoint	sender(ring);
+	runSender("shared memory", sender);
+	return reapReceiver(pid);
+}
+
+static bool	benchTcp()
+{
+	sockaddr_in	addr = sockaddr_in();
+	socklen_t	size = sizeof(addr);
+	int			listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listenFd == -1 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1
+		|| listen(listenFd, 1) == -1 || getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &size) == -1)
+	{
+		printf("link: cannot listen on the loopback interface\n");
+		return false;
+	}
+
+	pid_t	pid = fork();
+	if (pid == -1)
+		return false;
+	if (pid == 0)
+	{
+		int	fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd == -1 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+			_exit(1);
+		TcpEndpoint	receiver(fd);
+		runReceiver(receiver);
+		_exit(0);
+	}
+	int	fd = accept(listenFd, NULL, NULL);
+	close(listenFd);
+	if (fd == -1)
+		return false;
+	TcpEndpoint	sender(fd);
+	runSender("loopback TCP", sender);
+	return reapReceiver(pid);
+}
+
+int	main()
+{
+	bool	ok = benchRing();
+
+	if (!benchTcp())
+		ok = false;
+	if (!ok)
+		printf("link: a receiver did not finish\n");
+	return !ok;
+}
@@ -0,0 +1,210 @@
+#include <cstdio>		// printf(), snprintf()
+#include <cstdlib>		// rand(), srand()
+#include <string>
+#include <vector>
+#include <time.h>		// clock_gettime()
+
+#include "../../include/MaskSet.hpp"
+#include "../../include/IrcChars.hpp"
+#include "../../include/utils.hpp"		// matchMask(), normalize()
+
+/**
+Ban list matching (`make bench`): `MaskSet`, all masks in one pass, against
+`matchMask()` mask by mask.
+
+First both are compared, under each casemapping, on random lists: 200k
+lists of up to 6 short masks made of runs of `*` and `?`, `\` before
+wildcards (masks have no escapes: it is a nickname character, and folds to
+`|` except in `ascii`), the bytes folded to one another (`[]\^`, `{}|~`,
+letters), matched against random hostmasks of the same bytes; then 3000
+lists of 50 to 350 longer masks (state vectors of tens of words, often
+more than the 4096 states kept on the stack), 20 hostmasks each. Then a
+hostmask is checked against 10 to 1000 bans of the usual forms, both ways,
+and compiling the list is timed.
+*/
+
+static const char*	MAPPINGS[] = { "ascii", "strict-rfc1459", "rfc1459" };
+static const int	SMALL_LISTS = 200000;
+static const int	LARGE_LISTS = 3000;
+static const int	BAN_COUNTS[] = { 10, 50, 200, 1000 };
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Up to `maxPieces` pieces picked at random from `table`.
+static std::string	randomText(const char* const* table, size_t tableSize, int maxPieces)
+{
+	std::string	text;
+	int			pieces = rand() % (maxPieces + 1);
+
+	for (int i = 0; i < pieces; ++i)
+		text += table[rand() % tableSize];
+	return text;
+}
+
+// The naive matcher: every mask in turn, both sides folded (what `MaskSet` replaces).
+static bool	matchEach(const std::vector<MaskEntry>& entries, const std::string& hostmask)
+{
+	std::string	subject = normalize(hostmask);
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (matchMask(normalize(entries[i].mask), subject))
+			return true;
+	}
+	return false;
+}
+
+static bool	fail(const char* mapping, const std::vector<MaskEntry>& entries, const std::string& hostmask)
+{
+	printf("mask: %s: MaskSet and matchMask() differ on %s for", mapping, hostmask.c_str());
+	for (size_t i = 0; i < entries.size() && i < 8; ++i)
+		printf(" %s", entries[i].mask.c_str());
+	printf("%s\n", entries.size() > 8 ? " ..." : "");
+	return false;
+}
+
+// Compares both matchers under the selected casemapping; `false` on the first difference.
+static bool	fuzz(const char* mapping, unsigned long& matched)
+{
+	static const char*	maskPieces[] =
+	{
+		"*", "**", "?", "??", "*?", "?*", "*?*", "\\", "\\*", "\\?", "a", "B", "x", "[", "{", "]", "}", "^", "~",
+		"|", "!", "@", "."
+	};
+	static const char*	subjectPieces[] =
+	{
+		"a", "A", "b", "B", "x", "[", "{", "]", "}", "\\", "|", "^", "~", "!", "@", ".", "*", "?"
+	};
+	static const char*	largePieces[] = { "a", "b", "c", "*", "?", ".", "!", "@", "\\", "|" };
+	static const size_t	maskCount = sizeof(maskPieces) / sizeof(maskPieces[0]);
+	static const size_t	subjectCount = sizeof(subjectPieces) / sizeof(subjectPieces[0]);
+	static const size_t	largeCount = sizeof(largePieces) / sizeof(largePieces[0]);
+
+	srand(50);
+	for (int i = 0; i < SMALL_LISTS; ++i)
+	{
+		std::vector<MaskEntry>	entries(rand() % 7);
+		MaskSet					set;
+		for (size_t k = 0; k < entries.size(); ++k)
+			entries[k].mask = randomText(maskPieces, maskCount, 6);
+		set.compile(entries);
+
+		std::string	hostmask = randomText(subjectPieces, subjectCount, 10);
+		bool		expected = matchEach(entries, hostmask);
+		if (set.matches(hostmask) != expected)
+			return fail(mapping, entries, hostmask);
+		matched += expected;
+	}
+	for (int i = 0; i < LARGE_LISTS; ++i)
+	{
+		std::vector<MaskEntry>	entries(50 + rand() % 301);
+		MaskSet					set;
+		for (size_t k = 0; k < entries.size(); ++k)
+			entries[k].mask = randomText(largePieces, largeCount, 24);
+		set.compile(entries);
+
+		for (int k = 0; k < 20; ++k)
+		{
+			std::string	hostmask = randomText(largePieces + 4, largeCount - 4, 30) + randomText(largePieces, 3, 5);
+			bool		expected = matchEach(entries, hostmask);
+			if (set.matches(hostmask) != expected)
+				return fail(mapping, entries, hostmask);
+			matched += expected;
+		}
+	}
+	return true;
+}
+
+// A ban of one of the usual forms: by address, nickname, ident and domain, or domain.
+static std::string	randomBan(int index)
+{
+	char	mask[96];
+
+	switch (index % 4)
+	{
+		case 0:
+			snprintf(mask, sizeof(mask), "*!*@%d.%d.%d.%d", rand() % 256, rand() % 256, rand() % 256, rand() % 256);
+			break;
+		case 1:
+			snprintf(mask, sizeof(mask), "Spam%d*!*@*", rand() % 100000);
+			break;
+		case 2:
+			snprintf(mask, sizeof(mask), "*!~troll%d@*.isp%d.example.net", rand() % 1000, rand() % 50);
+			break;
+		default:
+			snprintf(mask, sizeof(mask), "*!*@*.BadHost%d.org", rand() % 1000);
+	}
+	return mask;
+}
+
+// Times checking hostmasks that match none of `bans` bans, mask by mask and in one pass.
+static void	timeBans(int bans)
+{
+	std::vector<MaskEntry>		entries(bans);
+	std::vector<std::string>	folded;
+	std::vector<std::string>	hostmasks;
+	MaskSet						set;
+	volatile int				hits = 0;
+	int							reps = 2000000 / bans + 2000;
+
+	srand(bans);
+	for (int i = 0; i < bans; ++i)
+	{
+		entries[i].mask = randomBan(i);
+		folded.push_back(normalize(entries[i].mask));
+	}
+	for (int i = 0; i < 64; ++i)
+	{
+		char	hostmask[96];
+		snprintf(hostmask, sizeof(hostmask), "User%d!~user%d@host-%d.dsl.Provider%d.example.com", i, i,
+			rand() % 10000, i % 7);
+		hostmasks.push_back(hostmask);
+	}
+
+	double	start = nowSeconds();
+	for (int r = 0; r < 200; ++r)
+		set.compile(entries);
+	double	compileUs = (nowSeconds() - start) / 200 * 1e6;
+
+	start = nowSeconds();
+	for (int r = 0; r < reps; ++r)
+	{
+		std::string	subject = normalize(hostmasks[r & 63]);
+		bool		banned = false;
+		for (size_t i = 0; i < folded.size() && !banned; ++i)
+			banned = matchMask(folded[i], subject);
+		hits += banned;
+	}
+	double	eachUs = (nowSeconds() - start) / reps * 1e6;
+
+	start = nowSeconds();
+	for (int r = 0; r < reps; ++r)
+		hits += set.matches(hostmasks[r & 63]);
+	double	onePassUs = (nowSeconds() - start) / reps * 1e6;
+
+	printf("mask: %4d bans: mask by mask %7.2f us, one pass %6.2f us (%5.1fx), compile %7.1f us%s\n", bans,
+		eachUs, onePassUs, eachUs / onePassUs, compileUs, hits ? " (unexpected match)" : "");
+}
+
+int	main()
+{
+	for (size_t m = 0; m < sizeof(MAPPINGS) / sizeof(MAPPINGS[0]); ++m)
+	{
+		unsigned long	matched = 0;
+		if (!IrcChars::selectCaseMapping(MAPPINGS[m]) || !fuzz(MAPPINGS[m], matched))
+			return 1;
+		printf("mask: %-14s fuzz ok (%d small lists, %d lists of 50-350 masks, %lu matches)\n", MAPPINGS[m],
+			SMALL_LISTS, LARGE_LISTS, matched);
+	}
+
+	IrcChars::selectCaseMapping("rfc1459");
+	for (size_t i = 0; i < sizeof(BAN_COUNTS) / sizeof(BAN_COUNTS[0]); ++i)
+		timeBans(BAN_COUNTS[i]);
+	return 0;
+}
@@ -0,0 +1,474 @@
+#include <cstdio>		// printf(), snprintf()
+#include <cstdlib>		// atoi(), strtoul(), realpath()
+#include <cerrno>		// errno
+#include <cstring>		// memset(), strerror()
+#include <climits>		// PATH_MAX
+#include <string>
+#include <vector>
+#include <algorithm>	// std::max()
+
+#include <unistd.h>			// fork(), execl(), pipe(), chdir(), dup2(), rmdir(), unlink()
+#include <fcntl.h>			// fcntl(), open(), O_NONBLOCK
+#include <signal.h>			// kill(), SIGINT
+#include <dirent.h>			// opendir(), readdir()
+#include <time.h>			// clock_gettime()
+#include <sys/select.h>		// select(), fd_set
+#include <sys/socket.h>		// socket(), connect()
+#include <sys/stat.h>		// mkdir()
+#include <sys/wait.h>		// wait4()
+#include <sys/resource.h>	// rusage
+#include <netinet/in.h>		// sockaddr_in, htons()
+#include <arpa/inet.h>		// inet_addr()
+
+/**
+Capacity of a network of linked servers (`make bench`): 1, 2, ... servers
+on localhost, each linked to the one started before it (a chain), each with
+its own load.
+
+Per server, a driver process connects 50 pairs of users; each pair shares a
+channel and the sender keeps 4 messages in flight to the receiver. Every 4th
+pair has its receiver on the neighbouring server, so that part of the traffic
+crosses a link. After all pairs are set up (the sender has seen the
+receiver's JOIN, which for a remote receiver came over the link), the
+drivers run for a few seconds and count the messages delivered.
+
+Servers and drivers share the CPUs of the machine, so the delivered rate
+only grows with the servers as far as there are cores for them. What the
+network would carry with a core per server is given by the CPU time of the
+busiest server (messages per CPU second of it): a network is limited by its
+busiest server. Each server runs in a temporary directory (logs, state
+files), removed afterwards.
+
+Usage: network_bench [ircserv binary] [max servers] [seconds]	(default ./ircserv 4 3)
+*/
+
+static const int	BASE_PORT = 6810;
+static const char	PASSWORD[] = "bench";
+static const int	PAIRS = 50;			// Per server
+static const int	CROSS_EVERY = 4;	// Every 4th pair crosses a link
+static const int	WINDOW = 4;			// Messages in flight per pair
+static const int	SETUP_MS = 15000;	// How long a pair may take to be set up
+static const int	MAX_SERVERS = 8;	// Drivers register one user at a time, below MAX_UNREG_PER_HOST
+
+struct	Client
+{
+	int				fd;
+	std::string		nick;
+	std::string		input;
+};
+
+struct	Pair
+{
+	Client			sender;
+	Client			receiver;
+	std::string		channel;
+	int				inFlight;
+};
+
+static unsigned long	nowMs()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool	sendLine(Client& client, const std::string& line)
+{
+	std::string	data = line + "\r\n";
+	size_t		done = 0;
+
+	while (done < data.size())
+	{
+		ssize_t	n = write(client.fd, data.data() + done, data.size() - done);
+		if (n > 0)
+			done += n;
+		else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return false;
+	}
+	return true;
+}
+
+static int	connectTo(int port)
+{
+	sockaddr_in	addr;
+	int			fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(port));
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+/**
+Reads what arrived for `client` and takes the complete lines out of its
+input (answering `PING` on the way).
+
+ @return	`false` if the connection was closed.
+*/
+static bool	readLines(Client& client, std::vector<std::string>& lines)
+{
+	char	buffer[16384];
+	ssize_t	n;
+
+	while ((n = read(client.fd, buffer, sizeof(buffer))) > 0)
+		client.input.append(buffer, n);
+	if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		return false;
+
+	size_t	start = 0;
+	size_t	end;
+	while ((end = client.input.find("\r\n", start)) != std::string::npos)
+	{
+		if (client.input.compare(start, 5, "PING ") == 0)
+			sendLine(client, "PONG " + client.input.substr(start + 5, end - start - 5));
+		else
+			lines.push_back(client.input.substr(start, end - start));
+		start = end + 2;
+	}
+	client.input.erase(0, start);
+	return true;
+}
+
+// Waits until a line from the server to `client` contains `needle`; `false` on timeout or disconnect.
+static bool	waitFor(Client& client, const std::string& needle)
+{
+	unsigned long	deadline = nowMs() + SETUP_MS;
+
+	while (nowMs() < deadline)
+	{
+		std::vector<std::string>	lines;
+		fd_set						readFds;
+		struct timeval				timeout = { 0, 100000 };
+
+		FD_ZERO(&readFds);
+		FD_SET(client.fd, &readFds);
+		select(client.fd + 1, &readFds, NULL, NULL, &timeout);
+		if (!readLines(client, lines))
+			return false;
+		for (size_t i = 0; i < lines.size(); ++i)
+			if (lines[i].find(needle) != std::string::npos)
+				return true;
+	}
+	return false;
+}
+
+static bool	registerClient(Client& client, int port, const std::string& nick)
+{
+	client.nick = nick;
+	client.fd = connectTo(port);
+	return client.fd != -1 && client.fd < FD_SETSIZE
+		&& sendLine(client, std::string("PASS ") + PASSWORD) && sendLine(client, "NICK " + nick)
+		&& sendLine(client, "USER " + nick + " 0 * :network bench") && waitFor(client, " 001 " + nick + " ");
+}
+
+// Connects pair `index` of server `server`, and waits until the sender sees the receiver in the channel.
+static bool	setupPair(Pair& pair, int server, int servers, int index)
+{
+	char	name[32];
+	int		receiverServer = server;
+
+	if (servers > 1 && index % CROSS_EVERY == CROSS_EVERY - 1)
+		receiverServer = server + 1 < servers ? server + 1 : server - 1;
+	snprintf(name, sizeof(name), "#p%d_%d", server, index);
+	pair.channel = name;
+	pair.inFlight = 0;
+	snprintf(name, sizeof(name), "s%dn%d", server, index);
+	if (!registerClient(pair.sender, BASE_PORT + server, name))
+		return false;
+	snprintf(name, sizeof(name), "r%dn%d", server, index);
+	return registerClient(pair.receiver, BASE_PORT + receiverServer, name)
+		&& sendLine(pair.sender, "JOIN " + pair.channel) && waitFor(pair.sender, " 366 ")
+		&& sendLine(pair.receiver, "JOIN " + pair.channel) && waitFor(pair.receiver, " 366 ")
+		&& waitFor(pair.sender, ":" + pair.receiver.nick + "!");
+}
+
+/**
+Keeps `WINDOW` messages in flight on every pair until `stopMs`.
+
+ @return	Messages delivered, -1 if a user was disconnected.
+*/
+static long	runLoad(std::vector<Pair>& pairs, unsigned long stopMs)
+{
+	long	delivered = 0;
+	int		sequence = 0;
+
+	while (nowMs() < stopMs)
+	{
+		fd_set	readFds;
+		int		maxFd = -1;
+
+		FD_ZERO(&readFds);
+		for (size_t i = 0; i < pairs.size(); ++i)
+		{
+			Pair&	pair = pairs[i];
+			char	text[80];
+			while (pair.inFlight < WINDOW)
+			{
+				snprintf(text, sizeof(text), " :message %d with some padding text", ++sequence);
+				if (!sendLine(pair.sender, "PRIVMSG " + pair.channel + text))
+					return -1;
+				++pair.inFlight;
+			}
+			FD_SET(pair.sender.fd, &readFds);
+			FD_SET(pair.receiver.fd, &readFds);
+			maxFd = std::max(maxFd, std::max(pair.sender.fd, pair.receiver.fd));
+		}
+
+		struct timeval	timeout = { 0, 10000 };
+		if (select(maxFd + 1, &readFds, NULL, NULL, &timeout) <= 0)
+			continue;
+		for (size_t i = 0; i < pairs.size(); ++i)
+		{
+			std::vector<std::string>	lines;
+			if ((FD_ISSET(pairs[i].sender.fd, &readFds) && !readLines(pairs[i].sender, lines))
+				|| (FD_ISSET(pairs[i].receiver.fd, &readFds) && !readLines(pairs[i].receiver, lines)))
+				return -1;
+			for (size_t j = 0; j < lines.size(); ++j)
+			{
+				if (lines[j].find(" PRIVMSG " + pairs[i].channel + " :") != std::string::npos)
+				{
+					--pairs[i].inFlight;
+					++delivered;
+				}
+			}
+		}
+	}
+	return delivered;
+}
+
+// Sends a line to the parent; if it is gone, so is the benchmark.
+static void	writeReport(int fd, const char* line)
+{
+	if (write(fd, line, strlen(line)) == -1)
+		_exit(1);
+}
+
+/**
+The load of server `server`, in its own process: sets up the pairs, reports
+"ready" on `report`, waits for the start on `start`, then reports the count.
+*/
+static void	runDriver(int server, int servers, int seconds, int report, int start)
+{
+	std::vector<Pair>	pairs(PAIRS);
+	char				line[64];
+	char				go;
+
+	for (int i = 0; i < PAIRS; ++i)
+	{
+		if (!setupPair(pairs[i], server, servers, i))
+		{
+			snprintf(line, sizeof(line), "pair %d of server %d could not be set up\n", i, server);
+			writeReport(report, line);
+			_exit(1);
+		}
+	}
+	writeReport(report, "ready\n");
+	if (read(start, &go, 1) != 1)
+		_exit(1);
+
+	long	delivered = runLoad(pairs, nowMs() + seconds * 1000UL);
+	if (delivered < 0)
+		snprintf(line, sizeof(line), "a user of server %d was disconnected\n", server);
+	else
+		snprintf(line, sizeof(line), "%ld\n", delivered);
+	writeReport(report, line);
+	_exit(delivered < 0);
+}
+
+// Reads one line a driver reported (without the newline); `false` if it exited without one.
+static bool	readReport(int fd, std::string& line)
+{
+	char	c;
+
+	line.clear();
+	while (read(fd, &c, 1) == 1)
+	{
+		if (c == '\n')
+			return true;
+		line += c;
+	}
+	return false;
+}
+
+// Starts server `index` in `dir`, linked to the previous one, and waits until it takes connections.
+static pid_t	startServer(const std::string& binary, const std::string& dir, int index)
+{
+	char	port[16];
+	char	name[32];
+	char	link[32];
+	pid_t	pid = fork();
+
+	snprintf(port, sizeof(port), "%d", BASE_PORT + index);
+	snprintf(name, sizeof(name), "n%d.bench", index);
+	snprintf(link, sizeof(link), "127.0.0.1:%d", BASE_PORT + index - 1);
+	if (pid == 0)
+	{
+		int	null = open("/dev/null", O_WRONLY);
+		if (chdir(dir.c_str()) == -1 || null == -1)
+			_exit(1);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		if (index == 0)
+			execl(binary.c_str(), binary.c_str(), port, PASSWORD, "--name", name, static_cast<char*>(NULL));
+		else
+			execl(binary.c_str(), binary.c_str(), port, PASSWORD, "--name", name, "--link", link,
+				static_cast<char*>(NULL));
+		_exit(1);
+	}
+	for (unsigned long deadline = nowMs() + 5000; pid > 0 && nowMs() < deadline; usleep(20000))
+	{
+		int	fd = connectTo(BASE_PORT + index);
+		if (fd != -1)
+		{
+			close(fd);
+			return pid;
+		}
+	}
+	if (pid > 0)
+		kill(pid, SIGKILL);
+	return -1;
+}
+
+// Removes a server's directory with what it wrote (logs, state files).
+static void	removeDir(const std::string& dir)
+{
+	DIR*	handle = opendir(dir.c_str());
+
+	while (dirent* entry = handle ? readdir(handle) : NULL)
+		if (std::string(entry->d_name) != "." && std::string(entry->d_name) != "..")
+			unlink((dir + "/" + entry->d_name).c_str());
+	if (handle)
+		closedir(handle);
+	rmdir(dir.c_str());
+}
+
+/**
+Runs a network of `servers` servers under load.
+
+ @param delivered	Messages delivered per second, all servers together.
+ @param perCpu		Messages delivered per CPU second of the busiest server (whose CPU time
+					includes setting up the users, so this is on the low side).
+ @return			`false` (after printing why) if the network could not be set up or a user was lost.
+*/
+static bool	runNetwork(const std::string& binary, const std::string& baseDir, int servers, int seconds,
+				double& delivered, double& perCpu)
+{
+	std::vector<pid_t>	serverPids;
+	std::vector<pid_t>	driverPids;
+	std::vector<int>	reports;
+	std::vector<int>	starts;
+	std::string			line;
+	std::string			failure;
+	long				total = 0;
+	double				busiestCpu = 0;
+
+	for (int i = 0; i < servers && failure.empty(); ++i)
+	{
+		std::string	dir = baseDir + "/n" + std::string(1, static_cast<char>('0' + i));
+		pid_t		pid = mkdir(dir.c_str(), 0700) == 0 ? startServer(binary, dir, i) : -1;
+		if (pid == -1)
+			failure = "server " + std::string(1, static_cast<char>('0' + i)) + " did not start";
+		else
+			serverPids.push_back(pid);
+	}
+	for (int i = 0; i < servers && failure.empty(); ++i)
+	{
+		int	report[2];
+		int	start[2];
+		if (pipe(report) == -1 || pipe(start) == -1)
+			break;
+		pid_t	pid = fork();
+		if (pid == 0)
+		{
+			close(report[0]);
+			close(start[1]);
+			runDriver(i, servers, seconds, report[1], start[0]);
+		}
+		close(report[1]);
+		close(start[0]);
+		reports.push_back(report[0]);
+		starts.push_back(start[1]);
+		driverPids.push_back(pid);
+	}
+	for (size_t i = 0; i < reports.size() && failure.empty(); ++i)
+		if (!readReport(reports[i], line) || line != "ready")
+			failure = line.empty() ? "a driver failed" : line;
+	for (size_t i = 0; i < starts.size() && failure.empty(); ++i)
+		if (write(starts[i], "g", 1) != 1)
+			failure = "a driver failed";
+	for (size_t i = 0; i < reports.size() && failure.empty(); ++i)
+	{
+		if (!readReport(reports[i], line) || line.find_first_not_of("0123456789") != std::string::npos)
+			failure = line.empty() ? "a driver failed" : line;
+		total += strtoul(line.c_str(), NULL, 10);
+	}
+	for (size_t i = 0; i < driverPids.size(); ++i)
+	{
+		if (!failure.empty())
+			kill(driverPids[i], SIGKILL);
+		close(reports[i]);
+		close(starts[i]);
+		waitpid(driverPids[i], NULL, 0);
+	}
+
+	for (size_t i = 0; i < serverPids.size(); ++i)
+	{
+		struct rusage	usage;
+		kill(serverPids[i], SIGINT);
+		if (wait4(serverPids[i], NULL, 0, &usage) == -1)
+			continue;
+		double	cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+			+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+		busiestCpu = std::max(busiestCpu, cpu);
+		removeDir(baseDir + "/n" + std::string(1, static_cast<char>('0' + i)));
+	}
+	delivered = total / static_cast<double>(seconds);
+	perCpu = busiestCpu > 0 ? total / busiestCpu : 0;
+	if (!failure.empty())
+		printf("network: %d servers: %s\n", servers, failure.c_str());
+	return failure.empty() && total > 0;
+}
+
+int	main(int argc, char** argv)
+{
+	const char*	binary = argc > 1 ? argv[1] : "./ircserv";
+	int			maxServers = argc > 2 ? atoi(argv[2]) : 4;
+	int			seconds = argc > 3 ? atoi(argv[3]) : 3;
+	char		path[PATH_MAX];
+	char		baseDir[] = "/tmp/ircserv-bench-XXXXXX";
+	bool		ok = true;
+
+	if (!realpath(binary, path) || access(path, X_OK) == -1)
+	{
+		printf("network: cannot run %s (make it first)\n", binary);
+		return 1;
+	}
+	if (maxServers < 1 || maxServers > MAX_SERVERS || seconds < 1 || !mkdtemp(baseDir))
+	{
+		printf("Usage: %s [ircserv binary] [max servers (1-%d)] [seconds]\n", argv[0], MAX_SERVERS);
+		return 2;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int servers = 1; servers <= maxServers && ok; ++servers)
+	{
+		double	delivered;
+		double	perCpu;
+		ok = runNetwork(path, baseDir, servers, seconds, delivered, perCpu);
+		if (ok)
+			printf("network: %d server%s %4d users: %8.0f msg/s delivered, %8.0f msg/s with a core per server\n",
+				servers, servers > 1 ? "s," : ", ", servers * PAIRS * 2, delivered, perCpu);
+	}
+	rmdir(baseDir);
+	return !ok;
+}
@@ -0,0 +1,188 @@
+#include <cstdio>		// printf()
+#include <cstdlib>		// rand(), srand()
+#include <string>
+#include <vector>
+#include <time.h>		// clock_gettime()
+
+#include "../../include/ScanIndex.hpp"
+#include "../../include/Command.hpp"
+
+/**
+Input framing and tokenizing (`make bench`), for every `ScanIndex` kernel
+the CPU has.
+
+First a differential check: 200k random lines of spaces, colons, `\r` and
+`\n` must give the same tokens as the reference tokenizer below, and the
+same newline and space positions as `std::string::find()`. Then 4 KB of
+typical client traffic is indexed, framed and tokenized, against the
+reference framing (one `find()`, `substr()` and `erase()` per line).
+*/
+
+static const char*	KERNELS[] = { "scalar", "sse2", "avx2" };
+static const int	FUZZ_LINES = 200000;
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reference tokenizer: splits at spaces, a token starting with `:` takes the rest of the line.
+static std::vector<std::string>	referenceTokenize(const std::string& message)
+{
+	std::vector<std::string>	tokens;
+	size_t						pos = 0;
+
+	while (pos < message.size())
+	{
+		while (pos < message.size() && message[pos] == ' ')
+			++pos;
+		if (pos >= message.size())
+			break;
+		if (message[pos] == ':')
+		{
+			if (pos + 1 < message.size())
+				tokens.push_back(message.substr(pos + 1));
+			break;
+		}
+		size_t	end = message.find(' ', pos);
+		if (end == std::string::npos)
+			end = message.size();
+		tokens.push_back(message.substr(pos, end - pos));
+		pos = end + 1;
+	}
+	return tokens;
+}
+
+// Reference framing: one line at a time, copied out and erased from the buffer.
+static size_t	referenceFrame(std::string buffer)
+{
+	size_t		tokens = 0;
+	size_t		newline;
+	std::string	line;
+
+	while ((newline = buffer.find('\n')) != std::string::npos)
+	{
+		line = buffer.substr(0, newline);
+		buffer.erase(0, newline + 1);
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.size() <= 510)
+			tokens += referenceTokenize(line).size();
+	}
+	return tokens;
+}
+
+// Framing as `Server::processUserInput()` does it: one index, lines and tokens cut in place.
+static size_t	indexFrame(const std::string& lines, ScanIndex& index)
+{
+	size_t	tokens = 0;
+	size_t	start = 0;
+	size_t	newline;
+	size_t	complete = lines.rfind('\n') + 1;
+
+	index.build(lines.data(), complete);
+	while ((newline = index.nextNewline(start, complete)) != std::string::npos)
+	{
+		size_t	end = newline;
+		if (end > start && lines[end - 1] == '\r')
+			--end;
+		size_t	lineStart = start;
+		start = newline + 1;
+		if (end - lineStart <= 510)
+			tokens += Command::tokenize(lines, lineStart, end, index).size();
+	}
+	return tokens;
+}
+
+// Compares a kernel with the references on random lines; `false` on the first mismatch.
+static bool	fuzz(const char* kernel)
+{
+	const char	alphabet[] = "ab :\r\n  ::x";
+	ScanIndex	index;
+
+	srand(42);
+	for (int i = 0; i < FUZZ_LINES; ++i)
+	{
+		std::string	line;
+		int			length = rand() % 300;
+		for (int k = 0; k < length; ++k)
+			line += alphabet[rand() % (sizeof(alphabet) - 1)];
+
+		size_t	from = length ? rand() % length : 0;
+		index.build(line);
+		if (Command::tokenize(line) != referenceTokenize(line)
+			|| index.nextNewline(from, line.size()) != line.find('\n', from)
+			|| index.nextSpace(from, line.size()) != line.find(' ', from))
+		{
+			printf("scan: %s differs from the reference on line %d\n", kernel, i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int	main()
+{
+	const char*	samples[] =
+	{
+		"PRIVMSG #general :hey, has anyone tried the new build yet? it seems a lot faster here\r\n",
+		"PRIVMSG alice :ok\r\n",
+		"PING :irc.example.net\r\n",
+		"JOIN #dev,#ops\r\n",
+		"MODE #dev +o bob\r\n",
+		"PRIVMSG #dev :the quick brown fox jumps over the lazy dog and then some more words to make it long enough\r\n",
+		"NOTICE #ops :backup done in 42s\r\n",
+		"PONG :1729\r\n"
+	};
+	std::string	traffic;
+	ScanIndex	index;
+
+	srand(7);
+	while (traffic.size() < 4096 - 200)
+		traffic += samples[rand() % 8];
+	size_t	expected = referenceFrame(traffic);
+
+	for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); ++k)
+	{
+		if (!ScanIndex::useKernel(KERNELS[k]))
+		{
+			printf("scan: %-6s not supported by this CPU\n", KERNELS[k]);
+			continue;
+		}
+		if (!fuzz(KERNELS[k]) || indexFrame(traffic, index) != expected)
+			return 1;
+
+		int		reps = 200000;
+		double	start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+		{
+			index.build(traffic);
+			__asm__ volatile("" ::: "memory");
+		}
+		double	buildSeconds = nowSeconds() - start;
+
+		size_t	tokens = 0;
+		reps = 20000;
+		start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+			tokens += indexFrame(traffic, index);
+		double	frameSeconds = nowSeconds() - start;
+
+		printf("scan: %-6s fuzz ok, index build %6.2f GB/s, frame + tokenize %6.3f GB/s\n", KERNELS[k],
+			traffic.size() * 200000.0 / buildSeconds / 1e9, traffic.size() * 20000.0 / frameSeconds / 1e9);
+		if (tokens == 0)
+			return 1;
+	}
+
+	int		reps = 20000;
+	size_t	tokens = 0;
+	double	start = nowSeconds();
+	for (int r = 0; r < reps; ++r)
+		tokens += referenceFrame(traffic);
+	printf("scan: reference find + substr    frame + tokenize %6.3f GB/s\n",
+		traffic.size() * static_cast<double>(reps) / (nowSeconds() - start) / 1e9);
+	return tokens == 0;
+}
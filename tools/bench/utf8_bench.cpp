@@ -0,0 +1,145 @@
+#include <cstdio>		// printf()
+#include <cstdlib>		// rand(), srand()
+#include <string>
+#include <vector>
+#include <time.h>		// clock_gettime()
+
+#include "../../include/Utf8.hpp"
+#include "../../include/Command.hpp"
+
+/**
+UTF-8 check of message text (`make bench`), for every `Utf8` kernel the CPU
+has.
+
+First the kernels are compared on 60k random strings built from valid and
+broken sequences (overlong forms, surrogates, cut-off sequences, stray
+continuation bytes), at lengths that straddle the 32-byte blocks; every
+repaired string must be valid. Then typical messages and 400 bytes of mixed
+text are timed, and what the check adds to relaying one message (tokenize,
+build the line, append it to 39 output buffers).
+*/
+
+static const char*	KERNELS[] = { "scalar", "avx2" };
+static const int	FUZZ_STRINGS = 60000;
+static const int	RELAY_TARGETS = 39;
+
+static double	nowSeconds()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A random string of valid and broken sequences, `length` pieces long.
+static std::string	randomText(int length)
+{
+	static const char*	pieces[] =
+	{
+		"a", "hello ", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xE3\x81\x93",
+		"\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF0\x9F\x98", "\x80", "\xFF", "\xC3"
+	};
+	std::string	text;
+
+	for (int i = 0; i < length; ++i)
+		text += pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+	return text;
+}
+
+// Checks that all kernels agree and that repaired text is valid; `false` on the first failure.
+static bool	fuzz(const std::vector<const char*>& kernels)
+{
+	srand(42);
+	for (int i = 0; i < FUZZ_STRINGS; ++i)
+	{
+		std::string	text = randomText(rand() % 40);
+		Utf8::useKernel(kernels[0]);
+		bool		valid = Utf8::isValid(text);
+
+		for (size_t k = 1; k < kernels.size(); ++k)
+		{
+			Utf8::useKernel(kernels[k]);
+			if (Utf8::isValid(text) != valid)
+			{
+				printf("utf8: %s and %s disagree on string %d\n", kernels[0], kernels[k], i);
+				return false;
+			}
+		}
+		std::string	repaired = text;
+		if ((Utf8::repair(repaired) == 0) != valid || !Utf8::isValid(repaired))
+		{
+			printf("utf8: repair of string %d is wrong\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int	main()
+{
+	const char*	texts[] =
+	{
+		"message number 42 with some text",
+		"message num\xC3\xA9ro 42 \xE2\x80\x94 \xC3\xBCn\xC3\xAF" "code text \xF0\x9F\x98\x80 and some more words",
+		"ok",
+		"\xE3\x81\x93\xE3\x82\x8C\xE3\x81\xAF\xE3\x83\x86\xE3\x82\xB9\xE3\x83\x88\xE3\x81\xA7\xE3\x81\x99\xE3\x80\x82",
+		"lol \xF0\x9F\x98\x82\xF0\x9F\x98\x82 that was great, see you tomorrow at the meeting in the big room"
+	};
+	std::vector<std::string>	lines;
+	std::vector<const char*>	kernels;
+	std::string					mixed(400, 'a');
+	volatile size_t				sink = 0;
+
+	for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i)
+		lines.push_back(std::string("PRIVMSG #b :") + texts[i]);
+	for (size_t i = 0; i < mixed.size(); i += 10)
+		mixed.replace(i, 5, "\xC3\xA9\xE2\x82\xAC");
+	for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); ++k)
+	{
+		if (Utf8::useKernel(KERNELS[k]))
+			kernels.push_back(KERNELS[k]);
+		else
+			printf("utf8: %-6s not supported by this CPU\n", KERNELS[k]);
+	}
+	if (kernels.empty() || !fuzz(kernels))
+		return 1;
+
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		Utf8::useKernel(kernels[k]);
+		int		reps = 200000;
+		double	start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+			sink += Utf8::isValid(lines[r % lines.size()].substr(12));
+		double	messageNs = (nowSeconds() - start) / reps * 1e9;
+
+		start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+			sink += Utf8::isValid(mixed);
+		double	mixedNs = (nowSeconds() - start) / reps * 1e9;
+		printf("utf8: %-6s fuzz ok, typical message %6.1f ns (incl. copy), 400 bytes mixed %6.1f ns (%.2f GB/s)\n",
+			kernels[k], messageNs, mixedNs, mixed.size() / mixedNs);
+	}
+
+	std::vector<std::string>	outputs(RELAY_TARGETS);
+	for (int check = 0; check < 2; ++check)
+	{
+		int		reps = 100000;
+		double	start = nowSeconds();
+		for (int r = 0; r < reps; ++r)
+		{
+			std::vector<std::string>	tokens = Command::tokenize(lines[r % lines.size()]);
+			if (check)
+				sink += Utf8::isValid(tokens[2]);
+			std::string	out = ":u0!u0@127.0.0.1 PRIVMSG " + tokens[1] + " :" + tokens[2] + "\r\n";
+			for (int i = 0; i < RELAY_TARGETS; ++i)
+				outputs[i] += out;
+			if ((r & 63) == 0)
+				for (int i = 0; i < RELAY_TARGETS; ++i)
+					outputs[i].clear();
+		}
+		printf("utf8: relay one message to %d buffers %s the check (%s): %6.1f ns\n", RELAY_TARGETS,
+			check ? "with   " : "without", Utf8::getKernelName(), (nowSeconds() - start) / reps * 1e9);
+	}
+	return sink == 0;
+}
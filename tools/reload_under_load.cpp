@@ -0,0 +1,236 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>		// errno
+#include <cstdlib>		// atoi(), strtol()
+#include <cstring>		// memset(), strerror()
+
+#include <unistd.h>		// close(), read(), write()
+#include <fcntl.h>		// fcntl(), O_NONBLOCK
+#include <signal.h>		// kill(), SIGHUP
+#include <time.h>		// clock_gettime()
+#include <sys/select.h>	// select(), fd_set
+#include <sys/socket.h>	// socket(), connect()
+#include <netinet/in.h>	// sockaddr_in, htons()
+#include <arpa/inet.h>	// inet_addr()
+
+/**
+Reload-under-load check for the bot plugins (`make reload_test`).
+
+Connects `clients` users to a server running in bot mode with the sample
+`roll` plugin, and has every one of them run `ROLL 1d6` in a loop (one
+command in flight per user) while the server is sent SIGHUP every
+`reloadMs` milliseconds, which reloads all plugin modules.
+
+Fails if a command goes unanswered, a user is disconnected or the server
+dies: a reload must neither drop nor break running or queued jobs.
+
+Usage: reload_under_load <port> <password> <server pid> [clients] [seconds] [reloadMs]
+*/
+
+# define DRAIN_MS	3000	// How long answers to the last commands are waited for
+
+struct	Client
+{
+	int				fd;
+	std::string		nick;
+	std::string		input;
+	bool			registered;
+	bool			waiting;	// A ROLL is in flight
+	unsigned long	sent;
+	unsigned long	answered;
+};
+
+static unsigned long	nowMs()
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool	sendLine(Client& client, const std::string& line)
+{
+	std::string	data = line + "\r\n";
+	size_t		done = 0;
+
+	while (done < data.size())
+	{
+		ssize_t	n = write(client.fd, data.data() + done, data.size() - done);
+		if (n > 0)
+			done += n;
+		else if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return false;
+	}
+	return true;
+}
+
+static int	connectClient(int port)
+{
+	sockaddr_in	addr;
+	int			fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd == -1)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(port));
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+/**
+Reads what the server sent and handles complete lines.
+
+ @return	`false` if the connection was closed or the bot does not know ROLL.
+*/
+static bool	readClient(Client& client)
+{
+	char	buffer[4096];
+	ssize_t	n;
+
+	while ((n = read(client.fd, buffer, sizeof(buffer))) > 0)
+		client.input.append(buffer, n);
+	if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		std::cerr << client.nick << ": disconnected" << std::endl;
+		return false;
+	}
+
+	size_t	end;
+	while ((end = client.input.find("\r\n")) != std::string::npos)
+	{
+		std::string	line = client.input.substr(0, end);
+		client.input.erase(0, end + 2);
+
+		if (line.compare(0, 5, "PING ") == 0)
+			sendLine(client, "PONG " + line.substr(5));
+		else if (line.find(" 001 " + client.nick + " ") != std::string::npos)
+			client.registered = true;
+		else if (line.find(" 421 " + client.nick + " ROLL ") != std::string::npos)
+		{
+			std::cerr << "ROLL is unknown: run the server in bot mode (make re_bot) with the roll plugin" << std::endl;
+			return false;
+		}
+		else if (client.waiting && line.find(" PRIVMSG " + client.nick + " :You rolled") != std::string::npos)
+		{
+			client.waiting = false;
+			++client.answered;
+		}
+	}
+	return true;
+}
+
+int	main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		std::cerr << "Usage: " << argv[0] << " <port> <password> <server pid> [clients] [seconds] [reloadMs]" << std::endl;
+		return 2;
+	}
+
+	int				port = atoi(argv[1]);
+	std::string		password = argv[2];
+	pid_t			serverPid = static_cast<pid_t>(atoi(argv[3]));
+	size_t			clientCount = argc > 4 ? strtol(argv[4], NULL, 10) : 20;
+	unsigned long	durationMs = (argc > 5 ? strtol(argv[5], NULL, 10) : 5) * 1000UL;
+	unsigned long	reloadMs = argc > 6 ? strtol(argv[6], NULL, 10) : 25;
+
+	std::vector<Client>	clients(clientCount);
+	for (size_t i = 0; i < clients.size(); ++i)
+	{
+		Client&	client = clients[i];
+		client.nick = "load" + std::string(1, static_cast<char>('a' + i / 26 % 26)) + static_cast<char>('a' + i % 26);
+		client.registered = false;
+		client.waiting = false;
+		client.sent = 0;
+		client.answered = 0;
+		client.fd = connectClient(port);
+		if (client.fd == -1 || client.fd >= FD_SETSIZE)
+		{
+			std::cerr << "Cannot connect to port " << port << ": " << strerror(errno) << std::endl;
+			return 1;
+		}
+		sendLine(client, "PASS " + password);
+		sendLine(client, "NICK " + client.nick);
+		sendLine(client, "USER " + client.nick + " 0 * :reload test");
+	}
+
+	unsigned long	startMs = nowMs();
+	unsigned long	stopMs = startMs + durationMs;
+	unsigned long	nextReloadMs = startMs;
+	unsigned long	reloads = 0;
+	bool			failed = false;
+
+	while (!failed)
+	{
+		unsigned long	now = nowMs();
+		bool			idle = true;
+
+		if (now < stopMs && now >= nextReloadMs)
+		{
+			if (kill(serverPid, SIGHUP) == -1)
+			{
+				std::cerr << "Server " << serverPid << " is gone: " << strerror(errno) << std::endl;
+				failed = true;
+				break;
+			}
+			++reloads;
+			nextReloadMs = now + reloadMs;
+		}
+
+		fd_set	readFds;
+		int		maxFd = -1;
+		FD_ZERO(&readFds);
+		for (size_t i = 0; i < clients.size(); ++i)
+		{
+			Client&	client = clients[i];
+			if (client.registered && !client.waiting && now < stopMs)
+			{
+				if (!sendLine(client, "ROLL 1d6"))
+					failed = true;
+				client.waiting = true;
+				++client.sent;
+			}
+			if (client.waiting || !client.registered)
+				idle = false;
+			FD_SET(client.fd, &readFds);
+			if (client.fd > maxFd)
+				maxFd = client.fd;
+		}
+		if ((now >= stopMs && idle) || now >= stopMs + DRAIN_MS)
+			break;
+
+		struct timeval	timeout = { 0, 5000 };
+		if (select(maxFd + 1, &readFds, NULL, NULL, &timeout) == -1 && errno != EINTR)
+		{
+			std::cerr << "select(): " << strerror(errno) << std::endl;
+			return 1;
+		}
+		for (size_t i = 0; i < clients.size(); ++i)
+		{
+			if (FD_ISSET(clients[i].fd, &readFds) && !readClient(clients[i]))
+				failed = true;
+		}
+	}
+
+	unsigned long	sent = 0;
+	unsigned long	answered = 0;
+	for (size_t i = 0; i < clients.size(); ++i)
+	{
+		sent += clients[i].sent;
+		answered += clients[i].answered;
+		close(clients[i].fd);
+	}
+	if (kill(serverPid, 0) == -1)
+		failed = true;
+	std::cout << clients.size() << " clients, " << reloads << " reloads: " << answered << "/" << sent
+		<< " commands answered" << (failed || answered != sent ? " -> FAILED" : " -> OK") << std::endl;
+	return failed || answered != sent ? 1 : 0;
+}